@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015 Audacious developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The allocation functions of the C library are replaced by counting wrappers.
+ * Since the executable is linked with --export-dynamic, the plugins and the
+ * C++ runtime (operator new) also call these.  The wrappers pass everything
+ * to glibc's internal entry points, so they need glibc. */
+
+#include "bench.h"
+
+#include <errno.h>
+#include <stddef.h>
+
+extern "C" {
+void * __libc_malloc (size_t size);
+void * __libc_calloc (size_t count, size_t size);
+void * __libc_realloc (void * ptr, size_t size);
+void * __libc_memalign (size_t align, size_t size);
+void __libc_free (void * ptr);
+}
+
+static thread_local bool counting;
+static thread_local int64_t count;
+
+void alloc_count_begin ()
+{
+    count = 0;
+    counting = true;
+}
+
+int64_t alloc_count_end ()
+{
+    counting = false;
+    return count;
+}
+
+extern "C" void * malloc (size_t size)
+{
+    if (counting)
+        count ++;
+
+    return __libc_malloc (size);
+}
+
+extern "C" void * calloc (size_t n, size_t size)
+{
+    if (counting)
+        count ++;
+
+    return __libc_calloc (n, size);
+}
+
+extern "C" void * realloc (void * ptr, size_t size)
+{
+    if (counting)
+        count ++;
+
+    return __libc_realloc (ptr, size);
+}
+
+extern "C" void * memalign (size_t align, size_t size)
+{
+    if (counting)
+        count ++;
+
+    return __libc_memalign (align, size);
+}
+
+extern "C" void * aligned_alloc (size_t align, size_t size)
+{
+    return memalign (align, size);
+}
+
+extern "C" int posix_memalign (void * * ptr, size_t align, size_t size)
+{
+    if (! align || (align & (align - 1)) || align % sizeof (void *))
+        return EINVAL;
+
+    void * mem = memalign (align, size);
+    if (! mem)
+        return ENOMEM;
+
+    * ptr = mem;
+    return 0;
+}
+
+extern "C" void free (void * ptr)
+{
+    __libc_free (ptr);
+}
@@ -0,0 +1,765 @@
+/*
+ * Copyright (c) 2015 Audacious developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Offline benchmark and regression test for effect plugins.  Each plugin
+ * module given on the command line is loaded, and a few seconds of synthetic
+ * audio at every combination of sample rate and channel count (or the WAV
+ * files given with -i) are run through it as the player would: start (),
+ * process () in blocks, flush () (as after a seek), more blocks, and
+ * finish ().  The time taken by each call and the heap allocations made
+ * during it are measured, and the output is either saved as the reference for
+ * later runs (-w) or compared with a saved reference (with -g).
+ *
+ * Example, after building the plugins:
+ *
+ *     ./effect-bench -g golden -w ../compressor/compressor.so
+ *     (change something, rebuild)
+ *     ./effect-bench -g golden ../compressor/compressor.so
+ *
+ * The exit status is nonzero if a plugin could not be loaded or an output
+ * differs from its reference by more than the tolerance.
+ *
+ * With -f, a sine wave of the given frequency is run instead, and the THD+N of
+ * the output is shown as well; "make resample-compare" uses this to compare
+ * the resampling methods.  With -k, the libdsp kernels are timed instead (see
+ * kernel-bench.cc). */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include <glib.h>
+#include <gmodule.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/index.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/stats.h"
+#include "bench.h"
+
+#define DEFAULT_SECONDS 5
+#define DEFAULT_BLOCK 512
+#define DEFAULT_TOLERANCE 1e-5
+
+/* first line of the reference files, followed by the channels, rate, and
+ * number of samples, then the samples as native floats */
+#define GOLDEN_HEADER "effect-bench 1"
+
+static const int default_rates[] = {22050, 44100, 48000, 96000};
+static const int default_channels[] = {1, 2, 6};
+
+struct Options
+{
+    Index<int> rates, channels;
+    int seconds = DEFAULT_SECONDS;
+    int block = DEFAULT_BLOCK;
+    double tolerance = DEFAULT_TOLERANCE;
+    const char * golden = nullptr;
+    bool write = false;
+    double sine = 0;  /* frequency of the test tone, if any */
+};
+
+/* the audio run through each plugin: generated, or read from a file */
+struct Input
+{
+    String name;
+    int channels, rate;
+    Index<float> signal;
+};
+
+struct Result
+{
+    int channels, rate;
+    Index<float> output;
+
+    int64_t process_ns = 0, max_call_ns = 0;
+    int calls = 0;
+    int64_t heap_allocs = 0;
+    int delay_ms = 0;
+    int flush_at = 0;  /* length of the output before flush () */
+};
+
+int64_t now_ns ()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/* A mixture meant to exercise both the linear and the nonlinear parts of an
+ * effect: a slow exponential sweep, quiet white noise, and a click every half
+ * second, with the level rising and falling over the whole signal so that
+ * dynamics processors change gain.  Each channel is offset in phase.  The
+ * noise comes from a fixed generator, so the signal is the same everywhere. */
+static void make_signal (Input & input, int channels, int rate, int seconds)
+{
+    int frames = rate * seconds;
+
+    input.name = String (str_printf ("%d-%d", rate, channels));
+    input.channels = channels;
+    input.rate = rate;
+    input.signal.resize (frames * channels);
+
+    uint32_t seed = 1;
+    double phase = 0;
+
+    for (int f = 0; f < frames; f ++)
+    {
+        double t = (double) f / rate;
+        double freq = 20 * pow (1000, t / seconds);
+        double level = 0.1 + 0.8 * (0.5 - 0.5 * cos (2 * M_PI * t / seconds));
+
+        phase += 2 * M_PI * freq / rate;
+
+        for (int c = 0; c < channels; c ++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            float noise = (int32_t) seed / 2147483648.0f;
+            float click = (f % (rate / 2) == c) ? 0.5f : 0;
+
+            input.signal[f * channels + c] = level * sin (phase + c * M_PI / 3) +
+             0.01f * noise + click;
+        }
+    }
+}
+
+/* A pure tone at half of full scale, the same in every channel, for measuring
+ * distortion and noise (THD+N).  A resampler can be compared across methods
+ * and rates this way. */
+static void make_sine (Input & input, int channels, int rate, int seconds,
+ double freq)
+{
+    int frames = rate * seconds;
+
+    input.name = String (str_printf ("%d-%d-%gHz", rate, channels, freq));
+    input.channels = channels;
+    input.rate = rate;
+    input.signal.resize (frames * channels);
+
+    for (int f = 0; f < frames; f ++)
+    {
+        float value = 0.5 * sin (2 * M_PI * freq * f / rate);
+
+        for (int c = 0; c < channels; c ++)
+            input.signal[f * channels + c] = value;
+    }
+}
+
+static double det3 (const double m[3][3])
+{
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+     m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+     m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+/* THD+N of one channel of <frames> interleaved frames, in dB: a sine of the
+ * known frequency (and any DC offset) is fitted by least squares, and what is
+ * left over is compared with it.  The fit finds the phase, so the delay of the
+ * effect does not matter. */
+static double measure_thdn (const float * data, int channels, int frames,
+ double freq, int rate)
+{
+    double w = 2 * M_PI * freq / rate;
+    double m[3][3] = {}, v[3] = {};
+
+    for (int f = 0; f < frames; f ++)
+    {
+        double basis[3] = {sin (w * f), cos (w * f), 1};
+        double x = data[f * channels];
+
+        for (int i = 0; i < 3; i ++)
+        {
+            v[i] += basis[i] * x;
+            for (int j = 0; j < 3; j ++)
+                m[i][j] += basis[i] * basis[j];
+        }
+    }
+
+    /* Cramer's rule */
+    double det = det3 (m), coef[3];
+    if (det == 0)
+        return NAN;
+
+    for (int k = 0; k < 3; k ++)
+    {
+        double mk[3][3];
+        for (int i = 0; i < 3; i ++)
+        {
+            for (int j = 0; j < 3; j ++)
+                mk[i][j] = (j == k) ? v[i] : m[i][j];
+        }
+
+        coef[k] = det3 (mk) / det;
+    }
+
+    double tone = 0, rest = 0;
+
+    for (int f = 0; f < frames; f ++)
+    {
+        double fit = coef[0] * sin (w * f) + coef[1] * cos (w * f);
+        double x = data[f * channels] - coef[2];
+
+        tone += fit * fit;
+        rest += (x - fit) * (x - fit);
+    }
+
+    return (tone > 0) ? 10 * log10 (rest / tone) : NAN;
+}
+
+/* The worst channel, measured from 0.2 seconds into the output (past any
+ * delay and the start-up of the effect) up to the flush. */
+static double result_thdn (const Result & result, double freq)
+{
+    int skip = result.rate / 5;
+    int frames = result.flush_at / result.channels - skip;
+
+    if (frames < result.rate / 10)
+        return NAN;
+
+    double worst = -INFINITY;
+
+    for (int c = 0; c < result.channels; c ++)
+        worst = fmax (worst, measure_thdn (& result.output[skip * result.channels + c],
+         result.channels, frames, freq, result.rate));
+
+    return worst;
+}
+
+static uint32_t read_le (const unsigned char * data, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i ++)
+        value |= (uint32_t) data[i] << (8 * i);
+
+    return value;
+}
+
+/* Reads a WAV file with 16-, 24-, or 32-bit integer or 32-bit float samples.
+ * Nothing else is supported, since the benchmark should not depend on the
+ * decoder plugins. */
+static bool read_wav (const char * filename, Input & input)
+{
+    char * data;
+    size_t size;
+
+    if (! g_file_get_contents (filename, & data, & size, nullptr))
+    {
+        fprintf (stderr, "%s: cannot read\n", filename);
+        return false;
+    }
+
+    const unsigned char * bytes = (const unsigned char *) data;
+    const unsigned char * samples = nullptr;
+    int format = 0, bits = 0, sample_bytes = 0;
+
+    input.channels = input.rate = 0;
+
+    if (size >= 12 && ! memcmp (data, "RIFF", 4) && ! memcmp (data + 8, "WAVE", 4))
+    {
+        for (size_t pos = 12; pos + 8 <= size; )
+        {
+            size_t len = read_le (bytes + pos + 4, 4);
+            const unsigned char * chunk = bytes + pos + 8;
+
+            if (len > size - pos - 8)
+                len = size - pos - 8;
+
+            if (! memcmp (bytes + pos, "fmt ", 4) && len >= 16)
+            {
+                format = read_le (chunk, 2);
+                input.channels = read_le (chunk + 2, 2);
+                input.rate = read_le (chunk + 4, 4);
+                bits = read_le (chunk + 14, 2);
+
+                /* WAVE_FORMAT_EXTENSIBLE: the format is in the sub-format GUID */
+                if (format == 0xfffe && len >= 26)
+                    format = read_le (chunk + 24, 2);
+            }
+            else if (! memcmp (bytes + pos, "data", 4))
+            {
+                samples = chunk;
+                sample_bytes = len;
+                break;
+            }
+
+            pos += 8 + len + (len & 1);
+        }
+    }
+
+    bool valid = (samples && input.channels > 0 && input.rate > 0 &&
+     ((format == 1 && (bits == 16 || bits == 24 || bits == 32)) ||
+     (format == 3 && bits == 32)));
+
+    if (valid)
+    {
+        int width = bits / 8;
+        int count = sample_bytes / width / input.channels * input.channels;
+
+        input.signal.resize (count);
+
+        for (int i = 0; i < count; i ++)
+        {
+            const unsigned char * sample = samples + i * width;
+
+            if (format == 3)
+            {
+                int32_t value = read_le (sample, 4);
+                memcpy (& input.signal[i], & value, 4);
+            }
+            else
+            {
+                /* sign-extend from the top byte */
+                int32_t value = read_le (sample, width) << (32 - bits);
+                input.signal[i] = value / 2147483648.0f;
+            }
+        }
+
+        const char * base = strrchr (filename, G_DIR_SEPARATOR);
+        base = base ? base + 1 : filename;
+
+        const char * dot = strrchr (base, '.');
+        input.name = String (str_copy (base, dot ? dot - base : -1));
+    }
+    else
+        fprintf (stderr, "%s: not a supported WAV file\n", filename);
+
+    g_free (data);
+    return valid;
+}
+
+/* Runs one call, keeping the output and the time taken. */
+static void run_call (EffectPlugin * effect, bool finish, const float * in,
+ int samples, Index<float> & buffer, Result & result)
+{
+    /* the plugin may write to its input */
+    buffer.resize (samples);
+    if (samples)
+        memcpy (buffer.begin (), in, sizeof (float) * samples);
+
+    float * data = buffer.begin ();
+
+    alloc_count_begin ();
+    int64_t start = now_ns ();
+
+    if (finish)
+        effect->finish (& data, & samples);
+    else
+        effect->process (& data, & samples);
+
+    int64_t elapsed = now_ns () - start;
+    result.heap_allocs += alloc_count_end ();
+
+    result.process_ns += elapsed;
+    result.max_call_ns = aud::max (result.max_call_ns, elapsed);
+    result.calls ++;
+
+    result.output.insert (data, -1, samples);
+}
+
+static void run_case (EffectPlugin * effect, const Options & options,
+ const Input & input, Result & result)
+{
+    const Index<float> & signal = input.signal;
+
+    result.channels = input.channels;
+    result.rate = input.rate;
+
+    effect->start (& result.channels, & result.rate);
+
+    int step = options.block * input.channels;
+    int flush_at = signal.len () / 2 / step * step;
+    Index<float> buffer;
+
+    for (int pos = 0; pos < signal.len (); pos += step)
+    {
+        if (pos == flush_at)
+        {
+            result.flush_at = result.output.len ();
+            effect->flush ();
+        }
+
+        int samples = aud::min (step, signal.len () - pos);
+        run_call (effect, false, & signal[pos], samples, buffer, result);
+    }
+
+    /* before finish (), which empties any buffers */
+    result.delay_ms = effect->adjust_delay (0);
+
+    run_call (effect, true, nullptr, 0, buffer, result);
+}
+
+static StringBuf golden_path (const Options & options, const char * module,
+ const char * input)
+{
+    const char * base = strrchr (module, G_DIR_SEPARATOR);
+    base = base ? base + 1 : module;
+
+    /* without the extension */
+    const char * dot = strrchr (base, '.');
+    int len = dot ? dot - base : strlen (base);
+
+    StringBuf name = str_printf ("%.*s-%s.raw", len, base, input);
+    return filename_build ({options.golden, name});
+}
+
+static bool write_golden (const char * path, const Result & result)
+{
+    FILE * file = fopen (path, "wb");
+    if (! file)
+        return false;
+
+    int len = result.output.len ();
+    bool ok = (fprintf (file, GOLDEN_HEADER " %d %d %d\n", result.channels,
+     result.rate, len) > 0 && (int) fwrite (result.output.begin (),
+     sizeof (float), len, file) == len);
+
+    return (fclose (file) == 0 && ok);
+}
+
+/* Returns the largest difference from the reference, or -1 if the reference
+ * cannot be read or has a different format or length. */
+static double compare_golden (const char * path, const Result & result)
+{
+    FILE * file = fopen (path, "rb");
+    if (! file)
+        return -1;
+
+    int channels, rate, len;
+    Index<float> golden;
+
+    if (fscanf (file, GOLDEN_HEADER " %d %d %d", & channels, & rate, & len) == 3 &&
+     fgetc (file) == '\n' && channels == result.channels && rate == result.rate &&
+     len == result.output.len ())
+    {
+        golden.resize (len);
+        if ((int) fread (golden.begin (), sizeof (float), len, file) != len)
+            golden.clear ();
+    }
+
+    fclose (file);
+
+    if (golden.len () != result.output.len ())
+        return -1;
+
+    double diff = 0;
+    for (int i = 0; i < golden.len (); i ++)
+        diff = aud::max (diff, (double) fabsf (golden[i] - result.output[i]));
+
+    return diff;
+}
+
+/* Returns the allocations counted by the plugin's EffectStats since the last
+ * reset, or -1 if it has not attached one. */
+static int64_t count_allocations ()
+{
+    Index<const EffectStats *> list;
+    effect_stats_list (list);
+    return list.len () ? list[0]->read ().allocations : -1;
+}
+
+/* what the plugin reports it is doing (such as the converter in use), or an
+ * empty string */
+static const char * current_note ()
+{
+    Index<const EffectStats *> list;
+    effect_stats_list (list);
+
+    const char * note = list.len () ? list[0]->read ().note : nullptr;
+    return note ? note : "";
+}
+
+static void reset_stats ()
+{
+    Index<const EffectStats *> list;
+    effect_stats_list (list);
+
+    for (const EffectStats * stats : list)
+        stats->request_reset ();
+}
+
+static bool bench_module (const char * module, const Options & options,
+ const Index<String> & settings, const Index<Input> & inputs)
+{
+    GModule * handle = g_module_open (module, G_MODULE_BIND_LOCAL);
+    if (! handle)
+    {
+        fprintf (stderr, "%s: %s\n", module, g_module_error ());
+        return false;
+    }
+
+    void * sym;
+    Plugin * plugin = nullptr;
+
+    if (g_module_symbol (handle, "aud_plugin_instance", & sym))
+        plugin = (Plugin *) sym;
+
+    if (! plugin || plugin->magic != _AUD_PLUGIN_MAGIC ||
+     plugin->version != _AUD_PLUGIN_VERSION || plugin->type != PluginType::Effect)
+    {
+        fprintf (stderr, "%s: not an effect plugin of this version\n", module);
+        g_module_close (handle);
+        return false;
+    }
+
+    EffectPlugin * effect = (EffectPlugin *) plugin;
+
+    if (! plugin->init ())
+    {
+        fprintf (stderr, "%s: init () failed\n", module);
+        g_module_close (handle);
+        return false;
+    }
+
+    /* "section:name=value" */
+    for (const String & setting : settings)
+    {
+        const char * colon = strchr (setting, ':');
+        const char * equals = strchr (setting, '=');
+
+        if (colon && equals > colon)
+            aud_set_str (str_copy (setting, colon - setting),
+             str_copy (colon + 1, equals - colon - 1), equals + 1);
+    }
+
+    printf ("%s (%s)\n", plugin->info.name, module);
+    printf ("  input            ->  rate  ch   Msamples/s  realtime   max call"
+     "   heap/call  counted/call   delay  %sreference\n",
+     options.sine ? "    THD+N  " : "");
+
+    bool ok = true;
+
+    for (const Input & input : inputs)
+    {
+        Result result;
+        reset_stats ();
+        run_case (effect, options, input, result);
+
+        int64_t counted = count_allocations ();
+        double seconds = result.process_ns / 1e9;
+        double length = (double) input.signal.len () / (input.channels * input.rate);
+
+        char allocs[32] = "-", check[64] = "", thdn[32] = "";
+
+        if (counted >= 0)
+            snprintf (allocs, sizeof allocs, "%.3f", (double) counted / result.calls);
+
+        if (options.golden)
+        {
+            StringBuf path = golden_path (options, module, input.name);
+
+            if (options.write)
+            {
+                if (write_golden (path, result))
+                    strcpy (check, "written");
+                else
+                {
+                    strcpy (check, "CANNOT WRITE");
+                    ok = false;
+                }
+            }
+            else
+            {
+                double diff = compare_golden (path, result);
+
+                if (diff < 0)
+                    strcpy (check, "MISSING or different length");
+                else
+                    snprintf (check, sizeof check, "%s (%g)",
+                     (diff <= options.tolerance) ? "ok" : "DIFFERS", diff);
+
+                if (diff < 0 || diff > options.tolerance)
+                    ok = false;
+            }
+        }
+
+        if (options.sine)
+        {
+            double level = result_thdn (result, options.sine);
+
+            /* too little output before the flush, e.g. behind a long delay */
+            if (isnan (level))
+                strcpy (thdn, "     -     ");
+            else
+                snprintf (thdn, sizeof thdn, "%6.1f dB  ", level);
+        }
+
+        const char * note = current_note ();
+
+        printf ("  %-16s ->  %5d  %2d   %10.2f  %7.1fx   %6.1f us   %9.3f  %12s   %3d ms  %s%s%s%s\n",
+         (const char *) input.name, result.rate, result.channels,
+         input.signal.len () / seconds / 1e6, length / seconds,
+         result.max_call_ns / 1e3, (double) result.heap_allocs / result.calls,
+         allocs, result.delay_ms, thdn, check, * note ? "  " : "", note);
+    }
+
+    plugin->cleanup ();
+    g_module_close (handle);
+
+    return ok;
+}
+
+static bool parse_list (const char * arg, Index<int> & list)
+{
+    list.clear ();
+
+    for (const char * pos = arg; * pos; )
+    {
+        char * end;
+        long value = strtol (pos, & end, 10);
+
+        if (end == pos || value <= 0 || (* end && * end != ','))
+            return false;
+
+        list.append (value);
+        pos = * end ? end + 1 : end;
+    }
+
+    return list.len () > 0;
+}
+
+static void usage ()
+{
+    fprintf (stderr,
+     "usage: effect-bench [options] plugin-module ...\n"
+     "  -r RATE,...       sample rates (default 22050,44100,48000,96000)\n"
+     "  -c CHANNELS,...   channel counts (default 1,2,6)\n"
+     "  -s SECONDS        length of the test signal (default %d)\n"
+     "  -i FILE.wav       run a WAV file instead (may be repeated)\n"
+     "  -b FRAMES         frames per process () call (default %d)\n"
+     "  -o SECTION:NAME=VALUE   plugin setting (may be repeated)\n"
+     "  -g DIR            compare the output with the references in DIR\n"
+     "  -w                write the references instead (with -g)\n"
+     "  -t TOLERANCE      largest difference allowed (default %g)\n"
+     "  -f FREQUENCY      run a sine wave instead and measure THD+N\n"
+     "  -k                time the libdsp kernels instead, on blocks of\n"
+     "                    -b samples (no plugin modules needed)\n",
+     DEFAULT_SECONDS, DEFAULT_BLOCK, DEFAULT_TOLERANCE);
+}
+
+int main (int argc, char * * argv)
+{
+    Options options;
+    Index<String> settings, files;
+    bool kernels = false;
+
+    options.rates.insert (default_rates, 0, aud::n_elems (default_rates));
+    options.channels.insert (default_channels, 0, aud::n_elems (default_channels));
+
+    int opt;
+    while ((opt = getopt (argc, argv, "r:c:s:i:b:o:g:wt:kf:")) != -1)
+    {
+        bool valid = true;
+
+        switch (opt)
+        {
+        case 'r':
+            valid = parse_list (optarg, options.rates);
+            break;
+        case 'c':
+            valid = parse_list (optarg, options.channels);
+            break;
+        case 's':
+            valid = ((options.seconds = atoi (optarg)) > 0);
+            break;
+        case 'i':
+            files.append (String (optarg));
+            break;
+        case 'b':
+            valid = ((options.block = atoi (optarg)) > 0);
+            break;
+        case 'o':
+            settings.append (String (optarg));
+            break;
+        case 'g':
+            options.golden = optarg;
+            break;
+        case 'w':
+            options.write = true;
+            break;
+        case 't':
+            valid = ((options.tolerance = atof (optarg)) >= 0);
+            break;
+        case 'k':
+            kernels = true;
+            break;
+        case 'f':
+            valid = ((options.sine = atof (optarg)) > 0);
+            break;
+        default:
+            valid = false;
+            break;
+        }
+
+        if (! valid)
+        {
+            usage ();
+            return 2;
+        }
+    }
+
+    if (kernels)
+        return kernel_bench (options.block) ? 0 : 1;
+
+    if (optind == argc || (options.write && ! options.golden))
+    {
+        usage ();
+        return 2;
+    }
+
+    if (options.golden && options.write)
+        g_mkdir_with_parents (options.golden, 0755);
+
+    Index<Input> inputs;
+
+    for (const String & file : files)
+    {
+        if (! read_wav (file, inputs.append ()))
+            return 1;
+    }
+
+    if (! files.len ())
+    {
+        for (int rate : options.rates)
+        {
+            for (int channels : options.channels)
+            {
+                if (options.sine)
+                    make_sine (inputs.append (), channels, rate, options.seconds, options.sine);
+                else
+                    make_signal (inputs.append (), channels, rate, options.seconds);
+            }
+        }
+    }
+
+    bool ok = true;
+
+    for (int i = optind; i < argc; i ++)
+    {
+        if (! bench_module (argv[i], options, settings, inputs))
+            ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2015 Audacious developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Times each libdsp kernel through every version the running CPU supports:
+ * scalar, then SSE2 and AVX2 or NEON, each table built as dsp.cc builds it,
+ * so a kernel with no faster version keeps the one before.  The time is per
+ * sample (nanoseconds); the number in parentheses is the largest difference
+ * from the scalar output for the same input. */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libaudcore/index.h>
+
+#include "../libdsp/dsp.h"
+#include "../libdsp/dsp-internal.h"
+#include "bench.h"
+
+#define MAX_ISAS 4
+#define BATCHES 5
+#define BATCH_SAMPLES 2000000
+
+#define SECTIONS 4
+#define HISTORY (DSP_TRUE_PEAK_TAPS - 1)
+
+/* Every kernel reads and writes these, n samples each (with some room for
+ * the true-peak history).  They are filled with the same pseudo-random values
+ * before each version is run. */
+struct Buffers
+{
+    int n;
+    Index<float> x, y, z, state;
+    Index<int16_t> s16;
+    Index<int32_t> s32, p32;
+    float matrix[12];
+    float sink;
+};
+
+struct Kernel
+{
+    const char * name;
+    size_t offset;  /* of the function in DSPKernels */
+    void (* run) (const DSPKernels & k, Buffers & b);
+};
+
+static const float biquad_coefs[5 * SECTIONS] = {
+    0.2f, 0.4f, 0.2f, -0.4f, 0.2f,
+    0.2f, 0.4f, 0.2f, -0.4f, 0.2f,
+    0.2f, 0.4f, 0.2f, -0.4f, 0.2f,
+    0.2f, 0.4f, 0.2f, -0.4f, 0.2f
+};
+
+/* multichannel kernels get stereo, except matrix_mix (5.1 to stereo) and
+ * hadamard (frames of 8) */
+static void run_ramp (const DSPKernels & k, Buffers & b)
+    { k.ramp (b.x.begin (), b.n, 0.5f, 1.5f); }
+static void run_scale (const DSPKernels & k, Buffers & b)
+    { k.scale (b.x.begin (), b.n, 0.999f); }
+static void run_mix (const DSPKernels & k, Buffers & b)
+    { k.mix (b.x.begin (), b.y.begin (), b.n); }
+static void run_multiply (const DSPKernels & k, Buffers & b)
+    { k.multiply (b.x.begin (), b.y.begin (), b.n); }
+static void run_mul_add (const DSPKernels & k, Buffers & b)
+    { k.mul_add (b.x.begin (), b.y.begin (), b.z.begin (), b.n); }
+static void run_abs_sum (const DSPKernels & k, Buffers & b)
+    { b.sink += k.abs_sum (b.x.begin (), b.n); }
+static void run_dot (const DSPKernels & k, Buffers & b)
+    { b.sink += k.dot (b.x.begin (), b.y.begin (), b.n); }
+
+static void run_interleave (const DSPKernels & k, Buffers & b)
+{
+    const float * in[2] = {b.y.begin (), b.y.begin () + b.n / 2};
+    k.interleave (in, b.x.begin (), 2, b.n / 2);
+}
+
+static void run_deinterleave (const DSPKernels & k, Buffers & b)
+{
+    float * out[2] = {b.x.begin (), b.x.begin () + b.n / 2};
+    k.deinterleave (b.y.begin (), out, 2, b.n / 2);
+}
+
+static void run_matrix_mix (const DSPKernels & k, Buffers & b)
+    { k.matrix_mix (b.y.begin (), 6, b.x.begin (), 2, b.matrix, b.n / 6); }
+
+static void run_butterfly (const DSPKernels & k, Buffers & b)
+{
+    int half = b.n / 2;
+    k.butterfly (b.x.begin (), b.x.begin () + half, b.y.begin (),
+     b.y.begin () + half, b.z.begin (), b.z.begin () + half, half);
+}
+
+static void run_complex_mac (const DSPKernels & k, Buffers & b)
+{
+    int half = b.n / 2;
+    k.complex_mac (b.x.begin (), b.x.begin () + half, b.y.begin (),
+     b.y.begin () + half, b.z.begin (), b.z.begin () + half, half);
+}
+
+static void run_hadamard (const DSPKernels & k, Buffers & b)
+    { k.hadamard (b.x.begin (), 8, b.n / 8); }
+static void run_true_peak (const DSPKernels & k, Buffers & b)
+    { k.true_peak (b.y.begin (), 2, b.n / 2 - HISTORY, b.z.begin (), b.x.begin ()); }
+static void run_biquads (const DSPKernels & k, Buffers & b)
+    { k.biquads (b.x.begin (), 2, b.n / 2, biquad_coefs, SECTIONS, b.state.begin ()); }
+static void run_to_s16 (const DSPKernels & k, Buffers & b)
+    { k.to_s16 (b.x.begin (), b.s16.begin (), b.n); }
+static void run_to_s32 (const DSPKernels & k, Buffers & b)
+    { k.to_s32 (b.x.begin (), b.s32.begin (), b.n, 8388608.0f, 8388607.0f); }
+
+static void run_pack_s16 (const DSPKernels & k, Buffers & b)
+{
+    const int32_t * in[2] = {b.p32.begin (), b.p32.begin () + b.n / 2};
+    k.pack_s16 (in, b.s16.begin (), 2, b.n / 2);
+}
+
+static void run_pack_s32 (const DSPKernels & k, Buffers & b)
+{
+    const int32_t * in[2] = {b.p32.begin (), b.p32.begin () + b.n / 2};
+    k.pack_s32 (in, b.s32.begin (), 2, b.n / 2);
+}
+
+#define KERNEL(name) {#name, offsetof (DSPKernels, name), run_##name}
+
+static const Kernel kernel_list[] = {
+    KERNEL (ramp),
+    KERNEL (scale),
+    KERNEL (mix),
+    KERNEL (multiply),
+    KERNEL (mul_add),
+    KERNEL (abs_sum),
+    KERNEL (dot),
+    KERNEL (interleave),
+    KERNEL (deinterleave),
+    KERNEL (matrix_mix),
+    KERNEL (butterfly),
+    KERNEL (complex_mac),
+    KERNEL (hadamard),
+    KERNEL (true_peak),
+    KERNEL (biquads),
+    KERNEL (to_s16),
+    KERNEL (to_s32),
+    KERNEL (pack_s16),
+    KERNEL (pack_s32)
+};
+
+/* the same tables as select_kernels () in dsp.cc, one per step */
+static int make_tables (DSPKernels * tables)
+{
+    int count = 0;
+    dsp_init_scalar (tables[count ++]);
+
+#ifdef DSP_X86
+#ifdef __GNUC__
+    __builtin_cpu_init ();
+#endif
+
+#if defined (__GNUC__) && ! defined (__SSE2__)
+    if (__builtin_cpu_supports ("sse2"))
+#endif
+    {
+        tables[count] = tables[count - 1];
+        dsp_init_sse2 (tables[count ++]);
+    }
+
+#ifdef __GNUC__
+    if (__builtin_cpu_supports ("avx2"))
+    {
+        tables[count] = tables[count - 1];
+        dsp_init_avx2 (tables[count ++]);
+    }
+#endif
+#endif
+
+#ifdef DSP_NEON
+    tables[count] = tables[count - 1];
+    dsp_init_neon (tables[count ++]);
+#endif
+
+    return count;
+}
+
+static void fill_buffers (Buffers & b)
+{
+    /* the same values every time */
+    srand (1);
+
+    auto random = [] ()
+        { return (float) rand () / RAND_MAX * 2 - 1; };
+
+    for (float & v : b.x)
+        v = random ();
+    for (float & v : b.y)
+        v = random ();
+    for (float & v : b.z)
+        v = random () * 0.5f;
+    for (float & v : b.state)
+        v = 0;
+    for (int16_t & v : b.s16)
+        v = 0;
+    for (int32_t & v : b.s32)
+        v = 0;
+    for (int32_t & v : b.p32)
+        v = rand () % 65536 - 32768;
+    for (float & v : b.matrix)
+        v = random ();
+
+    b.sink = 0;
+}
+
+static void alloc_buffers (Buffers & b, int n)
+{
+    b.n = n;
+    b.x.insert (0, n);
+    b.y.insert (0, n + 2 * HISTORY);
+    b.z.insert (0, n);
+    b.state.insert (0, 2 * 2 * SECTIONS);
+    b.s16.insert (0, n);
+    b.s32.insert (0, n);
+    b.p32.insert (0, n);
+}
+
+template<class T>
+static double max_diff (const Index<T> & a, const Index<T> & b)
+{
+    double diff = 0;
+    for (int i = 0; i < a.len (); i ++)
+        diff = fmax (diff, fabs ((double) a[i] - (double) b[i]));
+
+    return diff;
+}
+
+static double compare (const Buffers & a, const Buffers & b)
+{
+    double diff = fabs ((double) a.sink - b.sink);
+
+    diff = fmax (diff, max_diff (a.x, b.x));
+    diff = fmax (diff, max_diff (a.y, b.y));
+    diff = fmax (diff, max_diff (a.state, b.state));
+    diff = fmax (diff, max_diff (a.s16, b.s16));
+    diff = fmax (diff, max_diff (a.s32, b.s32));
+
+    return diff;
+}
+
+/* nanoseconds per sample, the best of a few batches */
+static double time_kernel (const Kernel & kernel, const DSPKernels & k, Buffers & b)
+{
+    int calls = aud::max (BATCH_SAMPLES / b.n, 1);
+    double best = 0;
+
+    for (int batch = 0; batch < BATCHES; batch ++)
+    {
+        fill_buffers (b);
+
+        int64_t start = now_ns ();
+
+        for (int i = 0; i < calls; i ++)
+            kernel.run (k, b);
+
+        double ns = (double) (now_ns () - start) / ((double) calls * b.n);
+        best = batch ? fmin (best, ns) : ns;
+    }
+
+    return best;
+}
+
+bool kernel_bench (int samples)
+{
+    /* a whole number of frames for every kernel */
+    int n = aud::max (samples / 48 * 48, 48 + 2 * HISTORY);
+
+    DSPKernels tables[MAX_ISAS];
+    int n_tables = make_tables (tables);
+
+    /* the values decay or grow over many calls; keep them out of the slow
+     * denormal range */
+    DenormalGuard denormals;
+
+    Buffers expect, test;
+    alloc_buffers (expect, n);
+    alloc_buffers (test, n);
+
+    printf ("libdsp kernels, %d samples per call, ns/sample (difference from scalar)\n", n);
+    printf ("  %-14s", "kernel");
+
+    for (int t = 0; t < n_tables; t ++)
+        printf ("  %-18s", tables[t].isa);
+
+    printf ("\n");
+
+    for (const Kernel & kernel : kernel_list)
+    {
+        printf ("  %-14s", kernel.name);
+
+        fill_buffers (expect);
+        kernel.run (tables[0], expect);
+
+        for (int t = 0; t < n_tables; t ++)
+        {
+            const DSPKernels & k = tables[t];
+
+            /* the same function as the table before: nothing to compare */
+            if (t && ! memcmp ((const char *) & k + kernel.offset,
+             (const char *) & tables[t - 1] + kernel.offset, sizeof (void (*) ())))
+            {
+                printf ("  %-18s", "-");
+                continue;
+            }
+
+            fill_buffers (test);
+            kernel.run (k, test);
+            double diff = compare (expect, test);
+
+            char cell[64];
+            if (t)
+                snprintf (cell, sizeof cell, "%.3f (%.2g)", time_kernel (kernel, k, test), diff);
+            else
+                snprintf (cell, sizeof cell, "%.3f", time_kernel (kernel, k, test));
+
+            printf ("  %-18s", cell);
+        }
+
+        printf ("\n");
+    }
+
+    return true;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015 Audacious developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Stand-ins for the parts of libaudcore that effect plugins use at run time
+ * and that need a running player: the configuration and the hooks.  They are
+ * exported from the executable (see Makefile), so the plugins loaded by the
+ * benchmark bind to them instead of to libaudcore.  Nothing is read from or
+ * written to the user's config file, so every run starts from the plugins'
+ * defaults plus the settings given on the command line. */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/hook.h>
+#include <libaudcore/index.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/runtime.h>
+
+struct HookItem
+{
+    String name;
+    HookFunction func;
+    void * user;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimpleHash<String, String> defaults, config;
+static Index<HookItem> hooks;
+
+static String config_key (const char * section, const char * name)
+{
+    return String (str_concat ({section ? section : "audacious", ":", name}));
+}
+
+void aud_config_set_defaults (const char * section, const char * const * entries)
+{
+    pthread_mutex_lock (& mutex);
+
+    for (; entries[0] && entries[1]; entries += 2)
+        defaults.add (config_key (section, entries[0]), String (entries[1]));
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void aud_set_str (const char * section, const char * name, const char * value)
+{
+    pthread_mutex_lock (& mutex);
+    config.add (config_key (section, name), String (value));
+    pthread_mutex_unlock (& mutex);
+}
+
+String aud_get_str (const char * section, const char * name)
+{
+    String key = config_key (section, name);
+
+    pthread_mutex_lock (& mutex);
+
+    String * value = config.lookup (key);
+    if (! value)
+        value = defaults.lookup (key);
+
+    String result = value ? * value : String ("");
+
+    pthread_mutex_unlock (& mutex);
+    return result;
+}
+
+void aud_set_bool (const char * section, const char * name, bool value)
+    { aud_set_str (section, name, value ? "TRUE" : "FALSE"); }
+bool aud_get_bool (const char * section, const char * name)
+    { return ! strcmp (aud_get_str (section, name), "TRUE"); }
+
+void aud_set_int (const char * section, const char * name, int value)
+    { aud_set_str (section, name, int_to_str (value)); }
+int aud_get_int (const char * section, const char * name)
+    { return str_to_int (aud_get_str (section, name)); }
+
+void aud_set_double (const char * section, const char * name, double value)
+    { aud_set_str (section, name, double_to_str (value)); }
+double aud_get_double (const char * section, const char * name)
+    { return str_to_double (aud_get_str (section, name)); }
+
+/* Only the main thread of the benchmark uses the hooks. */
+void hook_associate (const char * name, HookFunction func, void * user)
+{
+    hooks.append (HookItem {String (name), func, user});
+}
+
+void hook_dissociate_full (const char * name, HookFunction func, void * user)
+{
+    for (int i = 0; i < hooks.len (); i ++)
+    {
+        const HookItem & item = hooks[i];
+
+        if (! strcmp (item.name, name) && item.func == func && (! user || item.user == user))
+            hooks.remove (i --, 1);
+    }
+}
+
+void hook_call (const char * name, void * data)
+{
+    for (int i = 0; i < hooks.len (); i ++)
+    {
+        if (! strcmp (hooks[i].name, name))
+            hooks[i].func (data, hooks[i].user);
+    }
+}
@@ -27,6 +27,9 @@
 
 #include <bs2b.h>
 
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+
 class BS2BPlugin : public EffectPlugin
 {
 public:
@@ -55,6 +58,8 @@ EXPORT BS2BPlugin aud_plugin_instance;
 static t_bs2bdp bs2b = nullptr;
 static int bs2b_channels;
 
+static EffectStats stats (N_("Bauer Stereophonic-to-Binaural (BS2B)"));
+
 const char * const BS2BPlugin::defaults[] = {
  "feed", "45",
  "fcut", "700",
@@ -71,11 +76,14 @@ bool BS2BPlugin::init ()
     bs2b_set_level_feed (bs2b, aud_get_int ("bs2b", "feed"));
     bs2b_set_level_fcut (bs2b, aud_get_int ("bs2b", "fcut"));
 
+    stats.attach ();
     return true;
 }
 
 void BS2BPlugin::cleanup ()
 {
+    stats.detach ();
+
     bs2b_close (bs2b);
     bs2b = nullptr;
 }
@@ -88,6 +96,9 @@ void BS2BPlugin::start (int * channels, int * rate)
 
 void BS2BPlugin::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
     if (bs2b_channels == 2)
         bs2b_cross_feed_f (bs2b, * data, (* samples) / 2);
 }
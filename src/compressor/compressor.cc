@@ -28,27 +28,75 @@
 #include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+#include "crossover.h"
+#include "limiter.h"
+
 /* Response time adjustments.  Maybe this should be adjustable? */
 #define CHUNK_TIME 0.2f /* seconds */
 #define CHUNKS 5
 #define DECAY 0.3f
 
+/* In multiband mode, the target volume of each band is its share of the long-
+ * term average volume, which adapts at this rate (per chunk). */
+#define BALANCE_RATE 0.02f
+
+enum
+{
+    MODE_COMPRESSOR,
+    MODE_LIMITER,
+    MODE_MULTIBAND
+};
+
 /* What is a "normal" volume?  Replay Gain stuff claims to use 89 dB, but what
  * does that translate to in our PCM range? */
 static const char * const compressor_defaults[] = {
+    "mode", "0",  /* MODE_COMPRESSOR */
     "center", "0.5",
     "range", "0.5",
+    "bands", "3",
+    "lookahead", "5",
+    "release", "100",
+    "ceiling", "-1",
+    "true_peak", "TRUE",
      nullptr
 };
 
+static const ComboItem mode_list[] = {
+    ComboItem (N_("Compressor"), MODE_COMPRESSOR),
+    ComboItem (N_("Look-ahead limiter"), MODE_LIMITER),
+    ComboItem (N_("Multiband compressor"), MODE_MULTIBAND)
+};
+
 static const PreferencesWidget compressor_widgets[] = {
+    WidgetCombo (N_("Mode:"),
+        WidgetInt ("compressor", "mode"),
+        {{mode_list}}),
     WidgetLabel (N_("<b>Compression</b>")),
     WidgetSpin (N_("Center volume:"),
         WidgetFloat ("compressor", "center"),
         {0.1, 1, 0.1}),
     WidgetSpin (N_("Dynamic range:"),
         WidgetFloat ("compressor", "range"),
-        {0.0, 3.0, 0.1})
+        {0.0, 3.0, 0.1}),
+    WidgetSpin (N_("Bands (multiband mode):"),
+        WidgetInt ("compressor", "bands"),
+        {MIN_BANDS, MAX_BANDS, 1}),
+    WidgetLabel (N_("<b>Limiting</b>")),
+    WidgetSpin (N_("Look-ahead:"),
+        WidgetFloat ("compressor", "lookahead"),
+        {1, 20, 0.5, N_("ms")}),
+    WidgetSpin (N_("Release:"),
+        WidgetFloat ("compressor", "release"),
+        {10, 1000, 10, N_("ms")}),
+    WidgetSpin (N_("Ceiling:"),
+        WidgetFloat ("compressor", "ceiling"),
+        {-12, 0, 0.1, N_("dB")}),
+    WidgetCheck (N_("Detect peaks between samples (4x oversampling)"),
+        WidgetBool ("compressor", "true_peak")),
+    WidgetLabel (N_("<small>Changes to the mode, bands, and limiter settings "
+     "take effect at the next song.</small>"))
 };
 
 static const PluginPreferences compressor_prefs = {{compressor_widgets}};
@@ -81,17 +129,35 @@ public:
 
 EXPORT Compressor aud_plugin_instance;
 
-/* The read pointer of the ring buffer is kept aligned to the chunk size at all
+/* The read pointer of each ring buffer is kept aligned to the chunk size at all
  * times.  To preserve the alignment, each read from the buffer must either (a)
  * read a multiple of the chunk size or (b) empty the buffer completely.  Writes
- * to the buffer need not be aligned to the chunk size. */
+ * to the buffer need not be aligned to the chunk size.
+ *
+ * In multiband mode, each band has its own buffers, which are always filled
+ * and emptied together. */
+
+struct Band {
+    RingBuf<float> buffer, peaks;
+    float current_peak;
+    float average;  /* multiband mode only */
+};
+
+static Band bands[MAX_BANDS];
+static int n_bands;
+static Crossover crossover;
+static Index<float> band_input[MAX_BANDS];
 
-static RingBuf<float> buffer, peaks;
 static Index<float> output;
+static int output_size;  /* largest output since the buffer was freed */
 static int chunk_size;
-static float current_peak;
 static int current_channels, current_rate;
 
+static int mode;
+static Limiter limiter;
+
+static EffectStats stats (N_("Dynamic Range Compressor"));
+
 /* I used to find the maximum sample and take that as the peak, but that doesn't
  * work well on badly clipped tracks.  Now, I use the highly sophisticated
  * method of averaging the absolute value of the samples and multiplying by 6, a
@@ -100,40 +166,126 @@ static int current_channels, current_rate;
 
 static float calc_peak (float * data, int length)
 {
-    float sum = 0;
+    return aud::max (0.01f, dsp_abs_sum (data, length) / length * 6);
+}
+
+/* target volume of a band; in single-band mode, simply the center volume */
+static float band_center (int b)
+{
+    float center = aud_get_double ("compressor", "center");
+
+    if (n_bands == 1)
+        return center;
 
-    float * end = data + length;
-    while (data < end)
-        sum += fabsf (* data ++);
+    float total = 0;
+    for (int i = 0; i < n_bands; i ++)
+        total += bands[i].average * bands[i].average;
 
-    return aud::max (0.01f, sum / length * 6);
+    return center * bands[b].average / sqrtf (total);
 }
 
-static void do_ramp (float * data, int length, float peak_a, float peak_b)
+static void do_ramp (float * data, int length, float peak_a, float peak_b, float center)
 {
-    float center = aud_get_double ("compressor", "center");
     float range = aud_get_double ("compressor", "range");
     float a = powf (peak_a / center, range - 1);
     float b = powf (peak_b / center, range - 1);
 
-    for (int count = 0; count < length; count ++)
+    dsp_ramp (data, length, a, b);
+}
+
+/* Compresses the first chunk in the band's buffer. */
+static void compress_chunk (Band & band, int b)
+{
+    while (band.peaks.len () < CHUNKS)
+        band.peaks.push (calc_peak (& band.buffer[chunk_size * band.peaks.len ()], chunk_size));
+
+    if (band.current_peak == 0.0f)
     {
-        * data = (* data) * (a * (length - count) + b * count) / length;
-        data ++;
+        for (int i = 0; i < CHUNKS; i ++)
+            band.current_peak = aud::max (band.current_peak, band.peaks[i]);
+
+        band.average = band.current_peak;
+    }
+
+    float new_peak = aud::max (band.peaks[0], band.current_peak * (1.0f - DECAY));
+
+    for (int count = 1; count < CHUNKS; count ++)
+        new_peak = aud::max (new_peak, band.current_peak +
+         (band.peaks[count] - band.current_peak) / count);
+
+    do_ramp (& band.buffer[0], chunk_size, band.current_peak, new_peak, band_center (b));
+
+    band.current_peak = new_peak;
+    band.average += (new_peak - band.average) * BALANCE_RATE;
+    band.peaks.pop ();
+}
+
+/* Returns the input for each band: the data itself in single-band mode. */
+static void split_bands (float * data, int samples, float * * split)
+{
+    if (n_bands == 1)
+    {
+        split[0] = data;
+        return;
+    }
+
+    for (int b = 0; b < n_bands; b ++)
+    {
+        if (band_input[b].len () < samples)
+        {
+            band_input[b].insert (-1, samples - band_input[b].len ());
+            stats.count_alloc ();
+        }
+
+        split[b] = band_input[b].begin ();
+    }
+
+    crossover.split (data, samples, split);
+}
+
+/* Appends the first <length> samples of each band's buffer to the output,
+ * adding the bands together. */
+static void output_bands (int length)
+{
+    int at = output.len ();
+    output.insert (& bands[0].buffer[0], -1, length);
+
+    for (int b = 1; b < n_bands; b ++)
+        dsp_mix (& output[at], & bands[b].buffer[0], length);
+
+    for (int b = 0; b < n_bands; b ++)
+        bands[b].buffer.discard (length);
+
+    if (output.len () > output_size)
+    {
+        output_size = output.len ();
+        stats.count_alloc ();
     }
 }
 
 bool Compressor::init ()
 {
     aud_config_set_defaults ("compressor", compressor_defaults);
+    stats.attach ();
     return true;
 }
 
 void Compressor::cleanup ()
 {
-    buffer.destroy ();
-    peaks.destroy ();
+    stats.detach ();
+
+    for (Band & band : bands)
+    {
+        band.buffer.destroy ();
+        band.peaks.destroy ();
+    }
+
+    for (auto & input : band_input)
+        input.clear ();
+
     output.clear ();
+    output_size = 0;
+    limiter.destroy ();
 }
 
 void Compressor::start (int * channels, int * rate)
@@ -141,51 +293,91 @@ void Compressor::start (int * channels, int * rate)
     current_channels = * channels;
     current_rate = * rate;
 
+    mode = aud_get_int ("compressor", "mode");
+
+    if (mode == MODE_LIMITER)
+    {
+        limiter.init (current_channels, current_rate,
+         aud_get_double ("compressor", "lookahead"),
+         aud_get_double ("compressor", "release"),
+         aud_get_double ("compressor", "ceiling"),
+         aud_get_bool ("compressor", "true_peak"));
+    }
+
+    if (mode == MODE_MULTIBAND)
+    {
+        n_bands = aud::clamp (aud_get_int ("compressor", "bands"), MIN_BANDS, MAX_BANDS);
+        crossover.init (current_channels, current_rate, n_bands);
+    }
+    else
+        n_bands = 1;
+
     chunk_size = (* channels) * (int) ((* rate) * CHUNK_TIME);
 
-    buffer.alloc (chunk_size * CHUNKS);
-    peaks.alloc (CHUNKS);
+    for (int b = 0; b < n_bands; b ++)
+    {
+        bands[b].buffer.alloc (chunk_size * CHUNKS);
+        bands[b].peaks.alloc (CHUNKS);
+    }
+
+    /* Each call returns at most the block and what was buffered before it.
+     * The delay line of the limiter is far shorter than the buffers. */
+    int block = current_channels * DSP_BLOCK_FRAMES;
+    int size = block + chunk_size * CHUNKS;
+
+    if (output_size < size)
+    {
+        output.insert (0, size);
+        output.remove (0, -1);
+        output_size = size;
+    }
+
+    if (n_bands > 1)
+    {
+        for (int b = 0; b < n_bands; b ++)
+        {
+            if (band_input[b].len () < block)
+                band_input[b].insert (-1, block - band_input[b].len ());
+        }
+    }
 
     flush ();
 }
 
 void Compressor::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
+    /* the limiter works in place, with no copying */
+    if (mode == MODE_LIMITER)
+    {
+        limiter.process (* data, * samples / current_channels);
+        return;
+    }
+
     output.remove (0, -1);
 
     while (1)
     {
-        int writable = aud::min (* samples, buffer.space ());
+        int writable = aud::min (* samples, bands[0].buffer.space ());
+
+        float * split[MAX_BANDS];
+        split_bands (* data, writable, split);
 
-        buffer.copy_in (* data, writable);
+        for (int b = 0; b < n_bands; b ++)
+            bands[b].buffer.copy_in (split[b], writable);
 
         * data += writable;
         * samples -= writable;
 
-        if (buffer.space ())
+        if (bands[0].buffer.space ())
             break;
 
-        while (peaks.len () < CHUNKS)
-            peaks.push (calc_peak (& buffer[chunk_size * peaks.len ()], chunk_size));
-
-        if (current_peak == 0.0f)
-        {
-            for (int i = 0; i < CHUNKS; i ++)
-                current_peak = aud::max (current_peak, peaks[i]);
-        }
-
-        float new_peak = aud::max (peaks[0], current_peak * (1.0f - DECAY));
+        for (int b = 0; b < n_bands; b ++)
+            compress_chunk (bands[b], b);
 
-        for (int count = 1; count < CHUNKS; count ++)
-            new_peak = aud::max (new_peak, current_peak + (peaks[count] - current_peak) / count);
-
-        do_ramp (& buffer[0], chunk_size, current_peak, new_peak);
-
-        output.insert (& buffer[0], -1, chunk_size);
-        buffer.discard (chunk_size);
-
-        current_peak = new_peak;
-        peaks.pop ();
+        output_bands (chunk_size);
     }
 
     * data = output.begin ();
@@ -194,33 +386,74 @@ void Compressor::process (float * * data, int * samples)
 
 void Compressor::flush ()
 {
-    buffer.discard ();
-    peaks.discard ();
+    for (int b = 0; b < n_bands; b ++)
+    {
+        bands[b].buffer.discard ();
+        bands[b].peaks.discard ();
+        bands[b].current_peak = 0.0f;
+    }
 
-    current_peak = 0.0f;
+    if (mode == MODE_LIMITER)
+        limiter.reset ();
+    if (mode == MODE_MULTIBAND)
+        crossover.reset ();
 }
 
 void Compressor::finish (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
     output.remove (0, -1);
 
-    peaks.discard ();
+    if (mode == MODE_LIMITER)
+    {
+        limiter.process (* data, * samples / current_channels);
+        output.insert (* data, -1, * samples);
+        limiter.drain (output);
+        limiter.reset ();
+
+        * data = output.begin ();
+        * samples = output.len ();
+        return;
+    }
+
+    for (int b = 0; b < n_bands; b ++)
+        bands[b].peaks.discard ();
 
-    while (buffer.len ())
+    while (bands[0].buffer.len ())
     {
-        int writable = buffer.linear ();
+        int writable = bands[0].buffer.linear ();
+
+        for (int b = 0; b < n_bands; b ++)
+        {
+            Band & band = bands[b];
+
+            if (band.current_peak != 0.0f)
+                do_ramp (& band.buffer[0], writable, band.current_peak,
+                 band.current_peak, band_center (b));
+        }
+
+        output_bands (writable);
+    }
 
-        if (current_peak != 0.0f)
-            do_ramp (& buffer[0], writable, current_peak, current_peak);
+    float * split[MAX_BANDS];
+    split_bands (* data, * samples, split);
 
-        output.insert (& buffer[0], -1, writable);
-        buffer.discard (writable);
+    for (int b = 0; b < n_bands; b ++)
+    {
+        Band & band = bands[b];
+
+        if (band.current_peak != 0.0f)
+            do_ramp (split[b], * samples, band.current_peak, band.current_peak,
+             band_center (b));
     }
 
-    if (current_peak != 0.0f)
-        do_ramp (* data, * samples, current_peak, current_peak);
+    int at = output.len ();
+    output.insert (split[0], -1, * samples);
 
-    output.insert (* data, -1, * samples);
+    for (int b = 1; b < n_bands; b ++)
+        dsp_mix (& output[at], split[b], * samples);
 
     * data = output.begin ();
     * samples = output.len ();
@@ -228,5 +461,10 @@ void Compressor::finish (float * * data, int * samples)
 
 int Compressor::adjust_delay (int delay)
 {
-    return delay + aud::rescale<int64_t> (buffer.len () / current_channels, current_rate, 1000);
+    int frames = (mode == MODE_LIMITER) ? limiter.latency () :
+     bands[0].buffer.len () / current_channels;
+    int added = aud::rescale<int64_t> (frames, current_rate, 1000);
+
+    stats.set_delay (added);
+    return delay + added;
 }
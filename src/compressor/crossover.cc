@@ -0,0 +1,109 @@
+/*
+ * Dynamic Range Compression Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "crossover.h"
+
+#include <math.h>
+#include <string.h>
+
+/* crossover frequencies (Hz) for each number of bands */
+static const float frequencies[MAX_BANDS - MIN_BANDS + 1][MAX_BANDS - 1] = {
+    {200, 2000},
+    {150, 800, 4000},
+    {120, 500, 2000, 6000}
+};
+
+void Crossover::Filter::add (double b0, double b1, double b2, double a0,
+ double a1, double a2)
+{
+    float * k = coefs + 5 * sections;
+
+    k[0] = b0 / a0;
+    k[1] = b1 / a0;
+    k[2] = b2 / a0;
+    k[3] = a1 / a0;
+    k[4] = a2 / a0;
+
+    sections ++;
+}
+
+void Crossover::init (int channels, int rate, int bands)
+{
+    m_channels = channels;
+    m_bands = aud::clamp (bands, MIN_BANDS, MAX_BANDS);
+
+    const float * freqs = frequencies[m_bands - MIN_BANDS];
+
+    for (int b = 0; b < m_bands - 1; b ++)
+    {
+        m_low[b].sections = 0;
+        m_high[b].sections = 0;
+    }
+
+    /* second-order Butterworth sections (Q = 1 / sqrt (2)), after the "Audio EQ
+     * Cookbook" by Robert Bristow-Johnson */
+    for (int x = 0; x < m_bands - 1; x ++)
+    {
+        double w = 2 * M_PI * aud::min (freqs[x], rate * 0.45f) / rate;
+        double cw = cos (w);
+        double alpha = sin (w) * M_SQRT1_2;
+
+        for (int i = 0; i < 2; i ++)
+        {
+            m_low[x].add ((1 - cw) / 2, 1 - cw, (1 - cw) / 2, 1 + alpha, -2 * cw, 1 - alpha);
+            m_high[x].add ((1 + cw) / 2, -(1 + cw), (1 + cw) / 2, 1 + alpha, -2 * cw, 1 - alpha);
+        }
+
+        /* the all-pass response of this crossover, for the bands below it */
+        for (int b = 0; b < x; b ++)
+            m_low[b].add (1 - alpha, -2 * cw, 1 + alpha, 1 + alpha, -2 * cw, 1 - alpha);
+    }
+
+    for (int b = 0; b < m_bands - 1; b ++)
+    {
+        m_low[b].state.clear ();
+        m_low[b].state.insert (0, 2 * channels * m_low[b].sections);
+        m_high[b].state.clear ();
+        m_high[b].state.insert (0, 2 * channels * m_high[b].sections);
+    }
+}
+
+void Crossover::reset ()
+{
+    for (int b = 0; b < m_bands - 1; b ++)
+    {
+        memset (m_low[b].state.begin (), 0, sizeof (float) * m_low[b].state.len ());
+        memset (m_high[b].state.begin (), 0, sizeof (float) * m_high[b].state.len ());
+    }
+}
+
+void Crossover::split (const float * in, int samples, float * const * out)
+{
+    int frames = samples / m_channels;
+    float * rest = out[m_bands - 1];
+
+    memcpy (rest, in, sizeof (float) * samples);
+
+    for (int b = 0; b < m_bands - 1; b ++)
+    {
+        memcpy (out[b], rest, sizeof (float) * samples);
+        m_low[b].run (out[b], m_channels, frames);
+        m_high[b].run (rest, m_channels, frames);
+    }
+}
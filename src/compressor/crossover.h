@@ -0,0 +1,62 @@
+/*
+ * Dynamic Range Compression Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef COMPRESSOR_CROSSOVER_H
+#define COMPRESSOR_CROSSOVER_H
+
+#include <libaudcore/index.h>
+
+#include "../libdsp/dsp.h"
+
+#define MIN_BANDS 3
+#define MAX_BANDS 5
+
+/* Splits audio into frequency bands with 4th-order Linkwitz-Riley crossovers
+ * (two Butterworth biquads in series).  The low and high outputs of each
+ * crossover add up to an all-pass response, so each band is also passed
+ * through the all-pass filters of the crossovers above it; the bands then add
+ * up to a signal with a flat magnitude response. */
+
+class Crossover
+{
+public:
+    void init (int channels, int rate, int bands);
+    void reset ();
+
+    /* Writes <samples> interleaved samples of each band to out[0] (lowest)
+     * through out[bands - 1] (highest). */
+    void split (const float * in, int samples, float * const * out);
+
+private:
+    struct Filter {
+        float coefs[5 * DSP_MAX_BIQUADS];
+        int sections;
+        Index<float> state;
+
+        void add (double b0, double b1, double b2, double a0, double a1, double a2);
+        void run (float * data, int channels, int frames)
+            { dsp_biquads (data, channels, frames, coefs, sections, state.begin ()); }
+    };
+
+    int m_channels = 0, m_bands = 0;
+    Filter m_low[MAX_BANDS - 1];   /* low-pass (and all-pass) for each band */
+    Filter m_high[MAX_BANDS - 1];  /* high-pass, applied to the remainder */
+};
+
+#endif /* COMPRESSOR_CROSSOVER_H */
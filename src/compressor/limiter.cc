@@ -0,0 +1,173 @@
+/*
+ * Dynamic Range Compression Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "limiter.h"
+
+#include <math.h>
+#include <string.h>
+
+void SlidingMin::init (int size)
+{
+    m_size = size;
+    m_values.clear ();
+    m_times.clear ();
+
+    /* one more than the window, since a value is added before the oldest one
+     * is dropped */
+    m_values.insert (0, size + 1);
+    m_times.insert (0, size + 1);
+
+    reset ();
+}
+
+void SlidingMin::reset ()
+{
+    m_head = m_count = 0;
+    m_time = 0;
+}
+
+float SlidingMin::push (float value)
+{
+    int cap = m_size + 1;
+
+    /* drop values that can no longer be the minimum */
+    while (m_count && m_values[(m_head + m_count - 1) % cap] >= value)
+        m_count --;
+
+    int tail = (m_head + m_count) % cap;
+    m_values[tail] = value;
+    m_times[tail] = m_time;
+    m_count ++;
+
+    /* drop the oldest value once it leaves the window */
+    if (m_times[m_head] <= m_time - m_size)
+    {
+        m_head = (m_head + 1) % cap;
+        m_count --;
+    }
+
+    m_time ++;
+    return m_values[m_head];
+}
+
+void Limiter::init (int channels, int rate, float lookahead_ms, float release_ms,
+ float ceiling_db, bool true_peak)
+{
+    destroy ();
+
+    m_channels = channels;
+    m_lookahead = aud::max (1, (int) lroundf (rate * lookahead_ms / 1000));
+    m_delay = m_lookahead + (true_peak ? DSP_TRUE_PEAK_DELAY : 0);
+    m_ceiling = powf (10, ceiling_db / 20);
+    m_release = expf (-1000 / (rate * release_ms));
+    m_true_peak = true_peak;
+
+    m_line.insert (0, channels * m_delay);
+    m_box.insert (0, m_lookahead);
+    m_peaks.insert (0, DSP_BLOCK_FRAMES);  /* grown later only for larger blocks */
+    m_window.init (m_lookahead + 1);
+
+    reset ();
+}
+
+void Limiter::destroy ()
+{
+    m_line.clear ();
+    m_box.clear ();
+    m_peaks.clear ();
+    m_channels = m_lookahead = m_delay = 0;
+}
+
+void Limiter::reset ()
+{
+    memset (m_line.begin (), 0, sizeof (float) * m_line.len ());
+    m_line_pos = 0;
+
+    m_window.reset ();
+    m_env = 1;
+
+    for (float & value : m_box)
+        value = 1;
+
+    m_box_pos = 0;
+    m_box_sum = m_lookahead;
+
+    memset (m_history, 0, sizeof m_history);
+}
+
+void Limiter::process (float * data, int frames)
+{
+    if (m_peaks.len () < frames)
+        m_peaks.insert (-1, frames - m_peaks.len ());
+
+    float * peaks = m_peaks.begin ();
+
+    /* true peaks are measured DSP_TRUE_PEAK_DELAY frames late, which is made
+     * up for by the longer delay line */
+    if (m_true_peak)
+        dsp_true_peak (data, m_channels, frames, m_history, peaks);
+    else
+    {
+        for (int f = 0; f < frames; f ++)
+        {
+            float peak = 0;
+            for (int c = 0; c < m_channels; c ++)
+                peak = fmaxf (peak, fabsf (data[f * m_channels + c]));
+
+            peaks[f] = peak;
+        }
+    }
+
+    for (int f = 0; f < frames; f ++)
+    {
+        float needed = (peaks[f] > m_ceiling) ? m_ceiling / peaks[f] : 1;
+        float target = m_window.push (needed);
+
+        /* attack at once (smoothed below), release slowly */
+        if (target < m_env)
+            m_env = target;
+        else
+            m_env = target + (m_env - target) * m_release;
+
+        m_box_sum += m_env - m_box[m_box_pos];
+        m_box[m_box_pos] = m_env;
+        m_box_pos = (m_box_pos + 1) % m_lookahead;
+
+        float gain = m_box_sum / m_lookahead;
+        float * line = & m_line[m_line_pos * m_channels];
+        float * frame = data + f * m_channels;
+
+        for (int c = 0; c < m_channels; c ++)
+        {
+            float in = frame[c];
+            frame[c] = line[c] * gain;
+            line[c] = in;
+        }
+
+        m_line_pos = (m_line_pos + 1) % m_delay;
+    }
+}
+
+void Limiter::drain (Index<float> & out)
+{
+    /* push silence through to get the rest out */
+    int at = out.len ();
+    out.insert (-1, m_channels * m_delay);
+    process (& out[at], m_delay);
+}
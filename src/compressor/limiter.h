@@ -0,0 +1,90 @@
+/*
+ * Dynamic Range Compression Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef COMPRESSOR_LIMITER_H
+#define COMPRESSOR_LIMITER_H
+
+#include <stdint.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/index.h>
+
+#include "../libdsp/dsp.h"
+
+/* Running minimum of the last <size> values, in constant (amortized) time per
+ * value.  The values which can still become the minimum are kept in a deque,
+ * in increasing order. */
+class SlidingMin
+{
+public:
+    void init (int size);
+    void reset ();
+    float push (float value);
+
+private:
+    int m_size = 0;
+    Index<float> m_values;
+    Index<int64_t> m_times;
+    int m_head = 0, m_count = 0;
+    int64_t m_time = 0;
+};
+
+/* Look-ahead peak limiter.  The audio is delayed by the look-ahead time, so
+ * that the gain can be brought down smoothly before a peak arrives rather than
+ * clipping it: the gain needed for each frame is taken as the minimum over the
+ * look-ahead window, released exponentially, and smoothed with a moving
+ * average of the same length.  No output sample exceeds the ceiling. */
+class Limiter
+{
+public:
+    void init (int channels, int rate, float lookahead_ms, float release_ms,
+     float ceiling_db, bool true_peak);
+    void destroy ();
+    void reset ();
+
+    /* Processes <frames> interleaved frames in place.  The output is delayed
+     * by latency () frames. */
+    void process (float * data, int frames);
+
+    /* Appends the audio remaining in the delay line to <out>. */
+    void drain (Index<float> & out);
+
+    int latency () const
+        { return m_delay; }
+
+private:
+    int m_channels = 0;
+    int m_lookahead = 0, m_delay = 0;   /* in frames */
+    float m_ceiling = 1, m_release = 0;
+    bool m_true_peak = false;
+
+    Index<float> m_line;                /* delay line, m_delay frames */
+    int m_line_pos = 0;
+
+    SlidingMin m_window;
+    float m_env = 1;
+    Index<float> m_box;                 /* last m_lookahead values of m_env */
+    int m_box_pos = 0;
+    double m_box_sum = 0;
+
+    Index<float> m_peaks;
+    float m_history[(DSP_TRUE_PEAK_TAPS - 1) * AUD_MAX_CHANNELS];
+};
+
+#endif /* COMPRESSOR_LIMITER_H */
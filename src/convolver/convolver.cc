@@ -0,0 +1,489 @@
+/*
+ * Convolver Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+#include "impulse.h"
+#include "partition.h"
+
+static const char convolver_about[] =
+ N_("Convolver Plugin for Audacious\n"
+    "Copyright 2015 Audacious developers\n\n"
+    "Applies an impulse response, e.g. for room correction or headphone "
+    "crossfeed, by partitioned FFT convolution.");
+
+static const char * const convolver_defaults[] = {
+ "file", "",
+ "block", "256",
+ "gain", "0",
+ nullptr};
+
+/* largest block size offered */
+#define MAX_BLOCK 1024
+
+/* set from the main thread, checked by the audio thread */
+static std::atomic<bool> settings_changed;
+
+static void settings_cb ()
+    { settings_changed = true; }
+
+static void apply_cb ();
+
+static const ComboItem block_list[] = {
+    ComboItem ("64", 64),
+    ComboItem ("128", 128),
+    ComboItem ("256", 256),
+    ComboItem ("512", 512),
+    ComboItem ("1024", 1024)
+};
+
+static const PreferencesWidget convolver_widgets[] = {
+    WidgetEntry (N_("Impulse response:"),
+        WidgetString ("convolver", "file")),
+    WidgetButton (N_("Load"), {apply_cb}),
+    WidgetLabel (N_("<small>A WAV file with one channel for all channels, one "
+     "channel per channel, or four channels for true stereo (left to left, left "
+     "to right, right to left, right to right).  Its sample rate should match "
+     "that of the audio.</small>")),
+    WidgetCombo (N_("Block size (latency):"),
+        WidgetInt ("convolver", "block", apply_cb),
+        {{block_list}}),
+    WidgetSpin (N_("Gain:"),
+        WidgetFloat ("convolver", "gain", settings_cb),
+        {-24, 24, 0.5, N_("dB")})
+};
+
+static const PluginPreferences convolver_prefs = {{convolver_widgets}};
+
+class ConvolverPlugin : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Convolver"),
+        PACKAGE,
+        convolver_about,
+        & convolver_prefs
+    };
+
+    constexpr ConvolverPlugin () : EffectPlugin (info, 0, true) {}
+
+    bool init ();
+    void cleanup ();
+
+    void start (int * channels, int * rate);
+    void process (float * * data, int * samples);
+    void flush ();
+    void finish (float * * data, int * samples);
+    int adjust_delay (int delay);
+};
+
+EXPORT ConvolverPlugin aud_plugin_instance;
+
+static int conv_channels, conv_rate;
+static float conv_gain = 1;
+
+/* the convolver in use (null to pass the audio through), and what it was
+ * built from */
+static Convolver * convolver;
+static String current_file;
+static int current_block, current_channels;
+static int current_latency;
+
+static Index<float> output;
+
+static EffectStats stats (N_("Convolver"));
+
+/* Impulse responses are loaded, and convolvers built, by a background thread,
+ * which is woken whenever a new file or block size is applied or the number of
+ * channels changes.  The audio thread picks up a finished convolver without
+ * waiting for the lock, so it never blocks on reading a file.  The convolver
+ * it replaces goes back to the thread to be destroyed, since that means
+ * joining its tail thread. */
+static pthread_t load_thread;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static bool thread_running, quit;
+
+/* protected by the mutex */
+static String job_file;
+static int job_block, job_channels, job_rate;  /* zero: nothing to build for */
+static int job_serial, done_serial;
+static Convolver * ready_convolver;            /* may be null (no file) */
+static String ready_file;
+static int ready_block, ready_channels;
+static bool have_ready;
+static Convolver * retired;
+
+static void delete_convolver (Convolver * conv)
+{
+    if (conv)
+    {
+        conv->destroy ();
+        delete conv;
+    }
+}
+
+/* Returns the number of paths, or zero if the impulse response does not fit
+ * the number of channels. */
+static int make_paths (const Impulse & impulse, int channels, ConvPath * paths)
+{
+    int length = impulse.frames;
+
+    if (impulse.channels == 4 && channels == 2)
+    {
+        paths[0] = {0, 0, impulse.channel (0), length};
+        paths[1] = {0, 1, impulse.channel (1), length};
+        paths[2] = {1, 0, impulse.channel (2), length};
+        paths[3] = {1, 1, impulse.channel (3), length};
+        return 4;
+    }
+
+    if (impulse.channels != 1 && impulse.channels != channels)
+        return 0;
+
+    for (int c = 0; c < channels; c ++)
+        paths[c] = {c, c, impulse.channel ((impulse.channels == 1) ? 0 : c), length};
+
+    return channels;
+}
+
+/* called from the load thread */
+static Convolver * build_convolver (const Impulse & impulse, int channels,
+ int rate, int block)
+{
+    if (! impulse.frames)
+        return nullptr;
+
+    if (impulse.rate != rate)
+        AUDWARN ("The impulse response is at %d Hz, but the audio is at %d Hz.\n",
+         impulse.rate, rate);
+
+    ConvPath paths[AUD_MAX_CHANNELS];
+    int n_paths = make_paths (impulse, channels, paths);
+
+    if (! n_paths)
+    {
+        AUDERR ("An impulse response with %d channels cannot be used with %d "
+         "channels.\n", impulse.channels, channels);
+        return nullptr;
+    }
+
+    Convolver * conv = new Convolver;
+
+    if (! conv->init (channels, paths, n_paths, block))
+    {
+        delete_convolver (conv);
+        return nullptr;
+    }
+
+    return conv;
+}
+
+static void * load_worker (void *)
+{
+    /* the last file read, kept for a change of block size */
+    Impulse impulse;
+    String impulse_file;
+
+    pthread_mutex_lock (& mutex);
+
+    while (1)
+    {
+        while (! quit && ! retired && (! job_channels || done_serial == job_serial))
+            pthread_cond_wait (& wake, & mutex);
+
+        if (quit)
+            break;
+
+        if (retired)
+        {
+            Convolver * old = retired;
+            retired = nullptr;
+
+            pthread_mutex_unlock (& mutex);
+            delete_convolver (old);
+            pthread_mutex_lock (& mutex);
+
+            pthread_cond_broadcast (& done);
+            continue;
+        }
+
+        int serial = job_serial;
+        String file = job_file;
+        int block = job_block, channels = job_channels, rate = job_rate;
+        pthread_mutex_unlock (& mutex);
+
+        if (file != impulse_file)
+        {
+            impulse.clear ();
+            if (file[0])
+                impulse.load (file);
+
+            impulse_file = file;
+        }
+
+        Convolver * conv = build_convolver (impulse, channels, rate, block);
+
+        AUDDBG ("Convolver: built for %d channels, block %d.\n", channels, block);
+
+        pthread_mutex_lock (& mutex);
+        done_serial = serial;
+
+        /* a convolver built for old settings is of no use */
+        Convolver * unused = conv;
+
+        if (serial == job_serial)
+        {
+            unused = have_ready ? ready_convolver : nullptr;
+            ready_convolver = conv;
+            ready_file = file;
+            ready_block = block;
+            ready_channels = channels;
+            have_ready = true;
+        }
+
+        pthread_cond_broadcast (& done);
+        pthread_mutex_unlock (& mutex);
+
+        delete_convolver (unused);
+        pthread_mutex_lock (& mutex);
+    }
+
+    pthread_mutex_unlock (& mutex);
+    return nullptr;
+}
+
+static int get_block ()
+{
+    int block = aud::clamp (aud_get_int ("convolver", "block"), 64, MAX_BLOCK);
+
+    /* round down to a power of two */
+    while (block & (block - 1))
+        block &= block - 1;
+
+    return block;
+}
+
+/* Asks the load thread to build a convolver for the current file and block
+ * size and, if <channels> is given, a new format. */
+static void request_build (int channels, int rate)
+{
+    String file = aud_get_str ("convolver", "file");
+    int block = get_block ();
+
+    pthread_mutex_lock (& mutex);
+
+    if (channels)
+    {
+        job_channels = channels;
+        job_rate = rate;
+    }
+
+    job_file = file;
+    job_block = block;
+    job_serial ++;
+
+    pthread_cond_signal (& wake);
+    pthread_mutex_unlock (& mutex);
+}
+
+/* called from the main thread when a new file or block size is applied */
+static void apply_cb ()
+{
+    request_build (0, 0);
+}
+
+/* Swaps in a finished convolver if there is one.  Unless <wait> is set, gives
+ * up at once if the lock is taken or the last convolver replaced has not yet
+ * been destroyed. */
+static void collect_convolver (bool wait)
+{
+    if (wait)
+        pthread_mutex_lock (& mutex);
+    else if (pthread_mutex_trylock (& mutex))
+        return;
+
+    if (have_ready && ! retired)
+    {
+        retired = convolver;
+        convolver = ready_convolver;
+        current_file = std::move (ready_file);
+        current_block = ready_block;
+        current_channels = ready_channels;
+        current_latency = convolver ? convolver->latency () : 0;
+
+        ready_convolver = nullptr;
+        have_ready = false;
+
+        if (retired)
+            pthread_cond_signal (& wake);
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+bool ConvolverPlugin::init ()
+{
+    aud_config_set_defaults ("convolver", convolver_defaults);
+
+    quit = false;
+
+    if (pthread_create (& load_thread, nullptr, load_worker, nullptr))
+    {
+        AUDERR ("Failed to start impulse response loading thread.\n");
+        return false;
+    }
+
+    thread_running = true;
+    stats.attach ();
+    return true;
+}
+
+void ConvolverPlugin::cleanup ()
+{
+    stats.detach ();
+
+    if (thread_running)
+    {
+        pthread_mutex_lock (& mutex);
+        quit = true;
+        pthread_cond_signal (& wake);
+        pthread_mutex_unlock (& mutex);
+
+        pthread_join (load_thread, nullptr);
+        thread_running = false;
+    }
+
+    delete_convolver (convolver);
+    delete_convolver (ready_convolver);
+    delete_convolver (retired);
+    convolver = ready_convolver = retired = nullptr;
+    have_ready = false;
+
+    job_file = ready_file = current_file = String ();
+    job_block = job_channels = job_rate = 0;
+    current_block = current_channels = current_latency = 0;
+
+    output.clear ();
+}
+
+/* The first convolver for a format is waited for, so that the delay is right
+ * from the start.  Reading the file takes about as long as it did when it was
+ * done here directly. */
+void ConvolverPlugin::start (int * channels, int * rate)
+{
+    conv_channels = * channels;
+    conv_rate = * rate;
+
+    settings_changed = false;
+    conv_gain = powf (10, aud_get_double ("convolver", "gain") / 20);
+
+    String file = aud_get_str ("convolver", "file");
+
+    if (file != current_file || get_block () != current_block ||
+     conv_channels != current_channels)
+    {
+        request_build (conv_channels, conv_rate);
+
+        /* wait for the latest request, and for room to swap it in */
+        pthread_mutex_lock (& mutex);
+        while (done_serial != job_serial || retired)
+            pthread_cond_wait (& done, & mutex);
+        pthread_mutex_unlock (& mutex);
+
+        collect_convolver (true);
+    }
+
+    if (convolver)
+        convolver->reset ();
+
+    /* finish () returns the last block and the rest of the pipeline, for any
+     * block size that may be applied later */
+    output.insert (0, conv_channels * (DSP_BLOCK_FRAMES + MAX_BLOCK));
+    output.remove (0, -1);
+}
+
+void ConvolverPlugin::process (float * * data, int * samples)
+{
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
+    if (settings_changed.exchange (false))
+        conv_gain = powf (10, aud_get_double ("convolver", "gain") / 20);
+
+    collect_convolver (false);
+
+    if (! convolver)
+        return;
+
+    convolver->process (* data, * samples / conv_channels);
+
+    if (conv_gain != 1)
+        dsp_scale (* data, * samples, conv_gain);
+}
+
+void ConvolverPlugin::flush ()
+{
+    if (convolver)
+        convolver->reset ();
+}
+
+void ConvolverPlugin::finish (float * * data, int * samples)
+{
+    EffectStatsScope scope (stats, * samples);
+
+    process (data, samples);
+
+    if (! convolver)
+        return;
+
+    output.remove (0, -1);
+    output.insert (* data, -1, * samples);
+
+    int at = output.len ();
+    convolver->drain (output);
+    convolver->reset ();
+
+    if (conv_gain != 1)
+        dsp_scale (& output[at], output.len () - at, conv_gain);
+
+    * data = output.begin ();
+    * samples = output.len ();
+}
+
+int ConvolverPlugin::adjust_delay (int delay)
+{
+    int added = aud::rescale<int64_t> (current_latency, conv_rate, 1000);
+
+    stats.set_delay (added);
+    return delay + added;
+}
@@ -0,0 +1,180 @@
+/*
+ * Convolver Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "impulse.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+#define FORMAT_PCM 1
+#define FORMAT_FLOAT 3
+#define FORMAT_EXTENSIBLE 0xfffe
+
+static uint32_t get_le16 (const unsigned char * p)
+    { return p[0] | (p[1] << 8); }
+static uint32_t get_le24 (const unsigned char * p)
+    { return p[0] | (p[1] << 8) | (p[2] << 16); }
+static uint32_t get_le32 (const unsigned char * p)
+    { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+
+static float get_sample (const unsigned char * p, int format, int bits)
+{
+    if (format == FORMAT_FLOAT)
+    {
+        union { uint32_t i; float f; } u32;
+        union { uint64_t i; double d; } u64;
+
+        if (bits == 32)
+        {
+            u32.i = get_le32 (p);
+            return u32.f;
+        }
+
+        u64.i = get_le32 (p) | ((uint64_t) get_le32 (p + 4) << 32);
+        return u64.d;
+    }
+
+    switch (bits)
+    {
+    case 8:
+        return (p[0] - 128) / 128.0f;
+    case 16:
+        return (int16_t) get_le16 (p) / 32768.0f;
+    case 24:
+        return (int32_t) (get_le24 (p) << 8) / 2147483648.0f;
+    default:
+        return (int32_t) get_le32 (p) / 2147483648.0f;
+    }
+}
+
+void Impulse::clear ()
+{
+    channels = frames = rate = 0;
+    data.clear ();
+}
+
+bool Impulse::load (const char * filename)
+{
+    clear ();
+
+    StringBuf uri = strstr (filename, "://") ? str_copy (filename) : filename_to_uri (filename);
+    VFSFile file (uri, "r");
+
+    if (! file)
+    {
+        AUDERR ("Cannot open %s: %s.\n", filename, file.error ());
+        return false;
+    }
+
+    unsigned char header[12];
+    if (file.fread (header, 1, 12) != 12 || memcmp (header, "RIFF", 4) ||
+     memcmp (header + 8, "WAVE", 4))
+    {
+        AUDERR ("%s is not a WAV file.\n", filename);
+        return false;
+    }
+
+    int format = 0, bits = 0;
+
+    while (1)
+    {
+        unsigned char chunk[8];
+        if (file.fread (chunk, 1, 8) != 8)
+        {
+            AUDERR ("No audio data in %s.\n", filename);
+            return false;
+        }
+
+        uint32_t size = get_le32 (chunk + 4);
+
+        if (! memcmp (chunk, "fmt ", 4) && size >= 16 && size <= 64)
+        {
+            unsigned char fmt[64];
+            if (file.fread (fmt, 1, size) != size)
+                break;
+
+            format = get_le16 (fmt);
+            channels = get_le16 (fmt + 2);
+            rate = get_le32 (fmt + 4);
+            bits = get_le16 (fmt + 14);
+
+            /* the actual format is in the first two bytes of the GUID */
+            if (format == FORMAT_EXTENSIBLE && size >= 26)
+                format = get_le16 (fmt + 24);
+
+            if (size & 1)
+                file.fseek (1, VFS_SEEK_CUR);
+        }
+        else if (! memcmp (chunk, "data", 4))
+        {
+            if (! ((format == FORMAT_PCM && (bits == 8 || bits == 16 ||
+             bits == 24 || bits == 32)) || (format == FORMAT_FLOAT &&
+             (bits == 32 || bits == 64))) || channels < 1 ||
+             channels > AUD_MAX_CHANNELS || rate < 1)
+            {
+                AUDERR ("Unsupported format in %s.\n", filename);
+                break;
+            }
+
+            int frame_size = channels * bits / 8;
+
+            /* some writers leave the size at zero or -1 when streaming */
+            int64_t max_size = (int64_t) MAX_IMPULSE_FRAMES * frame_size;
+            int64_t read_size = max_size;
+
+            if (size && size != 0xffffffff)
+                read_size = aud::min ((int64_t) size, max_size);
+
+            Index<unsigned char> raw;
+            raw.insert (0, read_size);
+            frames = file.fread (raw.begin (), frame_size, read_size / frame_size);
+
+            if (frames < 1)
+            {
+                AUDERR ("No audio data in %s.\n", filename);
+                break;
+            }
+
+            if ((int64_t) size > max_size && size != 0xffffffff)
+                AUDWARN ("Impulse response %s truncated to %d frames.\n",
+                 filename, frames);
+
+            data.insert (0, channels * frames);
+
+            for (int f = 0; f < frames; f ++)
+            {
+                for (int c = 0; c < channels; c ++)
+                    data[c * frames + f] = get_sample (& raw[f * frame_size + c * bits / 8],
+                     format, bits);
+            }
+
+            return true;
+        }
+        else if (file.fseek (size + (size & 1), VFS_SEEK_CUR) < 0)
+            break;
+    }
+
+    clear ();
+    return false;
+}
@@ -0,0 +1,43 @@
+/*
+ * Convolver Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef CONVOLVER_IMPULSE_H
+#define CONVOLVER_IMPULSE_H
+
+#include <libaudcore/index.h>
+
+/* longest impulse response accepted (about 10 seconds at 96 kHz) */
+#define MAX_IMPULSE_FRAMES (1 << 20)
+
+/* An impulse response read from a WAV file (8, 16, 24, or 32-bit integer or
+ * 32 or 64-bit floating point samples). */
+struct Impulse
+{
+    int channels = 0, frames = 0, rate = 0;
+    Index<float> data;  /* planar: one row of <frames> samples per channel */
+
+    /* <filename> may be a local path or a URI. */
+    bool load (const char * filename);
+    void clear ();
+
+    const float * channel (int c) const
+        { return & data[c * frames]; }
+};
+
+#endif /* CONVOLVER_IMPULSE_H */
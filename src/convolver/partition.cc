@@ -0,0 +1,212 @@
+/*
+ * Convolver Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "partition.h"
+
+#include <string.h>
+
+#include <utility>
+
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/dsp.h"
+
+bool Convolver::init (int channels, const ConvPath * paths, int n_paths, int block)
+{
+    destroy ();
+
+    int length = 0;
+    for (int i = 0; i < n_paths; i ++)
+        length = aud::max (length, paths[i].length);
+
+    if (! length)
+        return false;
+
+    m_channels = channels;
+    m_block = block;
+    m_tail_block = TAIL_FACTOR * block;
+
+    int head_length = aud::min (length, 2 * m_tail_block);
+    m_head.init (block, channels, paths, n_paths, 0, head_length);
+    m_blocks.init (channels, block, run_block, this);
+
+    m_have_tail = (length > head_length);
+
+    if (m_have_tail)
+    {
+        m_tail.init (m_tail_block, channels, paths, n_paths, head_length,
+         length - head_length);
+
+        m_tail_in.insert (0, channels * m_tail_block);
+        m_tail_out.insert (0, channels * m_tail_block);
+        m_job_in.insert (0, channels * m_tail_block);
+        m_job_out.insert (0, channels * m_tail_block);
+
+        m_job_pending = m_quit = false;
+
+        if (pthread_create (& m_thread, nullptr, tail_thread, this))
+        {
+            AUDERR ("Failed to start convolution thread.\n");
+            m_have_tail = false;
+            destroy ();
+            return false;
+        }
+    }
+
+    AUDDBG ("Convolver: %d taps, blocks of %d and %d, %s.\n", length, block,
+     m_have_tail ? m_tail_block : 0, dsp_get_isa ());
+
+    return true;
+}
+
+void Convolver::destroy ()
+{
+    if (m_have_tail)
+    {
+        pthread_mutex_lock (& m_mutex);
+        m_quit = true;
+        pthread_cond_signal (& m_wake);
+        pthread_mutex_unlock (& m_mutex);
+
+        pthread_join (m_thread, nullptr);
+        m_have_tail = false;
+    }
+
+    m_blocks.destroy ();
+    m_head.destroy ();
+    m_tail.destroy ();
+
+    m_tail_in.clear ();
+    m_tail_out.clear ();
+    m_job_in.clear ();
+    m_job_out.clear ();
+
+    m_channels = m_block = m_tail_block = 0;
+    m_tail_fill = 0;
+}
+
+void Convolver::reset ()
+{
+    if (m_have_tail)
+    {
+        pthread_mutex_lock (& m_mutex);
+
+        while (m_job_pending)
+            pthread_cond_wait (& m_done, & m_mutex);
+
+        pthread_mutex_unlock (& m_mutex);
+
+        m_tail.reset ();
+        memset (m_tail_out.begin (), 0, sizeof (float) * m_tail_out.len ());
+        memset (m_job_out.begin (), 0, sizeof (float) * m_job_out.len ());
+    }
+
+    m_head.reset ();
+    m_blocks.reset ();
+
+    m_tail_fill = 0;
+}
+
+void * Convolver::tail_thread (void * data)
+{
+    Convolver * me = (Convolver *) data;
+
+    /* the thread runs nothing but audio processing */
+    dsp_flush_denormals ();
+
+    pthread_mutex_lock (& me->m_mutex);
+
+    while (1)
+    {
+        while (! me->m_job_pending && ! me->m_quit)
+            pthread_cond_wait (& me->m_wake, & me->m_mutex);
+
+        if (me->m_quit)
+            break;
+
+        pthread_mutex_unlock (& me->m_mutex);
+
+        const float * in[AUD_MAX_CHANNELS];
+        float * out[AUD_MAX_CHANNELS];
+
+        for (int c = 0; c < me->m_channels; c ++)
+        {
+            in[c] = & me->m_job_in[c * me->m_tail_block];
+            out[c] = & me->m_job_out[c * me->m_tail_block];
+        }
+
+        me->m_tail.process (in, out);
+
+        pthread_mutex_lock (& me->m_mutex);
+        me->m_job_pending = false;
+        pthread_cond_signal (& me->m_done);
+    }
+
+    pthread_mutex_unlock (& me->m_mutex);
+    return nullptr;
+}
+
+/* Waits for the previous tail block, whose output is needed from now on, and
+ * hands over the one just completed. */
+void Convolver::swap_tail ()
+{
+    pthread_mutex_lock (& m_mutex);
+
+    while (m_job_pending)
+        pthread_cond_wait (& m_done, & m_mutex);
+
+    std::swap (m_tail_in, m_job_in);
+    std::swap (m_tail_out, m_job_out);
+
+    m_job_pending = true;
+    pthread_cond_signal (& m_wake);
+    pthread_mutex_unlock (& m_mutex);
+}
+
+void Convolver::run_block (const float * const * in, float * const * out,
+ void * data)
+{
+    Convolver * me = (Convolver *) data;
+
+    me->m_head.process (in, out);
+
+    if (! me->m_have_tail)
+        return;
+
+    /* The tail stage starts two tail blocks into the impulse response, and the
+     * output of each tail block is delayed by one tail block while it is being
+     * computed, so it lines up with the input from one tail block later. */
+    int block = me->m_block, tail_block = me->m_tail_block;
+
+    for (int c = 0; c < me->m_channels; c ++)
+    {
+        float * tail = & me->m_tail_in[c * tail_block + me->m_tail_fill];
+        memcpy (tail, in[c], sizeof (float) * block);
+
+        dsp_mix (out[c], & me->m_tail_out[c * tail_block + me->m_tail_fill], block);
+    }
+
+    me->m_tail_fill += block;
+
+    if (me->m_tail_fill == tail_block)
+    {
+        me->swap_tail ();
+        me->m_tail_fill = 0;
+    }
+}
@@ -0,0 +1,86 @@
+/*
+ * Convolver Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef CONVOLVER_PARTITION_H
+#define CONVOLVER_PARTITION_H
+
+#include <pthread.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/index.h>
+
+#include "../libdsp/convolve.h"
+
+/* Convolution with a long impulse response at low latency, in two stages.
+ * The first part of the response (two tail blocks) is handled in short blocks
+ * by the audio thread; the rest is handled in blocks TAIL_FACTOR times as
+ * long by a background thread.  A tail block is handed to the thread as soon
+ * as its input is complete, and its output is needed only one tail block
+ * later, so the thread has a whole tail block's worth of audio to finish it.
+ * Latency is one short block. */
+#define TAIL_FACTOR 16
+
+class Convolver
+{
+public:
+    /* <paths> must use channels 0 through <channels> - 1. */
+    bool init (int channels, const ConvPath * paths, int n_paths, int block);
+    void destroy ();
+    void reset ();
+
+    bool ready () const
+        { return m_channels > 0; }
+
+    /* Filters <frames> interleaved frames in place.  The output is delayed by
+     * latency () frames. */
+    void process (float * data, int frames)
+        { m_blocks.process (data, frames); }
+
+    /* Appends the audio remaining in the pipeline to <out>. */
+    void drain (Index<float> & out)
+        { m_blocks.drain (out, m_block); }
+
+    int latency () const
+        { return m_block; }
+
+private:
+    static void * tail_thread (void * data);
+    static void run_block (const float * const * in, float * const * out,
+     void * data);
+    void swap_tail ();
+
+    int m_channels = 0, m_block = 0, m_tail_block = 0;
+    int m_tail_fill = 0;
+
+    BlockAdapter m_blocks;
+    ConvStage m_head, m_tail;
+    bool m_have_tail = false;
+
+    Index<float> m_tail_in, m_tail_out;  /* channel, one tail block */
+
+    /* used by the background thread */
+    Index<float> m_job_in, m_job_out;
+    pthread_t m_thread;
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_wake = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t m_done = PTHREAD_COND_INITIALIZER;
+    bool m_job_pending = false, m_quit = false;
+};
+
+#endif /* CONVOLVER_PARTITION_H */
@@ -17,17 +17,19 @@
  * the use of this software.
  */
 
-#include <stdlib.h>
+#include <math.h>
 #include <string.h>
 
-#include <glib.h>
-
 #include <libaudcore/i18n.h>
-#include <libaudcore/interface.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
+#include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+#include "../libdsp/dsp.h"
+#include "../libdsp/layout.h"
+#include "../libdsp/stats.h"
+
 enum
 {
     STATE_OFF,
@@ -37,19 +39,40 @@ enum
     STATE_STOPPING,
 };
 
+enum
+{
+    SHAPE_EQUAL_POWER,
+    SHAPE_LINEAR,
+    SHAPE_S_CURVE
+};
+
+/* The fade curves are tabulated at this many points and interpolated
+ * linearly in between. */
+#define FADE_STEPS 256
+
 static const char * const crossfade_defaults[] = {
  "length", "3",
+ "shape", "0",  /* SHAPE_EQUAL_POWER */
  nullptr};
 
 static const char crossfade_about[] =
  N_("Crossfade Plugin for Audacious\n"
     "Copyright 2010-2012 John Lindgren");
 
+static const ComboItem shape_list[] = {
+    ComboItem (N_("Equal power"), SHAPE_EQUAL_POWER),
+    ComboItem (N_("Linear"), SHAPE_LINEAR),
+    ComboItem (N_("S-curve"), SHAPE_S_CURVE)
+};
+
 static const PreferencesWidget crossfade_widgets[] = {
     WidgetLabel (N_("<b>Crossfade</b>")),
     WidgetSpin (N_("Overlap:"),
         WidgetInt ("crossfade", "length"),
-        {1, 10, 1, N_("seconds")})
+        {1, 10, 1, N_("seconds")}),
+    WidgetCombo (N_("Fade shape:"),
+        WidgetInt ("crossfade", "shape"),
+        {{shape_list}})
 };
 
 static const PluginPreferences crossfade_prefs = {{crossfade_widgets}};
@@ -81,86 +104,244 @@ EXPORT Crossfade aud_plugin_instance;
 
 static char state = STATE_OFF;
 static int current_channels = 0, current_rate = 0;
-static float * buffer = nullptr;
-static int buffer_size = 0, buffer_filled = 0;
+static int overlap = 0;  /* overlap length (samples), fixed for each song */
+static RingBuf<float> buffer;
+static int returned = 0;  /* samples at the head of the buffer which were
+                           * returned by the last call and are discarded by the
+                           * next one */
 static int prebuffer_filled = 0;
-static float * output = nullptr;
-static int output_size = 0;
+static Index<float> output;
+static int output_size = 0;  /* largest copy since the output was freed */
+
+static EffectStats stats (N_("Crossfade"));
+
+/* fade-in gain; the fade-out gain is read backwards */
+static float fade_table[FADE_STEPS + 1];
 
 static void reset ()
 {
     state = STATE_OFF;
     current_channels = 0;
     current_rate = 0;
-    g_free (buffer);
-    buffer = nullptr;
-    buffer_size = 0;
-    buffer_filled = 0;
+    buffer.destroy ();
+    returned = 0;
     prebuffer_filled = 0;
-    g_free (output);
-    output = nullptr;
+    output.clear ();
     output_size = 0;
 }
 
+static void make_fade_table (int shape)
+{
+    for (int i = 0; i <= FADE_STEPS; i ++)
+    {
+        double x = (double) i / FADE_STEPS;
+
+        switch (shape)
+        {
+        case SHAPE_LINEAR:
+            fade_table[i] = x;
+            break;
+        case SHAPE_S_CURVE:
+            fade_table[i] = 0.5 - 0.5 * cos (M_PI * x);
+            break;
+        default: /* the two gains have a constant sum of squares */
+            fade_table[i] = sin (M_PI / 2 * x);
+            break;
+        }
+    }
+}
+
+static float fade_gain (int64_t pos, int total, bool fade_in)
+{
+    double x = (double) pos * FADE_STEPS / total;
+    if (! fade_in)
+        x = FADE_STEPS - x;
+
+    int i = aud::clamp ((int) x, 0, FADE_STEPS - 1);
+    return fade_table[i] + (fade_table[i + 1] - fade_table[i]) * (float) (x - i);
+}
+
+/* Applies samples <pos> through <pos> + <length> of a fade lasting <total>
+ * samples, as a series of linear ramps between the points of the table. */
+static void apply_fade (float * data, int pos, int length, int total, bool fade_in)
+{
+    while (length > 0)
+    {
+        int step = (int64_t) pos * FADE_STEPS / total;
+        int next = ((int64_t) (step + 1) * total + FADE_STEPS - 1) / FADE_STEPS;
+        int copy = aud::min (length, next - pos);
+
+        dsp_ramp (data, copy, fade_gain (pos, total, fade_in),
+         fade_gain (pos + copy, total, fade_in));
+
+        data += copy;
+        pos += copy;
+        length -= copy;
+    }
+}
+
+/* Calls func (data, offset, length) for each contiguous part of buffer[pos]
+ * through buffer[pos + length - 1].  The buffer wraps around at most once, so
+ * there are at most two parts. */
+template<class Func>
+static void for_each_part (int pos, int length, Func func)
+{
+    int linear = buffer.linear ();
+    int done = 0;
+
+    if (pos < linear)
+    {
+        done = aud::min (length, linear - pos);
+        func (& buffer[pos], 0, done);
+    }
+
+    if (done < length)
+        func (& buffer[pos + done], done, length - done);
+}
+
+static void enlarge_buffer (int length)
+{
+    if (length > buffer.size ())
+    {
+        buffer.alloc (aud::max (length, 2 * buffer.size ()));
+        stats.count_alloc ();
+    }
+}
+
+static void discard_returned ()
+{
+    buffer.discard (returned);
+    prebuffer_filled = aud::max (prebuffer_filled - returned, 0);
+    returned = 0;
+}
+
 bool Crossfade::init ()
 {
     aud_config_set_defaults ("crossfade", crossfade_defaults);
+    stats.attach ();
     return true;
 }
 
 void Crossfade::cleanup ()
 {
+    stats.detach ();
     reset ();
 }
 
-void Crossfade::start (int * channels, int * rate)
+/* Converts the end of the previous song, which is still in the buffer, to the
+ * format of the next one.  This is only a few seconds of audio that is fading
+ * out anyway, so cubic interpolation is good enough for the rate. */
+static void convert_buffer (int channels, int rate)
 {
-    if (state != STATE_BETWEEN)
-        reset ();
-    else if (* channels != current_channels)
+    int frames = buffer.len () / current_channels;
+
+    /* only once per song, but in the audio thread nonetheless */
+    stats.count_alloc ();
+
+    Index<float> in, out;
+    in.insert (0, buffer.len ());
+    for_each_part (0, buffer.len (), [&] (float * data, int offset, int length)
+        { memcpy (& in[offset], data, sizeof (float) * length); });
+
+    buffer.discard ();
+
+    if (channels != current_channels)
     {
-        aud_ui_show_error (_("Crossfading failed because the songs had "
-         "a different number of channels.  You can use the Channel Mixer to "
-         "convert the songs to the same number of channels."));
-        reset ();
+        /* downmix or upmix by the speaker layouts (BS.775); beyond 7.1,
+         * mono goes to every channel and every channel goes to mono, and
+         * other channels go to the channel of the same number, wrapping
+         * around */
+        float matrix[AUD_MAX_CHANNELS * AUD_MAX_CHANNELS] = {};
+
+        if (! dsp_layout_matrix (matrix, current_channels, channels))
+        {
+            for (int i = 0; i < current_channels; i ++)
+            {
+                for (int c = 0; c < channels; c ++)
+                {
+                    if (current_channels == 1)
+                        matrix[c] = 1;
+                    else if (channels == 1)
+                        matrix[i] = 1.0f / current_channels;
+                    else if (c == i % channels)
+                        matrix[c * current_channels + i] = (i < channels) ? 1 : M_SQRT1_2;
+                }
+            }
+        }
+
+        out.insert (0, channels * frames);
+        dsp_matrix_mix (in.begin (), current_channels, out.begin (), channels, matrix, frames);
+        in = std::move (out);
     }
-    else if (* rate != current_rate)
+
+    if (rate != current_rate && frames > 0)
     {
-        aud_ui_show_error (_("Crossfading failed because the songs had "
-         "different sample rates.  You can use the Sample Rate Converter to "
-         "convert the songs to the same sample rate."));
+        int new_frames = (int64_t) frames * rate / current_rate;
+        double step = (double) current_rate / rate;
+
+        out.insert (0, channels * new_frames);
+
+        for (int f = 0; f < new_frames; f ++)
+        {
+            double x = f * step;
+            int i = (int) x;
+            float t = x - i;
+
+            int i0 = aud::max (i - 1, 0), i2 = aud::min (i + 1, frames - 1);
+            int i3 = aud::min (i + 2, frames - 1);
+
+            for (int c = 0; c < channels; c ++)
+            {
+                /* Catmull-Rom spline */
+                float p0 = in[i0 * channels + c], p1 = in[i * channels + c];
+                float p2 = in[i2 * channels + c], p3 = in[i3 * channels + c];
+
+                out[f * channels + c] = p1 + 0.5f * t * (p2 - p0 + t * (2 * p0 -
+                 5 * p1 + 4 * p2 - p3 + t * (3 * (p1 - p2) + p3 - p0)));
+            }
+        }
+
+        in = std::move (out);
+    }
+
+    enlarge_buffer (in.len ());
+    buffer.copy_in (in.begin (), in.len ());
+}
+
+void Crossfade::start (int * channels, int * rate)
+{
+    if (state != STATE_BETWEEN)
         reset ();
+    else
+    {
+        discard_returned ();
+
+        if (* channels != current_channels || * rate != current_rate)
+        {
+            AUDINFO ("Converting %d channels, %d Hz to %d channels, %d Hz for "
+             "crossfading.\n", current_channels, current_rate, * channels, * rate);
+            convert_buffer (* channels, * rate);
+        }
     }
 
     state = STATE_PREBUFFER;
     current_channels = * channels;
     current_rate = * rate;
     prebuffer_filled = 0;
-}
 
-static void do_ramp (float * data, int length, float a, float b)
-{
-    int count;
+    overlap = current_channels * current_rate * aud_get_int ("crossfade", "length");
+    make_fade_table (aud_get_int ("crossfade", "shape"));
 
-    for (count = 0; count < length; count ++)
-    {
-        * data = (* data) * (a * (length - count) + b * count) / length;
-        data ++;
-    }
-}
+    /* the buffer holds the overlap and the block being added, all of which may
+     * be copied out at the end */
+    int size = overlap + current_channels * DSP_BLOCK_FRAMES;
+    enlarge_buffer (size);
 
-static void mix (float * data, float * add, int length)
-{
-    while (length --)
-        (* data ++) += (* add ++);
-}
-
-static void enlarge_buffer (int length)
-{
-    if (length > buffer_size)
+    if (output_size < size)
     {
-        buffer = g_renew (float, buffer, length);
-        buffer_size = length;
+        output.insert (0, size);
+        output.remove (0, -1);
+        output_size = size;
     }
 }
 
@@ -168,24 +349,23 @@ static void add_data (float * data, int length)
 {
     if (state == STATE_PREBUFFER)
     {
-        int full = current_channels * current_rate * aud_get_int ("crossfade", "length");
+        int full = overlap;
 
         if (prebuffer_filled < full)
         {
             int copy = aud::min (length, full - prebuffer_filled);
-            float a = (float) prebuffer_filled / full;
-            float b = (float) (prebuffer_filled + copy) / full;
 
-            if (prebuffer_filled + copy > buffer_filled)
-            {
-                enlarge_buffer (prebuffer_filled + copy);
-                memset (buffer + buffer_filled, 0, sizeof (float) *
-                 (prebuffer_filled + copy - buffer_filled));
-                buffer_filled = prebuffer_filled + copy;
-            }
+            apply_fade (data, prebuffer_filled, copy, full, true);
+
+            /* mix with the end of the previous song, if there is any left */
+            int mix = aud::clamp (buffer.len () - prebuffer_filled, 0, copy);
+
+            for_each_part (prebuffer_filled, mix, [&] (float * part, int offset, int len)
+                { dsp_mix (part, data + offset, len); });
+
+            enlarge_buffer (buffer.len () + copy - mix);
+            buffer.copy_in (data + mix, copy - mix);
 
-            do_ramp (data, copy, a, b);
-            mix (buffer + prebuffer_filled, data, copy);
             prebuffer_filled += copy;
             data += copy;
             length -= copy;
@@ -194,17 +374,19 @@ static void add_data (float * data, int length)
         if (prebuffer_filled < full)
             return;
 
-        if (prebuffer_filled < buffer_filled)
+        if (prebuffer_filled < buffer.len ())
         {
-            int copy = aud::min (length, buffer_filled - prebuffer_filled);
+            int copy = aud::min (length, buffer.len () - prebuffer_filled);
+
+            for_each_part (prebuffer_filled, copy, [&] (float * part, int offset, int len)
+                { dsp_mix (part, data + offset, len); });
 
-            mix (buffer + prebuffer_filled, data, copy);
             prebuffer_filled += copy;
             data += copy;
             length -= copy;
         }
 
-        if (prebuffer_filled < buffer_filled)
+        if (prebuffer_filled < buffer.len ())
             return;
 
         state = STATE_RUNNING;
@@ -213,43 +395,56 @@ static void add_data (float * data, int length)
     if (state != STATE_RUNNING)
         return;
 
-    enlarge_buffer (buffer_filled + length);
-    memcpy (buffer + buffer_filled, data, sizeof (float) * length);
-    buffer_filled += length;
+    enlarge_buffer (buffer.len () + length);
+    buffer.copy_in (data, length);
 }
 
-static void enlarge_output (int length)
+/* Returns a pointer into the buffer itself, which stays valid until the next
+ * call.  If the data wraps around the end of the buffer, only the first part
+ * is returned this time. */
+static void return_data (float * * data, int * length)
 {
-    if (length > output_size)
+    int copy = buffer.len () - overlap;
+
+    if (state != STATE_RUNNING || copy <= 0)
     {
-        output = g_renew (float, output, length);
-        output_size = length;
+        * data = nullptr;
+        * length = 0;
+        return;
     }
+
+    returned = aud::min (copy, buffer.linear ());
+    * data = & buffer[0];
+    * length = returned;
 }
 
-static void return_data (float * * data, int * length)
+/* Returns a copy of the data instead, in case it wraps around. */
+static void return_copy (float * * data, int * length, int copy)
 {
-    int full = current_channels * current_rate * aud_get_int ("crossfade", "length");
-    int copy = buffer_filled - full;
+    output.remove (0, -1);
+    output.insert (0, copy);
 
-    /* only return if we have at least 1/2 second -- this reduces memmove's */
-    if (state != STATE_RUNNING || copy < current_channels * (current_rate / 2))
+    if (copy > output_size)
     {
-        * data = nullptr;
-        * length = 0;
-        return;
+        output_size = copy;
+        stats.count_alloc ();
     }
 
-    enlarge_output (copy);
-    memcpy (output, buffer, sizeof (float) * copy);
-    buffer_filled -= copy;
-    memmove (buffer, buffer + copy, sizeof (float) * buffer_filled);
-    * data = output;
+    for_each_part (0, copy, [] (float * part, int offset, int len)
+        { memcpy (& output[offset], part, sizeof (float) * len); });
+
+    buffer.discard (copy);
+
+    * data = output.begin ();
     * length = copy;
 }
 
 void Crossfade::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
+    discard_returned ();
     add_data (* data, * samples);
     return_data (data, samples);
 }
@@ -259,34 +454,47 @@ void Crossfade::flush ()
     if (state == STATE_PREBUFFER || state == STATE_RUNNING)
     {
         state = STATE_RUNNING;
-        buffer_filled = 0;
+        buffer.discard ();
+        returned = 0;
     }
 }
 
 void Crossfade::finish (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
+    discard_returned ();
+
     if (state == STATE_BETWEEN) /* second call, end of last song */
     {
-        enlarge_output (buffer_filled);
-        memcpy (output, buffer, sizeof (float) * buffer_filled);
-        * data = output;
-        * samples = buffer_filled;
-        buffer_filled = 0;
+        return_copy (data, samples, buffer.len ());
         state = STATE_OFF;
         return;
     }
 
     add_data (* data, * samples);
-    return_data (data, samples);
+
+    /* return everything but the overlap, which is faded out */
+    int copy = (state == STATE_RUNNING) ? aud::max (buffer.len () - overlap, 0) : 0;
+    return_copy (data, samples, copy);
 
     if (state == STATE_PREBUFFER || state == STATE_RUNNING)
     {
-        do_ramp (buffer, buffer_filled, 1.0, 0.0);
+        int length = buffer.len ();
+
+        for_each_part (0, length, [&] (float * part, int offset, int len)
+            { apply_fade (part, offset, len, length, false); });
+
         state = STATE_BETWEEN;
     }
 }
 
 int Crossfade::adjust_delay (int delay)
 {
-    return delay + aud::rescale<int64_t> (buffer_filled / current_channels, current_rate, 1000);
+    int buffered = (buffer.len () - returned) / current_channels;
+    int added = aud::rescale<int64_t> (buffered, current_rate, 1000);
+
+    stats.set_delay (added);
+    return delay + added;
 }
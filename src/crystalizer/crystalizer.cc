@@ -26,6 +26,9 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+
 static const char * const cryst_defaults[] = {
  "intensity", "1",
  nullptr};
@@ -64,14 +67,19 @@ EXPORT Crystalizer aud_plugin_instance;
 static int cryst_channels;
 static float * cryst_prev;
 
+static EffectStats stats (N_("Crystalizer"));
+
 bool Crystalizer::init ()
 {
     aud_config_set_defaults ("crystalizer", cryst_defaults);
+    stats.attach ();
     return true;
 }
 
 void Crystalizer::cleanup ()
 {
+    stats.detach ();
+
     free (cryst_prev);
     cryst_prev = nullptr;
 }
@@ -80,26 +88,17 @@ void Crystalizer::start (int * channels, int * rate)
 {
     cryst_channels = * channels;
     cryst_prev = (float *) realloc (cryst_prev, sizeof (float) * cryst_channels);
+    stats.count_alloc ();
     memset (cryst_prev, 0, sizeof (float) * cryst_channels);
 }
 
 void Crystalizer::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
     float value = aud_get_double ("crystalizer", "intensity");
-    float * f = * data;
-    float * end = f + (* samples);
-    int channel;
-
-    while (f < end)
-    {
-        for (channel = 0; channel < cryst_channels; channel ++)
-        {
-            float current = * f;
-
-            * f ++ = current + (current - cryst_prev[channel]) * value;
-            cryst_prev[channel] = current;
-        }
-    }
+    dsp_difference (* data, * samples, cryst_channels, cryst_prev, value);
 }
 
 void Crystalizer::flush ()
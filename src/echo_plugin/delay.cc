@@ -0,0 +1,67 @@
+/*
+ * Echo Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "delay.h"
+
+#include <string.h>
+
+#include <libaudcore/templates.h>
+
+void DelayLine::init (int size)
+{
+    m_buf.clear ();
+    m_buf.insert (0, size);
+    m_pos = 0;
+}
+
+void DelayLine::destroy ()
+{
+    m_buf.clear ();
+    m_pos = 0;
+}
+
+void DelayLine::clear ()
+{
+    memset (m_buf.begin (), 0, sizeof (float) * m_buf.len ());
+    m_pos = 0;
+}
+
+void DelayLine::read (int delay, float * out, int len) const
+{
+    int size = m_buf.len ();
+    int pos = m_pos - delay;
+    if (pos < 0)
+        pos += size;
+
+    int part = aud::min (len, size - pos);
+    memcpy (out, & m_buf[pos], sizeof (float) * part);
+    memcpy (out + part, & m_buf[0], sizeof (float) * (len - part));
+}
+
+void DelayLine::write (const float * in, int len)
+{
+    int size = m_buf.len ();
+    int part = aud::min (len, size - m_pos);
+    memcpy (& m_buf[m_pos], in, sizeof (float) * part);
+    memcpy (& m_buf[0], in + part, sizeof (float) * (len - part));
+
+    m_pos += len;
+    if (m_pos >= size)
+        m_pos -= size;
+}
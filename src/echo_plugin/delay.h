@@ -0,0 +1,50 @@
+/*
+ * Echo Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef ECHO_DELAY_H
+#define ECHO_DELAY_H
+
+#include <libaudcore/index.h>
+
+/* A circular buffer which is written and read in blocks.  A block can be read
+ * from any point in the past, as long as it ends before the write position;
+ * that is, the delay must be at least the length of the block. */
+
+class DelayLine
+{
+public:
+    /* Allocates room for <size> samples of history, all zero at first. */
+    void init (int size);
+    void destroy ();
+    void clear ();
+
+    /* Copies <len> samples to <out>, starting <delay> samples before the write
+     * position.  <len> must not be more than <delay>, and <delay> must not be
+     * more than the size of the buffer. */
+    void read (int delay, float * out, int len) const;
+
+    /* Appends <len> samples, overwriting the oldest ones. */
+    void write (const float * in, int len);
+
+private:
+    Index<float> m_buf;
+    int m_pos = 0;
+};
+
+#endif /* ECHO_DELAY_H */
@@ -1,19 +1,33 @@
-#include <stdlib.h>
 #include <string.h>
 
-#include <glib.h>
+#include <atomic>
 
 #include <libaudcore/i18n.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
+#include <libaudcore/templates.h>
+
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+#include "delay.h"
+#include "reverb.h"
 
 #define MAX_DELAY 1000
-#define MAX_SRATE 50000
-#define BYTES_PS sizeof(float)
-#define BUFFER_SAMPLES (MAX_SRATE * MAX_DELAY / 1000)
-#define BUFFER_SHORTS (BUFFER_SAMPLES * AUD_MAX_CHANNELS)
-#define BUFFER_BYTES (BUFFER_SHORTS * BYTES_PS)
+#define MAX_TAPS 8
+
+/* most frames processed at once */
+#define BLOCK_FRAMES 512
+
+/* Once the echo has decayed to this level (about -300 dB), it is set to zero,
+ * before it reaches the denormal range. */
+#define SILENCE 1e-15f
+
+enum
+{
+    MODE_ECHO,
+    MODE_REVERB
+};
 
 static const char echo_about[] =
  N_("Echo Plugin\n"
@@ -21,21 +35,57 @@ static const char echo_about[] =
     "Surround echo by Carl van Schaik, 1999");
 
 static const char * const echo_defaults[] = {
+ "mode", "0",  /* MODE_ECHO */
  "delay", "500",
  "feedback", "50",
  "volume", "50",
+ "taps", "1",
+ "room_size", "100",
+ "decay", "2",
+ "damping", "50",
+ "reverb_level", "30",
  nullptr};
 
+/* set from the main thread, checked by the audio thread */
+static std::atomic<bool> settings_changed;
+
+static void settings_cb ()
+    { settings_changed = true; }
+
+static const ComboItem mode_list[] = {
+    ComboItem (N_("Echo"), MODE_ECHO),
+    ComboItem (N_("Reverb"), MODE_REVERB)
+};
+
 static const PreferencesWidget echo_widgets[] = {
+    WidgetCombo (N_("Mode:"),
+        WidgetInt ("echo_plugin", "mode", settings_cb),
+        {{mode_list}}),
     WidgetLabel (N_("<b>Echo</b>")),
     WidgetSpin (N_("Delay:"),
-        WidgetInt ("echo_plugin", "delay"),
+        WidgetInt ("echo_plugin", "delay", settings_cb),
         {0, MAX_DELAY, 10, N_("ms")}),
     WidgetSpin (N_("Feedback:"),
-        WidgetInt ("echo_plugin", "feedback"),
+        WidgetInt ("echo_plugin", "feedback", settings_cb),
         {0, 100, 1, "%"}),
     WidgetSpin (N_("Volume:"),
-        WidgetInt ("echo_plugin", "volume"),
+        WidgetInt ("echo_plugin", "volume", settings_cb),
+        {0, 100, 1, "%"}),
+    WidgetSpin (N_("Taps:"),
+        WidgetInt ("echo_plugin", "taps", settings_cb),
+        {1, MAX_TAPS, 1}),
+    WidgetLabel (N_("<b>Reverb</b>")),
+    WidgetSpin (N_("Room size:"),
+        WidgetInt ("echo_plugin", "room_size", settings_cb),
+        {REVERB_MIN_SIZE, REVERB_MAX_SIZE, 5, "%"}),
+    WidgetSpin (N_("Decay time:"),
+        WidgetFloat ("echo_plugin", "decay", settings_cb),
+        {0.1, 20, 0.1, N_("seconds")}),
+    WidgetSpin (N_("Damping:"),
+        WidgetInt ("echo_plugin", "damping", settings_cb),
+        {0, 100, 1, "%"}),
+    WidgetSpin (N_("Volume:"),
+        WidgetInt ("echo_plugin", "reverb_level", settings_cb),
         {0, 100, 1, "%"})
 };
 
@@ -58,75 +108,166 @@ public:
 
     void start (int * channels, int * rate);
     void process (float * * data, int * samples);
+    void flush ();
 };
 
 EXPORT EchoPlugin aud_plugin_instance;
 
-static float *buffer = nullptr;
-static int w_ofs;
+static int echo_channels = 0;
+static int echo_rate = 0;
+static int echo_mode = MODE_ECHO;
+
+/* The echo is read from several taps, evenly spaced up to the delay time and
+ * growing quieter towards the last one, which also feeds back into the line.
+ * Delays are in samples, always a whole number of frames. */
+static DelayLine echo_line;
+static Index<float> echo_wet, echo_feed;
+static int tap_delays[MAX_TAPS];
+static float tap_gains[MAX_TAPS];
+static int n_taps;
+static float feedback;
+
+static Reverb reverb;
+
+static EffectStats stats (N_("Echo"));
 
 bool EchoPlugin::init ()
 {
     aud_config_set_defaults ("echo_plugin", echo_defaults);
+    stats.attach ();
     return true;
 }
 
-void EchoPlugin::cleanup ()
+static void destroy_all ()
 {
-    g_free(buffer);
-    buffer = nullptr;
+    echo_line.destroy ();
+    echo_wet.clear ();
+    echo_feed.clear ();
+    reverb.destroy ();
 }
 
-static int echo_channels = 0;
-static int echo_rate = 0;
+void EchoPlugin::cleanup ()
+{
+    stats.detach ();
+    destroy_all ();
+    echo_channels = echo_rate = 0;
+}
 
-void EchoPlugin::start (int * channels, int * rate)
+static void load_echo ()
 {
-    static int old_srate, old_nch;
+    if (! echo_wet.len ())
+    {
+        echo_line.init (echo_rate * MAX_DELAY / 1000 * echo_channels);
+        echo_wet.insert (0, BLOCK_FRAMES * echo_channels);
+        echo_feed.insert (0, BLOCK_FRAMES * echo_channels);
+        stats.count_alloc (true);
+    }
+
+    int delay_ms = aud::clamp (aud_get_int ("echo_plugin", "delay"), 0, MAX_DELAY);
+    int delay = echo_rate * delay_ms / 1000;
+    float volume = aud_get_int ("echo_plugin", "volume") / 100.0f;
 
-    if (buffer == nullptr)
-        buffer = (float *) g_malloc (BUFFER_BYTES);
+    n_taps = aud::clamp (aud_get_int ("echo_plugin", "taps"), 1, MAX_TAPS);
+    feedback = aud_get_int ("echo_plugin", "feedback") / 100.0f;
 
-    echo_channels = *channels;
-    echo_rate = *rate;
+    for (int t = 0; t < n_taps; t ++)
+    {
+        tap_delays[t] = aud::max (delay * (t + 1) / n_taps, 1) * echo_channels;
+        tap_gains[t] = volume * (n_taps - t) / n_taps;
+    }
+}
 
-    if (echo_channels != old_nch || echo_rate != old_srate)
+static void load_reverb ()
+{
+    if (! reverb.ready ())
     {
-        memset(buffer, 0, BUFFER_BYTES);
-        w_ofs = 0;
-        old_nch = echo_channels;
-        old_srate = echo_rate;
+        reverb.init (echo_channels, echo_rate);
+        stats.count_alloc (true);
     }
+
+    reverb.set_params (aud_get_int ("echo_plugin", "room_size"),
+     aud_get_double ("echo_plugin", "decay"),
+     aud_get_int ("echo_plugin", "damping") / 100.0f,
+     aud_get_int ("echo_plugin", "reverb_level") / 100.0f);
+}
+
+static void load_settings ()
+{
+    echo_mode = aud_get_int ("echo_plugin", "mode");
+
+    if (echo_mode == MODE_REVERB)
+        load_reverb ();
+    else
+        load_echo ();
 }
 
-void EchoPlugin::process (float * * d, int * samples)
+void EchoPlugin::start (int * channels, int * rate)
 {
-    int delay = aud_get_int ("echo_plugin", "delay");
-    int feedback = aud_get_int ("echo_plugin", "feedback");
-    int volume = aud_get_int ("echo_plugin", "volume");
+    /* the echo carries over into the next song unless the format changes */
+    if (* channels != echo_channels || * rate != echo_rate)
+    {
+        destroy_all ();
+        echo_channels = * channels;
+        echo_rate = * rate;
+    }
 
-    float in, out, buf;
-    int r_ofs;
-    float *data = *d;
-    float *end = *d + *samples;
+    settings_changed = false;
+    load_settings ();
+}
 
-    r_ofs = w_ofs - (echo_rate * delay / 1000) * echo_channels;
-    if (r_ofs < 0)
-        r_ofs += BUFFER_SHORTS;
+static void process_echo (float * data, int samples)
+{
+    int max_block = aud::min (tap_delays[0], BLOCK_FRAMES * echo_channels);
+    float * wet = echo_wet.begin ();
+    float * feed = echo_feed.begin ();
 
-    for (; data < end; data++)
+    while (samples > 0)
     {
-        in = *data;
-
-        buf = buffer[r_ofs];
-        out = in + buf * volume / 100;
-        buf = in + buf * feedback / 100;
-        buffer[w_ofs] = buf;
-        *data = out;
-
-        if (++r_ofs >= BUFFER_SHORTS)
-            r_ofs -= BUFFER_SHORTS;
-        if (++w_ofs >= BUFFER_SHORTS)
-            w_ofs -= BUFFER_SHORTS;
+        int block = aud::min (samples, max_block);
+
+        echo_line.read (tap_delays[0], wet, block);
+        dsp_scale (wet, block, tap_gains[0]);
+
+        for (int t = 1; t < n_taps; t ++)
+        {
+            echo_line.read (tap_delays[t], feed, block);
+            dsp_scale (feed, block, tap_gains[t]);
+            dsp_mix (wet, feed, block);
+        }
+
+        echo_line.read (tap_delays[n_taps - 1], feed, block);
+        dsp_scale (feed, block, feedback);
+
+        if (dsp_abs_sum (feed, block) < SILENCE * block)
+            memset (feed, 0, sizeof (float) * block);
+
+        dsp_mix (feed, data, block);
+        echo_line.write (feed, block);
+        dsp_mix (data, wet, block);
+
+        data += block;
+        samples -= block;
     }
 }
+
+void EchoPlugin::process (float * * data, int * samples)
+{
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
+    if (settings_changed.exchange (false))
+        load_settings ();
+
+    if (echo_mode == MODE_REVERB)
+        reverb.process (* data, * samples / echo_channels);
+    else
+        process_echo (* data, * samples);
+}
+
+void EchoPlugin::flush ()
+{
+    if (echo_wet.len ())
+        echo_line.clear ();
+    if (reverb.ready ())
+        reverb.reset ();
+}
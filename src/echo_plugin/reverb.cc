@@ -0,0 +1,214 @@
+/*
+ * Echo Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "reverb.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/runtime.h>
+#include <libaudcore/templates.h>
+
+#include "../libdsp/dsp.h"
+
+/* lengths of the shortest and longest lines at 100% room size (ms) */
+#define MIN_LENGTH 25.0
+#define MAX_LENGTH 85.0
+
+/* most frames processed at once */
+#define MAX_BLOCK 256
+
+/* A tiny constant (about -360 dB) is added to the feedback.  Otherwise, the
+ * low-pass filters would decay into the denormal range between sparse echoes
+ * and at the end of every song, and arithmetic there is many times slower. */
+#define DENORMAL_BIAS 1e-18f
+
+static bool is_prime (int n)
+{
+    for (int d = 2; d * d <= n; d ++)
+    {
+        if (n % d == 0)
+            return false;
+    }
+
+    return n >= 2;
+}
+
+/* sign of element (row, col) of a Sylvester-Hadamard matrix */
+static float hadamard_sign (int row, int col)
+{
+    int bits = 0;
+    for (int x = row & col; x; x >>= 1)
+        bits ^= (x & 1);
+
+    return bits ? -1 : 1;
+}
+
+/* Line lengths are spaced geometrically and rounded up to distinct primes, so
+ * that their echoes rarely coincide. */
+static void get_lengths (int size, int rate, int * lengths)
+{
+    int prev = 0;
+
+    for (int i = 0; i < REVERB_LINES; i ++)
+    {
+        double ms = MIN_LENGTH * pow (MAX_LENGTH / MIN_LENGTH, (double) i / (REVERB_LINES - 1));
+        int len = aud::max ((int) (ms * size * rate / 100000), prev + 1);
+
+        while (! is_prime (len))
+            len ++;
+
+        lengths[i] = prev = len;
+    }
+}
+
+void Reverb::init (int channels, int rate)
+{
+    destroy ();
+
+    int lengths[REVERB_LINES];
+
+    get_lengths (REVERB_MAX_SIZE, rate, lengths);
+    for (int i = 0; i < REVERB_LINES; i ++)
+        m_lines[i].init (lengths[i]);
+
+    get_lengths (REVERB_MIN_SIZE, rate, lengths);
+    m_block = aud::min (lengths[0], MAX_BLOCK);
+
+    m_gains.insert (0, m_block * REVERB_LINES);
+    m_bias.insert (0, m_block * REVERB_LINES);
+    m_planes.insert (0, REVERB_LINES * m_block);
+    m_frames.insert (0, m_block * REVERB_LINES);
+    m_input.insert (0, m_block * REVERB_LINES);
+    m_output.insert (0, m_block * channels);
+
+    for (float & x : m_bias)
+        x = DENORMAL_BIAS;
+
+    /* each input channel is spread over all the lines, and each output channel
+     * gathers from all of them, with a different pattern of signs */
+    for (int i = 0; i < REVERB_LINES; i ++)
+    {
+        for (int c = 0; c < channels; c ++)
+            m_in_matrix[i * channels + c] = hadamard_sign (c + 1, i) / sqrtf (channels);
+    }
+
+    m_channels = channels;
+    m_rate = rate;
+
+    set_params (100, 1, 0, 0);
+
+    AUDDBG ("Reverb: %d lines, %d-frame blocks, %s.\n", REVERB_LINES, m_block,
+     dsp_get_isa ());
+}
+
+void Reverb::destroy ()
+{
+    for (DelayLine & line : m_lines)
+        line.destroy ();
+
+    m_gains.clear ();
+    m_bias.clear ();
+    m_planes.clear ();
+    m_frames.clear ();
+    m_input.clear ();
+    m_output.clear ();
+
+    m_channels = m_rate = m_block = 0;
+}
+
+void Reverb::set_params (int size, float decay, float damping, float level)
+{
+    size = aud::clamp (size, REVERB_MIN_SIZE, REVERB_MAX_SIZE);
+    decay = aud::max (decay, 0.1f);
+
+    get_lengths (size, m_rate, m_lengths);
+
+    /* -60 dB after <decay> seconds */
+    for (int i = 0; i < REVERB_LINES; i ++)
+    {
+        float gain = powf (10, -3 * m_lengths[i] / (decay * m_rate));
+
+        for (int f = 0; f < m_block; f ++)
+            m_gains[f * REVERB_LINES + i] = gain;
+    }
+
+    /* y = (1 - p) x + p y[-1], which leaves the decay time at DC unchanged */
+    float pole = 0.8f * damping;
+    m_damping[0] = 1 - pole;
+    m_damping[3] = -pole;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        for (int i = 0; i < REVERB_LINES; i ++)
+            m_out_matrix[c * REVERB_LINES + i] = level *
+             hadamard_sign (REVERB_LINES - 1 - c, i) / sqrtf (REVERB_LINES);
+    }
+}
+
+void Reverb::reset ()
+{
+    for (DelayLine & line : m_lines)
+        line.clear ();
+
+    memset (m_state, 0, sizeof m_state);
+}
+
+void Reverb::process (float * data, int frames)
+{
+    while (frames > 0)
+    {
+        int block = aud::min (frames, m_block);
+        process_block (data, block);
+
+        data += block * m_channels;
+        frames -= block;
+    }
+}
+
+void Reverb::process_block (float * data, int frames)
+{
+    float * planes[REVERB_LINES];
+    int len = frames * REVERB_LINES;
+
+    for (int i = 0; i < REVERB_LINES; i ++)
+    {
+        planes[i] = & m_planes[i * m_block];
+        m_lines[i].read (m_lengths[i], planes[i], frames);
+    }
+
+    dsp_interleave (planes, m_frames.begin (), REVERB_LINES, frames);
+
+    dsp_matrix_mix (data, m_channels, m_input.begin (), REVERB_LINES,
+     m_in_matrix, frames);
+    dsp_matrix_mix (m_frames.begin (), REVERB_LINES, m_output.begin (),
+     m_channels, m_out_matrix, frames);
+    dsp_mix (data, m_output.begin (), frames * m_channels);
+
+    dsp_biquads (m_frames.begin (), REVERB_LINES, frames, m_damping, 1, m_state);
+    dsp_multiply (m_frames.begin (), m_gains.begin (), len);
+    dsp_hadamard (m_frames.begin (), REVERB_LINES, frames);
+
+    dsp_mix (m_frames.begin (), m_input.begin (), len);
+    dsp_mix (m_frames.begin (), m_bias.begin (), len);
+    dsp_deinterleave (m_frames.begin (), planes, REVERB_LINES, frames);
+
+    for (int i = 0; i < REVERB_LINES; i ++)
+        m_lines[i].write (planes[i], frames);
+}
@@ -0,0 +1,81 @@
+/*
+ * Echo Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef ECHO_REVERB_H
+#define ECHO_REVERB_H
+
+#include <libaudcore/audio.h>
+#include <libaudcore/index.h>
+
+#include "delay.h"
+
+/* Feedback delay network reverb (cf. Jot & Chaigne, 1991).  The input is fed
+ * into REVERB_LINES delay lines of mutually prime lengths, whose outputs are
+ * low-pass filtered, attenuated according to the decay time, mixed together by
+ * a Hadamard matrix, and fed back into the lines.  Since the shortest line is
+ * longer than a block, a whole block is read from every line before anything
+ * is written back, and each step is done on all the lines at once. */
+
+#define REVERB_LINES 16
+
+/* range of the room size setting (percent) */
+#define REVERB_MIN_SIZE 25
+#define REVERB_MAX_SIZE 200
+
+class Reverb
+{
+public:
+    void init (int channels, int rate);
+    void destroy ();
+
+    bool ready () const
+        { return m_channels > 0; }
+
+    /* <size> in percent, <decay> (RT60) in seconds, <damping> and <level> from
+     * 0 to 1. */
+    void set_params (int size, float decay, float damping, float level);
+
+    /* Adds the reverberation of <frames> interleaved frames to them. */
+    void process (float * data, int frames);
+
+    /* Silences the reverberation (for seeking). */
+    void reset ();
+
+private:
+    void process_block (float * data, int frames);
+
+    int m_channels = 0, m_rate = 0;
+    int m_block = 0;                       /* at most the shortest line */
+
+    DelayLine m_lines[REVERB_LINES];
+    int m_lengths[REVERB_LINES] {};
+
+    float m_in_matrix[REVERB_LINES * AUD_MAX_CHANNELS] {};
+    float m_out_matrix[AUD_MAX_CHANNELS * REVERB_LINES] {};
+    float m_damping[5] {};                 /* one-pole low-pass as a biquad */
+    float m_state[2 * REVERB_LINES] {};
+
+    Index<float> m_gains;                  /* per-line gains, m_block times */
+    Index<float> m_bias;                   /* see reverb.cc */
+    Index<float> m_planes;                 /* REVERB_LINES rows of m_block */
+    Index<float> m_frames, m_input;        /* m_block frames of all lines */
+    Index<float> m_output;                 /* m_block frames of all channels */
+};
+
+#endif /* ECHO_REVERB_H */
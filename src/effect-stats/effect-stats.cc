@@ -0,0 +1,223 @@
+/*
+ * Effect Statistics Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <gtk/gtk.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudgui/list.h>
+
+#include "../libdsp/stats.h"
+
+#define REFRESH_MS 1000
+
+enum {
+    COLUMN_NAME,
+    COLUMN_LOAD,
+    COLUMN_AVERAGE,
+    COLUMN_MAX,
+    COLUMN_SAMPLES,
+    COLUMN_ALLOCS,
+    COLUMN_DELAY,
+    COLUMN_NOTE,
+    COLUMNS
+};
+
+static const char * const column_titles[COLUMNS] = {
+    N_("Effect"),
+    N_("CPU"),
+    N_("Average block"),
+    N_("Longest block"),
+    N_("Samples"),
+    N_("Allocations"),
+    N_("Delay"),
+    N_("Mode")
+};
+
+struct Row {
+    const EffectStats * stats;
+    EffectStats::Values values;
+    float load;  /* fraction of the last interval spent processing */
+};
+
+static Index<const EffectStats *> effects;
+static Index<Row> rows;
+static gint64 last_time;
+
+static GtkWidget * list;
+static int refresh_source;
+
+static void get_value (void * user, int row, int column, GValue * value)
+{
+    g_return_if_fail (row >= 0 && row < rows.len ());
+
+    const Row & r = rows[row];
+    const EffectStats::Values & v = r.values;
+
+    switch (column)
+    {
+    case COLUMN_NAME:
+        g_value_set_string (value, _(r.stats->name ()));
+        break;
+    case COLUMN_LOAD:
+        g_value_set_string (value, str_printf ("%.1f%%", r.load * 100));
+        break;
+    case COLUMN_AVERAGE:
+        g_value_set_string (value, v.blocks ? (const char *) str_printf ("%.3f ms",
+         v.process_ns / 1e6 / v.blocks) : "");
+        break;
+    case COLUMN_MAX:
+        g_value_set_string (value, str_printf ("%.3f ms", v.max_block_ns / 1e6));
+        break;
+    case COLUMN_SAMPLES:
+        g_value_set_string (value, str_printf ("%" G_GINT64_FORMAT, (gint64) v.samples));
+        break;
+    case COLUMN_ALLOCS:
+        g_value_set_string (value, int_to_str (v.allocations));
+        break;
+    case COLUMN_DELAY:
+        g_value_set_string (value, str_printf ("%d ms", v.delay_ms));
+        break;
+    case COLUMN_NOTE:
+        g_value_set_string (value, v.note ? v.note : "");
+        break;
+    }
+}
+
+static const AudguiListCallbacks callbacks = {
+    get_value
+};
+
+static const Row * find_row (const EffectStats * stats)
+{
+    for (const Row & row : rows)
+    {
+        if (row.stats == stats)
+            return & row;
+    }
+
+    return nullptr;
+}
+
+/* The load is computed from the time spent since the last refresh, so a row
+ * that has just appeared (or been reset) shows zero until the next one. */
+static void refresh ()
+{
+    gint64 now = g_get_monotonic_time ();
+    double interval = (now - last_time) * 1000.0;  /* ns */
+    last_time = now;
+
+    effect_stats_list (effects);
+
+    Index<Row> new_rows;
+
+    for (const EffectStats * stats : effects)
+    {
+        Row row = {stats, stats->read (), 0};
+        const Row * old = find_row (stats);
+
+        if (old && interval > 0)
+            row.load = aud::max ((int64_t) 0, row.values.process_ns -
+             old->values.process_ns) / interval;
+
+        new_rows.append (row);
+    }
+
+    int old_count = rows.len ();
+    rows = std::move (new_rows);
+
+    if (rows.len () != old_count)
+    {
+        audgui_list_delete_rows (list, 0, old_count);
+        audgui_list_insert_rows (list, 0, rows.len ());
+    }
+    else if (rows.len ())
+        audgui_list_update_rows (list, 0, rows.len ());
+}
+
+static gboolean refresh_cb (void *)
+{
+    refresh ();
+    return TRUE;
+}
+
+static void reset_cb ()
+{
+    effect_stats_list (effects);
+
+    for (const EffectStats * stats : effects)
+        stats->request_reset ();
+}
+
+static void stats_cleanup ()
+{
+    if (refresh_source)
+    {
+        g_source_remove (refresh_source);
+        refresh_source = 0;
+    }
+
+    effects.clear ();
+    rows.clear ();
+}
+
+static void * stats_get_widget ()
+{
+    GtkWidget * vbox = gtk_vbox_new (FALSE, 6);
+
+    GtkWidget * scrolled = gtk_scrolled_window_new (nullptr, nullptr);
+    gtk_scrolled_window_set_shadow_type ((GtkScrolledWindow *) scrolled, GTK_SHADOW_IN);
+    gtk_scrolled_window_set_policy ((GtkScrolledWindow *) scrolled,
+     GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_box_pack_start ((GtkBox *) vbox, scrolled, TRUE, TRUE, 0);
+
+    list = audgui_list_new (& callbacks, nullptr, 0);
+    g_signal_connect (list, "destroy", (GCallback) gtk_widget_destroyed, & list);
+
+    for (int c = 0; c < COLUMNS; c ++)
+        audgui_list_add_column (list, _(column_titles[c]), c, G_TYPE_STRING, -1);
+
+    gtk_container_add ((GtkContainer *) scrolled, list);
+
+    GtkWidget * hbox = gtk_hbox_new (FALSE, 6);
+    gtk_box_pack_end ((GtkBox *) vbox, hbox, FALSE, FALSE, 0);
+
+    GtkWidget * label = gtk_label_new (_("Only effects that are enabled are listed."));
+    gtk_box_pack_start ((GtkBox *) hbox, label, FALSE, FALSE, 0);
+
+    GtkWidget * button = gtk_button_new_with_mnemonic (_("_Reset"));
+    gtk_box_pack_end ((GtkBox *) hbox, button, FALSE, FALSE, 0);
+
+    g_signal_connect (vbox, "destroy", (GCallback) stats_cleanup, nullptr);
+    g_signal_connect (button, "clicked", (GCallback) reset_cb, nullptr);
+
+    last_time = g_get_monotonic_time ();
+    refresh ();
+    refresh_source = g_timeout_add (REFRESH_MS, refresh_cb, nullptr);
+
+    gtk_widget_show_all (vbox);
+    return vbox;
+}
+
+#define AUD_PLUGIN_NAME        N_("Effect Statistics")
+#define AUD_GENERAL_GET_WIDGET   stats_get_widget
+
+#define AUD_DECLARE_GENERAL
+#include <libaudcore/plugin-declare.h>
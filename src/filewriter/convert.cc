@@ -1,38 +1,182 @@
 #include "convert.h"
 
+#include <math.h>
+#include <stdint.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/index.h>
+
+#include "../libdsp/dsp.h"
+
+#define MAX_SHAPING_TAPS 9
+
+/* error feedback coefficients, most recent error first */
+static const float shaping_coefs[SHAPING_COUNT][MAX_SHAPING_TAPS] = {
+    {0},
+    {1},
+    {2.033f, -2.165f, 1.959f, -1.590f, 0.6149f},
+    {2.412f, -3.370f, 3.937f, -4.174f, 3.353f, -2.205f, 1.281f, -0.569f, 0.0847f}
+};
+
+static const int shaping_taps[SHAPING_COUNT] = {0, 1, 5, 9};
+
 void * convert_output = nullptr;
 static int nch;
 static int in_fmt;
 static int out_fmt;
+static int out_bits;   /* 16, 24, or 32 if converted by libdsp, otherwise 0 */
+static gboolean dither;
+static int shaping;
+
+/* Both buffers are allocated in convert_init() for 100 ms of audio and only
+ * grow if the core writes larger blocks than that. */
+static Index<char> output_buf;
+static Index<float> float_buf;
+
+static float shaping_error[AUD_MAX_CHANNELS][MAX_SHAPING_TAPS];
+static uint32_t dither_state;
+
+/* bits of a native-endian signed format converted by libdsp */
+static int native_bits (int fmt)
+{
+    switch (fmt)
+    {
+        case FMT_S16_NE: return 16;
+        case FMT_S24_NE: return 24;
+        case FMT_S32_NE: return 32;
+        default: return 0;
+    }
+}
 
-gboolean convert_init(int input_fmt, int output_fmt, int channels)
+/* uniform in [0, 1) */
+static float dither_rand ()
+{
+    dither_state = dither_state * 1664525 + 1013904223;
+    return (dither_state >> 8) * (1.0f / 16777216);
+}
+
+static void grow (int samples)
+{
+    int out_size = FMT_SIZEOF (out_fmt) * samples;
+
+    if (output_buf.len () < out_size)
+        output_buf.insert (-1, out_size - output_buf.len ());
+    if (float_buf.len () < samples)
+        float_buf.insert (-1, samples - float_buf.len ());
+}
+
+gboolean convert_init(int input_fmt, int output_fmt, int channels, int rate,
+ gboolean use_dither, int use_shaping)
 {
     in_fmt = input_fmt;
     out_fmt = output_fmt;
     nch = channels;
 
+    out_bits = native_bits (out_fmt);
+
+    /* there is nothing to gain from dithering to 32 bits, or when the input
+     * fits into the output as it is */
+    int in_bits = (in_fmt == FMT_FLOAT) ? 32 : native_bits (in_fmt);
+    bool reducing = (out_bits == 16 || out_bits == 24) &&
+     (in_fmt == FMT_FLOAT || ! in_bits || in_bits > out_bits);
+
+    dither = reducing && use_dither;
+    shaping = (reducing && use_shaping > 0 && use_shaping < SHAPING_COUNT) ?
+     use_shaping : SHAPING_NONE;
+
+    memset (shaping_error, 0, sizeof shaping_error);
+    dither_state = 1;
+
+    output_buf.clear ();
+    float_buf.clear ();
+    grow (aud::max (rate / 10, 1) * channels);
+
     return TRUE;
 }
 
+/* Dithers <in> by one LSB of triangular (TPDF) noise and converts it with
+ * libdsp, or with error feedback if noise shaping is enabled, which cannot be
+ * vectorized since each sample depends on the error of the one before. */
+static void dither_to_int (const float * in, void * out, int samples)
+{
+    if (! shaping)
+    {
+        float * temp = float_buf.begin ();
+        float lsb = 1.0f / (1 << (out_bits - 1));
+
+        for (int i = 0; i < samples; i ++)
+            temp[i] = in[i] + (dither_rand () - dither_rand ()) * lsb;
+
+        dsp_to_int (temp, out, samples, out_bits);
+        return;
+    }
+
+    const float * coefs = shaping_coefs[shaping];
+    int taps = shaping_taps[shaping];
+
+    float scale = 1 << (out_bits - 1);
+    int16_t * out16 = (int16_t *) out;
+    int32_t * out32 = (int32_t *) out;
+
+    for (int i = 0; i < samples; i ++)
+    {
+        float * error = shaping_error[i % nch];
+
+        float want = in[i] * scale;
+        for (int t = 0; t < taps; t ++)
+            want -= coefs[t] * error[t];
+
+        float noise = dither ? dither_rand () - dither_rand () : 0;
+        float q = rintf (want + noise);
+
+        /* the error is taken before clipping, lest the filter run away */
+        for (int t = taps - 1; t > 0; t --)
+            error[t] = error[t - 1];
+        error[0] = aud::clamp (q - want, -16.0f, 16.0f);
+
+        q = aud::clamp (q, -scale, scale - 1);
+
+        if (out_bits == 16)
+            out16[i] = q;
+        else
+            out32[i] = q;
+    }
+}
+
+static void float_to_int (const float * in, void * out, int samples)
+{
+    if (! out_bits)
+        audio_to_int (in, out, out_fmt, samples);
+    else if (dither || shaping)
+        dither_to_int (in, out, samples);
+    else
+        dsp_to_int (in, out, samples, out_bits);
+}
+
 int convert_process(void * ptr, int length)
 {
     int samples = length / FMT_SIZEOF (in_fmt);
-    float * temp;
-
-    convert_output = g_realloc (convert_output, FMT_SIZEOF (out_fmt) * samples);
 
+    /* nothing to convert; the output plugins do not modify the data */
     if (in_fmt == out_fmt)
-        memcpy (convert_output, ptr, FMT_SIZEOF (in_fmt) * samples);
-    else if (in_fmt == FMT_FLOAT)
-        audio_to_int ((float *) ptr, convert_output, out_fmt, samples);
+    {
+        convert_output = ptr;
+        return length;
+    }
+
+    grow (samples);
+    convert_output = output_buf.begin ();
+
+    if (in_fmt == FMT_FLOAT)
+        float_to_int ((float *) ptr, convert_output, samples);
     else if (out_fmt == FMT_FLOAT)
         audio_from_int (ptr, in_fmt, (float *) convert_output, samples);
     else
     {
-        temp = g_new (float, samples);
+        /* dither_to_int() then dithers float_buf in place */
+        float * temp = float_buf.begin ();
         audio_from_int (ptr, in_fmt, temp, samples);
-        audio_to_int (temp, convert_output, out_fmt, samples);
-        g_free (temp);
+        float_to_int (temp, convert_output, samples);
     }
 
     return FMT_SIZEOF (out_fmt) * samples;
@@ -40,6 +184,7 @@ int convert_process(void * ptr, int length)
 
 void convert_free(void)
 {
-    g_free (convert_output);
+    output_buf.clear ();
+    float_buf.clear ();
     convert_output = nullptr;
 }
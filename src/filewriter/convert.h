@@ -3,9 +3,20 @@
 
 #include "filewriter.h"
 
+/* noise shaping filters, in order of increasing strength */
+enum {
+    SHAPING_NONE,
+    SHAPING_SIMPLE,     /* first order */
+    SHAPING_LIPSHITZ,   /* 5-tap E-weighted (Lipshitz et al.) */
+    SHAPING_WANNAMAKER, /* 9-tap F-weighted (Wannamaker) */
+    SHAPING_COUNT
+};
+
 extern void * convert_output;
 
-gboolean convert_init(int input_fmt, int output_fmt, int channels);
+/* Dither and noise shaping apply only when reducing to 16 or 24 bits. */
+gboolean convert_init(int input_fmt, int output_fmt, int channels, int rate,
+ gboolean dither, int shaping);
 
 int convert_process(void * ptr, int length);
 
@@ -119,6 +119,10 @@ static gboolean use_suffix;
 static GtkWidget *prependnumber_toggle;
 static gboolean prependnumber;
 
+static GtkWidget *dither_toggle, *shaping_combo;
+static gboolean dither;
+static int noise_shaping;
+
 static String file_path;
 
 VFSFile output_file;
@@ -158,6 +162,8 @@ const char * const FileWriter::defaults[] = {
  "prependnumber", "FALSE",
  "save_original", "TRUE",
  "use_suffix", "FALSE",
+ "dither", "TRUE",
+ "noise_shaping", "0", /* SHAPING_NONE */
  nullptr};
 
 bool FileWriter::init ()
@@ -170,6 +176,8 @@ bool FileWriter::init ()
     prependnumber = aud_get_bool ("filewriter", "prependnumber");
     save_original = aud_get_bool ("filewriter", "save_original");
     use_suffix = aud_get_bool ("filewriter", "use_suffix");
+    dither = aud_get_bool ("filewriter", "dither");
+    noise_shaping = aud_get_int ("filewriter", "noise_shaping");
 
     if (! file_path[0])
     {
@@ -288,7 +296,7 @@ bool FileWriter::open_audio (int fmt, int rate, int nch)
     if (! output_file)
         return 0;
 
-    convert_init (fmt, plugin->format_required (fmt), nch);
+    convert_init (fmt, plugin->format_required (fmt), nch, rate, dither, noise_shaping);
 
     rv = (plugin->open)();
 
@@ -339,12 +347,17 @@ static void configure_response_cb (void)
     prependnumber =
         gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(prependnumber_toggle));
 
+    dither = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(dither_toggle));
+    noise_shaping = gtk_combo_box_get_active(GTK_COMBO_BOX(shaping_combo));
+
     aud_set_int ("filewriter", "fileext", fileext);
     aud_set_bool ("filewriter", "filenamefromtags", filenamefromtags);
     aud_set_str ("filewriter", "file_path", file_path);
     aud_set_bool ("filewriter", "prependnumber", prependnumber);
     aud_set_bool ("filewriter", "save_original", save_original);
     aud_set_bool ("filewriter", "use_suffix", use_suffix);
+    aud_set_bool ("filewriter", "dither", dither);
+    aud_set_int ("filewriter", "noise_shaping", noise_shaping);
 }
 
 static void fileext_cb(GtkWidget *combo, void * data)
@@ -495,6 +508,26 @@ static void * file_configure (void)
         gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(prependnumber_toggle), prependnumber);
         gtk_box_pack_start(GTK_BOX(configure_vbox), prependnumber_toggle, FALSE, FALSE, 0);
 
+        gtk_box_pack_start(GTK_BOX(configure_vbox), gtk_hseparator_new(), FALSE, FALSE, 0);
+
+        dither_toggle = gtk_check_button_new_with_label(_("Dither when reducing to 16 or 24 bits"));
+        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(dither_toggle), dither);
+        gtk_box_pack_start(GTK_BOX(configure_vbox), dither_toggle, FALSE, FALSE, 0);
+
+        GtkWidget * shaping_hbox = gtk_hbox_new (FALSE, 5);
+        gtk_box_pack_start(GTK_BOX(configure_vbox), shaping_hbox, FALSE, FALSE, 0);
+
+        GtkWidget * shaping_label = gtk_label_new (_("Noise shaping:"));
+        gtk_box_pack_start(GTK_BOX(shaping_hbox), shaping_label, FALSE, FALSE, 0);
+
+        shaping_combo = gtk_combo_box_text_new ();
+        gtk_combo_box_text_append_text ((GtkComboBoxText *) shaping_combo, _("None"));
+        gtk_combo_box_text_append_text ((GtkComboBoxText *) shaping_combo, _("Simple"));
+        gtk_combo_box_text_append_text ((GtkComboBoxText *) shaping_combo, _("Moderate"));
+        gtk_combo_box_text_append_text ((GtkComboBoxText *) shaping_combo, _("Strong"));
+        gtk_combo_box_set_active(GTK_COMBO_BOX(shaping_combo), noise_shaping);
+        gtk_box_pack_start(GTK_BOX(shaping_hbox), shaping_combo, FALSE, FALSE, 0);
+
         g_signal_connect (fileext_combo, "changed", (GCallback) fileext_cb, nullptr);
         g_signal_connect (plugin_button, "clicked", (GCallback) plugin_configure_cb, nullptr);
         g_signal_connect (saveplace1, "toggled", (GCallback) saveplace_original_cb, nullptr);
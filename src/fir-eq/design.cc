@@ -0,0 +1,200 @@
+/*
+ * FIR Equalizer Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "design.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "../libdsp/fft.h"
+
+/* The minimum-phase filter is derived from a spectrum this many times longer
+ * than the filter, which keeps the aliasing of the cepstrum negligible. */
+#define CEPSTRUM_FACTOR 4
+
+/* floor for the logarithm of the magnitude (-120 dB) */
+#define MIN_MAGNITUDE 1e-6
+
+const float eq_band_freqs[EQ_BANDS] = {
+    20, 25, 31.5, 40, 50, 63, 80, 100, 125, 160, 200, 250, 315, 400, 500, 630,
+    800, 1000, 1250, 1600, 2000, 2500, 3150, 4000, 5000, 6300, 8000, 10000,
+    12500, 16000, 20000
+};
+
+static int point_compare (const EQPoint & a, const EQPoint & b, void *)
+{
+    return (a.freq > b.freq) - (a.freq < b.freq);
+}
+
+bool eq_parse_curve (const char * text, Index<EQPoint> & points)
+{
+    points.clear ();
+
+    while (1)
+    {
+        while (* text == ' ' || * text == ',' || * text == '\t')
+            text ++;
+
+        if (! * text)
+            break;
+
+        char * end;
+        float freq = strtof (text, & end);
+
+        if (end == text || * end != ':' || ! (freq > 0))
+            return false;
+
+        text = end + 1;
+        float gain = strtof (text, & end);
+
+        if (end == text)
+            return false;
+
+        text = end;
+        points.append (EQPoint {freq, gain});
+    }
+
+    points.sort (point_compare, nullptr);
+    return true;
+}
+
+/* Samples the target curve (as linear gain) at <bins> equally spaced
+ * frequencies from 0 to <rate> / 2. */
+static void sample_curve (const Index<EQPoint> & points, float gain, int rate,
+ int bins, float * mag)
+{
+    int n = points.len ();
+    int seg = 0;
+
+    for (int k = 0; k < bins; k ++)
+    {
+        double freq = (double) k * rate / (2 * (bins - 1));
+        double db = gain;
+
+        if (n)
+        {
+            while (seg < n - 1 && points[seg + 1].freq <= freq)
+                seg ++;
+
+            if (freq <= points[0].freq)
+                db += points[0].gain;
+            else if (seg == n - 1)
+                db += points[n - 1].gain;
+            else
+            {
+                const EQPoint & a = points[seg], & b = points[seg + 1];
+                double t = log (freq / a.freq) / log (b.freq / a.freq);
+                db += a.gain + t * (b.gain - a.gain);
+            }
+        }
+
+        mag[k] = pow (10, db / 20);
+    }
+}
+
+/* Frequency sampling: the inverse transform of the real (zero-phase) target
+ * response is centered on sample zero; rotating it by half the length and
+ * applying a Blackman window gives a symmetric filter. */
+static void design_linear (const Index<EQPoint> & points, float gain, int rate,
+ int taps, Index<float> & ir)
+{
+    FFT fft;
+    fft.init (taps);
+
+    int bins = taps / 2 + 1;
+    Index<float> re, im, h;
+    re.insert (0, bins);
+    im.insert (0, bins);
+    h.insert (0, taps);
+
+    sample_curve (points, gain, rate, bins, re.begin ());
+    fft.real_inverse (re.begin (), im.begin (), h.begin ());
+
+    ir.insert (0, taps);
+
+    for (int i = 0; i < taps; i ++)
+    {
+        double x = 2 * M_PI * i / taps;
+        double w = 0.42 - 0.5 * cos (x) + 0.08 * cos (2 * x);
+        ir[i] = h[(i + taps / 2) & (taps - 1)] * w;
+    }
+}
+
+/* Homomorphic method (cf. Oppenheim & Schafer, ch. 13): the real cepstrum of
+ * the target magnitude is folded onto positive time, which makes the phase
+ * the Hilbert transform of the log magnitude, i.e. minimum phase.  The
+ * resulting filter is truncated with the falling half of a Hann window. */
+static void design_minimum (const Index<EQPoint> & points, float gain, int rate,
+ int taps, Index<float> & ir)
+{
+    int size = CEPSTRUM_FACTOR * taps;
+    int bins = size / 2 + 1;
+
+    FFT fft;
+    fft.init (size);
+
+    Index<float> re, im, cep;
+    re.insert (0, bins);
+    im.insert (0, bins);
+    cep.insert (0, size);
+
+    sample_curve (points, gain, rate, bins, re.begin ());
+
+    for (int k = 0; k < bins; k ++)
+        re[k] = log (fmax (re[k], MIN_MAGNITUDE));
+
+    fft.real_inverse (re.begin (), im.begin (), cep.begin ());
+
+    for (int i = 1; i < size / 2; i ++)
+        cep[i] *= 2;
+    for (int i = size / 2 + 1; i < size; i ++)
+        cep[i] = 0;
+
+    fft.real_forward (cep.begin (), re.begin (), im.begin ());
+
+    for (int k = 0; k < bins; k ++)
+    {
+        double m = exp (re[k]);
+        double p = im[k];
+        re[k] = m * cos (p);
+        im[k] = m * sin (p);
+    }
+
+    fft.real_inverse (re.begin (), im.begin (), cep.begin ());
+
+    ir.insert (0, taps);
+
+    for (int i = 0; i < taps; i ++)
+        ir[i] = cep[i] * 0.5 * (1 + cos (M_PI * i / taps));
+}
+
+int eq_design (const Index<EQPoint> & points, float gain, int rate, int taps,
+ bool min_phase, Index<float> & ir)
+{
+    ir.clear ();
+
+    if (min_phase)
+    {
+        design_minimum (points, gain, rate, taps, ir);
+        return 0;
+    }
+
+    design_linear (points, gain, rate, taps, ir);
+    return taps / 2;
+}
@@ -0,0 +1,52 @@
+/*
+ * FIR Equalizer Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef FIR_EQ_DESIGN_H
+#define FIR_EQ_DESIGN_H
+
+#include <libaudcore/index.h>
+
+/* One point of the target curve.  Between points, the gain (in dB) is
+ * interpolated linearly over log frequency; below the first point and above
+ * the last, it is held constant. */
+struct EQPoint
+{
+    float freq;  /* Hz */
+    float gain;  /* dB */
+};
+
+/* ISO 266 1/3-octave center frequencies, 20 Hz to 20 kHz */
+#define EQ_BANDS 31
+
+extern const float eq_band_freqs[EQ_BANDS];
+
+/* Parses a curve written as "freq:gain" pairs separated by commas or spaces,
+ * e.g. "31.5:-2, 63:1.5, 8000:-3".  The points are sorted by frequency.
+ * Returns false if the text is not in that form. */
+bool eq_parse_curve (const char * text, Index<EQPoint> & points);
+
+/* Designs an FIR filter of <taps> taps (a power of two) following <points> at
+ * sample rate <rate>, plus a constant <gain> in dB.  The linear-phase filter
+ * is symmetric and delays the audio by <taps> / 2 frames; the minimum-phase
+ * filter has the same magnitude response with (nearly) no delay, but with
+ * phase shifts of its own.  Returns the delay in frames. */
+int eq_design (const Index<EQPoint> & points, float gain, int rate, int taps,
+ bool min_phase, Index<float> & ir);
+
+#endif /* FIR_EQ_DESIGN_H */
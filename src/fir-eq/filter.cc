@@ -0,0 +1,102 @@
+/*
+ * FIR Equalizer Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "filter.h"
+
+#include <libaudcore/audio.h>
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/dsp.h"
+
+/* length of a short fade (frames) */
+#define SHORT_FADE 256
+
+/* Shorter blocks mean less latency but more partitions to sum for each block,
+ * so the block is made long enough for at most MAX_PARTS of them where it can
+ * be. */
+#define MIN_BLOCK 256
+#define MAX_BLOCK 1024
+#define MAX_PARTS 32
+
+int FIRFilter::block_size (int taps)
+{
+    return aud::clamp (taps / MAX_PARTS, MIN_BLOCK, MAX_BLOCK);
+}
+
+static void make_paths (const float * ir, int taps, int channels,
+ ConvPath * paths)
+{
+    for (int c = 0; c < channels; c ++)
+        paths[c] = {c, c, ir, taps};
+}
+
+void FIRFilter::init (int channels, int taps, int delay)
+{
+    destroy ();
+
+    m_channels = channels;
+    m_taps = taps;
+
+    Index<float> impulse;
+    impulse.insert (0, taps);
+    impulse[delay] = 1;
+
+    ConvPath paths[AUD_MAX_CHANNELS];
+    make_paths (impulse.begin (), taps, channels, paths);
+
+    int block = block_size (taps);
+
+    m_stage.init (block, channels, paths, channels, 0, taps);
+    m_blocks.init (channels, block, run_block, this);
+
+    AUDDBG ("FIR filter: %d taps, blocks of %d, %s.\n", taps, block, dsp_get_isa ());
+}
+
+void FIRFilter::destroy ()
+{
+    m_channels = m_taps = 0;
+    m_stage.destroy ();
+    m_blocks.destroy ();
+}
+
+void FIRFilter::reset ()
+{
+    m_stage.reset ();
+    m_blocks.reset ();
+}
+
+void FIRFilter::make_filters (const float * ir, int taps, int channels,
+ Index<float> & filters)
+{
+    ConvPath paths[AUD_MAX_CHANNELS];
+    make_paths (ir, taps, channels, paths);
+
+    ConvStage::make_filters (block_size (taps), paths, channels, 0, taps, filters);
+}
+
+void FIRFilter::set_filters (Index<float> & filters, bool short_fade)
+{
+    m_stage.set_filters (filters, short_fade ? SHORT_FADE : latency ());
+}
+
+void FIRFilter::run_block (const float * const * in, float * const * out,
+ void * data)
+{
+    ((FIRFilter *) data)->m_stage.process (in, out);
+}
@@ -0,0 +1,87 @@
+/*
+ * FIR Equalizer Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef FIR_EQ_FILTER_H
+#define FIR_EQ_FILTER_H
+
+#include <libaudcore/index.h>
+
+#include "../libdsp/convolve.h"
+
+/* Uniformly partitioned FFT convolution in short blocks (see block_size ()),
+ * using the shared convolution stage, so the latency is one short block rather
+ * than the length of the filter.  The same filter is applied to every channel,
+ * and its spectra are computed once for all of them.  They are given as the
+ * partitions of the stage (see make_filters ()), which can be computed in
+ * another thread and handed over with set_filters ().  After new filters are
+ * set, the next block is faded from the old filter to the new one. */
+class FIRFilter
+{
+public:
+    /* The filter is initially a unit impulse delayed by <delay> frames. */
+    void init (int channels, int taps, int delay);
+    void destroy ();
+    void reset ();
+
+    bool ready () const
+        { return m_channels > 0; }
+    int channels () const
+        { return m_channels; }
+    int taps () const
+        { return m_taps; }
+
+    /* the block used for a filter of <taps> taps */
+    static int block_size (int taps);
+
+    /* Computes the partitions of a filter with impulse response <ir> (<taps>
+     * values) for <channels> channels.  May be called from any thread. */
+    static void make_filters (const float * ir, int taps, int channels,
+     Index<float> & filters);
+
+    /* Replaces the filter by swapping in <filters>, which must have been made
+     * for the same number of taps and channels.  If <short_fade> is set, the
+     * change is made over a few milliseconds rather than a whole block (as
+     * when the delay of the filter changes, so that the two do not overlap
+     * as an echo).  <filters> receives a buffer that is no longer needed. */
+    void set_filters (Index<float> & filters, bool short_fade);
+
+    /* Filters <frames> interleaved frames in place.  The output is delayed by
+     * latency () frames, plus the delay of the filter itself. */
+    void process (float * data, int frames)
+        { m_blocks.process (data, frames); }
+
+    /* Appends <frames> frames of the audio remaining in the pipeline to <out>;
+     * latency () plus the delay of the filter gets all of it. */
+    void drain (Index<float> & out, int frames)
+        { m_blocks.drain (out, frames); }
+
+    int latency () const
+        { return m_blocks.latency (); }
+
+private:
+    static void run_block (const float * const * in, float * const * out,
+     void * data);
+
+    int m_channels = 0, m_taps = 0;
+
+    ConvStage m_stage;
+    BlockAdapter m_blocks;
+};
+
+#endif /* FIR_EQ_FILTER_H */
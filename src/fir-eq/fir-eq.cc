@@ -0,0 +1,443 @@
+/*
+ * FIR Equalizer Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <utility>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+#include "design.h"
+#include "filter.h"
+
+#define CFG_SECTION "fir-eq"
+
+enum {
+    SOURCE_BANDS,
+    SOURCE_CURVE
+};
+
+enum {
+    PHASE_LINEAR,
+    PHASE_MINIMUM
+};
+
+static const char fir_eq_about[] =
+ N_("FIR Equalizer Plugin for Audacious\n"
+    "Copyright 2015 Audacious developers\n\n"
+    "Designs a high-resolution FIR filter from a 31-band or free-form target "
+    "curve and applies it by FFT convolution.  Changes to the curve are "
+    "faded in without interrupting playback.");
+
+/* the bands default to 0 dB */
+static const char * const fir_eq_defaults[] = {
+ "source", "0",
+ "curve", "",
+ "preamp", "0",
+ "phase", "0",
+ "taps", "8192",
+ nullptr};
+
+static void settings_cb ();
+
+static const ComboItem taps_list[] = {
+    ComboItem ("4096", 4096),
+    ComboItem ("8192", 8192),
+    ComboItem ("16384", 16384),
+    ComboItem ("32768", 32768)
+};
+
+#define BAND(n, label) \
+    WidgetSpin (label, WidgetFloat (CFG_SECTION, "band" #n, settings_cb), \
+     {-24, 12, 0.5, N_("dB")})
+
+static const PreferencesWidget bands_low[] = {
+    BAND (0, "20 Hz:"), BAND (1, "25 Hz:"), BAND (2, "31.5 Hz:"),
+    BAND (3, "40 Hz:"), BAND (4, "50 Hz:"), BAND (5, "63 Hz:"),
+    BAND (6, "80 Hz:"), BAND (7, "100 Hz:"), BAND (8, "125 Hz:"),
+    BAND (9, "160 Hz:"), BAND (10, "200 Hz:")
+};
+
+static const PreferencesWidget bands_mid[] = {
+    BAND (11, "250 Hz:"), BAND (12, "315 Hz:"), BAND (13, "400 Hz:"),
+    BAND (14, "500 Hz:"), BAND (15, "630 Hz:"), BAND (16, "800 Hz:"),
+    BAND (17, "1 kHz:"), BAND (18, "1.25 kHz:"), BAND (19, "1.6 kHz:"),
+    BAND (20, "2 kHz:"), BAND (21, "2.5 kHz:")
+};
+
+static const PreferencesWidget bands_high[] = {
+    BAND (22, "3.15 kHz:"), BAND (23, "4 kHz:"), BAND (24, "5 kHz:"),
+    BAND (25, "6.3 kHz:"), BAND (26, "8 kHz:"), BAND (27, "10 kHz:"),
+    BAND (28, "12.5 kHz:"), BAND (29, "16 kHz:"), BAND (30, "20 kHz:")
+};
+
+#undef BAND
+
+static const PreferencesWidget band_columns[] = {
+    WidgetTable ({{bands_low}}),
+    WidgetTable ({{bands_mid}}),
+    WidgetTable ({{bands_high}})
+};
+
+static const PreferencesWidget fir_eq_widgets[] = {
+    WidgetLabel (N_("<b>Target Curve</b>")),
+    WidgetRadio (N_("31 bands"),
+        WidgetInt (CFG_SECTION, "source", settings_cb),
+        {SOURCE_BANDS}),
+    WidgetBox ({{band_columns}, true}, WIDGET_CHILD),
+    WidgetRadio (N_("Custom points"),
+        WidgetInt (CFG_SECTION, "source", settings_cb),
+        {SOURCE_CURVE}),
+    WidgetEntry (N_("Points:"),
+        WidgetString (CFG_SECTION, "curve", settings_cb),
+        WIDGET_CHILD),
+    WidgetLabel (N_("<small>Frequency (Hz) and gain (dB) pairs, e.g. "
+     "\"28:2, 31.5:-1.5, 35.5:-4\".  Between points, the gain changes linearly "
+     "with log frequency.</small>"), WIDGET_CHILD),
+    WidgetSpin (N_("Preamp:"),
+        WidgetFloat (CFG_SECTION, "preamp", settings_cb),
+        {-24, 24, 0.5, N_("dB")}),
+    WidgetLabel (N_("<b>Filter</b>")),
+    WidgetRadio (N_("Linear phase"),
+        WidgetInt (CFG_SECTION, "phase", settings_cb),
+        {PHASE_LINEAR}),
+    WidgetRadio (N_("Minimum phase (less latency)"),
+        WidgetInt (CFG_SECTION, "phase", settings_cb),
+        {PHASE_MINIMUM}),
+    WidgetCombo (N_("Length (taps):"),
+        WidgetInt (CFG_SECTION, "taps", settings_cb),
+        {{taps_list}}),
+    WidgetLabel (N_("<small>Longer filters resolve finer detail at low "
+     "frequencies: 1/6-octave correction down to 30 Hz needs 16384 taps at "
+     "44.1 or 48 kHz.</small>"))
+};
+
+static const PluginPreferences fir_eq_prefs = {{fir_eq_widgets}};
+
+class FIREqualizer : public EffectPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("FIR Equalizer"),
+        PACKAGE,
+        fir_eq_about,
+        & fir_eq_prefs
+    };
+
+    constexpr FIREqualizer () : EffectPlugin (info, 0, true) {}
+
+    bool init ();
+    void cleanup ();
+
+    void start (int * channels, int * rate);
+    void process (float * * data, int * samples);
+    void flush ();
+    void finish (float * * data, int * samples);
+    int adjust_delay (int delay);
+};
+
+EXPORT FIREqualizer aud_plugin_instance;
+
+/* set from the main thread, checked by the audio thread */
+static std::atomic<bool> settings_changed;
+
+static int eq_channels, eq_rate;
+static int filter_delay;  /* delay of the current filter in frames */
+
+static FIRFilter filter;
+static Index<float> output;
+
+static EffectStats stats (N_("FIR Equalizer"));
+
+/* Filters are designed by a background thread, which is woken whenever the
+ * settings or the audio format change.  The audio thread picks up a finished
+ * filter without waiting for the lock, so it never blocks on a design. */
+static pthread_t design_thread;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static bool thread_running, quit;
+
+/* protected by the mutex */
+static int job_rate, job_taps, job_channels;  /* zero: nothing to design for */
+static int job_serial, done_serial;
+static Index<float> ready_filters;
+static int ready_taps, ready_channels, ready_delay;
+static bool have_ready;
+
+static int get_taps ()
+{
+    int taps = aud::clamp (aud_get_int (CFG_SECTION, "taps"), 4096, 32768);
+
+    /* round down to a power of two */
+    while (taps & (taps - 1))
+        taps &= taps - 1;
+
+    return taps;
+}
+
+static bool get_min_phase ()
+{
+    return aud_get_int (CFG_SECTION, "phase") == PHASE_MINIMUM;
+}
+
+/* called from the design thread */
+static int design_filter (int rate, int taps, Index<float> & ir)
+{
+    Index<EQPoint> points;
+
+    if (aud_get_int (CFG_SECTION, "source") == SOURCE_CURVE)
+    {
+        String curve = aud_get_str (CFG_SECTION, "curve");
+
+        if (! eq_parse_curve (curve, points))
+        {
+            AUDERR ("Invalid equalizer curve: %s\n", (const char *) curve);
+            points.clear ();
+        }
+    }
+    else
+    {
+        for (int i = 0; i < EQ_BANDS; i ++)
+        {
+            float gain = aud_get_double (CFG_SECTION, str_printf ("band%d", i));
+            points.append (EQPoint {eq_band_freqs[i], gain});
+        }
+    }
+
+    float preamp = aud_get_double (CFG_SECTION, "preamp");
+    return eq_design (points, preamp, rate, taps, get_min_phase (), ir);
+}
+
+static void * design_worker (void *)
+{
+    pthread_mutex_lock (& mutex);
+
+    while (1)
+    {
+        while (! quit && (! job_rate || done_serial == job_serial))
+            pthread_cond_wait (& wake, & mutex);
+
+        if (quit)
+            break;
+
+        int serial = job_serial, rate = job_rate, taps = job_taps;
+        int channels = job_channels;
+        pthread_mutex_unlock (& mutex);
+
+        Index<float> ir, filters;
+        int delay = design_filter (rate, taps, ir);
+        FIRFilter::make_filters (ir.begin (), taps, channels, filters);
+
+        AUDDBG ("FIR equalizer: designed %d taps at %d Hz.\n", taps, rate);
+
+        pthread_mutex_lock (& mutex);
+        done_serial = serial;
+
+        /* a filter designed for an old format is of no use */
+        if (rate == job_rate && taps == job_taps && channels == job_channels)
+        {
+            ready_filters = std::move (filters);
+            ready_taps = taps;
+            ready_channels = channels;
+            ready_delay = delay;
+            have_ready = true;
+        }
+    }
+
+    pthread_mutex_unlock (& mutex);
+    return nullptr;
+}
+
+static void request_design (int rate, int taps, int channels)
+{
+    pthread_mutex_lock (& mutex);
+
+    if (rate)
+    {
+        job_rate = rate;
+        job_taps = taps;
+        job_channels = channels;
+        have_ready = false;
+    }
+
+    job_serial ++;
+    pthread_cond_signal (& wake);
+    pthread_mutex_unlock (& mutex);
+}
+
+static void settings_cb ()
+{
+    settings_changed = true;
+    request_design (0, 0, 0);
+}
+
+/* Swaps in a finished filter if there is one.  The old filter goes back to
+ * the design thread to be freed.  A filter with a different delay (after a
+ * change between linear and minimum phase) cannot be faded in smoothly, since
+ * the old and new output would overlap as an echo; instead, the audio skips
+ * ahead or back with a short fade, and adjust_delay () reports the new delay
+ * from then on. */
+static void collect_filter ()
+{
+    if (pthread_mutex_trylock (& mutex))
+        return;
+
+    if (have_ready && ready_taps == filter.taps () && ready_channels == filter.channels ())
+    {
+        filter.set_filters (ready_filters, ready_delay != filter_delay);
+        filter_delay = ready_delay;
+        have_ready = false;
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+/* Until the first filter is designed, the audio passes through with the delay
+ * that the filter will have. */
+static void setup_filter (int taps)
+{
+    filter_delay = get_min_phase () ? 0 : taps / 2;
+    filter.init (eq_channels, taps, filter_delay);
+    stats.count_alloc (true);
+
+    request_design (eq_rate, taps, eq_channels);
+}
+
+bool FIREqualizer::init ()
+{
+    aud_config_set_defaults (CFG_SECTION, fir_eq_defaults);
+
+    quit = false;
+
+    if (pthread_create (& design_thread, nullptr, design_worker, nullptr))
+    {
+        AUDERR ("Failed to start filter design thread.\n");
+        return false;
+    }
+
+    thread_running = true;
+    stats.attach ();
+    return true;
+}
+
+void FIREqualizer::cleanup ()
+{
+    stats.detach ();
+
+    if (thread_running)
+    {
+        pthread_mutex_lock (& mutex);
+        quit = true;
+        pthread_cond_signal (& wake);
+        pthread_mutex_unlock (& mutex);
+
+        pthread_join (design_thread, nullptr);
+        thread_running = false;
+    }
+
+    job_rate = job_taps = job_channels = 0;
+    ready_filters.clear ();
+    have_ready = false;
+
+    filter.destroy ();
+    output.clear ();
+}
+
+void FIREqualizer::start (int * channels, int * rate)
+{
+    bool changed = (* channels != eq_channels || * rate != eq_rate);
+
+    eq_channels = * channels;
+    eq_rate = * rate;
+
+    settings_changed = false;
+    int taps = get_taps ();
+
+    if (changed || ! filter.ready () || taps != filter.taps ())
+        setup_filter (taps);
+    else
+        filter.reset ();
+
+    /* finish () returns the last block and the rest of the pipeline */
+    output.insert (0, eq_channels * (DSP_BLOCK_FRAMES + 2 * taps));
+    output.remove (0, -1);
+}
+
+void FIREqualizer::process (float * * data, int * samples)
+{
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
+    /* the design thread has already been woken; only a new length needs the
+     * filter to be set up again */
+    if (settings_changed.exchange (false))
+    {
+        int taps = get_taps ();
+        if (taps != filter.taps ())
+            setup_filter (taps);
+    }
+
+    if (! filter.ready ())
+        return;
+
+    collect_filter ();
+    filter.process (* data, * samples / eq_channels);
+}
+
+void FIREqualizer::flush ()
+{
+    if (filter.ready ())
+        filter.reset ();
+}
+
+void FIREqualizer::finish (float * * data, int * samples)
+{
+    EffectStatsScope scope (stats, * samples);
+
+    process (data, samples);
+
+    if (! filter.ready ())
+        return;
+
+    output.remove (0, -1);
+    output.insert (* data, -1, * samples);
+
+    filter.drain (output, filter.latency () + filter_delay);
+    filter.reset ();
+
+    * data = output.begin ();
+    * samples = output.len ();
+}
+
+int FIREqualizer::adjust_delay (int delay)
+{
+    int added = filter.ready () ? aud::rescale<int64_t> (filter.latency () +
+     filter_delay, eq_rate, 1000) : 0;
+
+    stats.set_delay (added);
+    return delay + added;
+}
@@ -26,20 +26,24 @@
 #include <libaudcore/tuple.h>
 #include <libaudcore/vfs.h>
 
-#define BUFFER_SIZE_SAMP (FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS)
-#define BUFFER_SIZE_BYTE (BUFFER_SIZE_SAMP * (FLAC__MAX_BITS_PER_SAMPLE/8))
-
 #define SAMPLE_SIZE(a) (a == 8 ? 1 : (a == 16 ? 2 : 4))
 #define SAMPLE_FMT(a) (a == 8 ? FMT_S8 : (a == 16 ? FMT_S16_NE : (a == 24 ? FMT_S24_NE : FMT_S32_NE)))
 
+/* Decoded frames are packed into output_buffer, which is provided by the
+ * caller and holds buffer_size samples.  buffer_used also counts samples.
+ * Samples before skip_to (if nonzero) are dropped, to finish a seek. */
 typedef struct callback_info {
     unsigned bits_per_sample;
     unsigned sample_rate;
     unsigned channels;
+    unsigned max_blocksize;
     unsigned long total_samples;
-    int32_t* output_buffer;
-    int32_t* write_pointer;
+    char* output_buffer;
+    char* write_pointer;
     unsigned buffer_used;
+    unsigned buffer_size;
+    int64_t skip_to;
+    bool has_seektable;
     VFSFile* fd;
     int bitrate;
 } callback_info;
@@ -18,6 +18,8 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <inttypes.h>
+#include <pthread.h>
 #include <string.h>
 #include <glib.h>
 
@@ -27,6 +29,8 @@
 #include <libaudcore/plugin.h>
 
 #include "flacng.h"
+#include "seek-index.h"
+#include "../libdsp/dsp.h"
 
 static FLAC__StreamDecoder *decoder;
 static callback_info *info;
@@ -49,6 +53,9 @@ static bool flac_init (void)
         return false;
     }
 
+    /* Without a seek table, seeks go through our own index */
+    FLAC__stream_decoder_set_metadata_respond(decoder, FLAC__METADATA_TYPE_SEEKTABLE);
+
     if (FLAC__STREAM_DECODER_INIT_STATUS_OK != (ret = FLAC__stream_decoder_init_stream(
         decoder,
         read_callback,
@@ -87,39 +94,111 @@ bool flac_is_our_fd(const char *filename, VFSFile &fd)
     return ! strncmp (buf, "fLaC", sizeof buf);
 }
 
-static void squeeze_audio(int32_t* src, void* dst, unsigned count, unsigned res)
+/* Decoding runs ahead of playback in a separate thread, so that a slow frame
+ * or a blocking output does not cause the other to stall.  The decoding thread
+ * packs frames into a ring of blocks, each holding about BLOCK_MS of audio,
+ * which the playback thread then writes out one at a time.  No more than
+ * DSP_BLOCK_FRAMES are written at once, so that the effects never enlarge
+ * their buffers in the audio thread (100 ms is more than that at 192 kHz). */
+#define QUEUE_BLOCKS 4
+#define BLOCK_MS 100
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t emptied = PTHREAD_COND_INITIALIZER;
+
+static Index<char> queue;
+static int block_bytes, block_samples;
+static int block_len[QUEUE_BLOCKS];
+static int queue_head, queue_count;
+static int64_t seek_to;
+static bool finished, failed, quit;
+
+/* Starts decoding at the indexed frame before <sample> if there is one, the
+ * write callback dropping the samples before <sample>.  Otherwise, libFLAC
+ * searches for the frame itself. */
+static bool seek_decoder (int64_t sample)
 {
-    int32_t* rp = src;
-    int8_t*  wp = (int8_t*) dst;
-    int16_t* wp2 = (int16_t*) dst;
-    int32_t* wp4 = (int32_t*) dst;
+    SeekPoint point;
 
-    switch (res)
+    if (seek_index.find (sample, point) && FLAC__stream_decoder_flush (decoder) &&
+        info->fd->fseek (point.offset, VFS_SEEK_SET) == 0)
     {
-        case 8:
-            for (unsigned i = 0; i < count; i++, wp++, rp++)
-                *wp = *rp & 0xff;
-            break;
+        info->skip_to = sample;
+        return true;
+    }
 
-        case 16:
-            for (unsigned i = 0; i < count; i++, wp2++, rp++)
-                *wp2 = *rp & 0xffff;
-            break;
+    info->skip_to = 0;
+    return FLAC__stream_decoder_seek_absolute (decoder, sample);
+}
 
-        case 24:
-        case 32:
-            for (unsigned i = 0; i < count; i++, wp4++, rp++)
-                *wp4 = *rp;
-            break;
+static void * decode_worker (void *)
+{
+    pthread_mutex_lock (& mutex);
+
+    while (! quit)
+    {
+        int64_t seek = seek_to;
+
+        if (seek < 0 && (finished || queue_count == QUEUE_BLOCKS))
+        {
+            pthread_cond_wait (& emptied, & mutex);
+            continue;
+        }
+
+        seek_to = -1;
+        int slot = (queue_head + queue_count) % QUEUE_BLOCKS;
+
+        pthread_mutex_unlock (& mutex);
+
+        info->output_buffer = queue.begin () + slot * block_bytes;
+        reset_info (info);
+
+        bool ok = (seek < 0 || seek_decoder (seek));
+        bool end = false;
+
+        if (! ok)
+            AUDERR ("Could not seek to sample %" PRId64 "!\n", seek);
+
+        while (ok && (int) info->buffer_used < block_samples)
+        {
+            if (FLAC__stream_decoder_get_state (decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+            {
+                end = true;
+                break;
+            }
+
+            if (FLAC__stream_decoder_process_single (decoder) == false)
+            {
+                AUDERR ("Error while decoding!\n");
+                ok = false;
+            }
+        }
+
+        pthread_mutex_lock (& mutex);
+
+        /* if a seek came in meanwhile, the block is stale */
+        if (seek_to < 0)
+        {
+            block_len[slot] = info->buffer_used * SAMPLE_SIZE (info->bits_per_sample);
 
-        default:
-            AUDERR("Can not convert to %u bps\n", res);
+            if (block_len[slot])
+                queue_count ++;
+
+            finished = (! ok || end);
+            failed = ! ok;
+
+            pthread_cond_signal (& filled);
+        }
     }
+
+    pthread_mutex_unlock (& mutex);
+    return nullptr;
 }
 
 static bool flac_play (const char * filename, VFSFile & file)
 {
-    void * play_buffer = nullptr;
+    pthread_t thread;
     bool error = false;
 
     info->fd = & file;
@@ -131,8 +210,6 @@ static bool flac_play (const char * filename, VFSFile & file)
         goto ERR_NO_CLOSE;
     }
 
-    play_buffer = g_malloc (BUFFER_SIZE_BYTE);
-
     if (! aud_input_open_audio (SAMPLE_FMT (info->bits_per_sample),
         info->sample_rate, info->channels))
     {
@@ -142,32 +219,84 @@ static bool flac_play (const char * filename, VFSFile & file)
 
     aud_input_set_bitrate(info->bitrate);
 
-    while (FLAC__stream_decoder_get_state(decoder) != FLAC__STREAM_DECODER_END_OF_STREAM)
+    if (! info->has_seektable)
+        seek_index.start (filename);
+
+    /* room for one more frame than needed to fill a block */
+    block_samples = aud::clamp ((int) info->sample_rate * BLOCK_MS / 1000, 1,
+     DSP_BLOCK_FRAMES) * info->channels;
+    info->buffer_size = block_samples + info->max_blocksize * info->channels;
+    block_bytes = info->buffer_size * SAMPLE_SIZE (info->bits_per_sample);
+
+    queue.insert (0, QUEUE_BLOCKS * block_bytes);
+    queue_head = queue_count = 0;
+    seek_to = -1;
+    finished = failed = quit = false;
+
+    if (pthread_create (& thread, nullptr, decode_worker, nullptr))
     {
-        if (aud_input_check_stop ())
-            break;
+        AUDERR("Could not start the decoding thread!\n");
+        error = true;
+        goto ERR_NO_CLOSE;
+    }
 
+    while (! aud_input_check_stop ())
+    {
         int seek_value = aud_input_check_seek ();
-        if (seek_value >= 0)
-            FLAC__stream_decoder_seek_absolute (decoder, (int64_t)
-             seek_value * info->sample_rate / 1000);
 
-        /* Try to decode a single frame of audio */
-        if (FLAC__stream_decoder_process_single(decoder) == false)
+        pthread_mutex_lock (& mutex);
+
+        if (seek_value >= 0 && ! failed)
         {
-            AUDERR("Error while decoding!\n");
-            error = true;
+            /* drop everything decoded ahead of the old position */
+            seek_to = (int64_t) seek_value * info->sample_rate / 1000;
+            queue_head = queue_count = 0;
+            finished = false;
+            pthread_cond_signal (& emptied);
+        }
+
+        while (! queue_count && ! finished)
+            pthread_cond_wait (& filled, & mutex);
+
+        if (! queue_count)
+        {
+            pthread_mutex_unlock (& mutex);
             break;
         }
 
-        squeeze_audio(info->output_buffer, play_buffer, info->buffer_used, info->bits_per_sample);
-        aud_input_write_audio(play_buffer, info->buffer_used * SAMPLE_SIZE(info->bits_per_sample));
+        /* the decoding thread does not touch the head block until it is
+         * released, so it can be written out without holding the lock */
+        int slot = queue_head;
+        pthread_mutex_unlock (& mutex);
+
+        /* the extra frame can take a block past DSP_BLOCK_FRAMES */
+        const char * block = queue.begin () + slot * block_bytes;
+        int chunk = DSP_BLOCK_FRAMES * info->channels * SAMPLE_SIZE (info->bits_per_sample);
+
+        for (int pos = 0; pos < block_len[slot]; pos += chunk)
+            aud_input_write_audio (block + pos, aud::min (chunk, block_len[slot] - pos));
 
-        reset_info(info);
+        pthread_mutex_lock (& mutex);
+        queue_head = (queue_head + 1) % QUEUE_BLOCKS;
+        queue_count --;
+        pthread_cond_signal (& emptied);
+        pthread_mutex_unlock (& mutex);
     }
 
+    pthread_mutex_lock (& mutex);
+    quit = true;
+    error = failed;
+    pthread_cond_signal (& emptied);
+    pthread_mutex_unlock (& mutex);
+
+    pthread_join (thread, nullptr);
+
 ERR_NO_CLOSE:
-    g_free (play_buffer);
+    seek_index.stop ();
+    queue.clear ();
+    info->output_buffer = nullptr;
+    info->buffer_size = 0;
+    info->skip_to = 0;
     reset_info(info);
 
     if (FLAC__stream_decoder_flush(decoder) == false)
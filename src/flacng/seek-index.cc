@@ -0,0 +1,80 @@
+/*
+ *  A FLAC decoder plugin for the Audacious Media Player
+ *  Copyright (C) 2015 Audacious developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "seek-index.h"
+
+#include "flacng.h"
+
+/* The frames are skipped, not decoded: libFLAC still has to parse them, since
+ * frames do not record their length, but does not reconstruct the samples. */
+static bool scan_frames (SeekIndex & index, VFSFile & file)
+{
+    FLAC__StreamDecoder * decoder = FLAC__stream_decoder_new ();
+
+    callback_info info = callback_info ();
+    info.fd = & file;
+
+    bool ok = (decoder != nullptr);
+
+    if (ok)
+    {
+        FLAC__stream_decoder_set_metadata_ignore_all (decoder);
+
+        ok = (FLAC__stream_decoder_init_stream (decoder, read_callback,
+         seek_callback, tell_callback, length_callback, eof_callback,
+         write_callback, metadata_callback, error_callback, & info) ==
+         FLAC__STREAM_DECODER_INIT_STATUS_OK &&
+         FLAC__stream_decoder_process_until_end_of_metadata (decoder));
+    }
+
+    int64_t sample = 0, next = 0;
+    bool done = false;
+
+    while (ok && ! index.cancelled ())
+    {
+        FLAC__uint64 offset;
+
+        if (! FLAC__stream_decoder_get_decode_position (decoder, & offset) ||
+         ! FLAC__stream_decoder_skip_single_frame (decoder))
+            break;
+
+        if (FLAC__stream_decoder_get_state (decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+        {
+            done = true;
+            break;
+        }
+
+        /* the sample rate is that of the frame header just read */
+        if (sample >= next)
+        {
+            index.add (SeekPoint {sample, (int64_t) offset});
+            next = sample + (int64_t) FLAC__stream_decoder_get_sample_rate (decoder) *
+             SEEK_INDEX_INTERVAL;
+        }
+
+        sample += FLAC__stream_decoder_get_blocksize (decoder);
+    }
+
+    if (decoder)
+        FLAC__stream_decoder_delete (decoder);
+
+    return done;
+}
+
+SeekIndex seek_index ("flac-seek-index", scan_frames);
@@ -0,0 +1,31 @@
+/*
+ *  A FLAC decoder plugin for the Audacious Media Player
+ *  Copyright (C) 2015 Audacious developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef FLACNG_SEEK_INDEX_H
+#define FLACNG_SEEK_INDEX_H
+
+#include "../libseekindex/seek-index.h"
+
+/* For files without a SEEKTABLE, libFLAC seeks by bisection.  Instead, the
+ * frames are indexed in the background (see libseekindex/seek-index.h); a
+ * point is the first sample of a frame and the byte offset at which it (or
+ * some padding just before it) starts. */
+extern SeekIndex seek_index;
+
+#endif
@@ -24,6 +24,7 @@
 #include <libaudcore/runtime.h>
 
 #include "flacng.h"
+#include "../libdsp/dsp.h"
 
 FLAC__StreamDecoderReadStatus read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
 {
@@ -117,20 +118,47 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
     callback_info *info = (callback_info*) client_data;
 
     if (info->channels != frame->header.channels ||
-        info->sample_rate != frame->header.sample_rate)
+        info->sample_rate != frame->header.sample_rate ||
+        info->bits_per_sample != frame->header.bits_per_sample)
     {
         return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
     }
 
-    for (unsigned sample = 0; sample < frame->header.blocksize; sample++)
+    unsigned skip = 0;
+
+    if (info->skip_to)
+    {
+        int64_t first = frame->header.number.sample_number;
+
+        if (first + frame->header.blocksize <= info->skip_to)
+            return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+
+        if (first < info->skip_to)
+            skip = info->skip_to - first;
+
+        info->skip_to = 0;
+    }
+
+    unsigned frames = frame->header.blocksize - skip;
+    unsigned samples = frames * frame->header.channels;
+
+    if (info->buffer_used + samples > info->buffer_size)
     {
-        for (unsigned channel = 0; channel < frame->header.channels; channel++)
-        {
-            *(info->write_pointer++) = buffer[channel][sample];
-            info->buffer_used += 1;
-        }
+        AUDERR("Frame of %u samples does not fit in the output buffer!\n", frames);
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
     }
 
+    const FLAC__int32 * channels[FLAC__MAX_CHANNELS];
+
+    for (unsigned channel = 0; channel < frame->header.channels; channel++)
+        channels[channel] = buffer[channel] + skip;
+
+    dsp_pack_int(channels, info->write_pointer, frame->header.channels, frames,
+        info->bits_per_sample);
+
+    info->write_pointer += samples * SAMPLE_SIZE(info->bits_per_sample);
+    info->buffer_used += samples;
+
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -158,6 +186,9 @@ void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMet
         info->sample_rate = metadata->data.stream_info.sample_rate;
         AUDDBG("sample_rate=%d\n", metadata->data.stream_info.sample_rate);
 
+        info->max_blocksize = metadata->data.stream_info.max_blocksize;
+        AUDDBG("max_blocksize=%d\n", metadata->data.stream_info.max_blocksize);
+
         size = info->fd->fsize ();
 
         if (size == -1 || info->total_samples == 0)
@@ -167,4 +198,9 @@ void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMet
 
         AUDDBG("bitrate=%d\n", info->bitrate);
     }
+    else if (metadata->type == FLAC__METADATA_TYPE_SEEKTABLE)
+    {
+        info->has_seektable = (metadata->data.seek_table.num_points > 0);
+        AUDDBG("seek points=%d\n", metadata->data.seek_table.num_points);
+    }
 }
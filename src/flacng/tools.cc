@@ -31,18 +31,13 @@ callback_info *init_callback_info(void)
     callback_info *info;
 
     info = g_new0 (callback_info, 1);
-    info->output_buffer = (int32_t*) g_malloc (BUFFER_SIZE_BYTE);
-
     reset_info(info);
 
-    AUDDBG("Playback buffer allocated for %d samples, %d bytes\n", BUFFER_SIZE_SAMP, BUFFER_SIZE_BYTE);
-
     return info;
 }
 
 void clean_callback_info(callback_info *info)
 {
-    g_free (info->output_buffer);
     g_free (info);
 }
 
@@ -57,6 +52,7 @@ bool read_metadata(FLAC__StreamDecoder *decoder, callback_info *info)
     FLAC__StreamDecoderState ret;
 
     reset_info(info);
+    info->has_seektable = false;
 
     /* Reset the decoder */
     if (FLAC__stream_decoder_reset(decoder) == false)
@@ -18,14 +18,82 @@
  */
 
 #include <assert.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
 
 #include "ladspa.h"
 #include "plugin.h"
+#include "workers.h"
 
+#include <libaudcore/audio.h>
 #include <libaudcore/runtime.h>
 
+#include "../libdsp/dsp.h"
+
+EffectStats effect_stats (N_("LADSPA Host"));
+
 static int ladspa_channels, ladspa_rate;
 
+/* The instances of a plugin process separate groups of channels, so they can
+ * run in parallel, e.g. eight instances of a mono plugin for 7.1 audio. */
+static WorkerPool workers;
+
+/* Waking the workers and waiting for them costs some tens of microseconds, so
+ * a stage that would take less than this to run inline is not worth it. */
+#define PARALLEL_MIN_NS 50000
+
+/* The audio is deinterleaved only once per block, into one of two sets of
+ * planar buffers, and goes through the whole chain of plugins before it is
+ * interleaved again.  A plugin normally reads and writes the same set; one
+ * that cannot work in place writes to the other set, which becomes the
+ * current one. */
+static Index<float> planar_bufs[2];
+
+static float * planar_buf (int set, int channel)
+{
+    return & planar_bufs[set][channel * LADSPA_BUFLEN];
+}
+
+static int output_set (const LoadedPlugin & loaded, int in_set)
+{
+    if (LADSPA_IS_INPLACE_BROKEN (loaded.plugin.properties))
+        return 1 - in_set;
+
+    return in_set;
+}
+
+static void connect_audio (LoadedPlugin & loaded, int in_set, int out_set)
+{
+    if (loaded.in_set == in_set && loaded.out_set == out_set)
+        return;
+
+    PluginData & plugin = loaded.plugin;
+    const LADSPA_Descriptor & desc = * plugin.desc;
+
+    int ports = plugin.in_ports.len ();
+    int instances = loaded.instances.len ();
+
+    for (int i = 0; i < instances; i ++)
+    {
+        LADSPA_Handle handle = loaded.instances[i];
+
+        for (int p = 0; p < ports; p ++)
+        {
+            int channel = ports * i + p;
+
+            desc.connect_port (handle, plugin.in_ports[p],
+             planar_buf (in_set, channel));
+            desc.connect_port (handle, plugin.out_ports[p],
+             planar_buf (out_set, channel));
+        }
+    }
+
+    loaded.in_set = in_set;
+    loaded.out_set = out_set;
+}
+
 static void start_plugin (LoadedPlugin & loaded)
 {
     if (loaded.active)
@@ -34,7 +102,7 @@ static void start_plugin (LoadedPlugin & loaded)
     loaded.active = 1;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int ports = plugin.in_ports.len ();
 
@@ -52,9 +120,7 @@ static void start_plugin (LoadedPlugin & loaded)
     }
 
     int instances = ladspa_channels / ports;
-
-    loaded.in_bufs.insert (0, ladspa_channels);
-    loaded.out_bufs.insert (0, ladspa_channels);
+    effect_stats.count_alloc (true);
 
     for (int i = 0; i < instances; i ++)
     {
@@ -63,89 +129,190 @@ static void start_plugin (LoadedPlugin & loaded)
 
         int controls = plugin.controls.len ();
         for (int c = 0; c < controls; c ++)
-            desc.connect_port (handle, plugin.controls[c].port, & loaded.values[c]);
-
-        for (int p = 0; p < ports; p ++)
-        {
-            int channel = ports * i + p;
-
-            Index<float> & in = loaded.in_bufs[channel];
-            in.insert (0, LADSPA_BUFLEN);
-            desc.connect_port (handle, plugin.in_ports[p], in.begin ());
+            desc.connect_port (handle, plugin.controls[c].port, & loaded.ports[c]);
+    }
 
-            Index<float> & out = loaded.out_bufs[channel];
-            out.insert (0, LADSPA_BUFLEN);
-            desc.connect_port (handle, plugin.out_ports[p], out.begin ());
-        }
+    /* the audio ports are connected again in run_chain () if need be */
+    loaded.in_set = loaded.out_set = -1;
+    connect_audio (loaded, 0, output_set (loaded, 0));
 
+    for (LADSPA_Handle handle : loaded.instances)
+    {
         if (desc.activate)
             desc.activate (handle);
     }
 }
 
-static void run_plugin (LoadedPlugin & loaded, float * data, int samples)
+/* picks up the latest values published by the main thread */
+static void update_controls (LoadedPlugin & loaded)
 {
-    if (! loaded.instances.len ())
+    if (! (loaded.shared_snapshot.load (std::memory_order_relaxed) & SNAPSHOT_FRESH))
         return;
 
-    PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    loaded.read_snapshot = loaded.shared_snapshot.exchange (loaded.read_snapshot) & 3;
 
-    int ports = plugin.in_ports.len ();
-    int instances = loaded.instances.len ();
-    assert (ports * instances == ladspa_channels);
+    Index<float> & snapshot = loaded.snapshots[loaded.read_snapshot];
+    std::copy (snapshot.begin (), snapshot.end (), loaded.ports.begin ());
+}
+
+/* A stage is a run of plugins in the chain with the same number of instances.
+ * Instance i of each plugin in the stage processes the same channels, so each
+ * instance can be taken through the whole stage on its own. */
+struct Stage
+{
+    int first, last;  /* indexes into loadeds */
+    int instances, frames;
+};
+
+static int64_t now_ns ()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/* The first instance of each plugin is timed, for stage_cost (). */
+static void run_stage_instance (void * data, int instance)
+{
+    Stage * stage = (Stage *) data;
+
+    for (int i = stage->first; i < stage->last; i ++)
+    {
+        LoadedPlugin & loaded = * loadeds[i];
+
+        if (! loaded.instances.len ())
+            continue;
+
+        int64_t start = instance ? 0 : now_ns ();
+
+        loaded.plugin.desc->run (loaded.instances[instance], stage->frames);
+
+        if (! instance)
+        {
+            float ns = (float) (now_ns () - start) / stage->frames;
+            loaded.run_ns += loaded.run_ns ? 0.1f * (ns - loaded.run_ns) : ns;
+        }
+    }
+}
+
+/* The time the stage would take to run inline, in nanoseconds, going by the
+ * blocks run so far.  Zero at first, so that a new plugin is timed inline. */
+static float stage_cost (const Stage & stage)
+{
+    float cost = 0;
+
+    for (int i = stage.first; i < stage.last; i ++)
+    {
+        if (loadeds[i]->instances.len ())
+            cost += loadeds[i]->run_ns;
+    }
+
+    return cost * stage.frames * stage.instances;
+}
+
+/* Finds the end of the stage starting at loadeds[stage.first] and connects
+ * its plugins, using the set of planar buffers <set> as input.  Returns the
+ * set holding the output. */
+static int connect_stage (Stage & stage, int set)
+{
+    int i = stage.first;
+    stage.instances = loadeds[i]->instances.len ();
+
+    for (; i < loadeds.len (); i ++)
+    {
+        LoadedPlugin & loaded = * loadeds[i];
+
+        if (! loaded.instances.len ())
+            continue;
+        if (loaded.instances.len () != stage.instances)
+            break;
+
+        assert (loaded.plugin.in_ports.len () * stage.instances == ladspa_channels);
+
+        int out_set = output_set (loaded, set);
+        connect_audio (loaded, set, out_set);
+        set = out_set;
+    }
+
+    stage.last = i;
+    return set;
+}
+
+static void run_chain (float * data, int samples)
+{
+    float * bufs[2][AUD_MAX_CHANNELS];
+
+    for (int c = 0; c < ladspa_channels; c ++)
+    {
+        bufs[0][c] = planar_buf (0, c);
+        bufs[1][c] = planar_buf (1, c);
+    }
 
     while (samples / ladspa_channels > 0)
     {
         int frames = aud::min (samples / ladspa_channels, LADSPA_BUFLEN);
+        int set = 0;
 
-        for (int i = 0; i < instances; i ++)
-        {
-            LADSPA_Handle handle = loaded.instances[i];
+        dsp_deinterleave (data, bufs[set], ladspa_channels, frames);
 
-            for (int p = 0; p < ports; p ++)
+        for (int i = 0; i < loadeds.len ();)
+        {
+            if (! loadeds[i]->instances.len ())
             {
-                int channel = ports * i + p;
-                float * get = data + channel;
-                float * in = loaded.in_bufs[channel].begin ();
-                float * in_end = in + frames;
-
-                while (in < in_end)
-                {
-                    * in ++ = * get;
-                    get += ladspa_channels;
-                }
+                i ++;
+                continue;
             }
 
-            desc.run (handle, frames);
+            Stage stage = {i, i, 0, frames};
+            set = connect_stage (stage, set);
 
-            for (int p = 0; p < ports; p ++)
+            if (stage.instances > 1 && workers.threads () &&
+             stage_cost (stage) >= PARALLEL_MIN_NS)
+                workers.run (run_stage_instance, & stage, stage.instances);
+            else
             {
-                int channel = ports * i + p;
-                float * set = data + channel;
-                float * out = loaded.out_bufs[channel].begin ();
-                float * out_end = out + frames;
-
-                while (out < out_end)
-                {
-                    * set = * out ++;
-                    set += ladspa_channels;
-                }
+                for (int t = 0; t < stage.instances; t ++)
+                    run_stage_instance (& stage, t);
             }
+
+            i = stage.last;
         }
 
+        dsp_interleave (bufs[set], data, ladspa_channels, frames);
+
         data += ladspa_channels * frames;
         samples -= ladspa_channels * frames;
     }
 }
 
+/* returns false if no plugin is running */
+static bool start_chain ()
+{
+    bool running = false;
+
+    for (auto & loaded : loadeds)
+    {
+        start_plugin (* loaded);
+        update_controls (* loaded);
+
+        if (loaded->instances.len ())
+            running = true;
+    }
+
+    return running;
+}
+
+void stop_workers ()
+{
+    workers.stop ();
+}
+
 static void flush_plugin (LoadedPlugin & loaded)
 {
     if (! loaded.instances.len ())
         return;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int instances = loaded.instances.len ();
     for (int i = 0; i < instances; i ++)
@@ -167,7 +334,7 @@ void shutdown_plugin_locked (LoadedPlugin & loaded)
         return;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int instances = loaded.instances.len ();
     for (int i = 0; i < instances; i ++)
@@ -181,8 +348,7 @@ void shutdown_plugin_locked (LoadedPlugin & loaded)
     }
 
     loaded.instances.clear ();
-    loaded.in_bufs.clear ();
-    loaded.out_bufs.clear ();
+    loaded.in_set = loaded.out_set = -1;
 }
 
 void LADSPAHost::start (int * channels, int * rate)
@@ -195,18 +361,32 @@ void LADSPAHost::start (int * channels, int * rate)
     ladspa_channels = * channels;
     ladspa_rate = * rate;
 
+    for (Index<float> & bufs : planar_bufs)
+    {
+        bufs.clear ();
+        bufs.insert (0, ladspa_channels * LADSPA_BUFLEN);
+    }
+
+    effect_stats.count_alloc ();
+
+    /* one thread per group of channels, counting the audio thread */
+    int threads = aud::min ((int) sysconf (_SC_NPROCESSORS_ONLN), ladspa_channels) - 1;
+
+    if (threads != workers.threads ())
+        workers.start (aud::max (threads, 0));
+
     pthread_mutex_unlock (& mutex);
 }
 
 void LADSPAHost::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (effect_stats, * samples);
+    DenormalGuard denormals;
+
     pthread_mutex_lock (& mutex);
 
-    for (auto & loaded : loadeds)
-    {
-        start_plugin (* loaded);
-        run_plugin (* loaded, * data, * samples);
-    }
+    if (start_chain ())
+        run_chain (* data, * samples);
 
     pthread_mutex_unlock (& mutex);
 }
@@ -223,14 +403,16 @@ void LADSPAHost::flush (void)
 
 void LADSPAHost::finish (float * * data, int * samples)
 {
+    EffectStatsScope scope (effect_stats, * samples);
+    DenormalGuard denormals;
+
     pthread_mutex_lock (& mutex);
 
+    if (start_chain ())
+        run_chain (* data, * samples);
+
     for (auto & loaded : loadeds)
-    {
-        start_plugin (* loaded);
-        run_plugin (* loaded, * data, * samples);
         shutdown_plugin_locked (* loaded);
-    }
 
     pthread_mutex_unlock (& mutex);
 }
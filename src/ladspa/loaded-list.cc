@@ -26,7 +26,7 @@ static void get_value (void * user, int row, int column, GValue * value)
     g_return_if_fail (row >= 0 && row < loadeds.len ());
     g_return_if_fail (column == 0);
 
-    g_value_set_string (value, loadeds[row]->plugin.desc.Name);
+    g_value_set_string (value, loadeds[row]->plugin.name);
 }
 
 static bool get_selected (void * user, int row)
@@ -0,0 +1,580 @@
+/*
+ * LADSPA Host for Audacious
+ * Copyright 2011-2015 John Lindgren and Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <gmodule.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/mainloop.h>
+#include <libaudcore/runtime.h>
+
+#include "plugin.h"
+
+/* Opening every module in LADSPA_PATH is slow when large collections are
+ * installed, so what we need to know about each plugin (names, ports, control
+ * ranges) is kept in an index file.  An entry is used as long as the module
+ * has the same modification time and size.  Modules are opened only when one
+ * of their plugins is enabled.  Stale modules are scanned in a background
+ * thread, except those with plugins enabled in the config, which are needed
+ * at once. */
+
+#define INDEX_HEADER "ladspa-index 1"
+
+Index<SmartPtr<ModuleData>> modules;
+Index<PluginData *> plugins;
+
+static pthread_t scan_thread;
+static bool scan_running;
+static std::atomic<bool> scan_cancel;
+static Index<SmartPtr<ModuleData>> scan_modules;  /* owned by the scan thread */
+static QueuedFunc scan_done;
+
+static ControlData parse_control (const LADSPA_Descriptor & desc, int port)
+{
+    const LADSPA_PortRangeHint & hint = desc.PortRangeHints[port];
+
+    ControlData control;
+    control.port = port;
+    control.name = String (desc.PortNames[port]);
+    control.is_toggle = LADSPA_IS_HINT_TOGGLED (hint.HintDescriptor) ? 1 : 0;
+
+    control.min = LADSPA_IS_HINT_BOUNDED_BELOW (hint.HintDescriptor) ? hint.LowerBound :
+     LADSPA_IS_HINT_BOUNDED_ABOVE (hint.HintDescriptor) ? hint.UpperBound - 100 : -100;
+    control.max = LADSPA_IS_HINT_BOUNDED_ABOVE (hint.HintDescriptor) ? hint.UpperBound :
+     LADSPA_IS_HINT_BOUNDED_BELOW (hint.HintDescriptor) ? hint.LowerBound + 100 : 100;
+
+    if (LADSPA_IS_HINT_SAMPLE_RATE (hint.HintDescriptor))
+    {
+        control.min *= 96000;
+        control.max *= 96000;
+    }
+
+    if (LADSPA_IS_HINT_DEFAULT_0 (hint.HintDescriptor))
+        control.def = 0;
+    else if (LADSPA_IS_HINT_DEFAULT_1 (hint.HintDescriptor))
+        control.def = 1;
+    else if (LADSPA_IS_HINT_DEFAULT_100 (hint.HintDescriptor))
+        control.def = 100;
+    else if (LADSPA_IS_HINT_DEFAULT_440 (hint.HintDescriptor))
+        control.def = 440;
+    else if (LADSPA_IS_HINT_DEFAULT_MINIMUM (hint.HintDescriptor))
+        control.def = control.min;
+    else if (LADSPA_IS_HINT_DEFAULT_MAXIMUM (hint.HintDescriptor))
+        control.def = control.max;
+    else if (LADSPA_IS_HINT_DEFAULT_LOW (hint.HintDescriptor))
+    {
+        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
+            control.def = expf (0.75 * logf (control.min) + 0.25 * logf (control.max));
+        else
+            control.def = 0.75 * control.min + 0.25 * control.max;
+    }
+    else if (LADSPA_IS_HINT_DEFAULT_HIGH (hint.HintDescriptor))
+    {
+        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
+            control.def = expf (0.25 * logf (control.min) + 0.75 * logf (control.max));
+        else
+            control.def = 0.25 * control.min + 0.75 * control.max;
+    }
+    else
+    {
+        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
+            control.def = expf (0.5 * logf (control.min) + 0.5 * logf (control.max));
+        else
+            control.def = 0.5 * control.min + 0.5 * control.max;
+    }
+
+    return control;
+}
+
+static PluginData * open_plugin (ModuleData & module, int index, const LADSPA_Descriptor & desc)
+{
+    const char * slash = strrchr (module.path, G_DIR_SEPARATOR);
+    g_return_val_if_fail (slash && slash[1], nullptr);
+    g_return_val_if_fail (desc.Label && desc.Name, nullptr);
+
+    PluginData & plugin = * module.plugins.append (SmartNew<PluginData> (slash + 1, module, index));
+
+    plugin.label = String (desc.Label);
+    plugin.name = String (desc.Name);
+    plugin.properties = desc.Properties;
+
+    for (unsigned i = 0; i < desc.PortCount; i ++)
+    {
+        if (LADSPA_IS_PORT_CONTROL (desc.PortDescriptors[i]))
+            plugin.controls.append (parse_control (desc, i));
+        else if (LADSPA_IS_PORT_AUDIO (desc.PortDescriptors[i]) &&
+         LADSPA_IS_PORT_INPUT (desc.PortDescriptors[i]))
+            plugin.in_ports.append (i);
+        else if (LADSPA_IS_PORT_AUDIO (desc.PortDescriptors[i]) &&
+         LADSPA_IS_PORT_OUTPUT (desc.PortDescriptors[i]))
+            plugin.out_ports.append (i);
+    }
+
+    return & plugin;
+}
+
+static LADSPA_Descriptor_Function open_module (ModuleData & module)
+{
+    if (! module.handle)
+    {
+        module.handle = g_module_open (module.path, G_MODULE_BIND_LOCAL);
+        if (! module.handle)
+        {
+            AUDERR ("Failed to open module %s: %s\n", (const char *) module.path,
+             g_module_error ());
+            return nullptr;
+        }
+    }
+
+    void * sym;
+    if (! g_module_symbol (module.handle, "ladspa_descriptor", & sym))
+    {
+        AUDERR ("Not a valid LADSPA module: %s\n", (const char *) module.path);
+        g_module_close (module.handle);
+        module.handle = nullptr;
+        return nullptr;
+    }
+
+    return (LADSPA_Descriptor_Function) sym;
+}
+
+/* Reads all the descriptors in a module, which is closed again unless
+ * <keep_open> is set. */
+static void scan_module (ModuleData & module, bool keep_open)
+{
+    AUDDBG ("Scanning %s.\n", (const char *) module.path);
+
+    LADSPA_Descriptor_Function descfun = open_module (module);
+    if (! descfun)
+        return;
+
+    const LADSPA_Descriptor * desc;
+    for (int i = 0; (desc = descfun (i)); i ++)
+    {
+        PluginData * plugin = open_plugin (module, i, * desc);
+
+        if (plugin && keep_open)
+            plugin->desc = desc;
+    }
+
+    if (! keep_open)
+    {
+        g_module_close (module.handle);
+        module.handle = nullptr;
+    }
+}
+
+static void save_index ();
+
+bool load_descriptor (PluginData & plugin)
+{
+    if (plugin.desc)
+        return true;
+
+    LADSPA_Descriptor_Function descfun = open_module (plugin.module);
+    if (! descfun)
+        return false;
+
+    const LADSPA_Descriptor * desc = descfun (plugin.index);
+
+    /* the module was changed without its size or time changing */
+    if (! desc || ! desc->Label || strcmp (desc->Label, plugin.label) ||
+     (int) desc->PortCount != plugin.in_ports.len () + plugin.out_ports.len () +
+     plugin.controls.len ())
+    {
+        AUDERR ("Plugin %s has changed in %s.\n", (const char *) plugin.label,
+         (const char *) plugin.module.path);
+
+        /* force a rescan next time */
+        plugin.module.mtime = -1;
+        save_index ();
+        return false;
+    }
+
+    plugin.desc = desc;
+    return true;
+}
+
+/* ---- index file ---- */
+
+static StringBuf index_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "ladspa-index"});
+}
+
+/* tabs and line breaks would break the file format */
+static void append_field (GString * out, const char * field)
+{
+    g_string_append_c (out, '\t');
+
+    for (const char * c = field; * c; c ++)
+        g_string_append_c (out, (* c == '\t' || * c == '\n' || * c == '\r') ? ' ' : * c);
+}
+
+static void append_int (GString * out, int64_t val)
+{
+    g_string_append_printf (out, "\t%" G_GINT64_FORMAT, (gint64) val);
+}
+
+static void append_number (GString * out, double val)
+{
+    char buf[G_ASCII_DTOSTR_BUF_SIZE];
+    append_field (out, g_ascii_formatd (buf, sizeof buf, "%.9g", val));
+}
+
+static void save_index ()
+{
+    GString * out = g_string_new (INDEX_HEADER "\n");
+
+    for (auto & module : modules)
+    {
+        g_string_append (out, "module");
+        append_int (out, module->mtime);
+        append_int (out, module->size);
+        append_field (out, module->path);
+        g_string_append_c (out, '\n');
+
+        for (auto & plugin : module->plugins)
+        {
+            g_string_append (out, "plugin");
+            append_int (out, plugin->index);
+            append_int (out, plugin->properties);
+            append_field (out, plugin->label);
+            append_field (out, plugin->name);
+            g_string_append_c (out, '\n');
+
+            for (int port : plugin->in_ports)
+            {
+                g_string_append (out, "input");
+                append_int (out, port);
+                g_string_append_c (out, '\n');
+            }
+
+            for (int port : plugin->out_ports)
+            {
+                g_string_append (out, "output");
+                append_int (out, port);
+                g_string_append_c (out, '\n');
+            }
+
+            for (auto & control : plugin->controls)
+            {
+                g_string_append (out, "control");
+                append_int (out, control.port);
+                append_int (out, control.is_toggle);
+                append_number (out, control.min);
+                append_number (out, control.max);
+                append_number (out, control.def);
+                append_field (out, control.name);
+                g_string_append_c (out, '\n');
+            }
+        }
+    }
+
+    StringBuf path = index_path ();
+    GError * err = nullptr;
+
+    /* written to a temporary file and renamed, so never left half-written */
+    if (! g_file_set_contents (path, out->str, out->len, & err))
+    {
+        AUDERR ("Failed to write %s: %s\n", (const char *) path, err->message);
+        g_error_free (err);
+    }
+
+    g_string_free (out, true);
+}
+
+static Index<SmartPtr<ModuleData>> load_index ()
+{
+    Index<SmartPtr<ModuleData>> index;
+
+    char * data;
+    if (! g_file_get_contents (index_path (), & data, nullptr, nullptr))
+        return index;
+
+    char * * lines = g_strsplit (data, "\n", -1);
+    g_free (data);
+
+    if (! lines[0] || strcmp (lines[0], INDEX_HEADER))
+    {
+        AUDINFO ("Ignoring old or invalid LADSPA index.\n");
+        g_strfreev (lines);
+        return index;
+    }
+
+    ModuleData * module = nullptr;
+    PluginData * plugin = nullptr;
+
+    for (int i = 1; lines[i]; i ++)
+    {
+        char * * fields = g_strsplit (lines[i], "\t", -1);
+        int n_fields = g_strv_length (fields);
+
+        if (! strcmp (fields[0], "module") && n_fields == 4)
+        {
+            module = index.append (SmartNew<ModuleData> ()).get ();
+            module->mtime = g_ascii_strtoll (fields[1], nullptr, 10);
+            module->size = g_ascii_strtoll (fields[2], nullptr, 10);
+            module->path = String (fields[3]);
+            plugin = nullptr;
+        }
+        else if (! strcmp (fields[0], "plugin") && n_fields == 5 && module)
+        {
+            const char * slash = strrchr (module->path, G_DIR_SEPARATOR);
+
+            plugin = module->plugins.append (SmartNew<PluginData> (slash ? slash + 1 :
+             (const char *) module->path, * module, atoi (fields[1]))).get ();
+            plugin->properties = atoi (fields[2]);
+            plugin->label = String (fields[3]);
+            plugin->name = String (fields[4]);
+        }
+        else if (! strcmp (fields[0], "input") && n_fields == 2 && plugin)
+            plugin->in_ports.append (atoi (fields[1]));
+        else if (! strcmp (fields[0], "output") && n_fields == 2 && plugin)
+            plugin->out_ports.append (atoi (fields[1]));
+        else if (! strcmp (fields[0], "control") && n_fields == 7 && plugin)
+        {
+            ControlData control;
+            control.port = atoi (fields[1]);
+            control.is_toggle = atoi (fields[2]);
+            control.min = g_ascii_strtod (fields[3], nullptr);
+            control.max = g_ascii_strtod (fields[4], nullptr);
+            control.def = g_ascii_strtod (fields[5], nullptr);
+            control.name = String (fields[6]);
+            plugin->controls.append (std::move (control));
+        }
+
+        g_strfreev (fields);
+    }
+
+    g_strfreev (lines);
+    return index;
+}
+
+/* ---- scanning ---- */
+
+static void list_plugins ()
+{
+    plugins.clear ();
+
+    for (auto & module : modules)
+    {
+        for (auto & plugin : module->plugins)
+            plugins.append (plugin.get ());
+    }
+}
+
+static void scan_finished (void *)
+{
+    pthread_join (scan_thread, nullptr);
+    scan_running = false;
+
+    pthread_mutex_lock (& mutex);
+
+    for (auto & module : scan_modules)
+        modules.append (std::move (module));
+
+    scan_modules.clear ();
+
+    list_plugins ();
+
+    pthread_mutex_unlock (& mutex);
+
+    save_index ();
+
+    if (plugin_list)
+        update_plugin_list (plugin_list);
+}
+
+static void * scan_worker (void *)
+{
+    for (auto & module : scan_modules)
+    {
+        if (scan_cancel.load (std::memory_order_relaxed))
+            break;
+
+        scan_module (* module, false);
+    }
+
+    scan_done.queue (scan_finished, nullptr);
+    return nullptr;
+}
+
+static void stop_scan ()
+{
+    if (! scan_running)
+        return;
+
+    scan_cancel.store (true, std::memory_order_relaxed);
+    pthread_join (scan_thread, nullptr);
+    scan_done.stop ();
+
+    scan_modules.clear ();
+    scan_running = false;
+}
+
+static bool find_module (const Index<SmartPtr<ModuleData>> & list, const char * path)
+{
+    for (auto & module : list)
+    {
+        if (! strcmp (module->path, path))
+            return true;
+    }
+
+    return false;
+}
+
+static SmartPtr<ModuleData> take_cached (Index<SmartPtr<ModuleData>> & cache,
+ const char * path, const struct stat & info)
+{
+    for (auto & module : cache)
+    {
+        if (module && ! strcmp (module->path, path) &&
+         module->mtime == (int64_t) info.st_mtime && module->size == (int64_t) info.st_size)
+            return std::move (module);
+    }
+
+    return SmartPtr<ModuleData> ();
+}
+
+static void open_modules_for_path (const char * path, Index<SmartPtr<ModuleData>> & cache,
+ const Index<String> & needed, bool & changed)
+{
+    GDir * folder = g_dir_open (path, 0, nullptr);
+    if (! folder)
+    {
+        AUDERR ("Failed to read folder %s: %s\n", path, strerror (errno));
+        return;
+    }
+
+    const char * name;
+    while ((name = g_dir_read_name (folder)))
+    {
+        if (! str_has_suffix_nocase (name, G_MODULE_SUFFIX))
+            continue;
+
+        StringBuf filename = filename_build ({path, name});
+
+        struct stat info;
+        if (stat (filename, & info) < 0 || ! S_ISREG (info.st_mode))
+            continue;
+
+        if (find_module (modules, filename) || find_module (scan_modules, filename))
+            continue;
+
+        SmartPtr<ModuleData> module = take_cached (cache, filename, info);
+
+        if (module)
+        {
+            modules.append (std::move (module));
+            continue;
+        }
+
+        module = SmartNew<ModuleData> ();
+        module->path = String (filename);
+        module->mtime = info.st_mtime;
+        module->size = info.st_size;
+
+        bool is_needed = false;
+        for (const String & n : needed)
+            is_needed = is_needed || ! strcmp (n, name);
+
+        if (is_needed)
+        {
+            scan_module (* module, true);
+            modules.append (std::move (module));
+        }
+        else
+            scan_modules.append (std::move (module));
+
+        changed = true;
+    }
+
+    g_dir_close (folder);
+}
+
+static void open_modules_for_paths (const char * paths, Index<SmartPtr<ModuleData>> & cache,
+ const Index<String> & needed, bool & changed)
+{
+    if (! paths || ! paths[0])
+        return;
+
+    char * * split = g_strsplit (paths, ":", -1);
+
+    for (int i = 0; split[i]; i ++)
+        open_modules_for_path (split[i], cache, needed, changed);
+
+    g_strfreev (split);
+}
+
+void open_modules (const Index<String> & needed)
+{
+    Index<SmartPtr<ModuleData>> cache = load_index ();
+    bool changed = false;
+
+    open_modules_for_paths (getenv ("LADSPA_PATH"), cache, needed, changed);
+    open_modules_for_paths (module_path, cache, needed, changed);
+
+    list_plugins ();
+
+    /* modules removed or no longer in the path */
+    for (auto & module : cache)
+        changed = changed || module;
+
+    if (scan_modules.len ())
+    {
+        scan_cancel.store (false, std::memory_order_relaxed);
+        scan_running = ! pthread_create (& scan_thread, nullptr, scan_worker, nullptr);
+
+        if (! scan_running)
+        {
+            for (auto & module : scan_modules)
+            {
+                scan_module (* module, false);
+                modules.append (std::move (module));
+            }
+
+            scan_modules.clear ();
+            list_plugins ();
+        }
+    }
+
+    if (changed && ! scan_running)
+        save_index ();
+}
+
+void close_modules ()
+{
+    stop_scan ();
+
+    plugins.clear ();
+
+    for (auto & module : modules)
+    {
+        if (module->handle)
+            g_module_close (module->handle);
+    }
+
+    modules.clear ();
+}
@@ -17,14 +17,11 @@
  * the use of this software.
  */
 
-#include <errno.h>
-#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <algorithm>
 
-#include <gmodule.h>
 #include <gtk/gtk.h>
 
 #include <libaudcore/audstrings.h>
@@ -39,176 +36,37 @@ const char * const LADSPAHost::defaults[] = {
 
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 String module_path;
-Index<GModule *> modules;
-Index<SmartPtr<PluginData>> plugins;
 Index<SmartPtr<LoadedPlugin>> loadeds;
 
 GtkWidget * plugin_list;
 GtkWidget * loaded_list;
 
-static ControlData parse_control (const LADSPA_Descriptor & desc, int port)
+SmartPtr<LoadedPlugin> create_loaded (PluginData & plugin)
 {
-    const LADSPA_PortRangeHint & hint = desc.PortRangeHints[port];
+    if (! load_descriptor (plugin))
+        return SmartPtr<LoadedPlugin> ();
 
-    ControlData control;
-    control.port = port;
-    control.name = String (desc.PortNames[port]);
-    control.is_toggle = LADSPA_IS_HINT_TOGGLED (hint.HintDescriptor) ? 1 : 0;
+    SmartPtr<LoadedPlugin> loaded = SmartNew<LoadedPlugin> (plugin);
 
-    control.min = LADSPA_IS_HINT_BOUNDED_BELOW (hint.HintDescriptor) ? hint.LowerBound :
-     LADSPA_IS_HINT_BOUNDED_ABOVE (hint.HintDescriptor) ? hint.UpperBound - 100 : -100;
-    control.max = LADSPA_IS_HINT_BOUNDED_ABOVE (hint.HintDescriptor) ? hint.UpperBound :
-     LADSPA_IS_HINT_BOUNDED_BELOW (hint.HintDescriptor) ? hint.LowerBound + 100 : 100;
-
-    if (LADSPA_IS_HINT_SAMPLE_RATE (hint.HintDescriptor))
-    {
-        control.min *= 96000;
-        control.max *= 96000;
-    }
-
-    if (LADSPA_IS_HINT_DEFAULT_0 (hint.HintDescriptor))
-        control.def = 0;
-    else if (LADSPA_IS_HINT_DEFAULT_1 (hint.HintDescriptor))
-        control.def = 1;
-    else if (LADSPA_IS_HINT_DEFAULT_100 (hint.HintDescriptor))
-        control.def = 100;
-    else if (LADSPA_IS_HINT_DEFAULT_440 (hint.HintDescriptor))
-        control.def = 440;
-    else if (LADSPA_IS_HINT_DEFAULT_MINIMUM (hint.HintDescriptor))
-        control.def = control.min;
-    else if (LADSPA_IS_HINT_DEFAULT_MAXIMUM (hint.HintDescriptor))
-        control.def = control.max;
-    else if (LADSPA_IS_HINT_DEFAULT_LOW (hint.HintDescriptor))
-    {
-        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
-            control.def = expf (0.75 * logf (control.min) + 0.25 * logf (control.max));
-        else
-            control.def = 0.75 * control.min + 0.25 * control.max;
-    }
-    else if (LADSPA_IS_HINT_DEFAULT_HIGH (hint.HintDescriptor))
-    {
-        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
-            control.def = expf (0.25 * logf (control.min) + 0.75 * logf (control.max));
-        else
-            control.def = 0.25 * control.min + 0.75 * control.max;
-    }
-    else
-    {
-        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
-            control.def = expf (0.5 * logf (control.min) + 0.5 * logf (control.max));
-        else
-            control.def = 0.5 * control.min + 0.5 * control.max;
-    }
-
-    return control;
-}
-
-static void open_plugin (const char * path, const LADSPA_Descriptor & desc)
-{
-    const char * slash = strrchr (path, G_DIR_SEPARATOR);
-    g_return_if_fail (slash && slash[1]);
-    g_return_if_fail (desc.Label && desc.Name);
-
-    PluginData & plugin = * plugins.append (SmartNew<PluginData> (slash + 1, desc));
-
-    for (unsigned i = 0; i < desc.PortCount; i ++)
-    {
-        if (LADSPA_IS_PORT_CONTROL (desc.PortDescriptors[i]))
-            plugin.controls.append (parse_control (desc, i));
-        else if (LADSPA_IS_PORT_AUDIO (desc.PortDescriptors[i]) &&
-         LADSPA_IS_PORT_INPUT (desc.PortDescriptors[i]))
-            plugin.in_ports.append (i);
-        else if (LADSPA_IS_PORT_AUDIO (desc.PortDescriptors[i]) &&
-         LADSPA_IS_PORT_OUTPUT (desc.PortDescriptors[i]))
-            plugin.out_ports.append (i);
-    }
-}
-
-static GModule * open_module (const char * path)
-{
-    GModule * handle = g_module_open (path, G_MODULE_BIND_LOCAL);
-    if (! handle)
-    {
-        AUDERR ("Failed to open module %s: %s\n", path, g_module_error ());
-        return nullptr;
-    }
-
-    void * sym;
-    if (! g_module_symbol (handle, "ladspa_descriptor", & sym))
-    {
-        AUDERR ("Not a valid LADSPA module: %s\n", path);
-        g_module_close (handle);
-        return nullptr;
-    }
-
-    LADSPA_Descriptor_Function descfun = (LADSPA_Descriptor_Function) sym;
-
-    const LADSPA_Descriptor * desc;
-    for (int i = 0; (desc = descfun (i)); i ++)
-        open_plugin (path, * desc);
-
-    return handle;
-}
-
-static void open_modules_for_path (const char * path)
-{
-    GDir * folder = g_dir_open (path, 0, nullptr);
-    if (! folder)
-    {
-        AUDERR ("Failed to read folder %s: %s\n", path, strerror (errno));
-        return;
-    }
-
-    const char * name;
-    while ((name = g_dir_read_name (folder)))
-    {
-        if (! str_has_suffix_nocase (name, G_MODULE_SUFFIX))
-            continue;
-
-        GModule * handle = open_module (filename_build ({path, name}));
-
-        if (handle)
-            modules.append (handle);
-    }
-
-    g_dir_close (folder);
-}
-
-static void open_modules_for_paths (const char * paths)
-{
-    if (! paths || ! paths[0])
-        return;
-
-    char * * split = g_strsplit (paths, ":", -1);
-
-    for (int i = 0; split[i]; i ++)
-        open_modules_for_path (split[i]);
-
-    g_strfreev (split);
-}
+    for (auto & control : plugin.controls)
+        loaded->values.append (control.def);
 
-static void open_modules ()
-{
-    open_modules_for_paths (getenv ("LADSPA_PATH"));
-    open_modules_for_paths (module_path);
-}
+    int count = loaded->values.len ();
+    loaded->ports.insert (loaded->values.begin (), 0, count);
 
-static void close_modules ()
-{
-    plugins.clear ();
+    for (Index<float> & snapshot : loaded->snapshots)
+        snapshot.insert (0, count);
 
-    for (GModule * module : modules)
-        g_module_close (module);
+    return loaded;
 }
 
-LoadedPlugin & enable_plugin_locked (PluginData & plugin)
+void publish_controls (LoadedPlugin & loaded)
 {
-    LoadedPlugin & loaded = * loadeds.append (SmartNew<LoadedPlugin> (plugin));
+    Index<float> & snapshot = loaded.snapshots[loaded.write_snapshot];
+    std::copy (loaded.values.begin (), loaded.values.end (), snapshot.begin ());
 
-    for (auto & control : plugin.controls)
-        loaded.values.append (control.def);
-
-    return loaded;
+    loaded.write_snapshot = loaded.shared_snapshot.exchange
+     (loaded.write_snapshot | SNAPSHOT_FRESH) & 3;
 }
 
 void disable_plugin_locked (LoadedPlugin & loaded)
@@ -221,10 +79,10 @@ void disable_plugin_locked (LoadedPlugin & loaded)
 
 static PluginData * find_plugin (const char * path, const char * label)
 {
-    for (auto & plugin : plugins)
+    for (PluginData * plugin : plugins)
     {
-        if (! strcmp (plugin->path, path) && ! strcmp (plugin->desc.Label, label))
-            return plugin.get ();
+        if (! strcmp (plugin->path, path) && ! strcmp (plugin->label, label))
+            return plugin;
     }
 
     return nullptr;
@@ -241,7 +99,7 @@ static void save_enabled_to_config ()
         LoadedPlugin & loaded = * loadeds[i];
 
         aud_set_str ("ladspa", str_printf ("plugin%d_path", i), loaded.plugin.path);
-        aud_set_str ("ladspa", str_printf ("plugin%d_label", i), loaded.plugin.desc.Label);
+        aud_set_str ("ladspa", str_printf ("plugin%d_label", i), loaded.plugin.label);
 
         Index<double> temp;
         temp.insert (0, loaded.values.len ());
@@ -266,6 +124,7 @@ static void save_enabled_to_config ()
 static void load_enabled_from_config ()
 {
     int count = aud_get_int ("ladspa", "plugin_count");
+    Index<SmartPtr<LoadedPlugin>> added;
 
     for (int i = 0; i < count; i ++)
     {
@@ -276,7 +135,11 @@ static void load_enabled_from_config ()
         if (! plugin)
             continue;
 
-        LoadedPlugin & loaded = enable_plugin_locked (* plugin);
+        SmartPtr<LoadedPlugin> loaded_ptr = create_loaded (* plugin);
+        if (! loaded_ptr)
+            continue;
+
+        LoadedPlugin & loaded = * loaded_ptr;
 
         String controls = aud_get_str ("ladspa", str_printf ("plugin%d_controls", i));
 
@@ -295,55 +158,74 @@ static void load_enabled_from_config ()
                 aud_set_str ("ladspa", key, "");
             }
         }
+
+        std::copy (loaded.values.begin (), loaded.values.end (), loaded.ports.begin ());
+        added.append (std::move (loaded_ptr));
     }
+
+    pthread_mutex_lock (& mutex);
+    loadeds.move_from (added, 0, -1, -1, true, true);
+    pthread_mutex_unlock (& mutex);
 }
 
-bool LADSPAHost::init ()
+/* the modules with plugins enabled in the config */
+static Index<String> enabled_modules ()
 {
-    pthread_mutex_lock (& mutex);
+    Index<String> names;
+    int count = aud_get_int ("ladspa", "plugin_count");
+
+    for (int i = 0; i < count; i ++)
+        names.append (aud_get_str ("ladspa", str_printf ("plugin%d_path", i)));
 
+    return names;
+}
+
+/* Opening modules and writing the index are slow, so the mutex is held only
+ * while loadeds is changed, never while the audio thread would wait on them. */
+
+bool LADSPAHost::init ()
+{
     aud_config_set_defaults ("ladspa", defaults);
 
     module_path = aud_get_str ("ladspa", "module_path");
 
-    open_modules ();
+    open_modules (enabled_modules ());
     load_enabled_from_config ();
 
-    pthread_mutex_unlock (& mutex);
+    effect_stats.attach ();
     return true;
 }
 
 void LADSPAHost::cleanup ()
 {
-    pthread_mutex_lock (& mutex);
+    effect_stats.detach ();
 
     aud_set_str ("ladspa", "module_path", module_path);
+
+    pthread_mutex_lock (& mutex);
     save_enabled_to_config ();
-    close_modules ();
+    pthread_mutex_unlock (& mutex);
 
-    modules.clear ();
-    plugins.clear ();
-    loadeds.clear ();
+    /* the audio thread no longer sees any plugin */
+    close_modules ();
+    stop_workers ();
 
     module_path = String ();
-
-    pthread_mutex_unlock (& mutex);
 }
 
 static void set_module_path (GtkEntry * entry)
 {
     pthread_mutex_lock (& mutex);
-
     save_enabled_to_config ();
+    pthread_mutex_unlock (& mutex);
+
     close_modules ();
 
     module_path = String (gtk_entry_get_text (entry));
 
-    open_modules ();
+    open_modules (enabled_modules ());
     load_enabled_from_config ();
 
-    pthread_mutex_unlock (& mutex);
-
     if (plugin_list)
         update_plugin_list (plugin_list);
     if (loaded_list)
@@ -352,14 +234,20 @@ static void set_module_path (GtkEntry * entry)
 
 static void enable_selected ()
 {
-    pthread_mutex_lock (& mutex);
+    Index<SmartPtr<LoadedPlugin>> added;
 
-    for (auto & plugin : plugins)
+    for (PluginData * plugin : plugins)
     {
-        if (plugin->selected)
-            enable_plugin_locked (* plugin);
+        if (! plugin->selected)
+            continue;
+
+        SmartPtr<LoadedPlugin> loaded = create_loaded (* plugin);
+        if (loaded)
+            added.append (std::move (loaded));
     }
 
+    pthread_mutex_lock (& mutex);
+    loadeds.move_from (added, 0, -1, -1, true, true);
     pthread_mutex_unlock (& mutex);
 
     if (loaded_list)
@@ -387,18 +275,23 @@ static void disable_selected ()
         update_loaded_list (loaded_list);
 }
 
-static void control_toggled (GtkToggleButton * toggle, float * value)
+/* The controls are changed without locking the mutex, so that moving them
+ * never holds up the audio thread. */
+static int control_index (void * widget)
 {
-    pthread_mutex_lock (& mutex);
-    * value = gtk_toggle_button_get_active (toggle) ? 1 : 0;
-    pthread_mutex_unlock (& mutex);
+    return GPOINTER_TO_INT (g_object_get_data ((GObject *) widget, "ladspa-control"));
 }
 
-static void control_changed (GtkSpinButton * spin, float * value)
+static void control_toggled (GtkToggleButton * toggle, LoadedPlugin * loaded)
 {
-    pthread_mutex_lock (& mutex);
-    * value = gtk_spin_button_get_value (spin);
-    pthread_mutex_unlock (& mutex);
+    loaded->values[control_index (toggle)] = gtk_toggle_button_get_active (toggle) ? 1 : 0;
+    publish_controls (* loaded);
+}
+
+static void control_changed (GtkSpinButton * spin, LoadedPlugin * loaded)
+{
+    loaded->values[control_index (spin)] = gtk_spin_button_get_value (spin);
+    publish_controls (* loaded);
 }
 
 static void configure_plugin (LoadedPlugin & loaded)
@@ -411,7 +304,7 @@ static void configure_plugin (LoadedPlugin & loaded)
 
     PluginData & plugin = loaded.plugin;
 
-    StringBuf title = str_printf (_("%s Settings"), plugin.desc.Name);
+    StringBuf title = str_printf (_("%s Settings"), (const char *) plugin.name);
     loaded.settings_win = gtk_dialog_new_with_buttons (title, nullptr,
      (GtkDialogFlags) 0, _("_Close"), GTK_RESPONSE_CLOSE, nullptr);
     gtk_window_set_resizable ((GtkWindow *) loaded.settings_win, 0);
@@ -432,7 +325,8 @@ static void configure_plugin (LoadedPlugin & loaded)
             gtk_toggle_button_set_active ((GtkToggleButton *) toggle, (loaded.values[i] > 0) ? 1 : 0);
             gtk_box_pack_start ((GtkBox *) hbox, toggle, 0, 0, 0);
 
-            g_signal_connect (toggle, "toggled", (GCallback) control_toggled, & loaded.values[i]);
+            g_object_set_data ((GObject *) toggle, "ladspa-control", GINT_TO_POINTER (i));
+            g_signal_connect (toggle, "toggled", (GCallback) control_toggled, & loaded);
         }
         else
         {
@@ -443,7 +337,8 @@ static void configure_plugin (LoadedPlugin & loaded)
             gtk_spin_button_set_value ((GtkSpinButton *) spin, loaded.values[i]);
             gtk_box_pack_start ((GtkBox *) hbox, spin, 0, 0, 0);
 
-            g_signal_connect (spin, "value-changed", (GCallback) control_changed, & loaded.values[i]);
+            g_object_set_data ((GObject *) spin, "ladspa-control", GINT_TO_POINTER (i));
+            g_signal_connect (spin, "value-changed", (GCallback) control_changed, & loaded);
         }
     }
 
@@ -23,10 +23,13 @@
 #include <pthread.h>
 #include <gtk/gtk.h>
 
+#include <atomic>
+
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 
 #include "ladspa.h"
+#include "../libdsp/stats.h"
 
 #define LADSPA_BUFLEN 1024
 
@@ -39,27 +42,54 @@ struct ControlData {
     float min, max, def;
 };
 
+struct ModuleData;
+
+/* Everything but the descriptor itself may come from the index file (see
+ * modules.cc); the descriptor is looked up by load_descriptor (). */
 struct PluginData
 {
-    String path;
-    const LADSPA_Descriptor & desc;
+    String path;  /* file name of the module */
+    ModuleData & module;
+    int index;    /* argument to ladspa_descriptor () */
+    String label, name;
+    int properties = 0;
     Index<ControlData> controls;
     Index<int> in_ports, out_ports;
+    const LADSPA_Descriptor * desc = nullptr;
     bool selected = false;
 
-    PluginData (const char * path, const LADSPA_Descriptor & desc) :
+    PluginData (const char * path, ModuleData & module, int index) :
         path (path),
-        desc (desc) {}
+        module (module),
+        index (index) {}
+};
+
+struct ModuleData
+{
+    String path;
+    int64_t mtime = 0, size = 0;
+    Index<SmartPtr<PluginData>> plugins;
+    GModule * handle = nullptr;  /* opened on demand */
 };
 
 struct LoadedPlugin
 {
     PluginData & plugin;
-    Index<float> values;
+    Index<float> values;  /* edited by the main thread */
+    Index<float> ports;   /* connected to the plugin, read by the audio thread */
+
+    /* Lock-free triple buffer through which the main thread passes new values
+     * to the audio thread (see publish_controls).  Each thread owns one
+     * snapshot; the third is exchanged between them. */
+    Index<float> snapshots[3];
+    int write_snapshot = 0, read_snapshot = 1;
+    std::atomic<int> shared_snapshot {2};
+
     bool selected = false;
     bool active = false;
     Index<LADSPA_Handle> instances;
-    Index<Index<float>> in_bufs, out_bufs;
+    int in_set = -1, out_set = -1;  /* planar buffers connected to the ports */
+    float run_ns = 0;  /* average time per frame of one instance */
     GtkWidget * settings_win = nullptr;
 
     LoadedPlugin (PluginData & plugin) :
@@ -100,19 +130,46 @@ public:
 
 extern pthread_mutex_t mutex;
 extern String module_path;
-extern Index<GModule *> modules;
-extern Index<SmartPtr<PluginData>> plugins;
 extern Index<SmartPtr<LoadedPlugin>> loadeds;
 
 extern GtkWidget * plugin_list;
 extern GtkWidget * loaded_list;
 
-LoadedPlugin & enable_plugin_locked (PluginData & plugin);
+/* Opens the plugin's module if need be, which is slow, so the mutex should not
+ * be locked.  The result is added to loadeds afterward, with the mutex locked.
+ * Returns nullptr if the module cannot be loaded. */
+SmartPtr<LoadedPlugin> create_loaded (PluginData & plugin);
 void disable_plugin_locked (LoadedPlugin & loaded);
 
+/* Makes the current values of a plugin's controls visible to the audio thread
+ * (main thread only).  The mutex need not be locked. */
+void publish_controls (LoadedPlugin & loaded);
+
+/* set in shared_snapshot when it holds values not yet seen by the audio
+ * thread */
+#define SNAPSHOT_FRESH 4
+
+/* modules.c */
+
+extern Index<SmartPtr<ModuleData>> modules;
+extern Index<PluginData *> plugins;
+
+/* Lists the plugins in LADSPA_PATH and module_path.  The modules named in
+ * <needed> (file names only) are read at once if not in the index; the rest
+ * are read in the background and listed when done. */
+void open_modules (const Index<String> & needed);
+void close_modules ();
+
+/* Opens the plugin's module if need be and sets plugin.desc (main thread, with
+ * the mutex unlocked, since it may also rewrite the index file). */
+bool load_descriptor (PluginData & plugin);
+
 /* effect.c */
 
+extern EffectStats effect_stats;
+
 void shutdown_plugin_locked (LoadedPlugin & loaded);
+void stop_workers ();
 
 /* plugin-list.c */
 
@@ -0,0 +1,125 @@
+/*
+ * LADSPA Host for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "workers.h"
+
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/dsp.h"
+
+void WorkerPool::start (int threads)
+{
+    stop ();
+
+    /* a new thread must not miss a call to run () made before it gets to
+     * wait for one */
+    m_first_generation = m_generation;
+
+    for (int i = 0; i < threads; i ++)
+    {
+        pthread_t thread;
+
+        if (pthread_create (& thread, nullptr, worker, this))
+        {
+            AUDERR ("Failed to create worker thread.\n");
+            break;
+        }
+
+        m_threads.append (thread);
+    }
+}
+
+void WorkerPool::stop ()
+{
+    pthread_mutex_lock (& m_mutex);
+    m_quit = true;
+    pthread_cond_broadcast (& m_wake);
+    pthread_mutex_unlock (& m_mutex);
+
+    for (pthread_t thread : m_threads)
+        pthread_join (thread, nullptr);
+
+    m_threads.clear ();
+    m_quit = false;
+}
+
+void WorkerPool::do_tasks ()
+{
+    int task;
+    while ((task = m_next.fetch_add (1)) < m_tasks)
+        m_func (m_data, task);
+}
+
+void WorkerPool::run (TaskFunc func, void * data, int tasks)
+{
+    pthread_mutex_lock (& m_mutex);
+
+    m_func = func;
+    m_data = data;
+    m_tasks = tasks;
+    m_next = 0;
+    m_busy = m_threads.len ();
+    m_generation ++;
+
+    pthread_cond_broadcast (& m_wake);
+    pthread_mutex_unlock (& m_mutex);
+
+    do_tasks ();
+
+    /* wait until no thread can touch the tasks any more */
+    pthread_mutex_lock (& m_mutex);
+
+    while (m_busy)
+        pthread_cond_wait (& m_done, & m_mutex);
+
+    pthread_mutex_unlock (& m_mutex);
+}
+
+void * WorkerPool::worker (void * data)
+{
+    WorkerPool * pool = (WorkerPool *) data;
+
+    /* the thread runs nothing but audio processing */
+    dsp_flush_denormals ();
+
+    pthread_mutex_lock (& pool->m_mutex);
+    int seen = pool->m_first_generation;
+
+    while (1)
+    {
+        while (! pool->m_quit && pool->m_generation == seen)
+            pthread_cond_wait (& pool->m_wake, & pool->m_mutex);
+
+        if (pool->m_quit)
+            break;
+
+        seen = pool->m_generation;
+        pthread_mutex_unlock (& pool->m_mutex);
+
+        pool->do_tasks ();
+
+        pthread_mutex_lock (& pool->m_mutex);
+
+        if (! -- pool->m_busy)
+            pthread_cond_signal (& pool->m_done);
+    }
+
+    pthread_mutex_unlock (& pool->m_mutex);
+    return nullptr;
+}
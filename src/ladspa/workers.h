@@ -0,0 +1,68 @@
+/*
+ * LADSPA Host for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_LADSPA_WORKERS_H
+#define AUD_LADSPA_WORKERS_H
+
+#include <pthread.h>
+
+#include <atomic>
+
+#include <libaudcore/index.h>
+
+/* A small pool of persistent threads for running independent tasks in
+ * parallel, such as the instances of a plugin that each process a different
+ * group of channels.  The calling thread takes part in the work, and run ()
+ * returns only when every task is finished, so it serves as a barrier. */
+
+class WorkerPool
+{
+public:
+    typedef void (* TaskFunc) (void * data, int task);
+
+    void start (int threads);
+    void stop ();
+
+    int threads () const
+        { return m_threads.len (); }
+
+    /* Calls func (data, task) for each task from 0 to <tasks> - 1. */
+    void run (TaskFunc func, void * data, int tasks);
+
+private:
+    static void * worker (void * pool);
+    void do_tasks ();
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_wake = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t m_done = PTHREAD_COND_INITIALIZER;
+
+    Index<pthread_t> m_threads;
+    bool m_quit = false;
+    int m_generation = 0;  /* incremented for each call to run () */
+    int m_first_generation = 0;
+    int m_busy = 0;        /* threads still working on the current call */
+
+    TaskFunc m_func = nullptr;
+    void * m_data = nullptr;
+    int m_tasks = 0;
+    std::atomic<int> m_next {0};
+};
+
+#endif /* AUD_LADSPA_WORKERS_H */
@@ -0,0 +1,308 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "convolve.h"
+
+#include <string.h>
+
+#include <utility>
+
+#include <libaudcore/audio.h>
+
+#include "dsp.h"
+
+/* Paths with the same impulse response share one set of partitions.  Returns
+ * the number of sets; shared[r] is the one used by path r. */
+static int share_filters (const ConvPath * paths, int n_paths, int * shared)
+{
+    int n_filters = 0;
+
+    for (int r = 0; r < n_paths; r ++)
+    {
+        shared[r] = n_filters;
+
+        for (int q = 0; q < r; q ++)
+        {
+            if (paths[q].ir == paths[r].ir && paths[q].length == paths[r].length)
+            {
+                shared[r] = shared[q];
+                break;
+            }
+        }
+
+        if (shared[r] == n_filters)
+            n_filters ++;
+    }
+
+    return n_filters;
+}
+
+void ConvStage::make_filters (int block, const ConvPath * paths, int n_paths,
+ int offset, int length, Index<float> & filters)
+{
+    int bins = block + 1;
+    int parts = (length + block - 1) / block;
+
+    Index<int> shared;
+    shared.insert (0, n_paths);
+    int n_filters = share_filters (paths, n_paths, shared.begin ());
+
+    FFT fft;
+    fft.init (2 * block);
+
+    Index<float> time;
+    time.insert (0, 2 * block);
+
+    filters.clear ();
+    filters.insert (0, n_filters * parts * 2 * bins);
+
+    /* sets are numbered in order of their first path, which computes them */
+    for (int r = 0, done = 0; r < n_paths; r ++)
+    {
+        if (shared[r] < done)
+            continue;
+
+        done ++;
+
+        const ConvPath & path = paths[r];
+
+        for (int p = 0; p < parts; p ++)
+        {
+            int start = offset + p * block;
+            int count = aud::clamp (path.length - start, 0, block);
+
+            memset (& time[0], 0, sizeof (float) * 2 * block);
+            if (count)
+                memcpy (& time[0], path.ir + start, sizeof (float) * count);
+
+            float * filter = & filters[(shared[r] * parts + p) * 2 * bins];
+            fft.real_forward (& time[0], filter, filter + bins);
+        }
+    }
+}
+
+void ConvStage::init (int block, int channels, const ConvPath * paths, int n_paths,
+ int offset, int length)
+{
+    destroy ();
+
+    m_block = block;
+    m_bins = block + 1;
+    m_parts = (length + block - 1) / block;
+    m_channels = channels;
+
+    m_fft.init (2 * block);
+
+    Index<int> shared;
+    shared.insert (0, n_paths);
+    share_filters (paths, n_paths, shared.begin ());
+
+    for (int r = 0; r < n_paths; r ++)
+        m_routes.append (Route {paths[r].in, paths[r].out, shared[r]});
+
+    make_filters (block, paths, n_paths, offset, length, m_filters);
+
+    m_old.insert (0, m_filters.len ());
+    m_spectra.insert (0, channels * m_parts * 2 * m_bins);
+    m_inputs.insert (0, channels * 2 * block);
+    m_sums.insert (0, 2 * m_bins);
+    m_time.insert (0, 2 * block);
+    m_faded.insert (0, block);
+}
+
+void ConvStage::destroy ()
+{
+    m_fft.destroy ();
+    m_block = m_bins = m_parts = m_channels = 0;
+    m_fade = 0;
+    m_started = false;
+    m_routes.clear ();
+    m_filters.clear ();
+    m_old.clear ();
+    m_spectra.clear ();
+    m_inputs.clear ();
+    m_sums.clear ();
+    m_time.clear ();
+    m_faded.clear ();
+    m_newest = 0;
+}
+
+void ConvStage::reset ()
+{
+    memset (m_spectra.begin (), 0, sizeof (float) * m_spectra.len ());
+    memset (m_inputs.begin (), 0, sizeof (float) * m_inputs.len ());
+    m_newest = 0;
+    m_fade = 0;
+    m_started = false;
+}
+
+/* Filters set before any audio has been processed replace the old ones at
+ * once.  If a fade is already pending, it starts from the filters in use
+ * before that. */
+void ConvStage::set_filters (Index<float> & filters, int fade)
+{
+    if (! m_fade)
+    {
+        std::swap (m_old, m_filters);
+        m_fade = m_started ? aud::clamp (fade, 1, m_block) : 0;
+    }
+    else
+        m_fade = aud::min (m_fade, aud::clamp (fade, 1, m_block));
+
+    std::swap (m_filters, filters);
+}
+
+/* writes one block of output channel <c>, using <filters> */
+void ConvStage::sum_routes (const float * filters, int c, float * out)
+{
+    int stride = 2 * m_bins;
+    float * sum = m_sums.begin ();
+
+    memset (sum, 0, sizeof (float) * stride);
+
+    for (const Route & route : m_routes)
+    {
+        if (route.out != c)
+            continue;
+
+        for (int p = 0; p < m_parts; p ++)
+        {
+            const float * spectrum = & m_spectra[(route.in * m_parts +
+             (m_newest + p) % m_parts) * stride];
+            const float * filter = & filters[(route.filter * m_parts + p) * stride];
+
+            dsp_complex_mac (sum, sum + m_bins, spectrum, spectrum + m_bins,
+             filter, filter + m_bins, m_bins);
+        }
+    }
+
+    /* the first half of the inverse transform is wrapped around */
+    m_fft.real_inverse (sum, sum + m_bins, & m_time[0]);
+    memcpy (out, & m_time[m_block], sizeof (float) * m_block);
+}
+
+void ConvStage::process (const float * const * in, float * const * out)
+{
+    int stride = 2 * m_bins;
+
+    m_newest = (m_newest + m_parts - 1) % m_parts;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        float * input = & m_inputs[c * 2 * m_block];
+        memcpy (input, input + m_block, sizeof (float) * m_block);
+        memcpy (input + m_block, in[c], sizeof (float) * m_block);
+
+        float * spectrum = & m_spectra[(c * m_parts + m_newest) * stride];
+        m_fft.real_forward (input, spectrum, spectrum + m_bins);
+    }
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        sum_routes (m_filters.begin (), c, out[c]);
+
+        if (m_fade)
+        {
+            sum_routes (m_old.begin (), c, m_faded.begin ());
+            dsp_ramp (out[c], m_fade, 0, 1);
+            dsp_ramp (m_faded.begin (), m_fade, 1, 0);
+            dsp_mix (out[c], m_faded.begin (), m_fade);
+        }
+    }
+
+    m_fade = 0;
+    m_started = true;
+}
+
+void BlockAdapter::init (int channels, int block, Func func, void * data)
+{
+    destroy ();
+
+    m_func = func;
+    m_data = data;
+    m_channels = channels;
+    m_block = block;
+
+    m_in.insert (0, channels * block);
+    m_out.insert (0, channels * block);
+}
+
+void BlockAdapter::destroy ()
+{
+    m_func = nullptr;
+    m_data = nullptr;
+    m_channels = m_block = m_fill = 0;
+
+    m_in.clear ();
+    m_out.clear ();
+}
+
+void BlockAdapter::reset ()
+{
+    memset (m_out.begin (), 0, sizeof (float) * m_out.len ());
+    m_fill = 0;
+}
+
+void BlockAdapter::process (float * data, int frames)
+{
+    while (frames > 0)
+    {
+        int chunk = aud::min (frames, m_block - m_fill);
+
+        float * in[AUD_MAX_CHANNELS];
+        const float * out[AUD_MAX_CHANNELS];
+
+        for (int c = 0; c < m_channels; c ++)
+        {
+            in[c] = & m_in[c * m_block + m_fill];
+            out[c] = & m_out[c * m_block + m_fill];
+        }
+
+        /* the output of the previous block goes out as the input of this one
+         * comes in */
+        dsp_deinterleave (data, in, m_channels, chunk);
+        dsp_interleave (out, data, m_channels, chunk);
+
+        m_fill += chunk;
+        data += m_channels * chunk;
+        frames -= chunk;
+
+        if (m_fill == m_block)
+        {
+            const float * block_in[AUD_MAX_CHANNELS];
+            float * block_out[AUD_MAX_CHANNELS];
+
+            for (int c = 0; c < m_channels; c ++)
+            {
+                block_in[c] = & m_in[c * m_block];
+                block_out[c] = & m_out[c * m_block];
+            }
+
+            m_func (block_in, block_out, m_data);
+            m_fill = 0;
+        }
+    }
+}
+
+void BlockAdapter::drain (Index<float> & out, int frames)
+{
+    int at = out.len ();
+    out.insert (-1, m_channels * frames);
+    process (& out[at], frames);
+}
@@ -0,0 +1,129 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_CONVOLVE_H
+#define AUD_DSP_CONVOLVE_H
+
+#include <libaudcore/index.h>
+
+#include "fft.h"
+
+/* One impulse response, applied to input channel <in> and added to output
+ * channel <out>.  True stereo uses four of these; plain per-channel filtering
+ * uses one per channel. */
+struct ConvPath
+{
+    int in, out;
+    const float * ir;
+    int length;
+};
+
+/* Uniformly partitioned overlap-save convolution.  The part of each impulse
+ * response from <offset> to <offset> + <length> is cut into partitions of one
+ * block each, whose spectra (FFT of two blocks, the second half zero) are
+ * computed once.  The spectrum of each new input block, together with the one
+ * before, goes into a frequency-domain delay line, and one block of output is
+ * the inverse FFT of the sum of the products of the delay line with the
+ * partitions (cf. Wefers, "Partitioned convolution algorithms for real-time
+ * auralization", 2015).  Paths with the same <ir> and <length> share their
+ * partitions. */
+class ConvStage
+{
+public:
+    void init (int block, int channels, const ConvPath * paths, int n_paths,
+     int offset, int length);
+    void destroy ();
+    void reset ();
+
+    /* Computes the spectra of the partitions, as init () does, into <filters>.
+     * May be called from any thread. */
+    static void make_filters (int block, const ConvPath * paths, int n_paths,
+     int offset, int length, Index<float> & filters);
+
+    /* Replaces the partitions with <filters>, made with the same block size,
+     * paths, and length.  The first <fade> frames of the next block are faded
+     * from the old filter to the new one (a whole block for the smoothest
+     * change).  <filters> receives a buffer that is no longer needed. */
+    void set_filters (Index<float> & filters, int fade);
+
+    /* Convolves one block from each of in[0] through in[channels - 1] and
+     * writes one block to each of out[0] through out[channels - 1]. */
+    void process (const float * const * in, float * const * out);
+
+private:
+    struct Route {
+        int in, out;
+        int filter;  /* which set of partitions */
+    };
+
+    void sum_routes (const float * filters, int c, float * out);
+
+    FFT m_fft;
+    int m_block = 0, m_bins = 0, m_parts = 0, m_channels = 0;
+    int m_fade = 0;           /* frames to fade from m_old in the next block */
+    bool m_started = false;   /* a block has been processed since reset () */
+    Index<Route> m_routes;
+    Index<float> m_filters;   /* filter, partition, re/im, bin */
+    Index<float> m_old;       /* the filters before set_filters () */
+    Index<float> m_spectra;   /* channel, partition (ring), re/im, bin */
+    Index<float> m_inputs;    /* channel, previous and current block */
+    Index<float> m_sums;      /* re/im, bin */
+    Index<float> m_time;      /* two blocks */
+    Index<float> m_faded;     /* one block */
+    int m_newest = 0;         /* index of the newest spectrum in the ring */
+};
+
+/* Runs a filter that works on whole blocks (such as a ConvStage) on
+ * interleaved audio in pieces of any length.  As each block of input comes
+ * in, the output of the previous one goes out, so the output is delayed by
+ * latency () frames. */
+class BlockAdapter
+{
+public:
+    /* Called for each complete block, with <block> frames of input and of
+     * output for each channel. */
+    typedef void (* Func) (const float * const * in, float * const * out,
+     void * data);
+
+    void init (int channels, int block, Func func, void * data);
+    void destroy ();
+
+    /* Discards the audio in the pipeline. */
+    void reset ();
+
+    /* Processes <frames> interleaved frames in place. */
+    void process (float * data, int frames);
+
+    /* Appends <frames> frames of the audio remaining in the pipeline to
+     * <out>; latency () frames (plus any delay of the filter itself) gets all
+     * of it. */
+    void drain (Index<float> & out, int frames);
+
+    int latency () const
+        { return m_block; }
+
+private:
+    Func m_func = nullptr;
+    void * m_data = nullptr;
+
+    int m_channels = 0, m_block = 0, m_fill = 0;
+    Index<float> m_in, m_out;   /* channel, one block */
+};
+
+#endif /* AUD_DSP_CONVOLVE_H */
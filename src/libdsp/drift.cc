@@ -0,0 +1,86 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "drift.h"
+
+/* Time allowed for the output buffer to fill after a reset, before the delay
+ * is taken as the level to hold (seconds). */
+#define SETTLE_TIME 5.0
+
+/* Time constant of the low-pass filter on the measured delay (seconds).  The
+ * delay is noisy: the output plugin drains its buffer in periods, and some
+ * effects return audio in bursts. */
+#define SMOOTH_TIME 10.0
+
+/* Loop gains.  An error of 10 ms gives a correction of 100 ppm at once, and
+ * the integral term removes the remaining error within a few minutes, without
+ * overshoot.  Real clocks are rarely more than 100 ppm apart. */
+#define KP 1e-5  /* per ms */
+#define KI 4e-8  /* per ms * s */
+
+void DriftControl::reset ()
+{
+    m_reported.store (-1, std::memory_order_relaxed);
+
+    m_elapsed = 0;
+    m_smoothed = 0;
+    m_target = -1;
+    m_integral = 0;
+    m_correction = 0;
+}
+
+double DriftControl::update (double nominal_ratio, int frames, int rate)
+{
+    int reported = m_reported.load (std::memory_order_relaxed);
+
+    if (reported >= 0 && frames > 0 && rate > 0)
+    {
+        double dt = (double) frames / rate;
+
+        if (m_elapsed == 0)
+            m_smoothed = reported;
+        else
+            m_smoothed += (reported - m_smoothed) * dt / (SMOOTH_TIME + dt);
+
+        m_elapsed += dt;
+
+        if (m_elapsed >= SETTLE_TIME)
+        {
+            if (m_target < 0)
+                m_target = m_smoothed;
+
+            /* positive if too much audio is buffered downstream, meaning that
+             * the output device is slower than nominal */
+            double error = m_smoothed - m_target;
+            double correction = KP * error + KI * (m_integral + error * dt);
+
+            /* don't wind up the integral while the correction is saturated */
+            if (correction > DRIFT_MAX_CORRECTION)
+                correction = DRIFT_MAX_CORRECTION;
+            else if (correction < -DRIFT_MAX_CORRECTION)
+                correction = -DRIFT_MAX_CORRECTION;
+            else
+                m_integral += error * dt;
+
+            m_correction = correction;
+        }
+    }
+
+    return nominal_ratio * (1 - m_correction);
+}
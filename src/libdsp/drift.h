@@ -0,0 +1,69 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_DRIFT_H
+#define AUD_DSP_DRIFT_H
+
+#include <atomic>
+
+/* Clock drift compensation for the resampler plugins.  The delay that the
+ * audio core passes to EffectPlugin::adjust_delay () is the amount of audio
+ * buffered after the effect, mostly in the output plugin (as reported by
+ * snd_pcm_delay, the JACK ring buffer, pa_stream_get_latency, etc.).  If the
+ * output device runs slower or faster than its nominal rate, this delay slowly
+ * grows or shrinks.  DriftControl measures it, remembers the level it settles
+ * at after playback starts, and steers the resampling ratio with a slow PI
+ * loop so that the level stays there.
+ *
+ * report_delay () may be called from any thread; the other functions must be
+ * called from the audio thread. */
+
+/* largest relative change made to the ratio (0.1%, inaudible as a pitch
+ * change) */
+#define DRIFT_MAX_CORRECTION 1e-3
+
+class DriftControl
+{
+public:
+    /* Forgets all measurements, e.g. after a seek. */
+    void reset ();
+
+    /* Records the downstream delay, in milliseconds. */
+    void report_delay (int delay)
+        { m_reported.store (delay, std::memory_order_relaxed); }
+
+    /* Advances the control loop by <frames> output frames at <rate> Hz and
+     * returns the corrected resampling ratio (output rate / input rate). */
+    double update (double nominal_ratio, int frames, int rate);
+
+    /* The current correction, in parts per million. */
+    double correction_ppm () const
+        { return m_correction * 1e6; }
+
+private:
+    std::atomic<int> m_reported {-1};
+
+    double m_elapsed = 0;     /* seconds of audio since reset () */
+    double m_smoothed = 0;    /* low-pass filtered delay (ms) */
+    double m_target = -1;     /* delay to hold, once known (ms) */
+    double m_integral = 0;    /* integrated error (ms * s) */
+    double m_correction = 0;  /* relative ratio correction */
+};
+
+#endif /* AUD_DSP_DRIFT_H */
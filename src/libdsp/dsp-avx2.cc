@@ -0,0 +1,286 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "dsp.h"
+#include "dsp-internal.h"
+
+#ifdef DSP_X86
+
+#include <immintrin.h>
+
+/* Only the kernels which are limited by arithmetic rather than by shuffling
+ * have AVX2 versions; the interleaving kernels stay with SSE2, since AVX
+ * cannot shuffle across its two 128-bit halves cheaply. */
+#define AVX2_FUNC __attribute__ ((target ("avx2")))
+
+AVX2_FUNC static void ramp_avx2 (float * data, int len, float a, float b)
+{
+    if (len <= 0)
+        return;
+
+    float step = (b - a) / len;
+    __m256 va = _mm256_set1_ps (a);
+    __m256 vstep = _mm256_set1_ps (step);
+    __m256i index = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i eight = _mm256_set1_epi32 (8);
+
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        __m256 gain = _mm256_add_ps (va, _mm256_mul_ps (vstep, _mm256_cvtepi32_ps (index)));
+        _mm256_storeu_ps (data + i, _mm256_mul_ps (_mm256_loadu_ps (data + i), gain));
+        index = _mm256_add_epi32 (index, eight);
+    }
+
+    dsp_ramp_scalar (data, i, len, a, step);
+}
+
+AVX2_FUNC static void scale_avx2 (float * data, int len, float gain)
+{
+    __m256 vgain = _mm256_set1_ps (gain);
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+        _mm256_storeu_ps (data + i, _mm256_mul_ps (_mm256_loadu_ps (data + i), vgain));
+
+    for (; i < len; i ++)
+        data[i] *= gain;
+}
+
+AVX2_FUNC static void mix_avx2 (float * data, const float * add, int len)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+        _mm256_storeu_ps (data + i, _mm256_add_ps (_mm256_loadu_ps (data + i),
+         _mm256_loadu_ps (add + i)));
+
+    for (; i < len; i ++)
+        data[i] += add[i];
+}
+
+AVX2_FUNC static void multiply_avx2 (float * data, const float * gain, int len)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+        _mm256_storeu_ps (data + i, _mm256_mul_ps (_mm256_loadu_ps (data + i),
+         _mm256_loadu_ps (gain + i)));
+
+    for (; i < len; i ++)
+        data[i] *= gain[i];
+}
+
+AVX2_FUNC static void mul_add_avx2 (float * data, const float * a, const float * b, int len)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+        _mm256_storeu_ps (data + i, _mm256_add_ps (_mm256_loadu_ps (data + i),
+         _mm256_mul_ps (_mm256_loadu_ps (a + i), _mm256_loadu_ps (b + i))));
+
+    for (; i < len; i ++)
+        data[i] += a[i] * b[i];
+}
+
+AVX2_FUNC static float abs_sum_avx2 (const float * data, int len)
+{
+    __m256 mask = _mm256_castsi256_ps (_mm256_set1_epi32 (0x7fffffff));
+    __m256 sum1 = _mm256_setzero_ps ();
+    __m256 sum2 = _mm256_setzero_ps ();
+    int i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        sum1 = _mm256_add_ps (sum1, _mm256_and_ps (_mm256_loadu_ps (data + i), mask));
+        sum2 = _mm256_add_ps (sum2, _mm256_and_ps (_mm256_loadu_ps (data + i + 8), mask));
+    }
+
+    float part[8];
+    _mm256_storeu_ps (part, _mm256_add_ps (sum1, sum2));
+
+    float sum = 0;
+    for (float p : part)
+        sum += p;
+
+    for (; i < len; i ++)
+        sum += (data[i] < 0) ? -data[i] : data[i];
+
+    return sum;
+}
+
+AVX2_FUNC static float dot_avx2 (const float * a, const float * b, int len)
+{
+    __m256 sum1 = _mm256_setzero_ps ();
+    __m256 sum2 = _mm256_setzero_ps ();
+    int i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        sum1 = _mm256_add_ps (sum1, _mm256_mul_ps (_mm256_loadu_ps (a + i),
+         _mm256_loadu_ps (b + i)));
+        sum2 = _mm256_add_ps (sum2, _mm256_mul_ps (_mm256_loadu_ps (a + i + 8),
+         _mm256_loadu_ps (b + i + 8)));
+    }
+
+    float part[8];
+    _mm256_storeu_ps (part, _mm256_add_ps (sum1, sum2));
+
+    float sum = 0;
+    for (float p : part)
+        sum += p;
+
+    for (; i < len; i ++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+AVX2_FUNC static void butterfly_avx2 (float * re0, float * im0, float * re1,
+ float * im1, const float * wr, const float * wi, int len)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        __m256 xr = _mm256_loadu_ps (re1 + i), xi = _mm256_loadu_ps (im1 + i);
+        __m256 cr = _mm256_loadu_ps (wr + i), ci = _mm256_loadu_ps (wi + i);
+        __m256 tr = _mm256_sub_ps (_mm256_mul_ps (xr, cr), _mm256_mul_ps (xi, ci));
+        __m256 ti = _mm256_add_ps (_mm256_mul_ps (xr, ci), _mm256_mul_ps (xi, cr));
+        __m256 yr = _mm256_loadu_ps (re0 + i), yi = _mm256_loadu_ps (im0 + i);
+
+        _mm256_storeu_ps (re1 + i, _mm256_sub_ps (yr, tr));
+        _mm256_storeu_ps (im1 + i, _mm256_sub_ps (yi, ti));
+        _mm256_storeu_ps (re0 + i, _mm256_add_ps (yr, tr));
+        _mm256_storeu_ps (im0 + i, _mm256_add_ps (yi, ti));
+    }
+
+    dsp_butterfly_scalar (re0, im0, re1, im1, wr, wi, i, len);
+}
+
+AVX2_FUNC static void complex_mac_avx2 (float * acc_re, float * acc_im,
+ const float * a_re, const float * a_im, const float * b_re, const float * b_im, int len)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        __m256 ar = _mm256_loadu_ps (a_re + i), ai = _mm256_loadu_ps (a_im + i);
+        __m256 br = _mm256_loadu_ps (b_re + i), bi = _mm256_loadu_ps (b_im + i);
+        __m256 pr = _mm256_sub_ps (_mm256_mul_ps (ar, br), _mm256_mul_ps (ai, bi));
+        __m256 pi = _mm256_add_ps (_mm256_mul_ps (ar, bi), _mm256_mul_ps (ai, br));
+
+        _mm256_storeu_ps (acc_re + i, _mm256_add_ps (_mm256_loadu_ps (acc_re + i), pr));
+        _mm256_storeu_ps (acc_im + i, _mm256_add_ps (_mm256_loadu_ps (acc_im + i), pi));
+    }
+
+    dsp_complex_mac_scalar (acc_re, acc_im, a_re, a_im, b_re, b_im, i, len);
+}
+
+AVX2_FUNC static void to_s16_avx2 (const float * in, int16_t * out, int len)
+{
+    __m256 scale = _mm256_set1_ps (32768);
+    __m256 lo = _mm256_set1_ps (-32768), hi = _mm256_set1_ps (32767);
+
+    int i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m256 a = _mm256_mul_ps (_mm256_loadu_ps (in + i), scale);
+        __m256 b = _mm256_mul_ps (_mm256_loadu_ps (in + i + 8), scale);
+        __m256i ia = _mm256_cvtps_epi32 (_mm256_min_ps (_mm256_max_ps (a, lo), hi));
+        __m256i ib = _mm256_cvtps_epi32 (_mm256_min_ps (_mm256_max_ps (b, lo), hi));
+
+        /* packing works within each 128-bit lane; put the quarters in order */
+        __m256i packed = _mm256_packs_epi32 (ia, ib);
+        packed = _mm256_permute4x64_epi64 (packed, _MM_SHUFFLE (3, 1, 2, 0));
+        _mm256_storeu_si256 ((__m256i *) (out + i), packed);
+    }
+
+    dsp_to_s16_scalar (in, out, i, len);
+}
+
+AVX2_FUNC static void to_s32_avx2 (const float * in, int32_t * out, int len,
+ float scale, float max)
+{
+    __m256 vscale = _mm256_set1_ps (scale);
+    __m256 lo = _mm256_set1_ps (-scale), hi = _mm256_set1_ps (max);
+
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        __m256 x = _mm256_mul_ps (_mm256_loadu_ps (in + i), vscale);
+        __m256i ix = _mm256_cvtps_epi32 (_mm256_min_ps (_mm256_max_ps (x, lo), hi));
+        _mm256_storeu_si256 ((__m256i *) (out + i), ix);
+    }
+
+    dsp_to_s32_scalar (in, out, i, len, scale, max);
+}
+
+/* the version which was in use before dsp_init_avx2 () was called */
+static void (* matrix_mix_prev) (const float * in, int in_channels, float * out,
+ int out_channels, const float * matrix, int frames);
+
+AVX2_FUNC static void matrix_mix_avx2 (const float * in, int in_channels,
+ float * out, int out_channels, const float * m, int frames)
+{
+    /* anything but stereo-to-stereo is left to the SSE2 version */
+    if (in_channels != 2 || out_channels != 2)
+    {
+        matrix_mix_prev (in, in_channels, out, out_channels, m, frames);
+        return;
+    }
+
+    __m256 direct = _mm256_setr_ps (m[0], m[3], m[0], m[3], m[0], m[3], m[0], m[3]);
+    __m256 cross = _mm256_setr_ps (m[1], m[2], m[1], m[2], m[1], m[2], m[1], m[2]);
+    int f = 0;
+
+    for (; f + 4 <= frames; f += 4)
+    {
+        __m256 x = _mm256_loadu_ps (in + 2 * f);
+        __m256 swapped = _mm256_permute_ps (x, _MM_SHUFFLE (2, 3, 0, 1));
+        _mm256_storeu_ps (out + 2 * f, _mm256_add_ps (_mm256_mul_ps (x, direct),
+         _mm256_mul_ps (swapped, cross)));
+    }
+
+    dsp_matrix_mix_scalar (in + 2 * f, 2, out + 2 * f, 2, m, frames - f);
+}
+
+void dsp_init_avx2 (DSPKernels & k)
+{
+    k.isa = "avx2";
+    k.ramp = ramp_avx2;
+    k.scale = scale_avx2;
+    k.mix = mix_avx2;
+    k.multiply = multiply_avx2;
+    k.mul_add = mul_add_avx2;
+    k.abs_sum = abs_sum_avx2;
+    k.dot = dot_avx2;
+    k.butterfly = butterfly_avx2;
+    k.complex_mac = complex_mac_avx2;
+    k.to_s16 = to_s16_avx2;
+    k.to_s32 = to_s32_avx2;
+
+    matrix_mix_prev = k.matrix_mix;
+    k.matrix_mix = matrix_mix_avx2;
+}
+
+#endif /* DSP_X86 */
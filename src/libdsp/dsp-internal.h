@@ -0,0 +1,129 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_INTERNAL_H
+#define AUD_DSP_INTERNAL_H
+
+#include <stdint.h>
+
+#if defined (__i386__) || defined (__x86_64__)
+#define DSP_X86 1
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define DSP_NEON 1
+#endif
+
+struct DSPKernels
+{
+    const char * isa;
+
+    void (* ramp) (float * data, int len, float a, float b);
+    void (* scale) (float * data, int len, float gain);
+    void (* mix) (float * data, const float * add, int len);
+    void (* multiply) (float * data, const float * gain, int len);
+    void (* mul_add) (float * data, const float * a, const float * b, int len);
+    float (* abs_sum) (const float * data, int len);
+    float (* dot) (const float * a, const float * b, int len);
+    void (* interleave) (const float * const * in, float * out, int channels, int frames);
+    void (* deinterleave) (const float * in, float * const * out, int channels, int frames);
+    void (* matrix_mix) (const float * in, int in_channels, float * out,
+     int out_channels, const float * matrix, int frames);
+    void (* butterfly) (float * re0, float * im0, float * re1, float * im1,
+     const float * wr, const float * wi, int len);
+    void (* complex_mac) (float * acc_re, float * acc_im, const float * a_re,
+     const float * a_im, const float * b_re, const float * b_im, int len);
+    void (* hadamard) (float * data, int size, int frames);
+    void (* true_peak) (const float * in, int channels, int frames,
+     const float * coefs, float * peaks);
+    void (* biquads) (float * data, int channels, int frames, const float * coefs,
+     int sections, float * state);
+    void (* to_s16) (const float * in, int16_t * out, int len);
+    void (* to_s32) (const float * in, int32_t * out, int len, float scale, float max);
+    void (* pack_s16) (const int32_t * const * in, int16_t * out, int channels, int frames);
+    void (* pack_s32) (const int32_t * const * in, int32_t * out, int channels, int frames);
+};
+
+/* Each of these replaces the entries of <k> which it has a faster version of.
+ * Entries it does not replace keep pointing to the previous version. */
+void dsp_init_scalar (DSPKernels & k);
+#ifdef DSP_X86
+void dsp_init_sse2 (DSPKernels & k);
+void dsp_init_avx2 (DSPKernels & k);
+#endif
+#ifdef DSP_NEON
+void dsp_init_neon (DSPKernels & k);
+#endif
+
+/* The scalar versions are also used by the vector versions to handle whatever
+ * does not fit into a whole number of vectors. */
+void dsp_ramp_scalar (float * data, int start, int len, float a, float step);
+void dsp_matrix_mix_scalar (const float * in, int in_channels, float * out,
+ int out_channels, const float * matrix, int frames);
+void dsp_interleave_scalar (const float * const * in, float * out, int channels,
+ int start, int frames);
+void dsp_deinterleave_scalar (const float * in, float * const * out, int channels,
+ int start, int frames);
+void dsp_butterfly_scalar (float * re0, float * im0, float * re1, float * im1,
+ const float * wr, const float * wi, int start, int len);
+void dsp_complex_mac_scalar (float * acc_re, float * acc_im, const float * a_re,
+ const float * a_im, const float * b_re, const float * b_im, int start, int len);
+
+/* <scale> is 2 ^ (bits - 1); <max> is the largest float that does not exceed
+ * the largest integer, which is less than scale - 1 for 32 bits. */
+void dsp_to_s16_scalar (const float * in, int16_t * out, int start, int len);
+void dsp_to_s32_scalar (const float * in, int32_t * out, int start, int len,
+ float scale, float max);
+
+void dsp_pack_s16_scalar (const int32_t * const * in, int16_t * out, int channels,
+ int start, int frames);
+void dsp_pack_s32_scalar (const int32_t * const * in, int32_t * out, int channels,
+ int start, int frames);
+
+/* Pairs of channel counts (in, out) for which the vector versions of
+ * dsp_matrix_mix () are specialized at compile time: downmixes from 3.0
+ * through 7.1 to stereo and mono, from 6.1 and 7.1 to 5.1, and upmixes from
+ * stereo.  Other pairs use the scalar version. */
+#define DSP_FIXED_MIXES(X) \
+    X (3, 2) X (4, 2) X (5, 2) X (6, 2) X (7, 2) X (8, 2) \
+    X (6, 1) X (8, 1) X (7, 6) X (8, 6) X (2, 4) X (2, 6) X (2, 8)
+
+struct DSPFixedMix
+{
+    int in_channels, out_channels;
+    void (* func) (const float * in, float * out, const float * matrix, int frames);
+};
+
+/* Filters channels <first> through <last> - 1 only. */
+void dsp_biquads_scalar (float * data, int channels, int first, int last,
+ int frames, const float * coefs, int sections, float * state);
+
+/* The true-peak kernels read DSP_TRUE_PEAK_TAPS - 1 frames of history before
+ * the first of <frames> frames, so <in> points to the oldest of these.  The
+ * coefficients are stored as coefs[tap * 4 + phase], oldest tap first. */
+void dsp_true_peak_scalar (const float * in, int channels, int frames,
+ const float * coefs, float * peaks);
+
+/* Radix-2 FFT butterflies on split (real and imaginary) arrays:
+ *     t = x1[i] * w[i], x1[i] = x0[i] - t, x0[i] = x0[i] + t
+ * Used by the FFT class, which is not performance critical otherwise. */
+void dsp_butterfly (float * re0, float * im0, float * re1, float * im1,
+ const float * wr, const float * wi, int len);
+
+#endif /* AUD_DSP_INTERNAL_H */
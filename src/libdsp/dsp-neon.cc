@@ -0,0 +1,651 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "dsp-internal.h"
+
+/* NEON is only used when the compiler targets it (always the case on AArch64,
+ * and with -mfpu=neon on 32-bit ARM), so no runtime check is done. */
+#ifdef DSP_NEON
+
+#include <arm_neon.h>
+
+static float horizontal_sum (float32x4_t v)
+{
+    float32x2_t pair = vadd_f32 (vget_low_f32 (v), vget_high_f32 (v));
+    return vget_lane_f32 (vpadd_f32 (pair, pair), 0);
+}
+
+static void ramp_neon (float * data, int len, float a, float b)
+{
+    if (len <= 0)
+        return;
+
+    float step = (b - a) / len;
+    float32x4_t va = vdupq_n_f32 (a);
+    float32x4_t vstep = vdupq_n_f32 (step);
+    static const int32_t first[4] = {0, 1, 2, 3};
+    int32x4_t index = vld1q_s32 (first);
+    int32x4_t four = vdupq_n_s32 (4);
+
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        float32x4_t gain = vmlaq_f32 (va, vstep, vcvtq_f32_s32 (index));
+        vst1q_f32 (data + i, vmulq_f32 (vld1q_f32 (data + i), gain));
+        index = vaddq_s32 (index, four);
+    }
+
+    dsp_ramp_scalar (data, i, len, a, step);
+}
+
+static void scale_neon (float * data, int len, float gain)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+        vst1q_f32 (data + i, vmulq_n_f32 (vld1q_f32 (data + i), gain));
+
+    for (; i < len; i ++)
+        data[i] *= gain;
+}
+
+static void mix_neon (float * data, const float * add, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+        vst1q_f32 (data + i, vaddq_f32 (vld1q_f32 (data + i), vld1q_f32 (add + i)));
+
+    for (; i < len; i ++)
+        data[i] += add[i];
+}
+
+static void multiply_neon (float * data, const float * gain, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+        vst1q_f32 (data + i, vmulq_f32 (vld1q_f32 (data + i), vld1q_f32 (gain + i)));
+
+    for (; i < len; i ++)
+        data[i] *= gain[i];
+}
+
+static void mul_add_neon (float * data, const float * a, const float * b, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+        vst1q_f32 (data + i, vmlaq_f32 (vld1q_f32 (data + i), vld1q_f32 (a + i), vld1q_f32 (b + i)));
+
+    for (; i < len; i ++)
+        data[i] += a[i] * b[i];
+}
+
+static float abs_sum_neon (const float * data, int len)
+{
+    float32x4_t sum1 = vdupq_n_f32 (0);
+    float32x4_t sum2 = vdupq_n_f32 (0);
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        sum1 = vaddq_f32 (sum1, vabsq_f32 (vld1q_f32 (data + i)));
+        sum2 = vaddq_f32 (sum2, vabsq_f32 (vld1q_f32 (data + i + 4)));
+    }
+
+    float sum = horizontal_sum (vaddq_f32 (sum1, sum2));
+
+    for (; i < len; i ++)
+        sum += (data[i] < 0) ? -data[i] : data[i];
+
+    return sum;
+}
+
+static float dot_neon (const float * a, const float * b, int len)
+{
+    float32x4_t sum1 = vdupq_n_f32 (0);
+    float32x4_t sum2 = vdupq_n_f32 (0);
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        sum1 = vmlaq_f32 (sum1, vld1q_f32 (a + i), vld1q_f32 (b + i));
+        sum2 = vmlaq_f32 (sum2, vld1q_f32 (a + i + 4), vld1q_f32 (b + i + 4));
+    }
+
+    float sum = horizontal_sum (vaddq_f32 (sum1, sum2));
+
+    for (; i < len; i ++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+/* Four frames at a time: each group of four channels is transposed, and a
+ * remaining pair of channels is zipped and stored in halves. */
+static void interleave_multi_neon (const float * const * in, float * out, int channels,
+ int frames)
+{
+    int f = 0;
+
+    for (; f + 4 <= frames; f += 4)
+    {
+        float * set = out + f * channels;
+        int c = 0;
+
+        for (; c + 4 <= channels; c += 4)
+        {
+            float32x4x2_t ab = vtrnq_f32 (vld1q_f32 (in[c] + f), vld1q_f32 (in[c + 1] + f));
+            float32x4x2_t xy = vtrnq_f32 (vld1q_f32 (in[c + 2] + f), vld1q_f32 (in[c + 3] + f));
+
+            vst1q_f32 (set + c, vcombine_f32 (vget_low_f32 (ab.val[0]), vget_low_f32 (xy.val[0])));
+            vst1q_f32 (set + channels + c, vcombine_f32 (vget_low_f32 (ab.val[1]), vget_low_f32 (xy.val[1])));
+            vst1q_f32 (set + 2 * channels + c, vcombine_f32 (vget_high_f32 (ab.val[0]), vget_high_f32 (xy.val[0])));
+            vst1q_f32 (set + 3 * channels + c, vcombine_f32 (vget_high_f32 (ab.val[1]), vget_high_f32 (xy.val[1])));
+        }
+
+        if (c + 2 <= channels)
+        {
+            float32x4x2_t ab = vzipq_f32 (vld1q_f32 (in[c] + f), vld1q_f32 (in[c + 1] + f));
+
+            vst1_f32 (set + c, vget_low_f32 (ab.val[0]));
+            vst1_f32 (set + channels + c, vget_high_f32 (ab.val[0]));
+            vst1_f32 (set + 2 * channels + c, vget_low_f32 (ab.val[1]));
+            vst1_f32 (set + 3 * channels + c, vget_high_f32 (ab.val[1]));
+
+            c += 2;
+        }
+
+        if (c < channels)
+        {
+            for (int k = 0; k < 4; k ++)
+                set[k * channels + c] = in[c][f + k];
+        }
+    }
+
+    dsp_interleave_scalar (in, out, channels, f, frames);
+}
+
+static void interleave_neon (const float * const * in, float * out, int channels, int frames)
+{
+    if (channels == 1)
+    {
+        memcpy (out, in[0], sizeof (float) * frames);
+        return;
+    }
+
+    if (channels != 2)
+    {
+        interleave_multi_neon (in, out, channels, frames);
+        return;
+    }
+
+    int f = 0;
+
+    for (; f + 4 <= frames; f += 4)
+    {
+        float32x4x2_t x = {{vld1q_f32 (in[0] + f), vld1q_f32 (in[1] + f)}};
+        vst2q_f32 (out + 2 * f, x);
+    }
+
+    dsp_interleave_scalar (in, out, 2, f, frames);
+}
+
+static void deinterleave_neon (const float * in, float * const * out, int channels, int frames)
+{
+    if (channels != 2)
+    {
+        dsp_deinterleave_scalar (in, out, channels, 0, frames);
+        return;
+    }
+
+    int f = 0;
+
+    for (; f + 4 <= frames; f += 4)
+    {
+        float32x4x2_t x = vld2q_f32 (in + 2 * f);
+        vst1q_f32 (out[0] + f, x.val[0]);
+        vst1q_f32 (out[1] + f, x.val[1]);
+    }
+
+    dsp_deinterleave_scalar (in, out, 2, f, frames);
+}
+
+/* Each input sample is multiplied by its column of the matrix, four outputs
+ * at a time.  With the channel counts known, the loops are unrolled and the
+ * columns stay in registers. */
+template<int IN, int OUT>
+static void matrix_mix_fixed_neon (const float * in, float * out,
+ const float * m, int frames)
+{
+    constexpr int V = (OUT + 3) / 4;
+    constexpr int rem = OUT % 4;
+
+    float32x4_t cols[IN][V];
+
+    for (int i = 0; i < IN; i ++)
+    {
+        for (int v = 0; v < V; v ++)
+        {
+            float col[4] = {};
+            for (int k = 0; k < 4 && 4 * v + k < OUT; k ++)
+                col[k] = m[(4 * v + k) * IN + i];
+
+            cols[i][v] = vld1q_f32 (col);
+        }
+    }
+
+    for (int f = 0; f < frames; f ++)
+    {
+        float32x4_t acc[V];
+
+        for (int v = 0; v < V; v ++)
+            acc[v] = vdupq_n_f32 (0);
+
+        for (int i = 0; i < IN; i ++)
+        {
+            for (int v = 0; v < V; v ++)
+                acc[v] = vmlaq_n_f32 (acc[v], cols[i][v], in[i]);
+        }
+
+        for (int v = 0; v < OUT / 4; v ++)
+            vst1q_f32 (out + 4 * v, acc[v]);
+
+        float * tail = out + 4 * (OUT / 4);
+
+        if (rem == 1)
+            vst1q_lane_f32 (tail, acc[V - 1], 0);
+        else if (rem >= 2)
+            vst1_f32 (tail, vget_low_f32 (acc[V - 1]));
+
+        if (rem == 3)
+            vst1q_lane_f32 (tail + 2, acc[V - 1], 2);
+
+        in += IN;
+        out += OUT;
+    }
+}
+
+#define FIXED_MIX_NEON(i, o) {i, o, matrix_mix_fixed_neon<i, o>},
+
+static const DSPFixedMix fixed_mixes_neon[] = {
+    DSP_FIXED_MIXES (FIXED_MIX_NEON)
+};
+
+static void matrix_mix_neon (const float * in, int in_channels, float * out,
+ int out_channels, const float * m, int frames)
+{
+    for (const DSPFixedMix & mix : fixed_mixes_neon)
+    {
+        if (mix.in_channels == in_channels && mix.out_channels == out_channels)
+        {
+            mix.func (in, out, m, frames);
+            return;
+        }
+    }
+
+    int f = 0;
+
+    if (in_channels == 2 && out_channels == 2)
+    {
+        for (; f + 4 <= frames; f += 4)
+        {
+            float32x4x2_t x = vld2q_f32 (in + 2 * f);
+            float32x4x2_t y;
+            y.val[0] = vmlaq_n_f32 (vmulq_n_f32 (x.val[0], m[0]), x.val[1], m[1]);
+            y.val[1] = vmlaq_n_f32 (vmulq_n_f32 (x.val[0], m[2]), x.val[1], m[3]);
+            vst2q_f32 (out + 2 * f, y);
+        }
+    }
+    else if (in_channels == 1 && out_channels == 2)
+    {
+        for (; f + 4 <= frames; f += 4)
+        {
+            float32x4_t x = vld1q_f32 (in + f);
+            float32x4x2_t y = {{vmulq_n_f32 (x, m[0]), vmulq_n_f32 (x, m[1])}};
+            vst2q_f32 (out + 2 * f, y);
+        }
+    }
+    else if (in_channels == 2 && out_channels == 1)
+    {
+        for (; f + 4 <= frames; f += 4)
+        {
+            float32x4x2_t x = vld2q_f32 (in + 2 * f);
+            vst1q_f32 (out + f, vmlaq_n_f32 (vmulq_n_f32 (x.val[0], m[0]), x.val[1], m[1]));
+        }
+    }
+
+    dsp_matrix_mix_scalar (in + in_channels * f, in_channels,
+     out + out_channels * f, out_channels, m, frames - f);
+}
+
+static void butterfly_neon (float * re0, float * im0, float * re1, float * im1,
+ const float * wr, const float * wi, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        float32x4_t xr = vld1q_f32 (re1 + i), xi = vld1q_f32 (im1 + i);
+        float32x4_t cr = vld1q_f32 (wr + i), ci = vld1q_f32 (wi + i);
+        float32x4_t tr = vmlsq_f32 (vmulq_f32 (xr, cr), xi, ci);
+        float32x4_t ti = vmlaq_f32 (vmulq_f32 (xr, ci), xi, cr);
+        float32x4_t yr = vld1q_f32 (re0 + i), yi = vld1q_f32 (im0 + i);
+
+        vst1q_f32 (re1 + i, vsubq_f32 (yr, tr));
+        vst1q_f32 (im1 + i, vsubq_f32 (yi, ti));
+        vst1q_f32 (re0 + i, vaddq_f32 (yr, tr));
+        vst1q_f32 (im0 + i, vaddq_f32 (yi, ti));
+    }
+
+    dsp_butterfly_scalar (re0, im0, re1, im1, wr, wi, i, len);
+}
+
+static void complex_mac_neon (float * acc_re, float * acc_im, const float * a_re,
+ const float * a_im, const float * b_re, const float * b_im, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        float32x4_t ar = vld1q_f32 (a_re + i), ai = vld1q_f32 (a_im + i);
+        float32x4_t br = vld1q_f32 (b_re + i), bi = vld1q_f32 (b_im + i);
+        float32x4_t pr = vmlsq_f32 (vmlaq_f32 (vld1q_f32 (acc_re + i), ar, br), ai, bi);
+        float32x4_t pi = vmlaq_f32 (vmlaq_f32 (vld1q_f32 (acc_im + i), ar, bi), ai, br);
+
+        vst1q_f32 (acc_re + i, pr);
+        vst1q_f32 (acc_im + i, pi);
+    }
+
+    dsp_complex_mac_scalar (acc_re, acc_im, a_re, a_im, b_re, b_im, i, len);
+}
+
+/* The channels of each frame are filtered together, four at a time. */
+static void biquads_neon (float * data, int channels, int frames,
+ const float * coefs, int sections, float * state)
+{
+    int c = 0;
+
+    for (; c + 4 <= channels; c += 4)
+    {
+        float32x4_t s1[DSP_MAX_BIQUADS], s2[DSP_MAX_BIQUADS];
+
+        for (int s = 0; s < sections; s ++)
+        {
+            s1[s] = vld1q_f32 (state + 2 * s * channels + c);
+            s2[s] = vld1q_f32 (state + (2 * s + 1) * channels + c);
+        }
+
+        for (int f = 0; f < frames; f ++)
+        {
+            float * frame = data + f * channels + c;
+            float32x4_t x = vld1q_f32 (frame);
+
+            for (int s = 0; s < sections; s ++)
+            {
+                const float * k = coefs + 5 * s;
+                float32x4_t y = vmlaq_n_f32 (s1[s], x, k[0]);
+
+                s1[s] = vmlsq_n_f32 (vmlaq_n_f32 (s2[s], x, k[1]), y, k[3]);
+                s2[s] = vmlsq_n_f32 (vmulq_n_f32 (x, k[2]), y, k[4]);
+                x = y;
+            }
+
+            vst1q_f32 (frame, x);
+        }
+
+        for (int s = 0; s < sections; s ++)
+        {
+            vst1q_f32 (state + 2 * s * channels + c, s1[s]);
+            vst1q_f32 (state + (2 * s + 1) * channels + c, s2[s]);
+        }
+    }
+
+    if (c + 2 <= channels)
+    {
+        float32x2_t s1[DSP_MAX_BIQUADS], s2[DSP_MAX_BIQUADS];
+
+        for (int s = 0; s < sections; s ++)
+        {
+            s1[s] = vld1_f32 (state + 2 * s * channels + c);
+            s2[s] = vld1_f32 (state + (2 * s + 1) * channels + c);
+        }
+
+        for (int f = 0; f < frames; f ++)
+        {
+            float * frame = data + f * channels + c;
+            float32x2_t x = vld1_f32 (frame);
+
+            for (int s = 0; s < sections; s ++)
+            {
+                const float * k = coefs + 5 * s;
+                float32x2_t y = vmla_n_f32 (s1[s], x, k[0]);
+
+                s1[s] = vmls_n_f32 (vmla_n_f32 (s2[s], x, k[1]), y, k[3]);
+                s2[s] = vmls_n_f32 (vmul_n_f32 (x, k[2]), y, k[4]);
+                x = y;
+            }
+
+            vst1_f32 (frame, x);
+        }
+
+        for (int s = 0; s < sections; s ++)
+        {
+            vst1_f32 (state + 2 * s * channels + c, s1[s]);
+            vst1_f32 (state + (2 * s + 1) * channels + c, s2[s]);
+        }
+
+        c += 2;
+    }
+
+    dsp_biquads_scalar (data, channels, c, channels, frames, coefs, sections, state);
+}
+
+static void hadamard_neon (float * data, int size, int frames)
+{
+    static const float sign1[4] = {1, -1, 1, -1};
+    static const float sign2[4] = {1, 1, -1, -1};
+
+    float32x4_t vsign1 = vld1q_f32 (sign1);
+    float32x4_t vsign2 = vld1q_f32 (sign2);
+    float scale = 1 / sqrtf (size);
+    int n = size / 4;
+
+    for (int f = 0; f < frames; f ++)
+    {
+        float32x4_t v[DSP_MAX_HADAMARD / 4];
+
+        for (int i = 0; i < n; i ++)
+        {
+            float32x4_t x = vld1q_f32 (data + 4 * i);
+            x = vmlaq_f32 (vrev64q_f32 (x), x, vsign1);
+            v[i] = vmlaq_f32 (vextq_f32 (x, x, 2), x, vsign2);
+        }
+
+        for (int h = 1; h < n; h *= 2)
+        {
+            for (int i = 0; i < n; i += 2 * h)
+            {
+                for (int j = i; j < i + h; j ++)
+                {
+                    float32x4_t a = v[j], b = v[j + h];
+                    v[j] = vaddq_f32 (a, b);
+                    v[j + h] = vsubq_f32 (a, b);
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i ++)
+            vst1q_f32 (data + 4 * i, vmulq_n_f32 (v[i], scale));
+
+        data += size;
+    }
+}
+
+static void true_peak_neon (const float * in, int channels, int frames,
+ const float * coefs, float * peaks)
+{
+    for (int f = 0; f < frames; f ++)
+    {
+        float32x4_t peak = vdupq_n_f32 (0);
+
+        for (int c = 0; c < channels; c ++)
+        {
+            const float * x = in + f * channels + c;
+            float32x4_t sum = vdupq_n_f32 (0);
+
+            for (int t = 0; t < DSP_TRUE_PEAK_TAPS; t ++)
+                sum = vmlaq_n_f32 (sum, vld1q_f32 (coefs + 4 * t), x[t * channels]);
+
+            peak = vmaxq_f32 (peak, vabsq_f32 (sum));
+        }
+
+        float32x2_t pair = vpmax_f32 (vget_low_f32 (peak), vget_high_f32 (peak));
+        peaks[f] = vget_lane_f32 (vpmax_f32 (pair, pair), 0);
+    }
+}
+
+/* Rounds to nearest; 32-bit ARM has only a truncating conversion. */
+static int32x4_t round_neon (float32x4_t x)
+{
+#ifdef __aarch64__
+    return vcvtnq_s32_f32 (x);
+#else
+    uint32x4_t sign = vandq_u32 (vreinterpretq_u32_f32 (x), vdupq_n_u32 (0x80000000));
+    float32x4_t half = vreinterpretq_f32_u32 (vorrq_u32 (sign,
+     vreinterpretq_u32_f32 (vdupq_n_f32 (0.5f))));
+    return vcvtq_s32_f32 (vaddq_f32 (x, half));
+#endif
+}
+
+static void to_s16_neon (const float * in, int16_t * out, int len)
+{
+    float32x4_t lo = vdupq_n_f32 (-32768), hi = vdupq_n_f32 (32767);
+
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        float32x4_t a = vmulq_n_f32 (vld1q_f32 (in + i), 32768);
+        float32x4_t b = vmulq_n_f32 (vld1q_f32 (in + i + 4), 32768);
+        int32x4_t ia = round_neon (vminq_f32 (vmaxq_f32 (a, lo), hi));
+        int32x4_t ib = round_neon (vminq_f32 (vmaxq_f32 (b, lo), hi));
+        vst1q_s16 (out + i, vcombine_s16 (vqmovn_s32 (ia), vqmovn_s32 (ib)));
+    }
+
+    dsp_to_s16_scalar (in, out, i, len);
+}
+
+static void to_s32_neon (const float * in, int32_t * out, int len, float scale,
+ float max)
+{
+    float32x4_t lo = vdupq_n_f32 (-scale), hi = vdupq_n_f32 (max);
+
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        float32x4_t x = vmulq_n_f32 (vld1q_f32 (in + i), scale);
+        vst1q_s32 (out + i, round_neon (vminq_f32 (vmaxq_f32 (x, lo), hi)));
+    }
+
+    dsp_to_s32_scalar (in, out, i, len, scale, max);
+}
+
+static void pack_s16_neon (const int32_t * const * in, int16_t * out, int channels,
+ int frames)
+{
+    int f = 0;
+
+    if (channels == 1)
+    {
+        for (; f + 8 <= frames; f += 8)
+        {
+            int16x4_t a = vqmovn_s32 (vld1q_s32 (in[0] + f));
+            int16x4_t b = vqmovn_s32 (vld1q_s32 (in[0] + f + 4));
+            vst1q_s16 (out + f, vcombine_s16 (a, b));
+        }
+    }
+    else if (channels == 2)
+    {
+        for (; f + 4 <= frames; f += 4)
+        {
+            int16x4x2_t x = {{vqmovn_s32 (vld1q_s32 (in[0] + f)),
+             vqmovn_s32 (vld1q_s32 (in[1] + f))}};
+            vst2_s16 (out + 2 * f, x);
+        }
+    }
+
+    dsp_pack_s16_scalar (in, out, channels, f, frames);
+}
+
+static void pack_s32_neon (const int32_t * const * in, int32_t * out, int channels,
+ int frames)
+{
+    int f = 0;
+
+    if (channels == 1)
+    {
+        memcpy (out, in[0], sizeof (int32_t) * frames);
+        return;
+    }
+
+    if (channels == 2)
+    {
+        for (; f + 4 <= frames; f += 4)
+        {
+            int32x4x2_t x = {{vld1q_s32 (in[0] + f), vld1q_s32 (in[1] + f)}};
+            vst2q_s32 (out + 2 * f, x);
+        }
+    }
+
+    dsp_pack_s32_scalar (in, out, channels, f, frames);
+}
+
+void dsp_init_neon (DSPKernels & k)
+{
+    k.isa = "neon";
+    k.ramp = ramp_neon;
+    k.scale = scale_neon;
+    k.mix = mix_neon;
+    k.multiply = multiply_neon;
+    k.mul_add = mul_add_neon;
+    k.abs_sum = abs_sum_neon;
+    k.dot = dot_neon;
+    k.interleave = interleave_neon;
+    k.deinterleave = deinterleave_neon;
+    k.matrix_mix = matrix_mix_neon;
+    k.butterfly = butterfly_neon;
+    k.complex_mac = complex_mac_neon;
+    k.hadamard = hadamard_neon;
+    k.true_peak = true_peak_neon;
+    k.biquads = biquads_neon;
+    k.to_s16 = to_s16_neon;
+    k.to_s32 = to_s32_neon;
+    k.pack_s16 = pack_s16_neon;
+    k.pack_s32 = pack_s32_neon;
+}
+
+#endif /* DSP_NEON */
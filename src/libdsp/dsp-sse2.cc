@@ -0,0 +1,707 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "dsp-internal.h"
+
+#ifdef DSP_X86
+
+#include <emmintrin.h>
+
+/* SSE2 is always present on x86_64, but on i386 we have to enable it per
+ * function and check for it at runtime. */
+#define SSE2_FUNC __attribute__ ((target ("sse2")))
+
+SSE2_FUNC static void ramp_sse2 (float * data, int len, float a, float b)
+{
+    if (len <= 0)
+        return;
+
+    float step = (b - a) / len;
+    __m128 va = _mm_set1_ps (a);
+    __m128 vstep = _mm_set1_ps (step);
+    __m128i index = _mm_setr_epi32 (0, 1, 2, 3);
+    __m128i four = _mm_set1_epi32 (4);
+
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        /* computed from the index rather than accumulated, so that rounding
+         * errors do not build up over long ramps */
+        __m128 gain = _mm_add_ps (va, _mm_mul_ps (vstep, _mm_cvtepi32_ps (index)));
+        _mm_storeu_ps (data + i, _mm_mul_ps (_mm_loadu_ps (data + i), gain));
+        index = _mm_add_epi32 (index, four);
+    }
+
+    dsp_ramp_scalar (data, i, len, a, step);
+}
+
+SSE2_FUNC static void scale_sse2 (float * data, int len, float gain)
+{
+    __m128 vgain = _mm_set1_ps (gain);
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+        _mm_storeu_ps (data + i, _mm_mul_ps (_mm_loadu_ps (data + i), vgain));
+
+    for (; i < len; i ++)
+        data[i] *= gain;
+}
+
+SSE2_FUNC static void mix_sse2 (float * data, const float * add, int len)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        __m128 a = _mm_add_ps (_mm_loadu_ps (data + i), _mm_loadu_ps (add + i));
+        __m128 b = _mm_add_ps (_mm_loadu_ps (data + i + 4), _mm_loadu_ps (add + i + 4));
+        _mm_storeu_ps (data + i, a);
+        _mm_storeu_ps (data + i + 4, b);
+    }
+
+    for (; i < len; i ++)
+        data[i] += add[i];
+}
+
+SSE2_FUNC static void multiply_sse2 (float * data, const float * gain, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+        _mm_storeu_ps (data + i, _mm_mul_ps (_mm_loadu_ps (data + i), _mm_loadu_ps (gain + i)));
+
+    for (; i < len; i ++)
+        data[i] *= gain[i];
+}
+
+SSE2_FUNC static void mul_add_sse2 (float * data, const float * a, const float * b, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+        _mm_storeu_ps (data + i, _mm_add_ps (_mm_loadu_ps (data + i),
+         _mm_mul_ps (_mm_loadu_ps (a + i), _mm_loadu_ps (b + i))));
+
+    for (; i < len; i ++)
+        data[i] += a[i] * b[i];
+}
+
+SSE2_FUNC static float abs_sum_sse2 (const float * data, int len)
+{
+    __m128 mask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+    __m128 sum1 = _mm_setzero_ps ();
+    __m128 sum2 = _mm_setzero_ps ();
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        sum1 = _mm_add_ps (sum1, _mm_and_ps (_mm_loadu_ps (data + i), mask));
+        sum2 = _mm_add_ps (sum2, _mm_and_ps (_mm_loadu_ps (data + i + 4), mask));
+    }
+
+    float part[4];
+    _mm_storeu_ps (part, _mm_add_ps (sum1, sum2));
+
+    float sum = part[0] + part[1] + part[2] + part[3];
+
+    for (; i < len; i ++)
+        sum += (data[i] < 0) ? -data[i] : data[i];
+
+    return sum;
+}
+
+SSE2_FUNC static float dot_sse2 (const float * a, const float * b, int len)
+{
+    __m128 sum1 = _mm_setzero_ps ();
+    __m128 sum2 = _mm_setzero_ps ();
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_loadu_ps (a + i), _mm_loadu_ps (b + i)));
+        sum2 = _mm_add_ps (sum2, _mm_mul_ps (_mm_loadu_ps (a + i + 4), _mm_loadu_ps (b + i + 4)));
+    }
+
+    float part[4];
+    _mm_storeu_ps (part, _mm_add_ps (sum1, sum2));
+
+    float sum = part[0] + part[1] + part[2] + part[3];
+
+    for (; i < len; i ++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+/* Four frames at a time: each group of four channels is transposed, and a
+ * remaining pair of channels is unpacked and stored in halves. */
+SSE2_FUNC static void interleave_multi_sse2 (const float * const * in, float * out,
+ int channels, int frames)
+{
+    int f = 0;
+
+    for (; f + 4 <= frames; f += 4)
+    {
+        float * set = out + f * channels;
+        int c = 0;
+
+        for (; c + 4 <= channels; c += 4)
+        {
+            __m128 a = _mm_loadu_ps (in[c] + f);
+            __m128 b = _mm_loadu_ps (in[c + 1] + f);
+            __m128 x = _mm_loadu_ps (in[c + 2] + f);
+            __m128 y = _mm_loadu_ps (in[c + 3] + f);
+
+            _MM_TRANSPOSE4_PS (a, b, x, y);
+
+            _mm_storeu_ps (set + c, a);
+            _mm_storeu_ps (set + channels + c, b);
+            _mm_storeu_ps (set + 2 * channels + c, x);
+            _mm_storeu_ps (set + 3 * channels + c, y);
+        }
+
+        if (c + 2 <= channels)
+        {
+            __m128 a = _mm_loadu_ps (in[c] + f);
+            __m128 b = _mm_loadu_ps (in[c + 1] + f);
+            __m128 lo = _mm_unpacklo_ps (a, b);
+            __m128 hi = _mm_unpackhi_ps (a, b);
+
+            _mm_storel_pi ((__m64 *) (set + c), lo);
+            _mm_storeh_pi ((__m64 *) (set + channels + c), lo);
+            _mm_storel_pi ((__m64 *) (set + 2 * channels + c), hi);
+            _mm_storeh_pi ((__m64 *) (set + 3 * channels + c), hi);
+
+            c += 2;
+        }
+
+        if (c < channels)
+        {
+            for (int k = 0; k < 4; k ++)
+                set[k * channels + c] = in[c][f + k];
+        }
+    }
+
+    dsp_interleave_scalar (in, out, channels, f, frames);
+}
+
+SSE2_FUNC static void interleave_sse2 (const float * const * in, float * out,
+ int channels, int frames)
+{
+    if (channels == 1)
+    {
+        memcpy (out, in[0], sizeof (float) * frames);
+        return;
+    }
+
+    if (channels != 2)
+    {
+        interleave_multi_sse2 (in, out, channels, frames);
+        return;
+    }
+
+    const float * left = in[0];
+    const float * right = in[1];
+    int f = 0;
+
+    for (; f + 4 <= frames; f += 4)
+    {
+        __m128 l = _mm_loadu_ps (left + f);
+        __m128 r = _mm_loadu_ps (right + f);
+        _mm_storeu_ps (out + 2 * f, _mm_unpacklo_ps (l, r));
+        _mm_storeu_ps (out + 2 * f + 4, _mm_unpackhi_ps (l, r));
+    }
+
+    dsp_interleave_scalar (in, out, 2, f, frames);
+}
+
+SSE2_FUNC static void deinterleave_sse2 (const float * in, float * const * out,
+ int channels, int frames)
+{
+    if (channels != 2)
+    {
+        dsp_deinterleave_scalar (in, out, channels, 0, frames);
+        return;
+    }
+
+    float * left = out[0];
+    float * right = out[1];
+    int f = 0;
+
+    for (; f + 4 <= frames; f += 4)
+    {
+        __m128 a = _mm_loadu_ps (in + 2 * f);
+        __m128 b = _mm_loadu_ps (in + 2 * f + 4);
+        _mm_storeu_ps (left + f, _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0)));
+        _mm_storeu_ps (right + f, _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1)));
+    }
+
+    dsp_deinterleave_scalar (in, out, 2, f, frames);
+}
+
+/* Each input sample is multiplied by its column of the matrix, four outputs
+ * at a time.  With the channel counts known, the loops are unrolled and the
+ * columns stay in registers. */
+template<int IN, int OUT>
+SSE2_FUNC static void matrix_mix_fixed_sse2 (const float * in, float * out,
+ const float * m, int frames)
+{
+    constexpr int V = (OUT + 3) / 4;
+    constexpr int rem = OUT % 4;
+
+    __m128 cols[IN][V];
+
+    for (int i = 0; i < IN; i ++)
+    {
+        for (int v = 0; v < V; v ++)
+        {
+            float col[4] = {};
+            for (int k = 0; k < 4 && 4 * v + k < OUT; k ++)
+                col[k] = m[(4 * v + k) * IN + i];
+
+            cols[i][v] = _mm_loadu_ps (col);
+        }
+    }
+
+    for (int f = 0; f < frames; f ++)
+    {
+        __m128 acc[V];
+
+        for (int v = 0; v < V; v ++)
+            acc[v] = _mm_setzero_ps ();
+
+        for (int i = 0; i < IN; i ++)
+        {
+            __m128 x = _mm_set1_ps (in[i]);
+            for (int v = 0; v < V; v ++)
+                acc[v] = _mm_add_ps (acc[v], _mm_mul_ps (x, cols[i][v]));
+        }
+
+        for (int v = 0; v < OUT / 4; v ++)
+            _mm_storeu_ps (out + 4 * v, acc[v]);
+
+        float * tail = out + 4 * (OUT / 4);
+
+        if (rem == 1)
+            _mm_store_ss (tail, acc[V - 1]);
+        else if (rem >= 2)
+            _mm_storel_pi ((__m64 *) tail, acc[V - 1]);
+
+        if (rem == 3)
+            _mm_store_ss (tail + 2, _mm_movehl_ps (acc[V - 1], acc[V - 1]));
+
+        in += IN;
+        out += OUT;
+    }
+}
+
+#define FIXED_MIX_SSE2(i, o) {i, o, matrix_mix_fixed_sse2<i, o>},
+
+static const DSPFixedMix fixed_mixes_sse2[] = {
+    DSP_FIXED_MIXES (FIXED_MIX_SSE2)
+};
+
+SSE2_FUNC static void matrix_mix_sse2 (const float * in, int in_channels,
+ float * out, int out_channels, const float * m, int frames)
+{
+    for (const DSPFixedMix & mix : fixed_mixes_sse2)
+    {
+        if (mix.in_channels == in_channels && mix.out_channels == out_channels)
+        {
+            mix.func (in, out, m, frames);
+            return;
+        }
+    }
+
+    int f = 0;
+
+    if (in_channels == 2 && out_channels == 2)
+    {
+        /* L' = m0 * L + m1 * R, R' = m2 * L + m3 * R */
+        __m128 direct = _mm_setr_ps (m[0], m[3], m[0], m[3]);
+        __m128 cross = _mm_setr_ps (m[1], m[2], m[1], m[2]);
+
+        for (; f + 2 <= frames; f += 2)
+        {
+            __m128 x = _mm_loadu_ps (in + 2 * f);
+            __m128 swapped = _mm_shuffle_ps (x, x, _MM_SHUFFLE (2, 3, 0, 1));
+            _mm_storeu_ps (out + 2 * f, _mm_add_ps (_mm_mul_ps (x, direct),
+             _mm_mul_ps (swapped, cross)));
+        }
+    }
+    else if (in_channels == 1 && out_channels == 2)
+    {
+        __m128 coef = _mm_setr_ps (m[0], m[1], m[0], m[1]);
+
+        for (; f + 4 <= frames; f += 4)
+        {
+            __m128 x = _mm_loadu_ps (in + f);
+            _mm_storeu_ps (out + 2 * f, _mm_mul_ps (_mm_unpacklo_ps (x, x), coef));
+            _mm_storeu_ps (out + 2 * f + 4, _mm_mul_ps (_mm_unpackhi_ps (x, x), coef));
+        }
+    }
+    else if (in_channels == 2 && out_channels == 1)
+    {
+        __m128 left_coef = _mm_set1_ps (m[0]);
+        __m128 right_coef = _mm_set1_ps (m[1]);
+
+        for (; f + 4 <= frames; f += 4)
+        {
+            __m128 a = _mm_loadu_ps (in + 2 * f);
+            __m128 b = _mm_loadu_ps (in + 2 * f + 4);
+            __m128 l = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+            __m128 r = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+            _mm_storeu_ps (out + f, _mm_add_ps (_mm_mul_ps (l, left_coef),
+             _mm_mul_ps (r, right_coef)));
+        }
+    }
+
+    dsp_matrix_mix_scalar (in + in_channels * f, in_channels,
+     out + out_channels * f, out_channels, m, frames - f);
+}
+
+SSE2_FUNC static void butterfly_sse2 (float * re0, float * im0, float * re1,
+ float * im1, const float * wr, const float * wi, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        __m128 xr = _mm_loadu_ps (re1 + i), xi = _mm_loadu_ps (im1 + i);
+        __m128 cr = _mm_loadu_ps (wr + i), ci = _mm_loadu_ps (wi + i);
+        __m128 tr = _mm_sub_ps (_mm_mul_ps (xr, cr), _mm_mul_ps (xi, ci));
+        __m128 ti = _mm_add_ps (_mm_mul_ps (xr, ci), _mm_mul_ps (xi, cr));
+        __m128 yr = _mm_loadu_ps (re0 + i), yi = _mm_loadu_ps (im0 + i);
+
+        _mm_storeu_ps (re1 + i, _mm_sub_ps (yr, tr));
+        _mm_storeu_ps (im1 + i, _mm_sub_ps (yi, ti));
+        _mm_storeu_ps (re0 + i, _mm_add_ps (yr, tr));
+        _mm_storeu_ps (im0 + i, _mm_add_ps (yi, ti));
+    }
+
+    dsp_butterfly_scalar (re0, im0, re1, im1, wr, wi, i, len);
+}
+
+SSE2_FUNC static void complex_mac_sse2 (float * acc_re, float * acc_im,
+ const float * a_re, const float * a_im, const float * b_re, const float * b_im, int len)
+{
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        __m128 ar = _mm_loadu_ps (a_re + i), ai = _mm_loadu_ps (a_im + i);
+        __m128 br = _mm_loadu_ps (b_re + i), bi = _mm_loadu_ps (b_im + i);
+        __m128 pr = _mm_sub_ps (_mm_mul_ps (ar, br), _mm_mul_ps (ai, bi));
+        __m128 pi = _mm_add_ps (_mm_mul_ps (ar, bi), _mm_mul_ps (ai, br));
+
+        _mm_storeu_ps (acc_re + i, _mm_add_ps (_mm_loadu_ps (acc_re + i), pr));
+        _mm_storeu_ps (acc_im + i, _mm_add_ps (_mm_loadu_ps (acc_im + i), pi));
+    }
+
+    dsp_complex_mac_scalar (acc_re, acc_im, a_re, a_im, b_re, b_im, i, len);
+}
+
+/* The first two stages mix values within a vector; the rest mix whole
+ * vectors. */
+SSE2_FUNC static void hadamard_sse2 (float * data, int size, int frames)
+{
+    __m128 sign1 = _mm_setr_ps (1, -1, 1, -1);
+    __m128 sign2 = _mm_setr_ps (1, 1, -1, -1);
+    __m128 scale = _mm_set1_ps (1 / sqrtf (size));
+    int n = size / 4;
+
+    for (int f = 0; f < frames; f ++)
+    {
+        __m128 v[DSP_MAX_HADAMARD / 4];
+
+        for (int i = 0; i < n; i ++)
+        {
+            __m128 x = _mm_loadu_ps (data + 4 * i);
+            x = _mm_add_ps (_mm_mul_ps (x, sign1),
+             _mm_shuffle_ps (x, x, _MM_SHUFFLE (2, 3, 0, 1)));
+            v[i] = _mm_add_ps (_mm_mul_ps (x, sign2),
+             _mm_shuffle_ps (x, x, _MM_SHUFFLE (1, 0, 3, 2)));
+        }
+
+        for (int h = 1; h < n; h *= 2)
+        {
+            for (int i = 0; i < n; i += 2 * h)
+            {
+                for (int j = i; j < i + h; j ++)
+                {
+                    __m128 a = v[j], b = v[j + h];
+                    v[j] = _mm_add_ps (a, b);
+                    v[j + h] = _mm_sub_ps (a, b);
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i ++)
+            _mm_storeu_ps (data + 4 * i, _mm_mul_ps (v[i], scale));
+
+        data += size;
+    }
+}
+
+/* The channels of each frame are filtered together, four at a time; the
+ * recursion runs across frames, so it cannot be vectorized that way. */
+SSE2_FUNC static void biquads_sse2 (float * data, int channels, int frames,
+ const float * coefs, int sections, float * state)
+{
+    __m128 b0[DSP_MAX_BIQUADS], b1[DSP_MAX_BIQUADS], b2[DSP_MAX_BIQUADS];
+    __m128 a1[DSP_MAX_BIQUADS], a2[DSP_MAX_BIQUADS];
+
+    for (int s = 0; s < sections; s ++)
+    {
+        b0[s] = _mm_set1_ps (coefs[5 * s]);
+        b1[s] = _mm_set1_ps (coefs[5 * s + 1]);
+        b2[s] = _mm_set1_ps (coefs[5 * s + 2]);
+        a1[s] = _mm_set1_ps (coefs[5 * s + 3]);
+        a2[s] = _mm_set1_ps (coefs[5 * s + 4]);
+    }
+
+    int c = 0;
+
+    for (; c + 4 <= channels; c += 4)
+    {
+        __m128 s1[DSP_MAX_BIQUADS], s2[DSP_MAX_BIQUADS];
+
+        for (int s = 0; s < sections; s ++)
+        {
+            s1[s] = _mm_loadu_ps (state + 2 * s * channels + c);
+            s2[s] = _mm_loadu_ps (state + (2 * s + 1) * channels + c);
+        }
+
+        for (int f = 0; f < frames; f ++)
+        {
+            float * frame = data + f * channels + c;
+            __m128 x = _mm_loadu_ps (frame);
+
+            for (int s = 0; s < sections; s ++)
+            {
+                __m128 y = _mm_add_ps (_mm_mul_ps (b0[s], x), s1[s]);
+                s1[s] = _mm_add_ps (_mm_sub_ps (_mm_mul_ps (b1[s], x),
+                 _mm_mul_ps (a1[s], y)), s2[s]);
+                s2[s] = _mm_sub_ps (_mm_mul_ps (b2[s], x), _mm_mul_ps (a2[s], y));
+                x = y;
+            }
+
+            _mm_storeu_ps (frame, x);
+        }
+
+        for (int s = 0; s < sections; s ++)
+        {
+            _mm_storeu_ps (state + 2 * s * channels + c, s1[s]);
+            _mm_storeu_ps (state + (2 * s + 1) * channels + c, s2[s]);
+        }
+    }
+
+    /* two remaining channels (stereo, or the last two of 5.1) */
+    if (c + 2 <= channels)
+    {
+        __m128 s1[DSP_MAX_BIQUADS], s2[DSP_MAX_BIQUADS];
+        __m128 zero = _mm_setzero_ps ();
+
+        for (int s = 0; s < sections; s ++)
+        {
+            s1[s] = _mm_loadl_pi (zero, (const __m64 *) (state + 2 * s * channels + c));
+            s2[s] = _mm_loadl_pi (zero, (const __m64 *) (state + (2 * s + 1) * channels + c));
+        }
+
+        for (int f = 0; f < frames; f ++)
+        {
+            float * frame = data + f * channels + c;
+            __m128 x = _mm_loadl_pi (zero, (const __m64 *) frame);
+
+            for (int s = 0; s < sections; s ++)
+            {
+                __m128 y = _mm_add_ps (_mm_mul_ps (b0[s], x), s1[s]);
+                s1[s] = _mm_add_ps (_mm_sub_ps (_mm_mul_ps (b1[s], x),
+                 _mm_mul_ps (a1[s], y)), s2[s]);
+                s2[s] = _mm_sub_ps (_mm_mul_ps (b2[s], x), _mm_mul_ps (a2[s], y));
+                x = y;
+            }
+
+            _mm_storel_pi ((__m64 *) frame, x);
+        }
+
+        for (int s = 0; s < sections; s ++)
+        {
+            _mm_storel_pi ((__m64 *) (state + 2 * s * channels + c), s1[s]);
+            _mm_storel_pi ((__m64 *) (state + (2 * s + 1) * channels + c), s2[s]);
+        }
+
+        c += 2;
+    }
+
+    dsp_biquads_scalar (data, channels, c, channels, frames, coefs, sections, state);
+}
+
+/* computes the four phases of each channel at once */
+SSE2_FUNC static void true_peak_sse2 (const float * in, int channels, int frames,
+ const float * coefs, float * peaks)
+{
+    __m128 mask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+
+    for (int f = 0; f < frames; f ++)
+    {
+        __m128 peak = _mm_setzero_ps ();
+
+        for (int c = 0; c < channels; c ++)
+        {
+            const float * x = in + f * channels + c;
+            __m128 sum = _mm_setzero_ps ();
+
+            for (int t = 0; t < DSP_TRUE_PEAK_TAPS; t ++)
+                sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (x[t * channels]),
+                 _mm_loadu_ps (coefs + 4 * t)));
+
+            peak = _mm_max_ps (peak, _mm_and_ps (sum, mask));
+        }
+
+        peak = _mm_max_ps (peak, _mm_shuffle_ps (peak, peak, _MM_SHUFFLE (1, 0, 3, 2)));
+        peak = _mm_max_ps (peak, _mm_shuffle_ps (peak, peak, _MM_SHUFFLE (2, 3, 0, 1)));
+        _mm_store_ss (peaks + f, peak);
+    }
+}
+
+/* The samples are clipped as floats, since out-of-range conversions yield
+ * INT_MIN, and then converted with the default rounding (to nearest). */
+SSE2_FUNC static void to_s16_sse2 (const float * in, int16_t * out, int len)
+{
+    __m128 scale = _mm_set1_ps (32768);
+    __m128 lo = _mm_set1_ps (-32768), hi = _mm_set1_ps (32767);
+
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        __m128 a = _mm_mul_ps (_mm_loadu_ps (in + i), scale);
+        __m128 b = _mm_mul_ps (_mm_loadu_ps (in + i + 4), scale);
+        __m128i ia = _mm_cvtps_epi32 (_mm_min_ps (_mm_max_ps (a, lo), hi));
+        __m128i ib = _mm_cvtps_epi32 (_mm_min_ps (_mm_max_ps (b, lo), hi));
+        _mm_storeu_si128 ((__m128i *) (out + i), _mm_packs_epi32 (ia, ib));
+    }
+
+    dsp_to_s16_scalar (in, out, i, len);
+}
+
+SSE2_FUNC static void to_s32_sse2 (const float * in, int32_t * out, int len,
+ float scale, float max)
+{
+    __m128 vscale = _mm_set1_ps (scale);
+    __m128 lo = _mm_set1_ps (-scale), hi = _mm_set1_ps (max);
+
+    int i = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        __m128 x = _mm_mul_ps (_mm_loadu_ps (in + i), vscale);
+        __m128i ix = _mm_cvtps_epi32 (_mm_min_ps (_mm_max_ps (x, lo), hi));
+        _mm_storeu_si128 ((__m128i *) (out + i), ix);
+    }
+
+    dsp_to_s32_scalar (in, out, i, len, scale, max);
+}
+
+/* Mono and stereo are the common cases; other layouts are left to the scalar
+ * version. */
+SSE2_FUNC static void pack_s16_sse2 (const int32_t * const * in, int16_t * out,
+ int channels, int frames)
+{
+    int f = 0;
+
+    if (channels == 1)
+    {
+        for (; f + 8 <= frames; f += 8)
+        {
+            __m128i a = _mm_loadu_si128 ((const __m128i *) (in[0] + f));
+            __m128i b = _mm_loadu_si128 ((const __m128i *) (in[0] + f + 4));
+            _mm_storeu_si128 ((__m128i *) (out + f), _mm_packs_epi32 (a, b));
+        }
+    }
+    else if (channels == 2)
+    {
+        for (; f + 4 <= frames; f += 4)
+        {
+            __m128i l = _mm_loadu_si128 ((const __m128i *) (in[0] + f));
+            __m128i r = _mm_loadu_si128 ((const __m128i *) (in[1] + f));
+            _mm_storeu_si128 ((__m128i *) (out + 2 * f), _mm_packs_epi32
+             (_mm_unpacklo_epi32 (l, r), _mm_unpackhi_epi32 (l, r)));
+        }
+    }
+
+    dsp_pack_s16_scalar (in, out, channels, f, frames);
+}
+
+SSE2_FUNC static void pack_s32_sse2 (const int32_t * const * in, int32_t * out,
+ int channels, int frames)
+{
+    int f = 0;
+
+    if (channels == 1)
+    {
+        memcpy (out, in[0], sizeof (int32_t) * frames);
+        return;
+    }
+
+    if (channels == 2)
+    {
+        for (; f + 4 <= frames; f += 4)
+        {
+            __m128i l = _mm_loadu_si128 ((const __m128i *) (in[0] + f));
+            __m128i r = _mm_loadu_si128 ((const __m128i *) (in[1] + f));
+            _mm_storeu_si128 ((__m128i *) (out + 2 * f), _mm_unpacklo_epi32 (l, r));
+            _mm_storeu_si128 ((__m128i *) (out + 2 * f + 4), _mm_unpackhi_epi32 (l, r));
+        }
+    }
+
+    dsp_pack_s32_scalar (in, out, channels, f, frames);
+}
+
+void dsp_init_sse2 (DSPKernels & k)
+{
+    k.isa = "sse2";
+    k.ramp = ramp_sse2;
+    k.scale = scale_sse2;
+    k.mix = mix_sse2;
+    k.multiply = multiply_sse2;
+    k.mul_add = mul_add_sse2;
+    k.abs_sum = abs_sum_sse2;
+    k.dot = dot_sse2;
+    k.interleave = interleave_sse2;
+    k.deinterleave = deinterleave_sse2;
+    k.matrix_mix = matrix_mix_sse2;
+    k.butterfly = butterfly_sse2;
+    k.complex_mac = complex_mac_sse2;
+    k.hadamard = hadamard_sse2;
+    k.true_peak = true_peak_sse2;
+    k.biquads = biquads_sse2;
+    k.to_s16 = to_s16_sse2;
+    k.to_s32 = to_s32_sse2;
+    k.pack_s16 = pack_s16_sse2;
+    k.pack_s32 = pack_s32_sse2;
+}
+
+#endif /* DSP_X86 */
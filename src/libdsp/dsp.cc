@@ -0,0 +1,654 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/templates.h>
+
+#include "dsp.h"
+#include "dsp-internal.h"
+
+void dsp_ramp_scalar (float * data, int start, int len, float a, float step)
+{
+    for (int i = start; i < len; i ++)
+        data[i] *= a + step * i;
+}
+
+static void ramp_scalar (float * data, int len, float a, float b)
+{
+    if (len > 0)
+        dsp_ramp_scalar (data, 0, len, a, (b - a) / len);
+}
+
+static void scale_scalar (float * data, int len, float gain)
+{
+    for (int i = 0; i < len; i ++)
+        data[i] *= gain;
+}
+
+static void mix_scalar (float * data, const float * add, int len)
+{
+    for (int i = 0; i < len; i ++)
+        data[i] += add[i];
+}
+
+static void multiply_scalar (float * data, const float * gain, int len)
+{
+    for (int i = 0; i < len; i ++)
+        data[i] *= gain[i];
+}
+
+static void mul_add_scalar (float * data, const float * a, const float * b, int len)
+{
+    for (int i = 0; i < len; i ++)
+        data[i] += a[i] * b[i];
+}
+
+static float abs_sum_scalar (const float * data, int len)
+{
+    float sum = 0;
+
+    for (int i = 0; i < len; i ++)
+        sum += fabsf (data[i]);
+
+    return sum;
+}
+
+static float dot_scalar (const float * a, const float * b, int len)
+{
+    float sum = 0;
+
+    for (int i = 0; i < len; i ++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+void dsp_interleave_scalar (const float * const * in, float * out, int channels,
+ int start, int frames)
+{
+    for (int c = 0; c < channels; c ++)
+    {
+        const float * get = in[c];
+        float * set = out + c;
+
+        for (int f = start; f < frames; f ++)
+            set[f * channels] = get[f];
+    }
+}
+
+void dsp_deinterleave_scalar (const float * in, float * const * out, int channels,
+ int start, int frames)
+{
+    for (int c = 0; c < channels; c ++)
+    {
+        const float * get = in + c;
+        float * set = out[c];
+
+        for (int f = start; f < frames; f ++)
+            set[f] = get[f * channels];
+    }
+}
+
+static void interleave_scalar (const float * const * in, float * out, int channels, int frames)
+    { dsp_interleave_scalar (in, out, channels, 0, frames); }
+static void deinterleave_scalar (const float * in, float * const * out, int channels, int frames)
+    { dsp_deinterleave_scalar (in, out, channels, 0, frames); }
+
+void dsp_matrix_mix_scalar (const float * in, int in_channels, float * out,
+ int out_channels, const float * matrix, int frames)
+{
+    float frame[in_channels];
+
+    while (frames --)
+    {
+        /* copy the input frame first, in case in == out */
+        for (int i = 0; i < in_channels; i ++)
+            frame[i] = in[i];
+
+        const float * coef = matrix;
+
+        for (int c = 0; c < out_channels; c ++)
+        {
+            float sum = 0;
+
+            for (int i = 0; i < in_channels; i ++)
+                sum += frame[i] * (* coef ++);
+
+            out[c] = sum;
+        }
+
+        in += in_channels;
+        out += out_channels;
+    }
+}
+
+void dsp_butterfly_scalar (float * re0, float * im0, float * re1, float * im1,
+ const float * wr, const float * wi, int start, int len)
+{
+    for (int i = start; i < len; i ++)
+    {
+        float tr = re1[i] * wr[i] - im1[i] * wi[i];
+        float ti = re1[i] * wi[i] + im1[i] * wr[i];
+
+        re1[i] = re0[i] - tr;
+        im1[i] = im0[i] - ti;
+        re0[i] += tr;
+        im0[i] += ti;
+    }
+}
+
+static void butterfly_scalar (float * re0, float * im0, float * re1, float * im1,
+ const float * wr, const float * wi, int len)
+    { dsp_butterfly_scalar (re0, im0, re1, im1, wr, wi, 0, len); }
+
+void dsp_complex_mac_scalar (float * acc_re, float * acc_im, const float * a_re,
+ const float * a_im, const float * b_re, const float * b_im, int start, int len)
+{
+    for (int i = start; i < len; i ++)
+    {
+        acc_re[i] += a_re[i] * b_re[i] - a_im[i] * b_im[i];
+        acc_im[i] += a_re[i] * b_im[i] + a_im[i] * b_re[i];
+    }
+}
+
+static void complex_mac_scalar (float * acc_re, float * acc_im, const float * a_re,
+ const float * a_im, const float * b_re, const float * b_im, int len)
+    { dsp_complex_mac_scalar (acc_re, acc_im, a_re, a_im, b_re, b_im, 0, len); }
+
+static void hadamard_scalar (float * data, int size, int frames)
+{
+    float scale = 1 / sqrtf (size);
+
+    for (int f = 0; f < frames; f ++)
+    {
+        for (int h = 1; h < size; h *= 2)
+        {
+            for (int i = 0; i < size; i += 2 * h)
+            {
+                for (int j = i; j < i + h; j ++)
+                {
+                    float a = data[j], b = data[j + h];
+                    data[j] = a + b;
+                    data[j + h] = a - b;
+                }
+            }
+        }
+
+        for (int i = 0; i < size; i ++)
+            data[i] *= scale;
+
+        data += size;
+    }
+}
+
+void dsp_true_peak_scalar (const float * in, int channels, int frames,
+ const float * coefs, float * peaks)
+{
+    for (int f = 0; f < frames; f ++)
+    {
+        float peak = 0;
+
+        for (int c = 0; c < channels; c ++)
+        {
+            const float * x = in + f * channels + c;
+
+            for (int p = 0; p < 4; p ++)
+            {
+                float sum = 0;
+
+                for (int t = 0; t < DSP_TRUE_PEAK_TAPS; t ++)
+                    sum += coefs[t * 4 + p] * x[t * channels];
+
+                peak = fmaxf (peak, fabsf (sum));
+            }
+        }
+
+        peaks[f] = peak;
+    }
+}
+
+void dsp_biquads_scalar (float * data, int channels, int first, int last,
+ int frames, const float * coefs, int sections, float * state)
+{
+    for (int c = first; c < last; c ++)
+    {
+        float s1[DSP_MAX_BIQUADS], s2[DSP_MAX_BIQUADS];
+
+        for (int s = 0; s < sections; s ++)
+        {
+            s1[s] = state[2 * s * channels + c];
+            s2[s] = state[(2 * s + 1) * channels + c];
+        }
+
+        for (int f = 0; f < frames; f ++)
+        {
+            float x = data[f * channels + c];
+
+            for (int s = 0; s < sections; s ++)
+            {
+                const float * k = coefs + 5 * s;
+                float y = k[0] * x + s1[s];
+
+                s1[s] = k[1] * x - k[3] * y + s2[s];
+                s2[s] = k[2] * x - k[4] * y;
+                x = y;
+            }
+
+            data[f * channels + c] = x;
+        }
+
+        for (int s = 0; s < sections; s ++)
+        {
+            state[2 * s * channels + c] = s1[s];
+            state[(2 * s + 1) * channels + c] = s2[s];
+        }
+    }
+}
+
+static void biquads_scalar (float * data, int channels, int frames,
+ const float * coefs, int sections, float * state)
+    { dsp_biquads_scalar (data, channels, 0, channels, frames, coefs, sections, state); }
+
+void dsp_to_s16_scalar (const float * in, int16_t * out, int start, int len)
+{
+    for (int i = start; i < len; i ++)
+        out[i] = lrintf (aud::clamp (in[i] * 32768.0f, -32768.0f, 32767.0f));
+}
+
+void dsp_to_s32_scalar (const float * in, int32_t * out, int start, int len,
+ float scale, float max)
+{
+    for (int i = start; i < len; i ++)
+        out[i] = lrintf (aud::clamp (in[i] * scale, -scale, max));
+}
+
+static void to_s16_scalar (const float * in, int16_t * out, int len)
+    { dsp_to_s16_scalar (in, out, 0, len); }
+static void to_s32_scalar (const float * in, int32_t * out, int len, float scale, float max)
+    { dsp_to_s32_scalar (in, out, 0, len, scale, max); }
+
+void dsp_pack_s16_scalar (const int32_t * const * in, int16_t * out, int channels,
+ int start, int frames)
+{
+    for (int c = 0; c < channels; c ++)
+    {
+        const int32_t * get = in[c];
+        int16_t * set = out + c;
+
+        for (int f = start; f < frames; f ++)
+            set[f * channels] = get[f];
+    }
+}
+
+void dsp_pack_s32_scalar (const int32_t * const * in, int32_t * out, int channels,
+ int start, int frames)
+{
+    for (int c = 0; c < channels; c ++)
+    {
+        const int32_t * get = in[c];
+        int32_t * set = out + c;
+
+        for (int f = start; f < frames; f ++)
+            set[f * channels] = get[f];
+    }
+}
+
+static void pack_s16_scalar (const int32_t * const * in, int16_t * out, int channels, int frames)
+    { dsp_pack_s16_scalar (in, out, channels, 0, frames); }
+static void pack_s32_scalar (const int32_t * const * in, int32_t * out, int channels, int frames)
+    { dsp_pack_s32_scalar (in, out, channels, 0, frames); }
+
+void dsp_init_scalar (DSPKernels & k)
+{
+    k.isa = "scalar";
+    k.ramp = ramp_scalar;
+    k.scale = scale_scalar;
+    k.mix = mix_scalar;
+    k.multiply = multiply_scalar;
+    k.mul_add = mul_add_scalar;
+    k.abs_sum = abs_sum_scalar;
+    k.dot = dot_scalar;
+    k.interleave = interleave_scalar;
+    k.deinterleave = deinterleave_scalar;
+    k.matrix_mix = dsp_matrix_mix_scalar;
+    k.butterfly = butterfly_scalar;
+    k.complex_mac = complex_mac_scalar;
+    k.hadamard = hadamard_scalar;
+    k.true_peak = dsp_true_peak_scalar;
+    k.biquads = biquads_scalar;
+    k.to_s16 = to_s16_scalar;
+    k.to_s32 = to_s32_scalar;
+    k.pack_s16 = pack_s16_scalar;
+    k.pack_s32 = pack_s32_scalar;
+}
+
+static DSPKernels select_kernels ()
+{
+    DSPKernels k;
+    dsp_init_scalar (k);
+
+#ifdef DSP_X86
+#ifdef __GNUC__
+    /* this runs from a static initializer, possibly before libgcc's own */
+    __builtin_cpu_init ();
+#endif
+
+#if defined (__GNUC__) && ! defined (__SSE2__)
+    if (__builtin_cpu_supports ("sse2"))
+#endif
+        dsp_init_sse2 (k);
+
+#ifdef __GNUC__
+    if (__builtin_cpu_supports ("avx2"))
+        dsp_init_avx2 (k);
+#endif
+#endif
+
+#ifdef DSP_NEON
+    dsp_init_neon (k);
+#endif
+
+    return k;
+}
+
+/* zeroth-order modified Bessel function of the first kind */
+static double bessel_i0 (double x)
+{
+    double sum = 1, term = 1;
+
+    for (int k = 1; k < 50 && term > sum * 1e-12; k ++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+struct TruePeakCoefs {
+    float c[DSP_TRUE_PEAK_TAPS * 4];
+};
+
+/* Kaiser-windowed sinc, evaluated at quarter-sample offsets.  Phase 0 falls
+ * exactly on a sample, and phases 1 to 3 between it and the next one. */
+static TruePeakCoefs make_true_peak_coefs ()
+{
+    TruePeakCoefs coefs;
+    const double beta = 5.0;
+    const double radius = DSP_TRUE_PEAK_TAPS / 2;
+
+    for (int p = 0; p < 4; p ++)
+    {
+        double sum = 0;
+
+        for (int t = 0; t < DSP_TRUE_PEAK_TAPS; t ++)
+        {
+            double d = t - (DSP_TRUE_PEAK_TAPS - 1 - DSP_TRUE_PEAK_DELAY) - p / 4.0;
+            double x = d / radius;
+            double h = 0;
+
+            if (x > -1 && x < 1)
+            {
+                double sinc = (d == 0) ? 1 : sin (M_PI * d) / (M_PI * d);
+                h = sinc * bessel_i0 (beta * sqrt (1 - x * x)) / bessel_i0 (beta);
+            }
+
+            coefs.c[t * 4 + p] = h;
+            sum += h;
+        }
+
+        for (int t = 0; t < DSP_TRUE_PEAK_TAPS; t ++)
+            coefs.c[t * 4 + p] /= sum;
+    }
+
+    return coefs;
+}
+
+/* initialized when the plugin is loaded */
+static const DSPKernels kernels = select_kernels ();
+static const TruePeakCoefs true_peak_coefs = make_true_peak_coefs ();
+
+const char * dsp_get_isa ()
+    { return kernels.isa; }
+
+void dsp_ramp (float * data, int len, float a, float b)
+    { kernels.ramp (data, len, a, b); }
+void dsp_scale (float * data, int len, float gain)
+    { kernels.scale (data, len, gain); }
+void dsp_mix (float * data, const float * add, int len)
+    { kernels.mix (data, add, len); }
+void dsp_multiply (float * data, const float * gain, int len)
+    { kernels.multiply (data, gain, len); }
+void dsp_mul_add (float * data, const float * a, const float * b, int len)
+    { kernels.mul_add (data, a, b, len); }
+float dsp_abs_sum (const float * data, int len)
+    { return kernels.abs_sum (data, len); }
+float dsp_dot (const float * a, const float * b, int len)
+    { return kernels.dot (a, b, len); }
+
+void dsp_interleave (const float * const * in, float * out, int channels, int frames)
+    { kernels.interleave (in, out, channels, frames); }
+void dsp_deinterleave (const float * in, float * const * out, int channels, int frames)
+    { kernels.deinterleave (in, out, channels, frames); }
+
+void dsp_matrix_mix (const float * in, int in_channels, float * out,
+ int out_channels, const float * matrix, int frames)
+    { kernels.matrix_mix (in, in_channels, out, out_channels, matrix, frames); }
+
+void dsp_butterfly (float * re0, float * im0, float * re1, float * im1,
+ const float * wr, const float * wi, int len)
+    { kernels.butterfly (re0, im0, re1, im1, wr, wi, len); }
+
+void dsp_complex_mac (float * acc_re, float * acc_im, const float * a_re,
+ const float * a_im, const float * b_re, const float * b_im, int len)
+    { kernels.complex_mac (acc_re, acc_im, a_re, a_im, b_re, b_im, len); }
+
+void dsp_hadamard (float * data, int size, int frames)
+    { kernels.hadamard (data, size, frames); }
+
+void dsp_biquads (float * data, int channels, int frames, const float * coefs,
+ int sections, float * state)
+    { kernels.biquads (data, channels, frames, coefs, sections, state); }
+
+void dsp_true_peak (const float * in, int channels, int frames, float * history,
+ float * peaks)
+{
+    const int keep = DSP_TRUE_PEAK_TAPS - 1;
+    const float * coefs = true_peak_coefs.c;
+
+    /* The first frames need the history; the rest can be read from the input
+     * directly. */
+    float start[2 * (DSP_TRUE_PEAK_TAPS - 1) * AUD_MAX_CHANNELS];
+    int head = aud::min (frames, keep);
+
+    memcpy (start, history, sizeof (float) * keep * channels);
+    memcpy (start + keep * channels, in, sizeof (float) * head * channels);
+
+    kernels.true_peak (start, channels, head, coefs, peaks);
+
+    if (frames > head)
+        kernels.true_peak (in, channels, frames - head, coefs, peaks + head);
+
+    if (frames >= keep)
+        memcpy (history, in + (frames - keep) * channels, sizeof (float) * keep * channels);
+    else
+        memcpy (history, start + frames * channels, sizeof (float) * keep * channels);
+}
+
+void dsp_difference (float * data, int len, int channels, float * prev, float amount)
+{
+    float * end = data + len;
+
+    while (data < end)
+    {
+        for (int c = 0; c < channels; c ++)
+        {
+            float current = * data;
+            * data ++ = current + (current - prev[c]) * amount;
+            prev[c] = current;
+        }
+    }
+}
+
+void dsp_to_int (const float * in, void * out, int len, int bits)
+{
+    if (bits == 16)
+    {
+        kernels.to_s16 (in, (int16_t *) out, len);
+        return;
+    }
+
+    float scale = (bits == 24) ? 8388608.0f : 2147483648.0f;
+    float max = (bits == 24) ? 8388607.0f : 2147483520.0f;
+
+    kernels.to_s32 (in, (int32_t *) out, len, scale, max);
+}
+
+void dsp_pack_int (const int32_t * const * in, void * out, int channels,
+ int frames, int bits)
+{
+    if (bits == 16)
+        kernels.pack_s16 (in, (int16_t *) out, channels, frames);
+    else if (bits != 8)
+        kernels.pack_s32 (in, (int32_t *) out, channels, frames);
+    else
+    {
+        int8_t * set = (int8_t *) out;
+
+        for (int f = 0; f < frames; f ++)
+        {
+            for (int c = 0; c < channels; c ++)
+                * set ++ = in[c][f];
+        }
+    }
+}
+
+/* FTZ and DAZ bits of the x86 MXCSR register */
+#define MXCSR_FTZ 0x8000
+#define MXCSR_DAZ 0x0040
+
+/* FZ bit of the ARM FPSCR (32-bit) and FPCR (64-bit) registers */
+#define ARM_FZ (1 << 24)
+
+#if defined (DSP_X86) && defined (__GNUC__)
+
+/* Some early SSE2 processors fault if DAZ is set; all with SSE3 have it. */
+static unsigned mxcsr_flush_bits ()
+{
+    __builtin_cpu_init ();
+
+#ifndef __SSE__
+    if (! __builtin_cpu_supports ("sse"))
+        return 0;
+#endif
+
+    return MXCSR_FTZ | (__builtin_cpu_supports ("sse3") ? MXCSR_DAZ : 0);
+}
+
+static const unsigned mxcsr_flush = mxcsr_flush_bits ();
+
+static unsigned get_mxcsr ()
+{
+    unsigned csr;
+    __asm__ __volatile__ ("stmxcsr %0" : "=m" (csr));
+    return csr;
+}
+
+static void set_mxcsr (unsigned csr)
+    { __asm__ __volatile__ ("ldmxcsr %0" : : "m" (csr)); }
+
+unsigned dsp_flush_denormals ()
+{
+    if (! mxcsr_flush)
+        return 0;
+
+    unsigned csr = get_mxcsr ();
+    if ((csr & mxcsr_flush) != mxcsr_flush)
+        set_mxcsr (csr | mxcsr_flush);
+
+    return csr;
+}
+
+/* only the bits that were set by dsp_flush_denormals () are cleared */
+void dsp_restore_denormals (unsigned state)
+{
+    unsigned clear = mxcsr_flush & ~state;
+    if (clear)
+        set_mxcsr (get_mxcsr () & ~clear);
+}
+
+#elif defined (__aarch64__) && defined (__GNUC__)
+
+unsigned dsp_flush_denormals ()
+{
+    uint64_t fpcr;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+
+    if (! (fpcr & ARM_FZ))
+        __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr | ARM_FZ));
+
+    return fpcr;
+}
+
+void dsp_restore_denormals (unsigned state)
+{
+    if (state & ARM_FZ)
+        return;
+
+    uint64_t fpcr;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+    __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr & ~(uint64_t) ARM_FZ));
+}
+
+#elif defined (__arm__) && defined (__ARM_FP) && defined (__GNUC__)
+
+unsigned dsp_flush_denormals ()
+{
+    unsigned fpscr;
+    __asm__ __volatile__ ("vmrs %0, fpscr" : "=r" (fpscr));
+
+    if (! (fpscr & ARM_FZ))
+        __asm__ __volatile__ ("vmsr fpscr, %0" : : "r" (fpscr | ARM_FZ));
+
+    return fpscr;
+}
+
+void dsp_restore_denormals (unsigned state)
+{
+    if (state & ARM_FZ)
+        return;
+
+    unsigned fpscr;
+    __asm__ __volatile__ ("vmrs %0, fpscr" : "=r" (fpscr));
+    __asm__ __volatile__ ("vmsr fpscr, %0" : : "r" (fpscr & ~ARM_FZ));
+}
+
+#else
+
+/* Other processors either have no denormal penalty to speak of or no portable
+ * way to avoid it. */
+unsigned dsp_flush_denormals ()
+    { return 0; }
+void dsp_restore_denormals (unsigned state)
+    { }
+
+#endif
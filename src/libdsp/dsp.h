@@ -0,0 +1,146 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_H
+#define AUD_DSP_H
+
+#include <stdint.h>
+
+/* This is a small static library linked into the effect plugins and a few
+ * others that convert samples.  Each kernel has a plain C++ version and, where
+ * it pays off, SSE2, AVX2, and NEON versions.  The fastest version supported
+ * by the running CPU is chosen once, when the plugin is loaded.  All kernels
+ * operate on interleaved float samples unless noted otherwise. */
+
+/* Returns the name of the instruction set in use ("scalar", "sse2", "avx2", or
+ * "neon"), for informational purposes. */
+const char * dsp_get_isa ();
+
+/* Multiplies data[i] by a gain that changes linearly from <a> (at i = 0)
+ * towards <b> (reached at i = len). */
+void dsp_ramp (float * data, int len, float a, float b);
+
+/* Multiplies data[i] by a constant gain. */
+void dsp_scale (float * data, int len, float gain);
+
+/* Adds add[i] to data[i]. */
+void dsp_mix (float * data, const float * add, int len);
+
+/* Multiplies data[i] by gain[i] (e.g. a window function). */
+void dsp_multiply (float * data, const float * gain, int len);
+
+/* Adds a[i] * b[i] to data[i] (windowed overlap-add). */
+void dsp_mul_add (float * data, const float * a, const float * b, int len);
+
+/* Returns the sum of the absolute values of data[i]. */
+float dsp_abs_sum (const float * data, int len);
+
+/* Returns the sum of a[i] * b[i] (the inner loop of an FIR filter). */
+float dsp_dot (const float * a, const float * b, int len);
+
+/* Converts between interleaved and planar (one buffer per channel) layouts. */
+void dsp_interleave (const float * const * in, float * out, int channels, int frames);
+void dsp_deinterleave (const float * in, float * const * out, int channels, int frames);
+
+/* Computes out[c] = sum (matrix[c * in_channels + i] * in[i]) for each frame.
+ * <in> and <out> may point to the same buffer if out_channels <= in_channels. */
+void dsp_matrix_mix (const float * in, int in_channels, float * out,
+ int out_channels, const float * matrix, int frames);
+
+/* Multiplies a[i] by b[i] and adds the product to acc[i], where all three are
+ * complex arrays in split form (separate real and imaginary parts), as used by
+ * the FFT class.  This is the inner loop of frequency-domain convolution. */
+void dsp_complex_mac (float * acc_re, float * acc_im, const float * a_re,
+ const float * a_im, const float * b_re, const float * b_im, int len);
+
+/* Replaces each frame of <size> values with its Walsh-Hadamard transform,
+ * scaled by 1 / sqrt (size).  This is an orthogonal matrix (it preserves
+ * energy) in which every output depends on every input, as used to mix the
+ * lines of a feedback delay network.  <size> must be a power of two, at least
+ * 4 and at most DSP_MAX_HADAMARD. */
+#define DSP_MAX_HADAMARD 32
+
+void dsp_hadamard (float * data, int size, int frames);
+
+/* Runs interleaved audio through a cascade of <sections> biquad filters
+ * (transposed direct form II), all channels at once.  coefs[5 * s] through
+ * coefs[5 * s + 4] are b0, b1, b2, a1, a2 of section s, normalized so that
+ * a0 = 1.  <state> holds 2 * channels values per section, zero at first. */
+#define DSP_MAX_BIQUADS 8
+
+void dsp_biquads (float * data, int channels, int frames, const float * coefs,
+ int sections, float * state);
+
+/* Length and delay (in frames) of the interpolation filter used by
+ * dsp_true_peak (). */
+#define DSP_TRUE_PEAK_TAPS 12
+#define DSP_TRUE_PEAK_DELAY 6
+
+/* Measures the "true peak" of interleaved audio by oversampling it 4x (cf.
+ * ITU-R BS.1770-4, annex 2).  peaks[i] is set to the largest absolute value on
+ * any channel between frames i - DSP_TRUE_PEAK_DELAY and i - DSP_TRUE_PEAK_DELAY
+ * + 1.  <history> holds the last DSP_TRUE_PEAK_TAPS - 1 frames of the previous
+ * call (zero at first) and is updated on return. */
+void dsp_true_peak (const float * in, int channels, int frames, float * history,
+ float * peaks);
+
+/* First-difference "crystalizer" filter: adds <amount> times the difference
+ * between each sample and the previous sample of the same channel.  <prev>
+ * holds the last frame of the previous block and is updated on return. */
+void dsp_difference (float * data, int len, int channels, float * prev, float amount);
+
+/* Converts samples to signed integers of <bits> bits (16, 24, or 32), rounding
+ * to nearest and clipping.  16-bit integers are stored as int16_t, the others
+ * as int32_t (24-bit in the low bits). */
+void dsp_to_int (const float * in, void * out, int len, int bits);
+
+/* Interleaves planar 32-bit integer samples, as output by lossless decoders,
+ * storing them as int8_t if <bits> is 8, int16_t if 16, and int32_t otherwise
+ * (24-bit in the low bits).  The samples are assumed to be in range. */
+void dsp_pack_int (const int32_t * const * in, void * out, int channels,
+ int frames, int bits);
+
+/* Makes the calling thread flush denormal numbers to zero (FTZ and DAZ on x86,
+ * FZ on ARM), returning the previous state for dsp_restore_denormals ().
+ * Feedback paths that decay towards silence (echoes, IIR filters) otherwise
+ * reach the denormal range on fade-outs, where arithmetic can be 10 to 100
+ * times slower. */
+unsigned dsp_flush_denormals ();
+void dsp_restore_denormals (unsigned state);
+
+/* Flushes denormals for the lifetime of the object, typically one call of an
+ * effect's process () or finish (). */
+class DenormalGuard
+{
+public:
+    DenormalGuard () :
+        m_state (dsp_flush_denormals ()) {}
+    ~DenormalGuard ()
+        { dsp_restore_denormals (m_state); }
+
+private:
+    const unsigned m_state;
+};
+
+/* Effects size their buffers in start () for blocks of up to this many frames,
+ * which is more than any decoder in this package writes at once.  Larger
+ * blocks still work, but the buffers are then enlarged in the audio thread. */
+#define DSP_BLOCK_FRAMES 16384
+
+#endif /* AUD_DSP_H */
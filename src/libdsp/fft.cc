@@ -0,0 +1,209 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "fft.h"
+
+#include <math.h>
+
+#include "dsp-internal.h"
+
+/* Twiddle factors are stored per stage: the <h> factors used by the stage with
+ * butterflies <h> apart start at index <h>. */
+void FFT::make_table (Index<int> & bitrev, Index<float> & wr, Index<float> & wi, int n)
+{
+    int bits = 0;
+    while ((1 << bits) < n)
+        bits ++;
+
+    bitrev.insert (0, n);
+    wr.insert (0, n);
+    wi.insert (0, n);
+
+    for (int i = 0; i < n; i ++)
+    {
+        int r = 0;
+        for (int b = 0; b < bits; b ++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+
+        bitrev[i] = r;
+    }
+
+    for (int h = 1; h < n; h <<= 1)
+    {
+        for (int k = 0; k < h; k ++)
+        {
+            wr[h + k] = cos (M_PI * k / h);
+            wi[h + k] = -sin (M_PI * k / h);
+        }
+    }
+}
+
+void FFT::init (int size)
+{
+    destroy ();
+
+    m_size = size;
+    make_table (m_bitrev, m_wr, m_wi, size);
+    make_table (m_half_bitrev, m_half_wr, m_half_wi, size / 2);
+
+    m_real_wr.insert (0, size / 2 + 1);
+    m_real_wi.insert (0, size / 2 + 1);
+
+    for (int k = 0; k <= size / 2; k ++)
+    {
+        m_real_wr[k] = cos (2 * M_PI * k / size);
+        m_real_wi[k] = -sin (2 * M_PI * k / size);
+    }
+
+    m_work_re.insert (0, size / 2);
+    m_work_im.insert (0, size / 2);
+}
+
+void FFT::destroy ()
+{
+    m_size = 0;
+    m_bitrev.clear ();
+    m_wr.clear ();
+    m_wi.clear ();
+    m_half_bitrev.clear ();
+    m_half_wr.clear ();
+    m_half_wi.clear ();
+    m_real_wr.clear ();
+    m_real_wi.clear ();
+    m_work_re.clear ();
+    m_work_im.clear ();
+}
+
+void FFT::transform (float * re, float * im, int n, const int * bitrev,
+ const float * wr, const float * wi)
+{
+    for (int i = 0; i < n; i ++)
+    {
+        int j = bitrev[i];
+
+        if (j > i)
+        {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    /* the first two stages need no multiplications and are too short to be
+     * worth vectorizing */
+    for (int i = 0; i < n; i += 4)
+    {
+        float ar = re[i] + re[i + 1], ai = im[i] + im[i + 1];
+        float br = re[i] - re[i + 1], bi = im[i] - im[i + 1];
+        float cr = re[i + 2] + re[i + 3], ci = im[i + 2] + im[i + 3];
+        float dr = re[i + 2] - re[i + 3], di = im[i + 2] - im[i + 3];
+
+        /* multiply d by -i */
+        re[i] = ar + cr; im[i] = ai + ci;
+        re[i + 2] = ar - cr; im[i + 2] = ai - ci;
+        re[i + 1] = br + di; im[i + 1] = bi - dr;
+        re[i + 3] = br - di; im[i + 3] = bi + dr;
+    }
+
+    for (int h = 4; h < n; h <<= 1)
+    {
+        for (int j = 0; j < n; j += 2 * h)
+            dsp_butterfly (re + j, im + j, re + j + h, im + j + h, wr + h, wi + h, h);
+    }
+}
+
+void FFT::forward (float * re, float * im)
+{
+    transform (re, im, m_size, & m_bitrev[0], & m_wr[0], & m_wi[0]);
+}
+
+/* computed as conj (forward (conj (x))) */
+void FFT::inverse (float * re, float * im)
+{
+    for (int i = 0; i < m_size; i ++)
+        im[i] = -im[i];
+
+    transform (re, im, m_size, & m_bitrev[0], & m_wr[0], & m_wi[0]);
+
+    for (int i = 0; i < m_size; i ++)
+        im[i] = -im[i];
+}
+
+/* The even samples go into the real part and the odd samples into the
+ * imaginary part of a half-size transform Z.  The spectra of the even and odd
+ * samples are then E[k] = (Z[k] + Z*[M-k]) / 2 and O[k] = (Z[k] - Z*[M-k]) / 2i,
+ * and X[k] = E[k] + W^k O[k]. */
+void FFT::real_forward (const float * in, float * re, float * im)
+{
+    int m = m_size / 2;
+    float * zr = & m_work_re[0];
+    float * zi = & m_work_im[0];
+
+    for (int k = 0; k < m; k ++)
+    {
+        zr[k] = in[2 * k];
+        zi[k] = in[2 * k + 1];
+    }
+
+    transform (zr, zi, m, & m_half_bitrev[0], & m_half_wr[0], & m_half_wi[0]);
+
+    for (int k = 0; k <= m; k ++)
+    {
+        int a = (k < m) ? k : 0;
+        int b = (k > 0) ? m - k : 0;
+
+        float er = (zr[a] + zr[b]) * 0.5f, ei = (zi[a] - zi[b]) * 0.5f;
+        float or_ = (zi[a] + zi[b]) * 0.5f, oi = (zr[b] - zr[a]) * 0.5f;
+        float wr = m_real_wr[k], wi = m_real_wi[k];
+
+        re[k] = er + or_ * wr - oi * wi;
+        im[k] = ei + or_ * wi + oi * wr;
+    }
+}
+
+/* the reverse of the above: E[k] = (X[k] + X*[M-k]) / 2, O[k] = (X[k] -
+ * X*[M-k]) W^-k / 2, and Z[k] = E[k] + i O[k] */
+void FFT::real_inverse (const float * re, const float * im, float * out)
+{
+    int m = m_size / 2;
+    float * zr = & m_work_re[0];
+    float * zi = & m_work_im[0];
+
+    for (int k = 0; k < m; k ++)
+    {
+        float er = (re[k] + re[m - k]) * 0.5f, ei = (im[k] - im[m - k]) * 0.5f;
+        float dr = (re[k] - re[m - k]) * 0.5f, di = (im[k] + im[m - k]) * 0.5f;
+        float wr = m_real_wr[k], wi = -m_real_wi[k];
+
+        float or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+
+        /* conjugated for the inverse transform */
+        zr[k] = er - oi;
+        zi[k] = -(ei + or_);
+    }
+
+    transform (zr, zi, m, & m_half_bitrev[0], & m_half_wr[0], & m_half_wi[0]);
+
+    float scale = 1.0f / m;
+
+    for (int k = 0; k < m; k ++)
+    {
+        out[2 * k] = zr[k] * scale;
+        out[2 * k + 1] = -zi[k] * scale;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_FFT_H
+#define AUD_DSP_FFT_H
+
+#include <libaudcore/index.h>
+
+/* Fast Fourier transform of a fixed power-of-two size, operating on split
+ * (separate real and imaginary) arrays so that the butterflies vectorize.
+ * The real transforms pack a real signal of <size> samples into a complex
+ * transform of half that size. */
+
+class FFT
+{
+public:
+    /* <size> must be a power of two, at least 8. */
+    void init (int size);
+    void destroy ();
+
+    int size () const
+        { return m_size; }
+
+    /* In-place complex transforms of <size> points.  The inverse is not
+     * scaled; applying both multiplies the input by <size>. */
+    void forward (float * re, float * im);
+    void inverse (float * re, float * im);
+
+    /* Real transforms: <size> samples <-> <size> / 2 + 1 bins.  Unlike the
+     * complex inverse, real_inverse () is scaled, so that it exactly undoes
+     * real_forward (). */
+    void real_forward (const float * in, float * re, float * im);
+    void real_inverse (const float * re, const float * im, float * out);
+
+private:
+    static void make_table (Index<int> & bitrev, Index<float> & wr,
+     Index<float> & wi, int n);
+    static void transform (float * re, float * im, int n, const int * bitrev,
+     const float * wr, const float * wi);
+
+    int m_size = 0;
+
+    /* tables for the full-size complex transform */
+    Index<int> m_bitrev;
+    Index<float> m_wr, m_wi;
+
+    /* tables for the half-size transform used by the real transforms */
+    Index<int> m_half_bitrev;
+    Index<float> m_half_wr, m_half_wi;
+    Index<float> m_real_wr, m_real_wi;  /* e^(-2 pi i k / size) */
+    Index<float> m_work_re, m_work_im;
+};
+
+#endif /* AUD_DSP_FFT_H */
@@ -0,0 +1,127 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "layout.h"
+
+#include <math.h>
+#include <string.h>
+
+enum Speaker {FL, FR, FC, LFE, BL, BR, BC, SL, SR};
+
+/* speaker order for each number of channels, as used by FFmpeg */
+static const Speaker layouts[DSP_MAX_LAYOUT][DSP_MAX_LAYOUT] = {
+    {FC},                              /* mono */
+    {FL, FR},                          /* stereo */
+    {FL, FR, FC},                      /* 3.0 */
+    {FL, FR, BL, BR},                  /* quadraphonic */
+    {FL, FR, FC, BL, BR},              /* 5.0 */
+    {FL, FR, FC, LFE, BL, BR},         /* 5.1 */
+    {FL, FR, FC, LFE, BC, SL, SR},     /* 6.1 */
+    {FL, FR, FC, LFE, BL, BR, SL, SR}  /* 7.1 */
+};
+
+static int find_speaker (Speaker s, int channels)
+{
+    for (int c = 0; c < channels; c ++)
+    {
+        if (layouts[channels - 1][c] == s)
+            return c;
+    }
+
+    return -1;
+}
+
+/* Adds speaker <s>, scaled by <gain>, to the column <col> of the matrix.  A
+ * speaker missing from the output is folded into its neighbors, following
+ * ITU-R BS.775 for the standard downmixes, with -3 dB for each step.  The LFE
+ * channel is dropped, as in BS.775.  The recursion always ends, since every
+ * layout has either FL and FR or FC. */
+static void route (Speaker s, float gain, float * matrix, int in, int out,
+ int col)
+{
+    int row = find_speaker (s, out);
+
+    if (row >= 0)
+    {
+        matrix[row * in + col] += gain;
+        return;
+    }
+
+    switch (s)
+    {
+    case FL:
+    case FR:
+        route (FC, gain * M_SQRT1_2, matrix, in, out, col);
+        break;
+
+    case FC:
+        /* a mono source plays at full volume on both speakers */
+        if (in > 1)
+            gain *= M_SQRT1_2;
+
+        route (FL, gain, matrix, in, out, col);
+        route (FR, gain, matrix, in, out, col);
+        break;
+
+    case LFE:
+        break;
+
+    case BL:
+    case BR:
+        if (find_speaker (SL, out) >= 0)
+            route ((s == BL) ? SL : SR, gain, matrix, in, out, col);
+        else
+            route ((s == BL) ? FL : FR, gain * M_SQRT1_2, matrix, in, out, col);
+        break;
+
+    case SL:
+    case SR:
+        if (find_speaker (BL, out) >= 0)
+            route ((s == SL) ? BL : BR, gain, matrix, in, out, col);
+        else
+            route ((s == SL) ? FL : FR, gain * M_SQRT1_2, matrix, in, out, col);
+        break;
+
+    case BC:
+        if (find_speaker (BL, out) >= 0)
+        {
+            route (BL, gain * M_SQRT1_2, matrix, in, out, col);
+            route (BR, gain * M_SQRT1_2, matrix, in, out, col);
+        }
+        else
+        {
+            route (SL, gain * M_SQRT1_2, matrix, in, out, col);
+            route (SR, gain * M_SQRT1_2, matrix, in, out, col);
+        }
+        break;
+    }
+}
+
+bool dsp_layout_matrix (float * matrix, int in, int out)
+{
+    if (in < 1 || in > DSP_MAX_LAYOUT || out < 1 || out > DSP_MAX_LAYOUT)
+        return false;
+
+    memset (matrix, 0, sizeof (float) * in * out);
+
+    for (int c = 0; c < in; c ++)
+        route (layouts[in - 1][c], 1, matrix, in, out, c);
+
+    return true;
+}
@@ -0,0 +1,32 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_LAYOUT_H
+#define AUD_DSP_LAYOUT_H
+
+/* Speaker layouts are defined (in FFmpeg order) for up to 7.1. */
+#define DSP_MAX_LAYOUT 8
+
+/* Fills <matrix> (one row per output channel and one column per input
+ * channel, as for dsp_matrix_mix ()) with the default mix from <in> to <out>
+ * channels, following ITU-R BS.775 for the standard downmixes.  Returns false
+ * if either layout is not defined. */
+bool dsp_layout_matrix (float * matrix, int in, int out);
+
+#endif /* AUD_DSP_LAYOUT_H */
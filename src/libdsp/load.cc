@@ -0,0 +1,185 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "load.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <libaudcore/templates.h>
+
+/* Fraction of real time above which the level is lowered.  One effect should
+ * leave most of the CPU to the decoder, the other effects, and the output. */
+#define LOAD_HIGH 0.15
+
+/* Fraction below which the level is raised.  Each level typically costs about
+ * twice as much as the one below it, so this leaves a wide margin. */
+#define LOAD_LOW 0.03
+
+/* Time constant of the low-pass filter on the measured load (seconds).  Single
+ * blocks can take much longer than usual if the thread is preempted. */
+#define SMOOTH_TIME 1.0
+
+/* Time to measure after a change before stepping up (seconds).  After a step
+ * down, this is multiplied each time, so that an effect that keeps running out
+ * of time settles at the lower level. */
+#define HOLD_TIME 3.0
+#define MAX_HOLD_TIME 300.0
+
+static int64_t now_ns ()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+void LoadControl::init (int levels, int level)
+{
+    m_levels = levels;
+    m_level.store (level, std::memory_order_relaxed);
+    m_hold = HOLD_TIME;
+    reset ();
+}
+
+/* m_load is kept for load () and replaced by the next measurement */
+void LoadControl::reset ()
+{
+    m_start = 0;
+    m_elapsed = 0;
+}
+
+void LoadControl::begin ()
+{
+    m_start = now_ns ();
+}
+
+bool LoadControl::end (int frames, int rate)
+{
+    if (! m_start || frames <= 0 || rate <= 0)
+        return false;
+
+    double duration = (double) frames / rate;
+    double load = (now_ns () - m_start) * 1e-9 / duration;
+
+    m_start = 0;
+
+    if (m_elapsed == 0)
+        m_load = load;
+    else
+        m_load += (load - m_load) * duration / (SMOOTH_TIME + duration);
+
+    m_elapsed += duration;
+
+    /* let the filter settle before acting on it */
+    if (m_elapsed < SMOOTH_TIME)
+        return false;
+
+    int level = m_level.load (std::memory_order_relaxed);
+
+    if (m_load > LOAD_HIGH && level > 0)
+    {
+        m_level.store (level - 1, std::memory_order_relaxed);
+        m_hold = aud::min (m_hold * 2, MAX_HOLD_TIME);
+    }
+    else if (m_load < LOAD_LOW && level < m_levels - 1 && m_elapsed >= m_hold)
+        m_level.store (level + 1, std::memory_order_relaxed);
+    else
+        return false;
+
+    reset ();
+    return true;
+}
+
+void InputHistory::init (int channels, int frames)
+{
+    m_channels = channels;
+    m_size = frames;
+    m_filled = m_write = 0;
+
+    m_data.clear ();
+    m_data.insert (0, channels * frames);
+    m_last.clear ();
+    m_last.insert (0, channels * frames);
+}
+
+void InputHistory::destroy ()
+{
+    m_channels = m_size = m_filled = m_write = 0;
+    m_data.clear ();
+    m_last.clear ();
+}
+
+void InputHistory::add (const float * in, int frames)
+{
+    int channels = m_channels;
+
+    if (frames > m_size)
+    {
+        in += (frames - m_size) * channels;
+        frames = m_size;
+    }
+
+    /* up to the end of the ring, then the rest from the start */
+    int first = aud::min (frames, m_size - m_write);
+
+    memcpy (& m_data[m_write * channels], in, sizeof (float) * channels * first);
+    memcpy (m_data.begin (), in + first * channels,
+     sizeof (float) * channels * (frames - first));
+
+    m_write = (m_write + frames) % m_size;
+    m_filled = aud::min (m_filled + frames, m_size);
+}
+
+const float * InputHistory::last (int frames)
+{
+    int channels = m_channels;
+    int start = (m_write - frames + m_size) % m_size;
+    int first = aud::min (frames, m_size - start);
+
+    memcpy (m_last.begin (), & m_data[start * channels],
+     sizeof (float) * channels * first);
+    memcpy (m_last.begin () + first * channels, m_data.begin (),
+     sizeof (float) * channels * (frames - first));
+
+    return m_last.begin ();
+}
+
+int InputHistory::frames_to_prime (double time, double ratio) const
+{
+    int best = m_filled;
+    double best_error = 1;
+
+    for (int n = m_filled; n > 0 && n > m_filled - 256; n --)
+    {
+        double start = time - n * ratio;
+        double error = fabs (start - floor (start + 0.5));
+
+        if (error < best_error)
+        {
+            best = n;
+            best_error = error;
+        }
+
+        if (error < 1e-6)
+            break;
+    }
+
+    return best;
+}
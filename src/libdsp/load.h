@@ -0,0 +1,110 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_LOAD_H
+#define AUD_DSP_LOAD_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <libaudcore/index.h>
+
+/* Automatic quality selection for effects whose cost depends on a quality
+ * setting (such as the filter length of a resampler).  LoadControl times each
+ * block with a monotonic clock and compares the time taken to the duration of
+ * the audio in the block.  If the effect uses too much of the real time
+ * available, it steps down one level; if it has been cheap for a while, it
+ * steps up one level.  The thresholds are far enough apart, and changes are
+ * far enough apart in time, that it does not switch back and forth.
+ *
+ * level () may be called from any thread (e.g. for monitoring); the other
+ * functions must be called from the audio thread. */
+
+class LoadControl
+{
+public:
+    /* <levels> quality levels, from 0 (cheapest) to levels - 1 (best). */
+    void init (int levels, int level);
+
+    /* Forgets all measurements, but keeps the current level. */
+    void reset ();
+
+    int level () const
+        { return m_level.load (std::memory_order_relaxed); }
+
+    /* The fraction of real time used (smoothed), or, right after a change,
+     * the fraction that caused it. */
+    double load () const
+        { return m_load; }
+
+    /* Call before and after processing a block of <frames> frames at <rate>
+     * Hz.  end () returns true if the level has changed; the new level should
+     * be used from the next block on. */
+    void begin ();
+    bool end (int frames, int rate);
+
+private:
+    std::atomic<int> m_level {0};
+    int m_levels = 0;
+
+    int64_t m_start = 0;      /* when begin () was called (ns) */
+    double m_load = 0;        /* low-pass filtered load */
+    double m_elapsed = 0;     /* seconds of audio since the last change */
+    double m_hold = 0;        /* seconds to wait before the next step up */
+};
+
+/* The most recent input of a resampler, kept so that when LoadControl changes
+ * the level, a new converter can be primed with it and pick up where the old
+ * one left off.  Nothing is allocated after init (). */
+
+class InputHistory
+{
+public:
+    /* Keeps up to <frames> frames of <channels> channels. */
+    void init (int channels, int frames);
+    void destroy ();
+
+    bool ready () const
+        { return m_channels > 0; }
+
+    /* Forgets the input kept so far. */
+    void reset ()
+        { m_filled = m_write = 0; }
+
+    void add (const float * in, int frames);
+
+    /* Of the input kept, the most that starts at a whole output frame, or as
+     * close to one as can be found.  <time> is the output position of the end
+     * of the input so far, and <ratio> is the output rate over the input
+     * rate. */
+    int frames_to_prime (double time, double ratio) const;
+
+    /* The last <frames> frames of input, interleaved.  The input is kept in a
+     * ring, so it is copied out in order first; this is only done when the
+     * converter is switched. */
+    const float * last (int frames);
+
+private:
+    int m_channels = 0, m_size = 0, m_filled = 0;
+    int m_write = 0;  /* frame of the ring written next */
+    Index<float> m_data, m_last;
+};
+
+#endif /* AUD_DSP_LOAD_H */
@@ -0,0 +1,107 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "stats.h"
+
+#include <stdlib.h>
+
+#include <chrono>
+
+#include <libaudcore/hook.h>
+#include <libaudcore/runtime.h>
+
+#define STATS_HOOK "effect stats"
+
+static int64_t now_ns ()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+static void list_cb (void * list, void * stats)
+{
+    ((Index<const EffectStats *> *) list)->append ((const EffectStats *) stats);
+}
+
+void EffectStats::attach ()
+{
+    m_strict = (getenv ("AUD_EFFECT_STRICT") != nullptr);
+    hook_associate (STATS_HOOK, list_cb, this);
+}
+
+void EffectStats::detach ()
+{
+    hook_dissociate_full (STATS_HOOK, list_cb, this);
+}
+
+void EffectStats::count_alloc (bool setup)
+{
+    add (m_allocations, 1);
+
+    if (m_strict && m_active && ! setup)
+    {
+        AUDERR ("%s allocated memory while processing audio.\n", m_name);
+        abort ();
+    }
+}
+
+void EffectStats::begin ()
+{
+    if (m_reset.exchange (false, std::memory_order_relaxed))
+    {
+        m_process_ns.store (0, std::memory_order_relaxed);
+        m_max_block_ns.store (0, std::memory_order_relaxed);
+        m_samples.store (0, std::memory_order_relaxed);
+        m_blocks.store (0, std::memory_order_relaxed);
+        m_allocations.store (0, std::memory_order_relaxed);
+    }
+
+    m_start = now_ns ();
+}
+
+void EffectStats::end (int samples)
+{
+    int64_t elapsed = now_ns () - m_start;
+
+    add (m_process_ns, elapsed);
+    add (m_samples, samples);
+    add (m_blocks, 1);
+
+    if (elapsed > m_max_block_ns.load (std::memory_order_relaxed))
+        m_max_block_ns.store (elapsed, std::memory_order_relaxed);
+}
+
+EffectStats::Values EffectStats::read () const
+{
+    return {
+        m_process_ns.load (std::memory_order_relaxed),
+        m_max_block_ns.load (std::memory_order_relaxed),
+        m_samples.load (std::memory_order_relaxed),
+        m_blocks.load (std::memory_order_relaxed),
+        m_allocations.load (std::memory_order_relaxed),
+        m_delay_ms.load (std::memory_order_relaxed),
+        m_note.load (std::memory_order_relaxed)
+    };
+}
+
+void effect_stats_list (Index<const EffectStats *> & list)
+{
+    list.remove (0, -1);
+    hook_call (STATS_HOOK, & list);
+}
@@ -0,0 +1,147 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_STATS_H
+#define AUD_DSP_STATS_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <libaudcore/index.h>
+
+/* Run-time statistics for an effect plugin: how much time it spends
+ * processing audio, how much audio it has processed, how often it has
+ * allocated memory in the audio thread, the delay it reports, and the mode it
+ * is running in.
+ *
+ * Only the audio thread writes the counters; any thread may read them.  Each
+ * counter is a separate relaxed atomic, so a reader may see one block counted
+ * in some counters but not yet in others.
+ *
+ * Every plugin links its own copy of libdsp, so the effects are found through
+ * a hook instead of a list in this library.  An effect calls attach () from
+ * its init () and detach () from its cleanup (); a monitor calls
+ * effect_stats_list () from the main thread.
+ *
+ * Effects are expected to allocate their buffers in start () and not while
+ * processing audio.  If the environment variable AUD_EFFECT_STRICT is set, an
+ * allocation counted inside an EffectStatsScope aborts the program, so that
+ * the culprit can be found in a debugger or core dump. */
+
+class EffectStats
+{
+public:
+    struct Values {
+        int64_t process_ns;     /* total time spent processing */
+        int64_t max_block_ns;   /* longest single block */
+        int64_t samples;        /* input samples (not frames) processed */
+        int64_t blocks;
+        int64_t allocations;    /* buffer reallocations in the audio thread */
+        int delay_ms;           /* added by adjust_delay () */
+        const char * note;      /* current mode, or null */
+    };
+
+    constexpr EffectStats (const char * name) :
+        m_name (name) {}
+
+    const char * name () const
+        { return m_name; }
+
+    void attach ();
+    void detach ();
+
+    /* Called by the audio thread around each block. */
+    void begin ();
+    void end (int samples);
+
+    /* <setup> is set for allocations caused by a change of settings (or of
+     * quality level) rather than by the audio itself; these are counted but
+     * never abort. */
+    void count_alloc (bool setup = false);
+    void set_delay (int ms)
+        { m_delay_ms.store (ms, std::memory_order_relaxed); }
+
+    /* A short description of the current mode, such as the quality level
+     * chosen by LoadControl.  <note> must be a constant string, since it is
+     * read from other threads. */
+    void set_note (const char * note)
+        { m_note.store (note, std::memory_order_relaxed); }
+
+    /* May be called from any thread. */
+    Values read () const;
+
+    /* Asks the audio thread to zero the counters at the start of the next
+     * block.  The delay and the note are kept. */
+    void request_reset () const
+        { m_reset.store (true, std::memory_order_relaxed); }
+
+private:
+    friend class EffectStatsScope;
+
+    static void add (std::atomic<int64_t> & counter, int64_t value)
+        { counter.store (counter.load (std::memory_order_relaxed) + value,
+           std::memory_order_relaxed); }
+
+    const char * const m_name;
+    int64_t m_start = 0;
+    bool m_active = false;
+    bool m_strict = false;
+
+    std::atomic<int64_t> m_process_ns {0}, m_max_block_ns {0};
+    std::atomic<int64_t> m_samples {0}, m_blocks {0}, m_allocations {0};
+    std::atomic<int> m_delay_ms {0};
+    std::atomic<const char *> m_note {nullptr};
+    mutable std::atomic<bool> m_reset {false};
+};
+
+/* Times one call of an effect's process () or finish ().  Nested scopes on the
+ * same EffectStats (finish () calling process ()) are counted only once. */
+class EffectStatsScope
+{
+public:
+    EffectStatsScope (EffectStats & stats, int samples) :
+        m_stats (stats.m_active ? nullptr : & stats),
+        m_samples (samples)
+    {
+        if (m_stats)
+        {
+            m_stats->m_active = true;
+            m_stats->begin ();
+        }
+    }
+
+    ~EffectStatsScope ()
+    {
+        if (m_stats)
+        {
+            m_stats->end (m_samples);
+            m_stats->m_active = false;
+        }
+    }
+
+private:
+    EffectStats * const m_stats;
+    const int m_samples;
+};
+
+/* Collects the statistics of all loaded effects that have attached. */
+void effect_stats_list (Index<const EffectStats *> & list);
+
+#endif /* AUD_DSP_STATS_H */
@@ -0,0 +1,176 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "stft.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/audio.h>
+
+#include "dsp.h"
+
+void STFT::init (int channels, int size, int overlap, Func func, void * data)
+{
+    destroy ();
+
+    m_func = func;
+    m_data = data;
+
+    m_channels = channels;
+    m_size = size;
+    m_hop = size / overlap;
+    m_bins = size / 2 + 1;
+
+    m_fft.init (size);
+
+    m_window.insert (0, size);
+    m_synth_window.insert (0, size);
+
+    /* Periodic Hann window.  Applied twice, it is squared, which adds up to a
+     * constant only with an overlap of 3 or more; for an overlap of 2, its
+     * square root is used instead, so that the square is a Hann window. */
+    for (int i = 0; i < size; i ++)
+    {
+        m_window[i] = 0.5 - 0.5 * cos (2 * M_PI * i / size);
+        if (overlap == 2)
+            m_window[i] = sqrtf (m_window[i]);
+    }
+
+    /* The overlapping frames add up to the sum of the squares of the window
+     * at every hop (1.5 for an overlap of 4, 1 for an overlap of 2). */
+    double sum = 0;
+    for (int i = 0; i < size; i += m_hop)
+        sum += m_window[i] * m_window[i];
+
+    for (int i = 0; i < size; i ++)
+        m_synth_window[i] = m_window[i] / sum;
+
+    m_input.insert (0, channels * size);
+    m_accum.insert (0, channels * size);
+    m_ready.insert (0, channels * m_hop);
+    m_time.insert (0, size);
+    m_re.insert (0, channels * m_bins);
+    m_im.insert (0, channels * m_bins);
+
+    m_fill = 0;
+}
+
+void STFT::destroy ()
+{
+    m_func = nullptr;
+    m_data = nullptr;
+    m_channels = m_size = m_hop = m_bins = 0;
+    m_fill = 0;
+
+    m_fft.destroy ();
+    m_window.clear ();
+    m_synth_window.clear ();
+    m_input.clear ();
+    m_accum.clear ();
+    m_ready.clear ();
+    m_time.clear ();
+    m_re.clear ();
+    m_im.clear ();
+}
+
+void STFT::reset ()
+{
+    memset (m_input.begin (), 0, sizeof (float) * m_input.len ());
+    memset (m_accum.begin (), 0, sizeof (float) * m_accum.len ());
+    memset (m_ready.begin (), 0, sizeof (float) * m_ready.len ());
+    m_fill = 0;
+}
+
+void STFT::run_frame ()
+{
+    float * re[AUD_MAX_CHANNELS], * im[AUD_MAX_CHANNELS];
+    float * time = m_time.begin ();
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        re[c] = & m_re[c * m_bins];
+        im[c] = & m_im[c * m_bins];
+
+        memcpy (time, & m_input[c * m_size], sizeof (float) * m_size);
+        dsp_multiply (time, m_window.begin (), m_size);
+        m_fft.real_forward (time, re[c], im[c]);
+    }
+
+    m_func (re, im, m_channels, m_bins, m_data);
+
+    int keep = m_size - m_hop;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        float * accum = & m_accum[c * m_size];
+        float * input = & m_input[c * m_size];
+
+        m_fft.real_inverse (re[c], im[c], time);
+        dsp_mul_add (accum, time, m_synth_window.begin (), m_size);
+
+        /* the first hop is complete, since no later frame overlaps it */
+        memcpy (& m_ready[c * m_hop], accum, sizeof (float) * m_hop);
+        memmove (accum, accum + m_hop, sizeof (float) * keep);
+        memset (accum + keep, 0, sizeof (float) * m_hop);
+
+        memmove (input, input + m_hop, sizeof (float) * keep);
+    }
+}
+
+/* Each hop of input goes in at the end of the input frame while the hop of
+ * output finished by the previous frame goes out. */
+void STFT::process (float * data, int frames)
+{
+    int keep = m_size - m_hop;
+
+    while (frames > 0)
+    {
+        int chunk = aud::min (frames, m_hop - m_fill);
+
+        float * in[AUD_MAX_CHANNELS];
+        const float * out[AUD_MAX_CHANNELS];
+
+        for (int c = 0; c < m_channels; c ++)
+        {
+            in[c] = & m_input[c * m_size + keep + m_fill];
+            out[c] = & m_ready[c * m_hop + m_fill];
+        }
+
+        dsp_deinterleave (data, in, m_channels, chunk);
+        dsp_interleave (out, data, m_channels, chunk);
+
+        m_fill += chunk;
+        data += m_channels * chunk;
+        frames -= chunk;
+
+        if (m_fill == m_hop)
+        {
+            run_frame ();
+            m_fill = 0;
+        }
+    }
+}
+
+void STFT::drain (Index<float> & out)
+{
+    int at = out.len ();
+    out.insert (-1, m_channels * m_size);
+    process (& out[at], m_size);
+}
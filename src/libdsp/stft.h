@@ -0,0 +1,85 @@
+/*
+ * Shared DSP Kernels for Audacious Effect Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef AUD_DSP_STFT_H
+#define AUD_DSP_STFT_H
+
+#include <libaudcore/index.h>
+
+#include "fft.h"
+
+/* Short-time Fourier transform analysis and resynthesis, for effects that
+ * work on the spectrum.  The input is cut into frames of <size> samples, one
+ * every <size> / <overlap> samples, each multiplied by a Hann window (or its
+ * square root, for an overlap of 2) and transformed.  A callback modifies the
+ * spectra of all channels of a frame at once; they are then transformed back,
+ * windowed again, and added together.
+ * If the callback changes nothing, the output is the input delayed by
+ * latency () frames.  Nothing is allocated after init (). */
+
+class STFT
+{
+public:
+    /* <re> and <im> point to the spectra (<bins> = <size> / 2 + 1 bins) of
+     * each channel; bin k is at frequency k * rate / size. */
+    typedef void (* Func) (float * const * re, float * const * im, int channels,
+     int bins, void * data);
+
+    /* <size> must be a power of two and <overlap> (at least 2) must divide
+     * it. */
+    void init (int channels, int size, int overlap, Func func, void * data);
+    void destroy ();
+
+    /* Discards buffered audio (for seeking). */
+    void reset ();
+
+    bool ready () const
+        { return m_channels > 0; }
+
+    int size () const
+        { return m_size; }
+
+    /* Processes <frames> interleaved frames in place. */
+    void process (float * data, int frames);
+
+    /* Appends the audio remaining in the pipeline to <out>. */
+    void drain (Index<float> & out);
+
+    int latency () const
+        { return m_size; }
+
+private:
+    void run_frame ();
+
+    Func m_func = nullptr;
+    void * m_data = nullptr;
+
+    int m_channels = 0, m_size = 0, m_hop = 0, m_bins = 0;
+    int m_fill = 0;                /* input frames in the current hop */
+
+    FFT m_fft;
+    Index<float> m_window, m_synth_window;
+    Index<float> m_input;          /* channel, last <size> frames */
+    Index<float> m_accum;          /* channel, <size> frames being added up */
+    Index<float> m_ready;          /* channel, one hop of finished output */
+    Index<float> m_time;           /* one frame */
+    Index<float> m_re, m_im;       /* channel, bin */
+};
+
+#endif /* AUD_DSP_STFT_H */
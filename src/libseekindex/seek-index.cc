@@ -0,0 +1,264 @@
+/*
+ * Seek Index for Audacious Input Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "seek-index.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+/* version of the index files, written after the name on their first line;
+ * then come the URI, size, and modification time, then one line per point,
+ * each the difference from the previous point */
+#define INDEX_VERSION 1
+
+bool get_local_file_info (const char * filename, int64_t & size, int64_t & mtime)
+{
+    StringBuf path = uri_to_filename (filename);
+    struct stat info;
+
+    if (! path || stat (path, & info) < 0 || ! S_ISREG (info.st_mode))
+        return false;
+
+    size = info.st_size;
+    mtime = info.st_mtime;
+    return true;
+}
+
+StringBuf SeekIndex::dir () const
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), m_name});
+}
+
+StringBuf SeekIndex::path (const char * filename) const
+{
+    char * hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, filename, -1);
+    StringBuf path = filename_build ({dir (), hash});
+    g_free (hash);
+    return path;
+}
+
+bool SeekIndex::load (const char * filename, int64_t size, int64_t mtime,
+ Index<SeekPoint> & points) const
+{
+    char * data;
+    if (! g_file_get_contents (path (filename), & data, nullptr, nullptr))
+        return false;
+
+    char * * lines = g_strsplit (data, "\n", -1);
+    g_free (data);
+
+    StringBuf header = str_printf ("%s %d", m_name, INDEX_VERSION);
+
+    gint64 file_size, file_mtime;
+    bool valid = (g_strv_length (lines) >= 3 && ! strcmp (lines[0], header) &&
+     ! strcmp (lines[1], filename) && sscanf (lines[2], "%" G_GINT64_FORMAT " %"
+     G_GINT64_FORMAT, & file_size, & file_mtime) == 2 && file_size == size &&
+     file_mtime == mtime);
+
+    SeekPoint point = SeekPoint ();
+
+    for (int i = 3; valid && lines[i]; i ++)
+    {
+        gint64 sample, offset;
+
+        if (! lines[i][0])
+            continue;
+
+        if (sscanf (lines[i], "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT, & sample, & offset) != 2)
+        {
+            valid = false;
+            break;
+        }
+
+        point.sample += sample;
+        point.offset += offset;
+        points.append (point);
+    }
+
+    g_strfreev (lines);
+
+    if (! valid)
+        points.clear ();
+
+    return valid;
+}
+
+void SeekIndex::save (const char * filename, int64_t size, int64_t mtime,
+ const Index<SeekPoint> & points) const
+{
+    GString * out = g_string_new (nullptr);
+    g_string_append_printf (out, "%s %d\n%s\n%" G_GINT64_FORMAT " %"
+     G_GINT64_FORMAT "\n", m_name, INDEX_VERSION, filename, (gint64) size,
+     (gint64) mtime);
+
+    SeekPoint prev = SeekPoint ();
+
+    for (const SeekPoint & point : points)
+    {
+        g_string_append_printf (out, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+         (gint64) (point.sample - prev.sample), (gint64) (point.offset - prev.offset));
+        prev = point;
+    }
+
+    StringBuf file = path (filename);
+    GError * err = nullptr;
+
+    if (g_mkdir_with_parents (dir (), 0755) < 0 ||
+     ! g_file_set_contents (file, out->str, out->len, & err))
+    {
+        AUDERR ("Failed to write %s: %s\n", (const char *) file,
+         err ? err->message : strerror (errno));
+
+        if (err)
+            g_error_free (err);
+    }
+
+    g_string_free (out, true);
+}
+
+void SeekIndex::add (const SeekPoint & point)
+{
+    pthread_mutex_lock (& m_mutex);
+    m_points.append (point);
+    pthread_mutex_unlock (& m_mutex);
+}
+
+bool SeekIndex::cancelled ()
+{
+    pthread_mutex_lock (& m_mutex);
+    bool cancel = m_cancel;
+    pthread_mutex_unlock (& m_mutex);
+    return cancel;
+}
+
+void * SeekIndex::worker (void * data)
+{
+    SeekIndex * index = (SeekIndex *) data;
+
+    /* m_filename, m_size, and m_mtime are not changed until the thread has
+     * been joined */
+    VFSFile file (index->m_filename, "r");
+    bool done = (file && index->m_scan (* index, file));
+
+    Index<SeekPoint> copy;
+
+    pthread_mutex_lock (& index->m_mutex);
+
+    bool cancelled = index->m_cancel;
+
+    if (done && ! cancelled)
+    {
+        index->m_complete = true;
+        copy.insert (index->m_points.begin (), 0, index->m_points.len ());
+    }
+
+    pthread_mutex_unlock (& index->m_mutex);
+
+    if (cancelled)
+        return nullptr;
+
+    const char * filename = index->m_filename;
+
+    if (done)
+    {
+        AUDINFO ("Indexed %d seek points in %s.\n", copy.len (), filename);
+        index->save (filename, index->m_size, index->m_mtime, copy);
+    }
+    else
+        AUDERR ("Could not index %s.\n", filename);
+
+    return nullptr;
+}
+
+void SeekIndex::start (const char * filename)
+{
+    int64_t size, mtime;
+    if (! get_local_file_info (filename, size, mtime))
+        return;
+
+    Index<SeekPoint> loaded;
+    bool found = load (filename, size, mtime, loaded);
+
+    pthread_mutex_lock (& m_mutex);
+
+    m_filename = String (filename);
+    m_size = size;
+    m_mtime = mtime;
+    m_points = std::move (loaded);
+    m_complete = found;
+    m_cancel = false;
+
+    if (! found)
+        m_running = ! pthread_create (& m_thread, nullptr, worker, this);
+
+    pthread_mutex_unlock (& m_mutex);
+}
+
+void SeekIndex::stop ()
+{
+    pthread_mutex_lock (& m_mutex);
+    bool join = m_running;
+    m_running = false;
+    m_cancel = true;
+    pthread_mutex_unlock (& m_mutex);
+
+    if (join)
+        pthread_join (m_thread, nullptr);
+
+    pthread_mutex_lock (& m_mutex);
+    m_filename = String ();
+    m_points.clear ();
+    m_complete = false;
+    pthread_mutex_unlock (& m_mutex);
+}
+
+bool SeekIndex::find (int64_t sample, SeekPoint & point)
+{
+    pthread_mutex_lock (& m_mutex);
+
+    /* find the first point after <sample> */
+    int low = 0, high = m_points.len ();
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (m_points[mid].sample <= sample)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    /* past the last point, the file may not be indexed that far yet */
+    bool found = (low > 0 && (low < m_points.len () || m_complete));
+
+    if (found)
+        point = m_points[low - 1];
+
+    pthread_mutex_unlock (& m_mutex);
+    return found;
+}
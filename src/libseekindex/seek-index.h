@@ -0,0 +1,103 @@
+/*
+ * Seek Index for Audacious Input Plugins
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+
+#ifndef AUD_SEEK_INDEX_H
+#define AUD_SEEK_INDEX_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+
+class VFSFile;
+
+/* Gets the size and modification time of a local file, which together with
+ * its URI identify results cached for it.  Returns false for anything but a
+ * regular local file. */
+bool get_local_file_info (const char * filename, int64_t & size, int64_t & mtime);
+
+/* A position in a compressed stream: a sample (per channel, counted from the
+ * start of the stream) and the byte offset from which decoding can resume to
+ * reach it. */
+struct SeekPoint
+{
+    int64_t sample, offset;
+};
+
+/* seconds of audio between the points a scanner adds */
+#define SEEK_INDEX_INTERVAL 1
+
+/* For decoders that can only seek by bisection, which takes many small reads
+ * scattered across the file.  Instead, an index of positions is built in the
+ * background the first time a file is played and kept in the user's config
+ * directory (in a folder named <name>, one file per indexed file, named by a
+ * hash of its URI), keyed by URI, size, and modification time.  Only local
+ * files are indexed.
+ *
+ * The format-specific part is the scanner, which is run in the background
+ * thread on the file opened for reading.  It adds points in increasing order,
+ * about SEEK_INDEX_INTERVAL seconds apart, checks cancelled () regularly, and
+ * returns true if it reached the end of the file.  The points added so far can
+ * be used before it finishes.
+ *
+ * start () loads the index for a file or starts building it, and stop ()
+ * abandons an unfinished build.  find () may be called from any thread in
+ * between; it returns the last indexed point at or before <sample>, or false if
+ * that part of the file is not indexed (yet). */
+
+class SeekIndex
+{
+public:
+    typedef bool (* ScanFunc) (SeekIndex & index, VFSFile & file);
+
+    SeekIndex (const char * name, ScanFunc scan) :
+        m_name (name), m_scan (scan) {}
+
+    void start (const char * filename);
+    void stop ();
+    bool find (int64_t sample, SeekPoint & point);
+
+    /* for the scanner */
+    void add (const SeekPoint & point);
+    bool cancelled ();
+
+private:
+    const char * const m_name;
+    const ScanFunc m_scan;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t m_thread;
+    bool m_running = false, m_cancel = false, m_complete = false;
+
+    String m_filename;
+    int64_t m_size = 0, m_mtime = 0;
+    Index<SeekPoint> m_points;
+
+    StringBuf dir () const;
+    StringBuf path (const char * filename) const;
+
+    bool load (const char * filename, int64_t size, int64_t mtime, Index<SeekPoint> & points) const;
+    void save (const char * filename, int64_t size, int64_t mtime, const Index<SeekPoint> & points) const;
+
+    static void * worker (void * data);
+};
+
+#endif /* AUD_SEEK_INDEX_H */
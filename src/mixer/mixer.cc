@@ -17,15 +17,19 @@
  * the use of this software.
  */
 
-/* TODO: implement more surround converters */
-
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <libaudcore/i18n.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../libdsp/dsp.h"
+#include "../libdsp/layout.h"
+#include "../libdsp/stats.h"
+
 class ChannelMixer : public EffectPlugin
 {
 public:
@@ -53,108 +57,83 @@ public:
 
 EXPORT ChannelMixer aud_plugin_instance;
 
-typedef void (* Converter) (float * * data, int * samples);
+/* The conversions handled before the matrices were built from the layouts
+ * keep their old coefficients, so as not to change the volume or balance of
+ * existing setups. */
+struct FixedMatrix {
+    int in, out;
+    float matrix[12];
+};
 
-static Index<float> mixer_buf;
+static const FixedMatrix fixed_matrices[] = {
+    {1, 2, {1,
+            1}},
+    {2, 1, {0.5, 0.5}},
+    {4, 2, {1, 0, 0.7, 0,
+            0, 1, 0, 0.7}},
+    {6, 2, {1, 0, 0.5, 0.5, 0.5, 0,
+            0, 1, 0.5, 0.5, 0, 0.5}}
+};
 
-static void mono_to_stereo (float * * data, int * samples)
+/* Each matrix has one row per output channel and one column per input
+ * channel. */
+static void default_matrix (float * matrix, int in, int out)
 {
-    int frames = * samples;
-    mixer_buf.enlarge (2 * frames);
-
-    float * get = * data;
-    float * set = mixer_buf.begin ();
-
-    * data = set;
-    * samples = 2 * frames;
-
-    while (frames --)
+    for (const FixedMatrix & fixed : fixed_matrices)
     {
-        float val = * get ++;
-        * set ++ = val;
-        * set ++ = val;
+        if (fixed.in == in && fixed.out == out)
+        {
+            memcpy (matrix, fixed.matrix, sizeof (float) * in * out);
+            return;
+        }
     }
-}
-
-static void stereo_to_mono (float * * data, int * samples)
-{
-    int frames = * samples / 2;
-    mixer_buf.enlarge (frames);
-
-    float * get = * data;
-    float * set = mixer_buf.begin ();
-
-    * data = set;
-    * samples = frames;
 
-    while (frames --)
-    {
-        float val = * get ++;
-        val += * get ++;
-        * set ++ = val / 2;
-    }
+    dsp_layout_matrix (matrix, in, out);
 }
 
-static void quadro_to_stereo (float * * data, int * samples)
-{
-    int frames = * samples / 4;
-    mixer_buf.enlarge (2 * frames);
-
-    float * get = * data;
-    float * set = mixer_buf.begin ();
+/* The user may give a matrix with the rows separated by semicolons and the
+ * values by commas or spaces, e.g. "1, 0, 0.5; 0, 1, 0.5" for 3.0 to stereo.
+ * Line breaks count as spaces, and a semicolon after the last row is allowed.
+ * It is used only if it has the right number of rows and columns. */
+#define MATRIX_BLANKS " \t\r\n"
 
-    * data = set;
-    * samples = 2 * frames;
+static bool parse_matrix (const char * str, float * matrix, int in, int out)
+{
+    int row = 0, col = 0;
 
-    while (frames --)
+    while (* (str += strspn (str, MATRIX_BLANKS)))
     {
-        float front_left  = * get ++;
-        float front_right = * get ++;
-        float back_left   = * get ++;
-        float back_right  = * get ++;
-        * set ++ = front_left + (back_left * 0.7);
-        * set ++ = front_right + (back_right * 0.7);
-    }
-}
+        char * end;
+        float value = strtof (str, & end);
 
-static void surround_5p1_to_stereo (float * * data, int * samples)
-{
-    int frames = * samples / 6;
-    mixer_buf.enlarge (2 * frames);
+        if (end == str || row >= out || col >= in)
+            return false;
 
-    float * get = * data;
-    float * set = mixer_buf.begin ();
+        matrix[row * in + col ++] = value;
 
-    * data = set;
-    * samples = 2 * frames;
+        str = end + strspn (end, MATRIX_BLANKS);
 
-    while (frames --)
-    {
-        float front_left  = * get ++;
-        float front_right = * get ++;
-        float center = * get ++;
-        float lfe    = * get ++;
-        float rear_left   = * get ++;
-        float rear_right  = * get ++;
-        * set ++ = front_left + (center * 0.5) + (lfe * 0.5) + (rear_left * 0.5);
-        * set ++ = front_right + (center * 0.5) + (lfe * 0.5) + (rear_right * 0.5);
+        if (* str == ';')
+        {
+            if (col != in)
+                return false;
+
+            row ++;
+            col = 0;
+            str ++;
+        }
+        else if (* str == ',')
+            str ++;
     }
-}
 
-static Converter get_converter (int in, int out)
-{
-    if (in == 1 && out == 2)
-        return mono_to_stereo;
-    if (in == 2 && out == 1)
-        return stereo_to_mono;
-    if (in == 4 && out == 2)
-        return quadro_to_stereo;
-    if (in == 6 && out == 2)
-        return surround_5p1_to_stereo;
-
-    return nullptr;
+    return (row == out - 1 && col == in) || (row == out && ! col);
 }
 
+static float mixer_matrix[AUD_MAX_CHANNELS * AUD_MAX_CHANNELS];
+static Index<float> mixer_buf;
+
+static EffectStats stats (N_("Channel Mixer"));
+
 static int input_channels, output_channels;
 
 void ChannelMixer::start (int * channels, int * rate)
@@ -165,13 +144,29 @@ void ChannelMixer::start (int * channels, int * rate)
     if (input_channels == output_channels)
         return;
 
-    if (! get_converter (input_channels, output_channels))
+    if (input_channels > DSP_MAX_LAYOUT || output_channels < 1 ||
+     output_channels > DSP_MAX_LAYOUT)
     {
         AUDERR ("Converting %d to %d channels is not implemented.\n",
          input_channels, output_channels);
+        output_channels = input_channels;
         return;
     }
 
+    String custom = aud_get_str ("mixer", "matrix");
+
+    if (! custom[0] || ! parse_matrix (custom, mixer_matrix, input_channels,
+     output_channels))
+    {
+        if (custom[0])
+            AUDWARN ("Custom matrix \"%s\" does not fit %d to %d channels; "
+             "using the default.\n", (const char *) custom, input_channels,
+             output_channels);
+
+        default_matrix (mixer_matrix, input_channels, output_channels);
+    }
+
+    mixer_buf.enlarge (output_channels * DSP_BLOCK_FRAMES);
     * channels = output_channels;
 }
 
@@ -180,23 +175,39 @@ void ChannelMixer::process (float * * data, int * samples)
     if (input_channels == output_channels)
         return;
 
-    Converter converter = get_converter (input_channels, output_channels);
-    if (converter)
-        converter (data, samples);
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
+    int frames = * samples / input_channels;
+
+    if (mixer_buf.len () < output_channels * frames)
+    {
+        mixer_buf.enlarge (output_channels * frames);
+        stats.count_alloc ();
+    }
+
+    dsp_matrix_mix (* data, input_channels, mixer_buf.begin (), output_channels,
+     mixer_matrix, frames);
+
+    * data = mixer_buf.begin ();
+    * samples = output_channels * frames;
 }
 
 const char * const ChannelMixer::defaults[] = {
  "channels", "2",
+ "matrix", "",
   nullptr};
 
 bool ChannelMixer::init ()
 {
     aud_config_set_defaults ("mixer", defaults);
+    stats.attach ();
     return true;
 }
 
 void ChannelMixer::cleanup ()
 {
+    stats.detach ();
     mixer_buf.clear ();
 }
 
@@ -208,7 +219,11 @@ const PreferencesWidget ChannelMixer::widgets[] = {
     WidgetLabel (N_("<b>Channel Mixer</b>")),
     WidgetSpin (N_("Output channels:"),
         WidgetInt ("mixer", "channels"),
-        {1, AUD_MAX_CHANNELS, 1})
+        {1, DSP_MAX_LAYOUT, 1}),
+    WidgetEntry (N_("Custom matrix:"),
+        WidgetString ("mixer", "matrix")),
+    WidgetLabel (N_("<small>One row per output channel, separated by "
+     "semicolons.  Leave empty for the ITU-R BS.775 defaults.</small>"))
 };
 
 const PluginPreferences ChannelMixer::prefs = {{ChannelMixer::widgets}};
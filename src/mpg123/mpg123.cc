@@ -19,6 +19,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <math.h>
 #include <string.h>
 
 #undef EXPORT
@@ -43,6 +44,8 @@
 #include <libaudcore/preferences.h>
 #include <audacious/audtag.h>
 
+#include "scan-cache.h"
+
 static const char * const mpg123_defaults[] = {
     "full_scan", "FALSE",
     nullptr
@@ -58,6 +61,12 @@ static const PluginPreferences mpg123_prefs = {{mpg123_widgets}};
 
 #define DECODE_OPTIONS (MPG123_QUIET | MPG123_GAPLESS | MPG123_SEEKBUFFER | MPG123_FUZZY)
 
+/* The scan cache keeps the offset of about one frame per second of audio; a
+ * seek decodes forward from the nearest one.  Very long files get fewer, to
+ * keep each entry to about 16 KB (an offset takes up to 8 bytes there). */
+#define CACHED_OFFSET_SECONDS 1
+#define MAX_CACHED_OFFSETS 2048
+
 static ssize_t replace_read (void * file, void * buffer, size_t length)
 {
     return ((VFSFile *) file)->fread (buffer, 1, length);
@@ -92,6 +101,75 @@ aud_mpg123_deinit(void)
 {
     AUDDBG("deinitializing mpg123 library\n");
     mpg123_exit();
+
+    scan_cache_cleanup ();
+}
+
+/* The encoder delay and padding from the LAME tag, if there is one and this
+ * version of mpg123 reports them. */
+static void get_gapless_info (mpg123_handle * dec, ScanInfo & info)
+{
+    info.delay = info.padding = -1;
+
+#if MPG123_API_VERSION >= 42
+    long delay, padding;
+
+    if (mpg123_getstate (dec, MPG123_ENC_DELAY, & delay, nullptr) == MPG123_OK &&
+     mpg123_getstate (dec, MPG123_ENC_PADDING, & padding, nullptr) == MPG123_OK)
+    {
+        info.delay = delay;
+        info.padding = padding;
+    }
+#endif
+}
+
+/* A full scan reads the whole file, so its results are cached: the exact
+ * length, and the frame index that mpg123 builds while scanning, which is
+ * given back to the decoder so that seeking does not need another scan.
+ * Returns the length in samples, or -1 on error. */
+static int64_t full_scan (const char * filename, mpg123_handle * dec)
+{
+    ScanInfo info;
+
+    if (scan_cache_lookup (filename, info))
+    {
+        Index<off_t> offsets;
+        for (int64_t offset : info.offsets)
+            offsets.append (offset);
+
+        if (offsets.len () && mpg123_set_index (dec, offsets.begin (),
+         info.step, offsets.len ()) != MPG123_OK)
+            AUDDBG ("Failed to set frame index: %s\n", mpg123_strerror (dec));
+
+        return info.samples;
+    }
+
+    if (mpg123_scan (dec) < 0)
+        return -1;
+
+    info.samples = mpg123_length (dec);
+    get_gapless_info (dec, info);
+
+    off_t * offsets, step;
+    size_t fill;
+
+    if (mpg123_index (dec, & offsets, & step, & fill) == MPG123_OK && fill > 0)
+    {
+        /* keep every n-th entry, n entries being CACHED_OFFSET_SECONDS long */
+        double seconds = mpg123_tpf (dec) * step;
+        size_t n = (seconds > 0) ? lrint (CACHED_OFFSET_SECONDS / seconds) : 1;
+
+        n = aud::max (n, (size_t) 1);
+        n = aud::max (n, (fill + MAX_CACHED_OFFSETS - 1) / MAX_CACHED_OFFSETS);
+
+        for (size_t i = 0; i < fill; i += n)
+            info.offsets.append (offsets[i]);
+
+        info.step = step * n;
+    }
+
+    scan_cache_store (filename, info);
+    return info.samples;
 }
 
 static void set_format (mpg123_handle * dec)
@@ -154,9 +232,6 @@ ERR:
         return false;
     }
 
-    if (! is_streaming && aud_get_bool ("mpg123", "full_scan") && mpg123_scan (dec) < 0)
-        goto ERR;
-
 RETRY:;
     long rate;
     int chan, enc;
@@ -201,11 +276,22 @@ static Tuple mpg123_probe_for_tuple (const char * filename, VFSFile & file)
     else
         mpg123_replace_reader_handle (decoder, replace_read, replace_lseek, nullptr);
 
-    if ((result = mpg123_open_handle (decoder, & file)) < 0
-     || (! stream && aud_get_bool ("mpg123", "full_scan") && (result = mpg123_scan (decoder)) < 0)
-     || (result = mpg123_getformat (decoder, & rate, & channels, & encoding)) < 0
+    int64_t samples = -1;
+
+    if ((result = mpg123_open_handle (decoder, & file)) < 0)
+        goto ERR;
+
+    if (! stream && aud_get_bool ("mpg123", "full_scan")
+     && (samples = full_scan (filename, decoder)) < 0)
+    {
+        result = MPG123_ERR;
+        goto ERR;
+    }
+
+    if ((result = mpg123_getformat (decoder, & rate, & channels, & encoding)) < 0
      || (result = mpg123_info (decoder, & info)) < 0)
     {
+ERR:
         AUDERR ("mpg123 probe error for %s: %s\n", filename, mpg123_plain_strerror (result));
         mpg123_delete (decoder);
         return Tuple ();
@@ -223,7 +309,10 @@ static Tuple mpg123_probe_for_tuple (const char * filename, VFSFile & file)
     if (! stream)
     {
         int64_t size = file.fsize ();
-        int64_t samples = mpg123_length (decoder);
+
+        if (samples < 0)
+            samples = mpg123_length (decoder);
+
         int length = (samples > 0 && rate > 0) ? samples * 1000 / rate : 0;
 
         if (length > 0)
@@ -297,7 +386,8 @@ OPEN_ERROR:
         goto cleanup;
     }
 
-    if (! ctx.stream && aud_get_bool ("mpg123", "full_scan") && mpg123_scan (ctx.decoder) < 0)
+    if (! ctx.stream && aud_get_bool ("mpg123", "full_scan") &&
+     full_scan (filename, ctx.decoder) < 0)
         goto OPEN_ERROR;
 
 GET_FORMAT:
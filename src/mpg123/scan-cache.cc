@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2015 Audacious developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scan-cache.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/runtime.h>
+
+#include "../libseekindex/seek-index.h"
+
+/* One line per file: URI, size, modification time, samples, encoder delay,
+ * padding, index step, and the index as differences between successive offsets.  New entries are
+ * appended, so adding a large library does not rewrite the file each time; a
+ * later line for the same URI replaces an earlier one.  The file is rewritten
+ * without the replaced lines when they make up more than half of it. */
+#define CACHE_HEADER "mpg123-scan-cache 2"
+
+struct CacheEntry
+{
+    int64_t size, mtime;
+    ScanInfo info;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimpleHash<String, CacheEntry> cache;
+static bool loaded;
+
+static StringBuf cache_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "mpg123-scan-cache"});
+}
+
+static void append_entry (GString * out, const String & filename, const CacheEntry & entry)
+{
+    /* URIs are escaped and cannot contain tabs or line breaks */
+    g_string_append_printf (out, "%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT
+     "\t%" G_GINT64_FORMAT "\t%d\t%d\t%" G_GINT64_FORMAT "\t", (const char *) filename,
+     (gint64) entry.size, (gint64) entry.mtime, (gint64) entry.info.samples,
+     entry.info.delay, entry.info.padding, (gint64) entry.info.step);
+
+    int64_t prev = 0;
+
+    for (int i = 0; i < entry.info.offsets.len (); i ++)
+    {
+        int64_t offset = entry.info.offsets[i];
+        g_string_append_printf (out, i ? " %" G_GINT64_FORMAT : "%"
+         G_GINT64_FORMAT, (gint64) (offset - prev));
+        prev = offset;
+    }
+
+    g_string_append_c (out, '\n');
+}
+
+static bool parse_entry (char * line, String & filename, CacheEntry & entry)
+{
+    char * * fields = g_strsplit (line, "\t", -1);
+    bool valid = (g_strv_length (fields) == 8);
+
+    if (valid)
+    {
+        filename = String (fields[0]);
+        entry.size = g_ascii_strtoll (fields[1], nullptr, 10);
+        entry.mtime = g_ascii_strtoll (fields[2], nullptr, 10);
+        entry.info.samples = g_ascii_strtoll (fields[3], nullptr, 10);
+        entry.info.delay = atoi (fields[4]);
+        entry.info.padding = atoi (fields[5]);
+        entry.info.step = g_ascii_strtoll (fields[6], nullptr, 10);
+
+        int64_t offset = 0;
+        char * pos = fields[7];
+
+        while (* pos)
+        {
+            char * end;
+            offset += g_ascii_strtoll (pos, & end, 10);
+
+            if (end == pos)
+            {
+                valid = false;
+                break;
+            }
+
+            entry.info.offsets.append (offset);
+            pos = (* end == ' ') ? end + 1 : end;
+        }
+    }
+
+    g_strfreev (fields);
+    return valid;
+}
+
+static void rewrite_cb (const String & filename, CacheEntry & entry, void * out)
+{
+    append_entry ((GString *) out, filename, entry);
+}
+
+static void rewrite_cache ()
+{
+    GString * out = g_string_new (CACHE_HEADER "\n");
+    cache.iterate (rewrite_cb, out);
+
+    StringBuf path = cache_path ();
+    GError * err = nullptr;
+
+    /* written to a temporary file and renamed, so never left half-written */
+    if (! g_file_set_contents (path, out->str, out->len, & err))
+    {
+        AUDERR ("Failed to write %s: %s\n", (const char *) path, err->message);
+        g_error_free (err);
+    }
+
+    g_string_free (out, true);
+}
+
+static void load_cache ()
+{
+    loaded = true;
+
+    char * data;
+    if (! g_file_get_contents (cache_path (), & data, nullptr, nullptr))
+        return;
+
+    char * * lines = g_strsplit (data, "\n", -1);
+    g_free (data);
+
+    if (! lines[0] || strcmp (lines[0], CACHE_HEADER))
+    {
+        AUDINFO ("Replacing old or invalid MPEG scan cache.\n");
+        g_strfreev (lines);
+        rewrite_cache ();
+        return;
+    }
+
+    int n_lines = 0;
+
+    for (int i = 1; lines[i]; i ++)
+    {
+        String filename;
+        CacheEntry entry;
+
+        if (lines[i][0] && parse_entry (lines[i], filename, entry))
+        {
+            cache.add (filename, std::move (entry));
+            n_lines ++;
+        }
+    }
+
+    g_strfreev (lines);
+
+    AUDDBG ("Loaded %d MPEG scan results.\n", cache.n_items ());
+
+    if (n_lines > 2 * cache.n_items ())
+        rewrite_cache ();
+}
+
+bool scan_cache_lookup (const char * filename, ScanInfo & info)
+{
+    int64_t size, mtime;
+    if (! get_local_file_info (filename, size, mtime))
+        return false;
+
+    pthread_mutex_lock (& mutex);
+
+    if (! loaded)
+        load_cache ();
+
+    CacheEntry * entry = cache.lookup (String (filename));
+    bool found = (entry && entry->size == size && entry->mtime == mtime);
+
+    if (found)
+    {
+        info.samples = entry->info.samples;
+        info.delay = entry->info.delay;
+        info.padding = entry->info.padding;
+        info.step = entry->info.step;
+        info.offsets.clear ();
+        info.offsets.insert (entry->info.offsets.begin (), 0, entry->info.offsets.len ());
+    }
+
+    pthread_mutex_unlock (& mutex);
+    return found;
+}
+
+void scan_cache_store (const char * filename, const ScanInfo & info)
+{
+    CacheEntry entry;
+    if (! get_local_file_info (filename, entry.size, entry.mtime))
+        return;
+
+    entry.info.samples = info.samples;
+    entry.info.delay = info.delay;
+    entry.info.padding = info.padding;
+    entry.info.step = info.step;
+    entry.info.offsets.insert (info.offsets.begin (), 0, info.offsets.len ());
+
+    pthread_mutex_lock (& mutex);
+
+    if (! loaded)
+        load_cache ();
+
+    StringBuf path = cache_path ();
+    FILE * file = fopen (path, "a");
+
+    if (file)
+    {
+        GString * out = g_string_new (nullptr);
+
+        if (fseek (file, 0, SEEK_END) == 0 && ! ftell (file))
+            g_string_append (out, CACHE_HEADER "\n");
+
+        append_entry (out, String (filename), entry);
+
+        if (fwrite (out->str, 1, out->len, file) != out->len)
+            AUDERR ("Failed to write %s.\n", (const char *) path);
+
+        g_string_free (out, true);
+        fclose (file);
+    }
+    else
+        AUDERR ("Failed to open %s: %s\n", (const char *) path, strerror (errno));
+
+    cache.add (String (filename), std::move (entry));
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void scan_cache_cleanup ()
+{
+    pthread_mutex_lock (& mutex);
+    cache.clear ();
+    loaded = false;
+    pthread_mutex_unlock (& mutex);
+}
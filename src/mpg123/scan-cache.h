@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2015 Audacious developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MPG123_SCAN_CACHE_H
+#define MPG123_SCAN_CACHE_H
+
+#include <stdint.h>
+
+#include <libaudcore/index.h>
+
+/* What a full scan finds out about a file: the exact number of samples
+ * (per channel, as decoded with MPG123_GAPLESS), the encoder delay and padding
+ * (-1 if unknown), and a sparse table of frame offsets, with offsets[i] being
+ * the file position of frame i * step.  The offsets count every frame in the
+ * file, including those that hold only the delay or padding. */
+struct ScanInfo
+{
+    int64_t samples = 0;
+    int delay = -1, padding = -1;
+    int64_t step = 0;
+    Index<int64_t> offsets;
+};
+
+/* The results are kept in a file in the user's config directory, keyed by URI
+ * and valid as long as the file has the same size and modification time.
+ * Only local files are cached.  Both functions are thread-safe. */
+bool scan_cache_lookup (const char * filename, ScanInfo & info);
+void scan_cache_store (const char * filename, const ScanInfo & info);
+
+/* Frees the entries loaded into memory. */
+void scan_cache_cleanup ();
+
+#endif /* MPG123_SCAN_CACHE_H */
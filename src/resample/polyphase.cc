@@ -0,0 +1,314 @@
+/*
+ * Sample Rate Converter Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "polyphase.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/audio.h>
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/dsp.h"
+
+/* Limits on the size of the coefficient table (in floats) and on the length of
+ * the filter.  44.1 kHz to 48 kHz needs 160 phases; 8 kHz to 44.1 kHz needs
+ * 441 phases. */
+#define MAX_COEFS (1 << 18)
+#define MAX_TAPS 1024
+
+/* input kept before the current filter window */
+#define HISTORY (MAX_TAPS / 2)
+
+/* stopband attenuation in dB, used to pick the Kaiser window parameter */
+#define ATTENUATION 100.0
+
+static int gcd (int a, int b)
+{
+    while (b)
+    {
+        int c = a % b;
+        a = b;
+        b = c;
+    }
+
+    return a;
+}
+
+/* zeroth-order modified Bessel function of the first kind */
+static double bessel_i0 (double x)
+{
+    double sum = 1, term = 1;
+
+    for (int k = 1; k < 50 && term > sum * 1e-12; k ++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+int Polyphase::taps_for_width (double width)
+{
+    return (int) ceil ((ATTENUATION - 8) / (2.285 * 2 * M_PI * width));
+}
+
+/* the number of taps actually used for <taps> at the output rate */
+static int scale_taps (int taps, int up, int down)
+{
+    /* When downsampling, the filter must be longer (in input samples) to get
+     * the same transition band relative to the output rate. */
+    if (down > up)
+        taps = (int) ((int64_t) taps * down / up);
+
+    /* round up to a multiple of 8 for the SIMD dot product */
+    return (taps + 7) & ~7;
+}
+
+bool Polyphase::make_coefs (int taps, Index<float> & coefs)
+{
+    int up = m_up, down = m_down;
+
+    if (taps > MAX_TAPS || (int64_t) up * taps > MAX_COEFS)
+        return false;
+
+    /* Kaiser window design (cf. Oppenheim & Schafer); the cutoff is placed so
+     * that the stopband begins at the lower of the two Nyquist frequencies. */
+    double beta = 0.1102 * (ATTENUATION - 8.7);
+    double width = (ATTENUATION - 8) / (2.285 * 2 * M_PI * taps);
+    double cutoff = 0.5 * aud::min (1.0, (double) up / down) - width / 2;
+    double radius = taps / 2.0;
+    double norm = bessel_i0 (beta);
+
+    coefs.insert (0, up * taps);
+
+    for (int phase = 0; phase < up; phase ++)
+    {
+        float * row = & coefs[phase * taps];
+        double sum = 0;
+
+        for (int j = 0; j < taps; j ++)
+        {
+            /* distance from the output instant to input sample j */
+            double t = (double) phase / up + radius - 1 - j;
+            double x = t / radius;
+            double h = 0;
+
+            if (x > -1 && x < 1)
+            {
+                double sinc = (t == 0) ? 1 : sin (2 * M_PI * cutoff * t) / (2 * M_PI * cutoff * t);
+                h = 2 * cutoff * sinc * bessel_i0 (beta * sqrt (1 - x * x)) / norm;
+            }
+
+            row[j] = h;
+            sum += h;
+        }
+
+        /* normalize each phase to unity gain at DC */
+        for (int j = 0; j < taps; j ++)
+            row[j] /= sum;
+    }
+
+    return true;
+}
+
+bool Polyphase::init (int in_rate, int out_rate, int channels, int taps)
+{
+    destroy ();
+
+    int div = gcd (in_rate, out_rate);
+    m_up = out_rate / div;
+    m_down = in_rate / div;
+
+    taps = scale_taps (taps, m_up, m_down);
+
+    if (! make_coefs (taps, m_coefs))
+    {
+        destroy ();
+        return false;
+    }
+
+    m_channels = channels;
+    m_taps = taps;
+
+    AUDDBG ("Polyphase resampler: %d/%d, %d taps, %s.\n", m_up, m_down, taps, dsp_get_isa ());
+
+    reset ();
+    return true;
+}
+
+bool Polyphase::set_taps (int taps)
+{
+    taps = scale_taps (taps, m_up, m_down);
+
+    if (taps == m_taps)
+        return true;
+
+    Index<float> coefs;
+    if (! make_coefs (taps, coefs))
+        return false;
+
+    /* keep the filter centered on the same input sample */
+    int pos = m_pos + (m_taps / 2 - 1) - (taps / 2 - 1);
+
+    /* only happens near the start of the stream, before which the input is
+     * taken to be silence anyway */
+    if (pos < 0)
+    {
+        Index<float> planes;
+        int stride = m_stride - pos;
+        planes.insert (0, m_channels * stride);
+
+        for (int c = 0; c < m_channels; c ++)
+            memcpy (& planes[c * stride - pos], & m_planes[c * m_stride], sizeof (float) * m_filled);
+
+        m_planes = std::move (planes);
+        m_stride = stride;
+        m_filled -= pos;
+        pos = 0;
+    }
+
+    m_coefs = std::move (coefs);
+    m_taps = taps;
+    m_pos = pos;
+
+    AUDDBG ("Polyphase resampler: now %d taps.\n", taps);
+    return true;
+}
+
+void Polyphase::destroy ()
+{
+    m_coefs.clear ();
+    m_planes.clear ();
+    m_channels = m_up = m_down = m_taps = 0;
+    m_stride = m_filled = 0;
+    m_phase = m_pos = 0;
+}
+
+void Polyphase::reset ()
+{
+    m_phase = 0;
+    m_pos = 0;
+    m_filled = 0;
+
+    /* center the first filter window on the first input sample */
+    append_silence (m_taps / 2 - 1);
+}
+
+int Polyphase::max_output (int in_frames) const
+{
+    int64_t avail = (int64_t) m_filled - m_pos + in_frames + m_taps;
+    return avail * m_up / m_down + 1;
+}
+
+void Polyphase::resize_planes (int stride)
+{
+    Index<float> planes;
+    planes.insert (0, m_channels * stride);
+
+    for (int c = 0; c < m_channels && m_filled; c ++)
+        memcpy (& planes[c * stride], & m_planes[c * m_stride], sizeof (float) * m_filled);
+
+    m_planes = std::move (planes);
+    m_stride = stride;
+}
+
+/* After append () drops old input, at most HISTORY frames before the filter
+ * window and the window itself are left; at the end, half a window of silence
+ * is added. */
+void Polyphase::reserve (int frames)
+{
+    int stride = HISTORY + 2 * MAX_TAPS + frames;
+    if (stride > m_stride)
+        resize_planes (stride);
+}
+
+void Polyphase::append (const float * in, int frames)
+{
+    if (! frames)
+        return;
+
+    /* drop the samples that no filter window will need again, except for
+     * enough history for set_taps () to lengthen the filter */
+    int drop = m_pos - HISTORY;
+
+    if (drop > 0)
+    {
+        int keep = m_filled - drop;
+
+        for (int c = 0; c < m_channels; c ++)
+        {
+            float * plane = & m_planes[c * m_stride];
+            memmove (plane, plane + drop, sizeof (float) * keep);
+        }
+
+        m_filled = keep;
+        m_pos -= drop;
+    }
+
+    if (m_filled + frames > m_stride)
+        resize_planes (aud::max (m_filled + frames, 2 * m_stride));
+
+    float * dest[AUD_MAX_CHANNELS];
+    for (int c = 0; c < m_channels; c ++)
+        dest[c] = & m_planes[c * m_stride + m_filled];
+
+    dsp_deinterleave (in, dest, m_channels, frames);
+    m_filled += frames;
+}
+
+void Polyphase::append_silence (int frames)
+{
+    static const float silence[AUD_MAX_CHANNELS * 64] = {};
+
+    while (frames > 0)
+    {
+        int chunk = aud::min (frames, 64);
+        append (silence, chunk);
+        frames -= chunk;
+    }
+}
+
+int Polyphase::process (const float * in, int in_frames, float * out, bool finish)
+{
+    append (in, in_frames);
+
+    /* run the last input sample through the center of the filter */
+    if (finish)
+        append_silence (m_taps / 2);
+
+    int frames = 0;
+
+    while (m_pos + m_taps <= m_filled)
+    {
+        const float * coefs = & m_coefs[m_phase * m_taps];
+
+        for (int c = 0; c < m_channels; c ++)
+            * out ++ = dsp_dot (coefs, & m_planes[c * m_stride + m_pos], m_taps);
+
+        frames ++;
+
+        m_phase += m_down;
+        m_pos += m_phase / m_up;
+        m_phase %= m_up;
+    }
+
+    return frames;
+}
@@ -0,0 +1,80 @@
+/*
+ * Sample Rate Converter Plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef RESAMPLE_POLYPHASE_H
+#define RESAMPLE_POLYPHASE_H
+
+#include <libaudcore/index.h>
+
+/* Polyphase FIR resampler for rational ratios (up / down, in lowest terms).
+ * The prototype low-pass filter is a Kaiser-windowed sinc, split ahead of
+ * time into one table of coefficients per phase, so that each output sample
+ * costs a single dot product of <taps> samples.  The filter is centered on
+ * the input sample, so the output is not delayed relative to the input. */
+
+class Polyphase
+{
+public:
+    /* Returns false if the ratio between the rates is too complicated, in
+     * which case libsamplerate should be used instead. */
+    bool init (int in_rate, int out_rate, int channels, int taps);
+    void destroy ();
+
+    bool ready () const
+        { return m_coefs.len () > 0; }
+
+    /* The filter length (as passed to init ()) needed for a transition band of
+     * <width>, as a fraction of the lower of the two sample rates. */
+    static int taps_for_width (double width);
+
+    /* Changes the filter length (as passed to init ()) without disturbing the
+     * audio.  Returns false if the new length is too long. */
+    bool set_taps (int taps);
+
+    /* Allocates ahead of time for blocks of up to <frames> input frames. */
+    void reserve (int frames);
+
+    /* The most output frames that process () can produce from <in_frames>
+     * input frames. */
+    int max_output (int in_frames) const;
+
+    /* Consumes <in_frames> interleaved input frames and writes interleaved
+     * output frames to <out>, returning the number of frames written.  If
+     * <finish> is set, the remaining input is flushed through the filter. */
+    int process (const float * in, int in_frames, float * out, bool finish);
+
+    /* Discards buffered input (for seeking). */
+    void reset ();
+
+private:
+    bool make_coefs (int taps, Index<float> & coefs);
+    void resize_planes (int stride);
+    void append (const float * in, int frames);
+    void append_silence (int frames);
+
+    int m_channels = 0, m_up = 0, m_down = 0, m_taps = 0;
+    int m_phase = 0;              /* current phase, 0 <= m_phase < m_up */
+    int m_pos = 0;                /* start of the current filter window */
+
+    Index<float> m_coefs;         /* m_up rows of m_taps coefficients */
+    Index<float> m_planes;        /* m_channels rows of m_stride samples */
+    int m_stride = 0, m_filled = 0;
+};
+
+#endif /* RESAMPLE_POLYPHASE_H */
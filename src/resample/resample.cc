@@ -17,7 +17,9 @@
  * the use of this software.
  */
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib.h>
 
@@ -29,10 +31,23 @@
 #include <libaudcore/preferences.h>
 #include <libaudcore/audstrings.h>
 
+#include "polyphase.h"
+#include "../libdsp/dsp.h"
+#include "../libdsp/drift.h"
+#include "../libdsp/load.h"
+#include "../libdsp/stats.h"
+
 #define MIN_RATE 8000
 #define MAX_RATE 192000
 #define RATE_STEP 50
 
+/* not a libsamplerate method: choose one according to the CPU load */
+#define METHOD_AUTO -1
+
+/* input kept for starting a new libsamplerate converter where the old one left
+ * off; enough for the longest filter at any ratio we allow */
+#define HISTORY_FRAMES 4096
+
 #define RESAMPLE_ERROR(e) AUDERR ("%s\n", src_strerror (e))
 
 class Resampler : public EffectPlugin
@@ -60,6 +75,7 @@ public:
     void process (float * * data, int * samples);
     void flush ();
     void finish (float * * data, int * samples);
+    int adjust_delay (int delay);
 };
 
 EXPORT Resampler aud_plugin_instance;
@@ -68,6 +84,8 @@ static const char default_method[] = {'0' + SRC_SINC_FASTEST, 0};
 
 const char * const Resampler::defaults[] = {
  "method", default_method,
+ "polyphase", "TRUE",
+ "adaptive", "FALSE",
  "default-rate", "44100",
  "use-mappings", "FALSE",
  "8000", "48000",
@@ -82,31 +100,87 @@ const char * const Resampler::defaults[] = {
  "192000", "48000",
  nullptr};
 
+/* methods used in automatic mode, cheapest first */
+static const int auto_methods[] = {
+    SRC_SINC_FASTEST,
+    SRC_SINC_MEDIUM_QUALITY,
+    SRC_SINC_BEST_QUALITY
+};
+
 static SRC_STATE * state;
-static int stored_channels;
+static Polyphase polyphase;
+static DriftControl drift;
+static LoadControl load;
+static EffectStats stats (N_("Sample Rate Converter"));
+static bool adaptive, auto_method;
+static int auto_level;
+static int stored_channels, stored_rate, input_rate;
 static double ratio;
 static float * buffer;
 static int buffer_samples;
 
+/* for switching libsamplerate converters in automatic mode */
+static InputHistory history;
+static double src_time;       /* output position of the end of the input so far */
+static int64_t src_pos;       /* output position of the next frame returned */
+static int pending_frames;    /* output at the start of the buffer, not yet returned */
+static int skip_frames;       /* output of the new converter not to be returned */
+
 bool Resampler::init ()
 {
     aud_config_set_defaults ("resample", defaults);
+    stats.attach ();
     return true;
 }
 
 void Resampler::cleanup ()
 {
+    stats.detach ();
+
     if (state)
     {
         src_delete (state);
         state = nullptr;
     }
 
+    polyphase.destroy ();
+    history.destroy ();
+
     g_free (buffer);
     buffer = nullptr;
     buffer_samples = 0;
 }
 
+/* Transition band of the built-in polyphase resampler, as a fraction of the
+ * sample rate, for each libsamplerate method.  The passband thus ends at 90%,
+ * 95%, and 97.5% of the Nyquist frequency, at least as wide as that of the
+ * corresponding libsamplerate converter.  The simpler methods are cheap enough
+ * as they are and are always left to libsamplerate. */
+static int polyphase_taps (int method)
+{
+    switch (method)
+    {
+    case SRC_SINC_BEST_QUALITY:
+        return Polyphase::taps_for_width (0.0125);
+    case SRC_SINC_MEDIUM_QUALITY:
+        return Polyphase::taps_for_width (0.025);
+    case SRC_SINC_FASTEST:
+        return Polyphase::taps_for_width (0.05);
+    default:
+        return 0;
+    }
+}
+
+static void enlarge_buffer (int samples)
+{
+    if (buffer_samples < samples)
+    {
+        buffer_samples = samples;
+        buffer = g_renew (float, buffer, buffer_samples);
+        stats.count_alloc ();
+    }
+}
+
 void Resampler::start (int * channels, int * rate)
 {
     if (state)
@@ -115,6 +189,11 @@ void Resampler::start (int * channels, int * rate)
         state = nullptr;
     }
 
+    polyphase.destroy ();
+    drift.reset ();
+    history.destroy ();
+    stats.set_note (nullptr);
+
     int new_rate = 0;
 
     if (aud_get_bool ("resample", "use-mappings"))
@@ -125,41 +204,169 @@ void Resampler::start (int * channels, int * rate)
 
     new_rate = aud::clamp (new_rate, MIN_RATE, MAX_RATE);
 
-    if (new_rate == * rate)
+    /* In adaptive mode, we resample even if the rates match, since the clocks
+     * behind them may not. */
+    adaptive = aud_get_bool ("resample", "adaptive");
+
+    if (new_rate == * rate && ! adaptive)
         return;
 
     int method = aud_get_int ("resample", "method");
-    int error;
 
-    if ((state = src_new (method, * channels, & error)) == nullptr)
+    /* start cheap and work up, rather than risk an underrun */
+    auto_method = (method == METHOD_AUTO);
+    if (auto_method)
     {
-        RESAMPLE_ERROR (error);
-        return;
+        auto_level = 0;
+        load.init (aud::n_elems (auto_methods), auto_level);
+        method = auto_methods[auto_level];
     }
 
+    int taps = polyphase_taps (method);
+
+    /* Use the polyphase resampler for simple ratios (such as 44.1 kHz to
+     * 48 kHz) and fall back to libsamplerate for the rest.  The adaptive mode
+     * needs a continuously variable ratio, which only libsamplerate has. */
+    if (adaptive || ! taps || ! aud_get_bool ("resample", "polyphase") ||
+     ! polyphase.init (* rate, new_rate, * channels, taps))
+    {
+        int error;
+
+        if ((state = src_new (method, * channels, & error)) == nullptr)
+        {
+            RESAMPLE_ERROR (error);
+            return;
+        }
+
+        if (auto_method)
+            history.init (* channels, HISTORY_FRAMES);
+    }
+
+    stats.set_note (src_get_name (method));
+
     stored_channels = * channels;
+    stored_rate = new_rate;
+    input_rate = * rate;
     ratio = (double) new_rate / * rate;
     * rate = new_rate;
+
+    /* The polyphase filter holds back up to its longest length (1024 frames)
+     * of input.  In automatic mode, the output of a new libsamplerate
+     * converter primed with the history may be waiting in the buffer. */
+    if (polyphase.ready ())
+    {
+        polyphase.reserve (DSP_BLOCK_FRAMES);
+        enlarge_buffer (stored_channels * polyphase.max_output (DSP_BLOCK_FRAMES + 1024));
+    }
+    else
+        enlarge_buffer (stored_channels * ((int) ((DSP_BLOCK_FRAMES +
+         (auto_method ? HISTORY_FRAMES : 0)) * ratio) + 512));
+
+    src_time = src_pos = 0;
+    pending_frames = skip_frames = 0;
+    history.reset ();
 }
 
-void do_resample (float * * data, int * samples, bool finish)
+/* Replaces the libsamplerate converter, feeding the new one the recent input
+ * so that its filter is primed, and lining up its output with what the old
+ * one has returned.  Both filters are centered on the input, so the new one
+ * produces output for the history from the start of the history on.  The old
+ * converter is kept if the new one cannot be started. */
+static bool switch_src (int method)
 {
-    if (! state || ! * samples)
-        return;
+    int channels = stored_channels;
+    int error;
 
-    if (buffer_samples < (int) (* samples * ratio) + 256)
+    SRC_STATE * next = src_new (method, channels, & error);
+    if (! next)
     {
-        buffer_samples = (int) (* samples * ratio) + 256;
-        buffer = g_renew (float, buffer, buffer_samples);
+        RESAMPLE_ERROR (error);
+        return false;
     }
 
+    int frames = history.frames_to_prime (src_time, ratio);
+    enlarge_buffer (channels * ((int) (frames * ratio) + 256));
+
     SRC_DATA d = {0};
 
-    d.data_in = * data;
-    d.input_frames = * samples / stored_channels;
+    d.data_in = history.last (frames);
+    d.input_frames = frames;
     d.data_out = buffer;
-    d.output_frames = buffer_samples / stored_channels;
+    d.output_frames = buffer_samples / channels;
     d.src_ratio = ratio;
+
+    if ((error = src_process (next, & d)))
+    {
+        RESAMPLE_ERROR (error);
+        src_delete (next);
+        return false;
+    }
+
+    /* output of the new converter up to where the old one stopped */
+    int64_t start = lrint (src_time - frames * ratio);
+    int drop = aud::max ((int64_t) 0, src_pos - start);
+    int gen = d.output_frames_gen;
+
+    if (gen > drop)
+    {
+        pending_frames = gen - drop;
+        memmove (buffer, buffer + channels * drop, sizeof (float) * channels * pending_frames);
+        skip_frames = 0;
+    }
+    else
+        skip_frames = drop - gen;
+
+    src_delete (state);
+    state = next;
+    return true;
+}
+
+static void change_method (int method)
+{
+    AUDINFO ("Switching to %s (%.1f%% CPU load).\n", src_get_name (method),
+     load.load () * 100);
+
+    /* the new filter or converter is allocated here */
+    stats.count_alloc (true);
+
+    if (polyphase.ready ())
+    {
+        if (! polyphase.set_taps (polyphase_taps (method)))
+        {
+            AUDWARN ("Polyphase filter too long; keeping the old one.\n");
+            return;
+        }
+    }
+    else if (! state || ! switch_src (method))
+        return;
+
+    stats.set_note (src_get_name (method));
+}
+
+static void resample_polyphase (float * * data, int * samples, bool finish)
+{
+    int frames = * samples / stored_channels;
+    enlarge_buffer (stored_channels * polyphase.max_output (frames));
+
+    frames = polyphase.process (* data, frames, buffer, finish);
+
+    * data = buffer;
+    * samples = stored_channels * frames;
+}
+
+static void resample_src (float * * data, int * samples, bool finish)
+{
+    int channels = stored_channels;
+
+    enlarge_buffer (channels * pending_frames + (int) (* samples * ratio) + 256);
+
+    SRC_DATA d = {0};
+
+    d.data_in = * data;
+    d.input_frames = * samples / channels;
+    d.data_out = buffer + channels * pending_frames;
+    d.output_frames = buffer_samples / channels - pending_frames;
+    d.src_ratio = adaptive ? drift.update (ratio, d.input_frames * ratio, stored_rate) : ratio;
     d.end_of_input = finish;
 
     int error;
@@ -169,17 +376,78 @@ void do_resample (float * * data, int * samples, bool finish)
         return;
     }
 
+    int gen = d.output_frames_gen;
+
+    if (auto_method)
+    {
+        history.add (d.data_in, d.input_frames_used);
+        src_time += d.input_frames_used * d.src_ratio;
+
+        int skip = aud::min (skip_frames, gen);
+        if (skip)
+        {
+            memmove (d.data_out, d.data_out + channels * skip,
+             sizeof (float) * channels * (gen - skip));
+            skip_frames -= skip;
+            gen -= skip;
+        }
+
+        src_pos += pending_frames + gen;
+    }
+
     * data = buffer;
-    * samples = stored_channels * d.output_frames_gen;
+    * samples = channels * (pending_frames + gen);
+    pending_frames = 0;
+}
+
+void do_resample (float * * data, int * samples, bool finish)
+{
+    if (! polyphase.ready () && (! state || ! * samples))
+        return;
+
+    int frames = * samples / stored_channels;
+
+    if (auto_method)
+    {
+        /* switch only now, since the output of the last block was returned
+         * in the buffer */
+        if (load.level () != auto_level)
+        {
+            auto_level = load.level ();
+            change_method (auto_methods[auto_level]);
+        }
+
+        load.begin ();
+    }
+
+    if (polyphase.ready ())
+        resample_polyphase (data, samples, finish);
+    else
+        resample_src (data, samples, finish);
+
+    if (auto_method)
+        load.end (frames, input_rate);
 }
 
 void Resampler::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
     do_resample (data, samples, false);
 }
 
 void Resampler::flush ()
 {
+    if (polyphase.ready ())
+        polyphase.reset ();
+
+    drift.reset ();
+    load.reset ();
+
+    src_time = src_pos = 0;
+    pending_frames = skip_frames = 0;
+    history.reset ();
+
     int error;
     if (state && (error = src_reset (state)))
         RESAMPLE_ERROR (error);
@@ -187,15 +455,29 @@ void Resampler::flush ()
 
 void Resampler::finish (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
     do_resample (data, samples, true);
     flush ();
 }
 
+int Resampler::adjust_delay (int delay)
+{
+    /* the delay after us is what the adaptive mode tries to hold steady */
+    if (adaptive)
+        drift.report_delay (delay);
+
+    /* the filters are centered on the input, so there is no delay to add */
+    stats.set_delay (0);
+    return delay;
+}
+
 const char Resampler::about[] =
  N_("Sample Rate Converter Plugin for Audacious\n"
     "Copyright 2010-2012 John Lindgren");
 
 static const ComboItem method_list[] = {
+    ComboItem(N_("Automatic (best the CPU can sustain)"), METHOD_AUTO),
     ComboItem(N_("Skip/repeat samples"), SRC_ZERO_ORDER_HOLD),
     ComboItem(N_("Linear interpolation"), SRC_LINEAR),
     ComboItem(N_("Fast sinc interpolation"), SRC_SINC_FASTEST),
@@ -208,6 +490,10 @@ const PreferencesWidget Resampler::widgets[] = {
     WidgetCombo (N_("Method:"),
         WidgetInt ("resample", "method"),
         {{method_list}}),
+    WidgetCheck (N_("Use built-in filter for simple ratios"),
+        WidgetBool ("resample", "polyphase")),
+    WidgetCheck (N_("Compensate for output clock drift"),
+        WidgetBool ("resample", "adaptive")),
     WidgetSpin (N_("Rate:"),
         WidgetInt ("resample", "default-rate"),
         {MIN_RATE, MAX_RATE, RATE_STEP, N_("Hz")}),
@@ -20,7 +20,9 @@
  * the use of this software.
  */
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <soxr.h>
 
 #include <libaudcore/i18n.h>
@@ -28,10 +30,21 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../libdsp/dsp.h"
+#include "../libdsp/drift.h"
+#include "../libdsp/load.h"
+#include "../libdsp/stats.h"
+
 #define MIN_RATE 8000
 #define MAX_RATE 192000
 #define RATE_STEP 50
 
+/* not a soxr recipe: choose one according to the CPU load */
+#define QUALITY_AUTO -1
+
+/* input kept for starting a new resampler where the old one left off */
+#define HISTORY_FRAMES 4096
+
 const char default_quality[] = {'0' + SOXR_HQ, 0};
 
 class SoXResampler : public EffectPlugin
@@ -58,6 +71,7 @@ public:
     void start (int * channels, int * rate);
     void process (float * * data, int * samples);
     void flush ();
+    int adjust_delay (int delay);
 };
 
 EXPORT SoXResampler aud_plugin_instance;
@@ -65,25 +79,107 @@ EXPORT SoXResampler aud_plugin_instance;
 const char * const SoXResampler::defaults[] = {
  "quality", default_quality,
  "rate", "44100",
+ "adaptive", "FALSE",
  nullptr};
 
+/* recipes used in automatic mode, cheapest first */
+static const int auto_qualities[] = {SOXR_MQ, SOXR_HQ, SOXR_VHQ};
+
 static soxr_t soxr;
 static soxr_error_t error;
-static int stored_channels;
+static int stored_channels, stored_rate, input_rate;
 static double ratio;
 static Index<float> buffer;
+static DriftControl drift;
+static LoadControl load;
+static EffectStats stats (N_("SoX Resampler"));
+static bool adaptive, auto_quality;
+static int auto_level;
+
+/* for switching resamplers in automatic mode */
+static InputHistory history;
+static double soxr_time;      /* output position of the end of the input so far */
+static int64_t soxr_pos;      /* output position of the next frame returned */
+static int skip_frames;       /* output of the new resampler not to be returned */
 
 bool SoXResampler::init ()
 {
     aud_config_set_defaults ("soxr", defaults);
+    stats.attach ();
     return true;
 }
 
 void SoXResampler::cleanup ()
 {
+    stats.detach ();
+
     soxr_delete (soxr);
     soxr = 0;
     buffer.clear ();
+    history.destroy ();
+}
+
+static void enlarge_buffer (int samples)
+{
+    if (buffer.len () < samples)
+    {
+        buffer.enlarge (samples);
+        stats.count_alloc ();
+    }
+}
+
+static soxr_t create_soxr (int quality, int channels)
+{
+    soxr_t s;
+
+    if (adaptive)
+    {
+        /* In variable-rate mode, soxr takes the largest input/output ratio that
+         * will be used in place of the rates.  DriftControl never lowers the
+         * output/input ratio by more than DRIFT_MAX_CORRECTION. */
+        double io_ratio = 1 / ratio;
+        soxr_quality_spec_t q = soxr_quality_spec (quality, SOXR_VR);
+
+        s = soxr_create (io_ratio / (1 - DRIFT_MAX_CORRECTION), 1, channels,
+         & error, nullptr, & q, nullptr);
+
+        if (! error)
+            soxr_set_io_ratio (s, io_ratio, 0);
+    }
+    else
+    {
+        soxr_quality_spec_t q = soxr_quality_spec (quality, 0);
+
+        s = soxr_create (input_rate, stored_rate, channels, & error, nullptr, & q, nullptr);
+    }
+
+    if (error)
+    {
+        AUDERR (error);
+        soxr_delete (s);
+        return 0;
+    }
+
+    return s;
+}
+
+static const char * quality_name (int quality)
+{
+    switch (quality)
+    {
+    case SOXR_QQ:
+        return "quick";
+    case SOXR_LQ:
+        return "low";
+    case SOXR_MQ:
+        return "medium";
+    case SOXR_HQ:
+        return "high";
+    case SOXR_VHQ:
+        return "very high";
+    default:
+        return nullptr;
+    }
 }
 
 void SoXResampler::start (int * channels, int * rate)
@@ -91,37 +187,145 @@ void SoXResampler::start (int * channels, int * rate)
     soxr_delete (soxr);
     soxr = 0;
 
+    drift.reset ();
+    history.destroy ();
+    stats.set_note (nullptr);
+
     int new_rate = aud_get_int ("soxr", "rate");
     new_rate = aud::clamp (new_rate, MIN_RATE, MAX_RATE);
 
-    if (new_rate == * rate)
-        return;
+    /* In adaptive mode, we resample even if the rates match, since the clocks
+     * behind them may not. */
+    adaptive = aud_get_bool ("soxr", "adaptive");
 
-    soxr_quality_spec_t q = soxr_quality_spec(aud_get_int ("soxr", "quality"), 0);
+    if (new_rate == * rate && ! adaptive)
+        return;
 
-    soxr = soxr_create((double) * rate, (double) new_rate, * channels, & error, nullptr, & q, nullptr);
+    int quality = aud_get_int ("soxr", "quality");
 
-    if (error)
+    /* start cheap and work up, rather than risk an underrun */
+    auto_quality = (quality == QUALITY_AUTO);
+    if (auto_quality)
     {
-        AUDERR (error);
-        return;
+        auto_level = 0;
+        load.init (aud::n_elems (auto_qualities), auto_level);
+        quality = auto_qualities[auto_level];
+        history.init (* channels, HISTORY_FRAMES);
     }
 
     stored_channels = * channels;
+    stored_rate = new_rate;
+    input_rate = * rate;
     ratio = (double) new_rate / * rate;
+
+    if (! (soxr = create_soxr (quality, * channels)))
+        return;
+
     * rate = new_rate;
+    stats.set_note (quality_name (quality));
+
+    /* in automatic mode, the output of a new resampler primed with the history
+     * may be waiting in the buffer */
+    enlarge_buffer (stored_channels * ((int) ((DSP_BLOCK_FRAMES +
+     (auto_quality ? HISTORY_FRAMES : 0)) * ratio) + 512));
+
+    soxr_time = soxr_pos = skip_frames = 0;
+    history.reset ();
+}
+
+/* Replaces the resampler, feeding the new one the recent input so that its
+ * filter is primed.  soxr compensates for the delay of its filter, so the new
+ * resampler produces output for the history from the start of the history on;
+ * whatever the old one has already returned is skipped.  The output of the new
+ * one that is still due is left at the start of the buffer, and the number of
+ * frames is returned. */
+static int switch_soxr (int quality)
+{
+    AUDINFO ("Switching to %s quality (%.1f%% CPU load).\n",
+     quality_name (quality), load.load () * 100);
+
+    int channels = stored_channels;
+    soxr_t next = create_soxr (quality, channels);
+    if (! next)
+        return 0;
+
+    stats.count_alloc (true);
+
+    int frames = history.frames_to_prime (soxr_time, ratio);
+    enlarge_buffer (channels * ((int) (frames * ratio) + 256));
+
+    size_t gen = 0;
+    if ((error = soxr_process (next, history.last (frames),
+     frames, nullptr, buffer.begin (), buffer.len () / channels, & gen)))
+    {
+        AUDERR (error);
+        soxr_delete (next);
+        return 0;
+    }
+
+    /* output of the new resampler up to where the old one stopped */
+    int64_t start = lrint (soxr_time - frames * ratio);
+    int drop = aud::max ((int64_t) 0, soxr_pos - start);
+    int pending = 0;
+
+    if ((int) gen > drop)
+    {
+        pending = gen - drop;
+        memmove (buffer.begin (), & buffer[channels * drop], sizeof (float) * channels * pending);
+        skip_frames = 0;
+    }
+    else
+        skip_frames = drop - gen;
+
+    soxr_delete (soxr);
+    soxr = next;
+    stats.set_note (quality_name (quality));
+
+    return pending;
 }
 
 void SoXResampler::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
     if (! soxr)
          return;
 
-    buffer.enlarge ((int) (* samples * ratio) + 256);
+    int frames = * samples / stored_channels;
+    int pending = 0;
+
+    if (auto_quality)
+    {
+        /* switch only now, since the output of the last block was returned in
+         * the buffer */
+        if (load.level () != auto_level)
+        {
+            auto_level = load.level ();
+            pending = switch_soxr (auto_qualities[auto_level]);
+        }
+
+        load.begin ();
+    }
+
+    enlarge_buffer (stored_channels * pending + (int) (* samples * ratio) + 256);
+
+    double new_ratio = ratio;
+
+    if (adaptive)
+    {
+        new_ratio = drift.update (ratio, frames * ratio, stored_rate);
+
+        /* slew to the new ratio over the length of this block, which soxr
+         * counts in output frames */
+        soxr_set_io_ratio (soxr, 1 / new_ratio, lrint (frames * new_ratio));
+    }
+
+    float * out = & buffer[stored_channels * pending];
 
     size_t samples_done;
-    error = soxr_process (soxr, * data, * samples / stored_channels, nullptr,
-     buffer.begin (), buffer.len () / stored_channels, & samples_done);
+    error = soxr_process (soxr, * data, frames, nullptr, out,
+     buffer.len () / stored_channels - pending, & samples_done);
 
     if (error)
     {
@@ -129,14 +333,50 @@ void SoXResampler::process (float * * data, int * samples)
         return;
     }
 
+    int gen = samples_done;
+
+    if (auto_quality)
+    {
+        history.add (* data, frames);
+        soxr_time += frames * new_ratio;
+
+        int skip = aud::min (skip_frames, gen);
+        if (skip)
+        {
+            memmove (out, out + stored_channels * skip, sizeof (float) * stored_channels * (gen - skip));
+            skip_frames -= skip;
+            gen -= skip;
+        }
+
+        soxr_pos += pending + gen;
+        load.end (frames, input_rate);
+    }
+
     * data = buffer.begin ();
-    * samples = samples_done * stored_channels;
+    * samples = (pending + gen) * stored_channels;
 }
 
 void SoXResampler::flush ()
 {
     if (soxr && (error = soxr_process(soxr, nullptr, 0, nullptr, nullptr, 0, nullptr)))
         AUDERR (error);
+
+    drift.reset ();
+    load.reset ();
+
+    soxr_time = soxr_pos = skip_frames = 0;
+    history.reset ();
+}
+
+int SoXResampler::adjust_delay (int delay)
+{
+    /* the delay after us is what the adaptive mode tries to hold steady */
+    if (adaptive)
+        drift.report_delay (delay);
+
+    /* soxr compensates for the delay of its filter */
+    stats.set_delay (0);
+    return delay;
 }
 
 const char SoXResampler::about[] =
@@ -146,6 +386,7 @@ const char SoXResampler::about[] =
     "Copyright 2010-2012 John Lindgren");
 
 static const ComboItem method_list[] = {
+    ComboItem (N_("Automatic (best the CPU can sustain)"), QUALITY_AUTO),
     ComboItem (N_("Quick"), SOXR_QQ),
     ComboItem (N_("Low"), SOXR_LQ),
     ComboItem (N_("Medium"), SOXR_MQ),
@@ -159,7 +400,9 @@ const PreferencesWidget SoXResampler::widgets[] = {
         {{method_list}}),
     WidgetSpin (N_("Rate:"),
         WidgetInt ("soxr", "rate"),
-        {MIN_RATE, MAX_RATE, RATE_STEP, N_("Hz")})
+        {MIN_RATE, MAX_RATE, RATE_STEP, N_("Hz")}),
+    WidgetCheck (N_("Compensate for output clock drift"),
+        WidgetBool ("soxr", "adaptive"))
 };
 
 const PluginPreferences SoXResampler::prefs = {{SoXResampler::widgets}};
@@ -18,10 +18,6 @@
  */
 
 #include <math.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include <glib.h>
 
 #include <samplerate.h>
 
@@ -30,17 +26,15 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
-/* The general idea of the speed change algorithm is to divide the input signal
- * into pieces, spaced at a time interval A, using a cosine-shaped window
- * function.  The pieces are then reassembled by adding them together again,
- * spaced at another time interval B.  By varying the ratio A:B, we change the
- * speed of the audio.  To get better results at the two ends of a song, we add
- * a short period of silence (half the width of the cosine window, to be exact)
- * to each end of the input signal beforehand and afterwards trim the same
- * amount from each end of the output signal. */
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+#include "stretch.h"
 
-#define FREQ    10
-#define OVERLAP  3
+/* The pitch is changed by resampling the input (which also changes its
+ * speed), and the speed is then corrected by time-stretching (see stretch.h).
+ * To get better results at the two ends of a song, the time-stretcher adds a
+ * short period of silence to the beginning of the input and trims it from the
+ * output again. */
 
 #define CFGSECT "speed-pitch"
 #define MINSPEED 0.5
@@ -48,9 +42,6 @@
 #define MINPITCH 0.5
 #define MAXPITCH 2.0
 
-#define BYTES(frames) ((frames) * curchans * sizeof (float))
-#define OFFSET(buf,frames) ((buf) + (frames) * curchans)
-
 class SpeedPitch : public EffectPlugin
 {
 public:
@@ -79,70 +70,59 @@ public:
 
 EXPORT SpeedPitch aud_plugin_instance;
 
-typedef struct {
-    float * mem;
-    int size, len;
-} Buffer;
-
 static int curchans, currate;
 static SRC_STATE * srcstate;
-static int outstep, width;
-static double * cosine;
-static Buffer in, out;
-static int trim, written;
+static bool resampling;
+static TimeStretch stretch;
+static Index<float> pitched, out;
 static bool ending;
+static int out_size;  /* largest output since the buffer was freed */
 
-static void bufgrow (Buffer * b, int len)
+static EffectStats stats (N_("Speed and Pitch"));
+
+/* Scales the input to adjust pitch; skipped when the pitch is unchanged. */
+static const float * change_pitch (const float * data, int * frames, double pitch)
 {
-    if (len > b->size)
+    if (pitch == 1)
     {
-        b->mem = (float *) g_realloc (b->mem, BYTES (len));
-        b->size = len;
+        resampling = false;
+        return data;
     }
 
-    if (len > b->len)
+    if (! resampling)
     {
-        memset (OFFSET (b->mem, b->len), 0, BYTES (len - b->len));
-        b->len = len;
+        src_reset (srcstate);
+        resampling = true;
     }
-}
 
-static void bufcut (Buffer * b, int len)
-{
-    memmove (b->mem, OFFSET (b->mem, len), BYTES (b->len - len));
-    b->len -= len;
-}
+    int max = * frames / pitch + 256;
 
-static void bufadd (Buffer * b, float * data, int len, double ratio)
-{
-    int oldlen = b->len;
-    int max = len * ratio + 100;
-    bufgrow (b, oldlen + max);
+    if (pitched.len () < curchans * max)
+    {
+        pitched.insert (-1, curchans * max - pitched.len ());
+        stats.count_alloc ();
+    }
 
-    SRC_DATA d;
+    SRC_DATA d = SRC_DATA ();
 
     d.data_in = data;
-    d.input_frames = len;
-    d.data_out = OFFSET (b->mem, oldlen);
+    d.input_frames = * frames;
+    d.data_out = pitched.begin ();
     d.output_frames = max;
-    d.src_ratio = ratio;
+    d.src_ratio = 1.0 / pitch;
 
     src_process (srcstate, & d);
-    b->len = oldlen + d.output_frames_gen;
+
+    * frames = d.output_frames_gen;
+    return pitched.begin ();
 }
 
 void SpeedPitch::flush ()
 {
     src_reset (srcstate);
+    stretch.reset ();
 
-    in.len = 0;
-    out.len = 0;
-
-    /* Add silence to the beginning of the input signal. */
-    bufgrow (& in, width / 2);
-
-    trim = width / 2;
-    written = 0;
+    out.remove (0, -1);
     ending = false;
 }
 
@@ -154,79 +134,52 @@ void SpeedPitch::start (int * chans, int * rate)
     if (srcstate)
         src_delete (srcstate);
 
-    srcstate = src_new (SRC_LINEAR, curchans, nullptr);
+    srcstate = src_new (SRC_SINC_FASTEST, curchans, nullptr);
+    resampling = false;
+
+    auto mode = (TimeStretch::Mode) aud_get_int (CFGSECT, "mode");
+    stretch.init (mode, curchans, currate);
 
-    /* Calculate the width of the cosine window and the spacing interval for
-     * output. */
-    outstep = currate / FREQ;
-    width = outstep * OVERLAP;
+    /* The resampler may stretch a block by 1 / MINPITCH, and the output may be
+     * 1 / MINSPEED times as long as the input, plus what is held back in the
+     * time-stretcher (much less than a second). */
+    int max_pitched = curchans * (int) (DSP_BLOCK_FRAMES / MINPITCH + 256);
+    int max_out = curchans * (int) (DSP_BLOCK_FRAMES / MINSPEED + currate);
 
-    /* Generate the cosine window, scaled vertically to compensate for the
-     * overlap of the reassembled pieces of audio. */
-    cosine = g_renew (double, cosine, width);
-    for (int i = 0; i < width; i ++)
-        cosine[i] = (1.0 - cos (2.0 * M_PI * i / width)) / OVERLAP;
+    if (pitched.len () < max_pitched)
+        pitched.insert (-1, max_pitched - pitched.len ());
+
+    if (out_size < max_out)
+    {
+        out.insert (0, max_out);
+        out_size = max_out;
+    }
 
     flush ();
 }
 
 void SpeedPitch::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
     double pitch = aud_get_double (CFGSECT, "pitch");
     double speed = aud_get_double (CFGSECT, "speed");
 
-    /* Remove audio that has already been played from the output buffer. */
-    bufcut (& out, written);
+    int frames = * samples / curchans;
+    const float * in = change_pitch (* data, & frames, pitch);
 
-    /* Copy the passed audio to the input buffer, scaled to adjust pitch. */
-    bufadd (& in, * data, * samples / curchans, 1.0 / pitch);
+    out.remove (0, -1);
+    stretch.process (in, frames, speed / pitch, out, ending);
 
-    /* If we are ending, add silence to the end of the input signal. */
-    if (ending)
-        bufgrow (& in, in.len + width / 2);
-
-    /* Calculate the spacing interval for input. */
-    int instep = round (outstep * speed / pitch);
-
-    /* Run the speed change algorithm. */
-    int src = 0;
-    int dst = 0;
-
-    while (src + aud::max (width, instep) <= in.len)
-    {
-        bufgrow (& out, dst + width);
-        out.len = dst + width;
-
-        for (int i = 0; i < width; i ++)
-        for (int c = 0; c < curchans; c ++)
-            OFFSET (out.mem, dst + i)[c] += OFFSET (in.mem, src + i)[c] * cosine[i];
-
-        src += instep;
-        dst += outstep;
-    }
-
-    /* Remove processed audio from the input buffer. */
-    bufcut (& in, src);
-
-    /* Trim silence from the beginning of the output buffer. */
-    if (trim > 0)
+    if (out.len () > out_size)
     {
-        int cut = aud::min (trim, dst);
-        bufcut (& out, cut);
-        dst -= cut;
-        trim -= cut;
+        out_size = out.len ();
+        stats.count_alloc ();
     }
 
-    /* If we are ending, return all of the output buffer except the silence that
-     * we trim from the end of it. */
-    if (ending)
-        dst = out.len - width / 2;
-
-    /* Return processed audio in the output buffer and mark it to be removed on
-     * the next call. */
-    * data = out.mem;
-    * samples = dst * curchans;
-    written = dst;
+    * data = out.begin ();
+    * samples = out.len ();
 }
 
 void SpeedPitch::finish (float * * data, int * samples)
@@ -240,18 +193,31 @@ void SpeedPitch::finish (float * * data, int * samples)
     }
 }
 
+/* The delay is converted to input time: audio that has been played out went
+ * through at <speed>, while audio still in the time-stretcher is measured in
+ * resampled frames, each worth <pitch> input frames. */
 int SpeedPitch::adjust_delay (int delay)
 {
-    /* Not sample-accurate, but should be a decent estimate. */
+    double pitch = aud_get_double (CFGSECT, "pitch");
     double speed = aud_get_double (CFGSECT, "speed");
-    return delay * speed + width * 1000 / currate;
+
+    int adjusted = delay * speed + stretch.latency (speed / pitch) * pitch * 1000 / currate;
+
+    stats.set_delay (adjusted - delay);
+    return adjusted;
 }
 
 const char * const SpeedPitch::defaults[] = {
  "speed", "1",
  "pitch", "1",
+ "mode", "0",  /* TimeStretch::WSOLA */
  nullptr};
 
+static const ComboItem mode_list[] = {
+    ComboItem (N_("Waveform matching (best for speech)"), TimeStretch::WSOLA),
+    ComboItem (N_("Phase vocoder (best for music)"), TimeStretch::PhaseVocoder)
+};
+
 const PreferencesWidget SpeedPitch::widgets[] = {
     WidgetLabel (N_("<b>Speed and Pitch</b>")),
     WidgetSpin (N_("Speed:"),
@@ -259,7 +225,11 @@ const PreferencesWidget SpeedPitch::widgets[] = {
         {MINSPEED, MAXSPEED, 0.05}),
     WidgetSpin (N_("Pitch:"),
         WidgetFloat (CFGSECT, "pitch"),
-        {MINPITCH, MAXPITCH, 0.05})
+        {MINPITCH, MAXPITCH, 0.05}),
+    WidgetCombo (N_("Method:"),
+        WidgetInt (CFGSECT, "mode"),
+        {{mode_list}}),
+    WidgetLabel (N_("<small>The method takes effect at the next song.</small>"))
 };
 
 const PluginPreferences SpeedPitch::prefs = {{SpeedPitch::widgets}};
@@ -267,24 +237,21 @@ const PluginPreferences SpeedPitch::prefs = {{SpeedPitch::widgets}};
 bool SpeedPitch::init ()
 {
     aud_config_set_defaults (CFGSECT, defaults);
+    stats.attach ();
     return true;
 }
 
 void SpeedPitch::cleanup ()
 {
+    stats.detach ();
+
     if (srcstate)
         src_delete (srcstate);
 
     srcstate = nullptr;
 
-    g_free (cosine);
-    cosine = nullptr;
-
-    g_free (in.mem);
-    in.mem = nullptr;
-    in.size = 0;
-
-    g_free (out.mem);
-    out.mem = nullptr;
-    out.size = 0;
+    stretch.destroy ();
+    pitched.clear ();
+    out.clear ();
+    out_size = 0;
 }
@@ -0,0 +1,486 @@
+/*
+ * Speed and Pitch effect plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "stretch.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/audio.h>
+
+#include "../libdsp/dsp.h"
+
+/* WSOLA frames are 40 ms long (20 ms hop), long enough to hold two periods of
+ * a low voice; the alignment search covers +/- 10 ms. */
+#define WSOLA_HOP_MS 20
+#define WSOLA_SEARCH_MS 10
+
+/* The coarse alignment search is done on a decimated signal. */
+#define DECIMATE 4
+
+/* The phase vocoder uses frames of about 45 ms with 75% overlap. */
+#define VOCODER_FRAME_MS 45
+#define VOCODER_OVERLAP 4
+
+static float wrap_phase (float phase)
+{
+    return phase - (float) (2 * M_PI) * roundf (phase * (float) (0.5 / M_PI));
+}
+
+void TimeStretch::init (Mode mode, int channels, int rate)
+{
+    destroy ();
+
+    m_mode = mode;
+    m_channels = channels;
+    m_rate = rate;
+
+    if (mode == WSOLA)
+    {
+        m_hop = rate * WSOLA_HOP_MS / 1000;
+        m_size = 2 * m_hop;
+        m_search = rate * WSOLA_SEARCH_MS / 1000;
+    }
+    else
+    {
+        /* largest power of two that fits */
+        m_size = 8;
+        while (m_size * 2 <= rate * VOCODER_FRAME_MS / 1000)
+            m_size *= 2;
+
+        m_hop = m_size / VOCODER_OVERLAP;
+        m_search = 0;
+    }
+
+    /* Periodic Hann window.  For WSOLA, the window sums to one at 50% overlap.
+     * For the phase vocoder, it is applied both before and after the FFT, and
+     * its square sums to 3/8 * VOCODER_OVERLAP. */
+    m_window.insert (0, m_size);
+    m_synth_window.insert (0, m_size);
+
+    float synth_gain = (mode == WSOLA) ? 1 : 8.0f / (3 * VOCODER_OVERLAP);
+
+    for (int i = 0; i < m_size; i ++)
+    {
+        m_window[i] = 0.5 - 0.5 * cos (2 * M_PI * i / m_size);
+        m_synth_window[i] = m_window[i] * synth_gain;
+    }
+
+    m_accum.insert (0, channels * m_size);
+    m_frame.insert (0, channels * m_size);
+    m_scratch.insert (0, channels * (m_size + 2 * m_search));
+
+    if (mode == WSOLA)
+        m_mono.insert (0, 2 * (m_hop + 2 * m_search + m_hop));
+    else
+    {
+        int bins = m_size / 2 + 1;
+
+        m_fft.init (m_size);
+        m_re.insert (0, bins);
+        m_im.insert (0, bins);
+        m_mag.insert (0, bins);
+        m_phase.insert (0, bins);
+        m_last_phase.insert (0, channels * bins);
+        m_synth_phase.insert (0, channels * bins);
+        m_peaks.insert (0, bins);
+    }
+
+    m_input.alloc (channels * (m_size + 2 * m_search) * 4);
+
+    reset ();
+}
+
+void TimeStretch::destroy ()
+{
+    m_input.destroy ();
+    m_window.clear ();
+    m_synth_window.clear ();
+    m_accum.clear ();
+    m_frame.clear ();
+    m_scratch.clear ();
+    m_mono.clear ();
+
+    m_fft.destroy ();
+    m_re.clear ();
+    m_im.clear ();
+    m_mag.clear ();
+    m_phase.clear ();
+    m_last_phase.clear ();
+    m_synth_phase.clear ();
+    m_peaks.clear ();
+
+    m_channels = m_rate = 0;
+    m_size = m_hop = m_search = 0;
+}
+
+void TimeStretch::reset ()
+{
+    static const float silence[AUD_MAX_CHANNELS * 64] = {};
+
+    m_input.discard ();
+
+    /* Add silence so that the first input sample is covered by as many frames
+     * as any other (and the alignment search has room to look backward).  The
+     * corresponding output is trimmed again. */
+    int pad = m_size - m_hop + m_search;
+
+    while (pad > 0)
+    {
+        int chunk = aud::min (pad, 64);
+        m_input.copy_in (silence, m_channels * chunk);
+        pad -= chunk;
+    }
+
+    m_next = m_search;
+    m_have_prev = false;
+    m_trim = m_size - m_hop;
+    m_pending = 0;
+
+    memset (& m_accum[0], 0, sizeof (float) * m_accum.len ());
+    m_accum_pos = 0;
+}
+
+/* Copies frames out of the input ring buffer, which holds at most two
+ * contiguous runs: up to linear () and from there to the end. */
+void TimeStretch::read_input (int pos, int frames, float * const * planes)
+{
+    float * buf = & m_scratch[0];
+    int start = pos * m_channels;
+    int len = frames * m_channels;
+    int linear = m_input.linear ();
+
+    if (start < linear)
+    {
+        int part = aud::min (len, linear - start);
+        memcpy (buf, & m_input[start], sizeof (float) * part);
+        buf += part;
+        start += part;
+        len -= part;
+    }
+
+    if (len > 0)
+        memcpy (buf, & m_input[start], sizeof (float) * len);
+
+    dsp_deinterleave (& m_scratch[0], planes, m_channels, frames);
+}
+
+void TimeStretch::read_mono (int pos, int frames, float * mono)
+{
+    float * planes[AUD_MAX_CHANNELS];
+    for (int c = 0; c < m_channels; c ++)
+        planes[c] = & m_frame[c * m_size];
+
+    /* in pieces, since m_frame holds only m_size frames per channel */
+    while (frames > 0)
+    {
+        int chunk = aud::min (frames, m_size);
+        read_input (pos, chunk, planes);
+
+        memcpy (mono, planes[0], sizeof (float) * chunk);
+        for (int c = 1; c < m_channels; c ++)
+            dsp_mix (mono, planes[c], chunk);
+
+        pos += chunk;
+        mono += chunk;
+        frames -= chunk;
+    }
+}
+
+static float similarity (const float * target, const float * cand, int len)
+{
+    float energy = dsp_dot (cand, cand, len);
+    return dsp_dot (target, cand, len) / sqrtf (energy + 1e-9f);
+}
+
+/* Returns the offset between <first> and <last> at which <candidates> best
+ * matches <target>, or <prefer> if nothing matches better. */
+static int best_offset (const float * target, const float * candidates, int len,
+ int first, int last, int prefer)
+{
+    int best = prefer;
+    float best_score = similarity (target, candidates + prefer, len);
+
+    for (int i = first; i <= last; i ++)
+    {
+        float score = similarity (target, candidates + i, len);
+
+        if (score > best_score)
+        {
+            best = i;
+            best_score = score;
+        }
+    }
+
+    return best;
+}
+
+/* Finds the frame start within +/- m_search of <base> whose first half best
+ * matches the waveform at m_prev (normalized cross-correlation).  The search
+ * is first done coarsely on a decimated signal, then refined. */
+int TimeStretch::find_alignment (int base)
+{
+    if (! m_have_prev)
+        return base;
+
+    int len = m_hop;
+    int range = 2 * m_search;
+
+    float * target = & m_mono[0];
+    float * cand = target + len;
+    read_mono (m_prev, len, target);
+    read_mono (base - m_search, range + len, cand);
+
+    int dlen = len / DECIMATE;
+    int drange = range / DECIMATE;
+    float * dtarget = cand + range + len;
+    float * dcand = dtarget + dlen;
+
+    for (int i = 0; i < dlen; i ++)
+        dtarget[i] = target[DECIMATE * i] + target[DECIMATE * i + 1] +
+         target[DECIMATE * i + 2] + target[DECIMATE * i + 3];
+    for (int i = 0; i < drange + dlen; i ++)
+        dcand[i] = cand[DECIMATE * i] + cand[DECIMATE * i + 1] +
+         cand[DECIMATE * i + 2] + cand[DECIMATE * i + 3];
+
+    /* unless something else is clearly better, stay with the natural position
+     * (this makes a ratio of 1 transparent) */
+    int coarse = DECIMATE * best_offset (dtarget, dcand, dlen, 0, drange, drange / 2);
+    int fine = best_offset (target, cand, len, aud::max (coarse - DECIMATE + 1, 0),
+     aud::min (coarse + DECIMATE - 1, range), m_search);
+
+    return base - m_search + fine;
+}
+
+void TimeStretch::run_vocoder (float * const * planes, int hop)
+{
+    int bins = m_size / 2 + 1;
+    float * re = & m_re[0], * im = & m_im[0];
+    float * mag = & m_mag[0], * phase = & m_phase[0];
+    int * peaks = & m_peaks[0];
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        float * last = & m_last_phase[c * bins];
+        float * synth = & m_synth_phase[c * bins];
+
+        dsp_multiply (planes[c], & m_window[0], m_size);
+        m_fft.real_forward (planes[c], re, im);
+
+        for (int k = 0; k < bins; k ++)
+        {
+            mag[k] = sqrtf (re[k] * re[k] + im[k] * im[k]);
+            phase[k] = atan2f (im[k], re[k]);
+        }
+
+        if (! m_have_prev)
+            memcpy (synth, phase, sizeof (float) * bins);
+        else
+        {
+            int n_peaks = 0;
+
+            for (int k = 1; k < bins - 1; k ++)
+            {
+                if (mag[k] > mag[k - 1] && mag[k] >= mag[k + 1])
+                    peaks[n_peaks ++] = k;
+            }
+
+            /* Advance each peak by its measured frequency, then give the bins
+             * around it (up to halfway to the next peak) the same phase
+             * relationship to it as in the analysis frame.  Without peaks
+             * (silence), every bin is advanced on its own. */
+            int lo = 0;
+
+            for (int p = 0; p < (n_peaks ? n_peaks : bins); p ++)
+            {
+                int k = n_peaks ? peaks[p] : p;
+                int hi = n_peaks ? ((p + 1 < n_peaks) ? (k + peaks[p + 1]) / 2 : bins - 1) : k;
+
+                float omega = (float) (2 * M_PI) * k / m_size;
+                float delta = wrap_phase (phase[k] - last[k] - omega * hop);
+                float peak = wrap_phase (synth[k] + (omega + delta / hop) * m_hop);
+
+                for (int j = lo; j <= hi; j ++)
+                    synth[j] = wrap_phase (peak + phase[j] - phase[k]);
+
+                lo = hi + 1;
+            }
+        }
+
+        memcpy (last, phase, sizeof (float) * bins);
+
+        for (int k = 0; k < bins; k ++)
+        {
+            re[k] = mag[k] * cosf (synth[k]);
+            im[k] = mag[k] * sinf (synth[k]);
+        }
+
+        m_fft.real_inverse (re, im, planes[c]);
+    }
+}
+
+void TimeStretch::add_frame (const float * const * planes, const float * window)
+{
+    int part = m_size - m_accum_pos;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        float * accum = & m_accum[c * m_size];
+
+        dsp_mul_add (accum + m_accum_pos, planes[c], window, part);
+        dsp_mul_add (accum, planes[c] + part, window + part, m_size - part);
+    }
+}
+
+/* Moves the first <frames> (at most m_size - m_accum_pos) completed frames out
+ * of the overlap-add accumulator. */
+void TimeStretch::emit (Index<float> & out, int frames)
+{
+    const float * planes[AUD_MAX_CHANNELS];
+    for (int c = 0; c < m_channels; c ++)
+        planes[c] = & m_accum[c * m_size + m_accum_pos];
+
+    int skip = aud::min (m_trim, frames);
+    m_trim -= skip;
+
+    if (frames > skip)
+    {
+        for (int c = 0; c < m_channels; c ++)
+            planes[c] += skip;
+
+        int at = out.len ();
+        out.insert (-1, m_channels * (frames - skip));
+        dsp_interleave (planes, & out[at], m_channels, frames - skip);
+        m_pending -= frames - skip;
+    }
+
+    for (int c = 0; c < m_channels; c ++)
+        memset (& m_accum[c * m_size + m_accum_pos], 0, sizeof (float) * frames);
+
+    m_accum_pos = (m_accum_pos + frames) % m_size;
+}
+
+bool TimeStretch::next_frame (double ratio, Index<float> & out)
+{
+    int base = lround (m_next);
+    int avail = m_input.len () / m_channels;
+
+    if (base + m_size + m_search > avail)
+        return false;
+
+    float * planes[AUD_MAX_CHANNELS];
+    for (int c = 0; c < m_channels; c ++)
+        planes[c] = & m_frame[c * m_size];
+
+    int keep;
+
+    if (m_mode == WSOLA)
+    {
+        int start = find_alignment (base);
+
+        read_input (start, m_size, planes);
+        add_frame (planes, & m_window[0]);
+
+        m_prev = start + m_hop;
+        m_next += m_hop * ratio;
+        keep = aud::min ((int) m_next - m_search, m_prev);
+    }
+    else
+    {
+        read_input (base, m_size, planes);
+        run_vocoder (planes, m_have_prev ? aud::max (base - m_prev, 1) : m_hop);
+        add_frame (planes, & m_synth_window[0]);
+
+        m_prev = base;
+        m_next += m_hop * ratio;
+        keep = (int) m_next;
+    }
+
+    m_have_prev = true;
+
+    /* Only m_hop frames are complete; the rest still overlaps later frames
+     * (wrapping around the accumulator is handled in two steps). */
+    int part = aud::min (m_hop, m_size - m_accum_pos);
+    emit (out, part);
+    if (part < m_hop)
+        emit (out, m_hop - part);
+
+    if (keep > 0)
+    {
+        m_input.discard (m_channels * keep);
+        m_next -= keep;
+        m_prev -= keep;
+    }
+
+    return true;
+}
+
+void TimeStretch::process (const float * in, int frames, double ratio,
+ Index<float> & out, bool finish)
+{
+    static const float silence[AUD_MAX_CHANNELS * 64] = {};
+
+    int needed = m_channels * (frames + (finish ? m_size + m_search : 0));
+
+    if (m_input.space () < needed)
+        m_input.alloc (aud::max (m_input.len () + needed, 2 * m_input.size ()));
+
+    m_input.copy_in (in, m_channels * frames);
+    m_pending += frames / ratio;
+
+    int start = out.len ();
+
+    if (finish)
+    {
+        /* push the last input sample through the last frame */
+        int pad = m_size + m_search;
+
+        while (pad > 0)
+        {
+            int chunk = aud::min (pad, 64);
+            m_input.copy_in (silence, m_channels * chunk);
+            pad -= chunk;
+        }
+    }
+
+    while (next_frame (ratio, out))
+        ;
+
+    if (finish)
+    {
+        /* return everything, less the silence added at the end */
+        int part = m_size - m_accum_pos;
+        emit (out, part);
+        emit (out, m_size - part);
+
+        int excess = aud::min ((int) lround (-m_pending), (out.len () - start) / m_channels);
+        if (excess > 0)
+            out.remove (out.len () - m_channels * excess, -1);
+
+        reset ();
+    }
+}
+
+double TimeStretch::latency (double ratio) const
+{
+    if (! m_channels)
+        return 0;
+
+    return m_input.len () / m_channels - m_next - m_size / 2 + m_size / 2 * ratio;
+}
@@ -0,0 +1,106 @@
+/*
+ * Speed and Pitch effect plugin for Audacious
+ * Copyright 2015 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SPEED_PITCH_STRETCH_H
+#define SPEED_PITCH_STRETCH_H
+
+#include <libaudcore/index.h>
+#include <libaudcore/ringbuf.h>
+
+#include "../libdsp/fft.h"
+
+/* Time-stretching (speed change without pitch change).  The input is cut into
+ * overlapping windowed frames, spaced at an analysis hop that depends on the
+ * speed, and the frames are added together again at a fixed synthesis hop.
+ *
+ * In WSOLA mode (waveform similarity overlap-add), the start of each frame is
+ * moved by up to half a hop so that it lines up with the waveform which the
+ * previous frame would have continued with.  This keeps periodic sounds such
+ * as voices free of the "phasey" cancellation of plain overlap-add.
+ *
+ * In phase vocoder mode, each frame is transformed with an FFT and the phase of
+ * each bin is advanced according to the frequency measured in that bin, with
+ * the bins around each spectral peak locked to the peak ("identity phase
+ * locking", Laroche & Dolson 1999).  This is smoother for music with sustained
+ * notes, but smears transients somewhat. */
+
+class TimeStretch
+{
+public:
+    enum Mode {
+        WSOLA,
+        PhaseVocoder
+    };
+
+    void init (Mode mode, int channels, int rate);
+    void destroy ();
+
+    /* Discards buffered audio (for seeking). */
+    void reset ();
+
+    /* Consumes <frames> interleaved input frames and appends the output to
+     * <out>.  <ratio> is the number of input frames per output frame (the
+     * speed).  If <finish> is set, all of the buffered input is returned. */
+    void process (const float * in, int frames, double ratio, Index<float> & out,
+     bool finish);
+
+    /* The amount of input (in frames) that is buffered but not yet returned,
+     * if processing continues at the given ratio. */
+    double latency (double ratio) const;
+
+private:
+    void add_frame (const float * const * planes, const float * window);
+    void emit (Index<float> & out, int frames);
+    void read_input (int pos, int frames, float * const * planes);
+    void read_mono (int pos, int frames, float * mono);
+    int find_alignment (int base);
+    void run_vocoder (float * const * planes, int hop);
+    bool next_frame (double ratio, Index<float> & out);
+
+    Mode m_mode = WSOLA;
+    int m_channels = 0, m_rate = 0;
+    int m_size = 0, m_hop = 0;    /* frame size and synthesis hop (frames) */
+    int m_search = 0;             /* WSOLA alignment range (+/- frames) */
+
+    RingBuf<float> m_input;       /* interleaved */
+    double m_next = 0;            /* start of the next frame, relative to the
+                                   * head of m_input */
+    int m_prev = 0;               /* WSOLA: natural continuation of the last
+                                   * frame; vocoder: start of the last frame */
+    bool m_have_prev = false;
+    int m_trim = 0;               /* output frames to drop (initial silence) */
+    double m_pending = 0;         /* output frames still owed for the input */
+
+    Index<float> m_window, m_synth_window;
+    Index<float> m_accum;         /* planar, circular, m_size frames each */
+    int m_accum_pos = 0;
+
+    Index<float> m_frame;         /* planar scratch, m_size frames each */
+    Index<float> m_scratch;       /* interleaved scratch */
+    Index<float> m_mono;          /* WSOLA search scratch */
+
+    /* phase vocoder state, m_size / 2 + 1 bins per channel */
+    FFT m_fft;
+    Index<float> m_re, m_im;
+    Index<float> m_last_phase, m_synth_phase;
+    Index<float> m_mag, m_phase;
+    Index<int> m_peaks;
+};
+
+#endif /* SPEED_PITCH_STRETCH_H */
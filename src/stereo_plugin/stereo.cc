@@ -7,6 +7,9 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+
 class ExtraStereo : public EffectPlugin
 {
 public:
@@ -25,6 +28,7 @@ public:
     constexpr ExtraStereo () : EffectPlugin (info, 0, true) {}
 
     bool init ();
+    void cleanup ();
 
     void start (int * channels, int * rate);
     void process (float * * data, int * samples);
@@ -49,13 +53,21 @@ const PreferencesWidget ExtraStereo::widgets[] = {
 
 const PluginPreferences ExtraStereo::prefs = {{ExtraStereo::widgets}};
 
+static int stereo_channels;
+
+static EffectStats stats (N_("Extra Stereo"));
+
 bool ExtraStereo::init ()
 {
     aud_config_set_defaults ("extra_stereo", defaults);
+    stats.attach ();
     return true;
 }
 
-static int stereo_channels;
+void ExtraStereo::cleanup ()
+{
+    stats.detach ();
+}
 
 void ExtraStereo::start (int * channels, int * rate)
 {
@@ -64,19 +76,19 @@ void ExtraStereo::start (int * channels, int * rate)
 
 void ExtraStereo::process (float * * data, int * samples)
 {
+    EffectStatsScope scope (stats, * samples);
+    DenormalGuard denormals;
+
     float value = aud_get_double ("extra_stereo", "intensity");
-    float * f, * end;
-    float center;
 
     if (stereo_channels != 2 || samples == 0)
         return;
 
-    end = (* data) + (* samples);
+    /* center + (left - center) * value, where center = (left + right) / 2 */
+    float matrix[4] = {
+        (1 + value) / 2, (1 - value) / 2,
+        (1 - value) / 2, (1 + value) / 2
+    };
 
-    for (f = * data; f < end; f += 2)
-    {
-        center = (f[0] + f[1]) / 2;
-        f[0] = center + (f[0] - center) * value;
-        f[1] = center + (f[1] - center) * value;
-    }
+    dsp_matrix_mix (* data, 2, * data, 2, matrix, * samples / 2);
 }
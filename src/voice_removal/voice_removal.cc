@@ -18,43 +18,309 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <utility>
+
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/runtime.h>
+
+#include "../libdsp/dsp.h"
+#include "../libdsp/stats.h"
+#include "../libdsp/stft.h"
+
+enum {
+	MODE_CLASSIC,   /* both channels become left - right */
+	MODE_SPECTRAL   /* only what is in the center is removed */
+};
+
+static const char * const voice_defaults[] = {
+	"mode", "1",  /* MODE_SPECTRAL */
+	"low_cutoff", "120",
+	"high_cutoff", "8000",
+	"strength", "100",
+	nullptr
+};
+
+static void settings_cb ();
+
+static const ComboItem mode_list[] = {
+	ComboItem (N_("Classic (left minus right)"), MODE_CLASSIC),
+	ComboItem (N_("Spectral (keeps bass and stereo)"), MODE_SPECTRAL)
+};
+
+static const PreferencesWidget voice_widgets[] = {
+	WidgetCombo (N_("Mode:"),
+		WidgetInt ("voice_removal", "mode", settings_cb),
+		{{mode_list}}),
+	WidgetLabel (N_("<b>Spectral</b>")),
+	WidgetSpin (N_("Lowest frequency:"),
+		WidgetInt ("voice_removal", "low_cutoff", settings_cb),
+		{20, 1000, 10, N_("Hz")}),
+	WidgetSpin (N_("Highest frequency:"),
+		WidgetInt ("voice_removal", "high_cutoff", settings_cb),
+		{1000, 20000, 100, N_("Hz")}),
+	WidgetSpin (N_("Strength:"),
+		WidgetInt ("voice_removal", "strength", settings_cb),
+		{0, 100, 1, "%"})
+};
+
+static const PluginPreferences voice_prefs = {{voice_widgets}};
 
 class VoiceRemoval : public EffectPlugin
 {
 public:
 	static constexpr PluginInfo info = {
 		N_("Voice Removal"),
-		PACKAGE
+		PACKAGE,
+		nullptr,
+		& voice_prefs
 	};
 
 	constexpr VoiceRemoval () : EffectPlugin (info, 0, true) {}
 
+	bool init ();
+	void cleanup ();
+
 	void start (int * channels, int * rate);
 	void process (float * * data, int * samples);
+	void flush ();
+	void finish (float * * data, int * samples);
+	int adjust_delay (int delay);
 };
 
 EXPORT VoiceRemoval aud_plugin_instance;
 
-static int voice_channels;
+static int voice_channels, voice_rate;
+static int voice_mode;
+
+static STFT stft;
+static Index<float> band;  /* how much of each bin may be removed */
+static Index<float> output;
+
+/* New settings are read and the band is made by the main thread, and swapped
+ * in by the audio thread at the start of a block.  The STFT itself depends
+ * only on the format, so it is set up in start () alone. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static int band_rate;  /* zero: not started */
+static int ready_mode;
+static Index<float> ready_band;
+static bool have_ready;
+
+static EffectStats stats (N_("Voice Removal"));
+
+bool VoiceRemoval::init ()
+{
+	aud_config_set_defaults ("voice_removal", voice_defaults);
+	stats.attach ();
+	return true;
+}
+
+void VoiceRemoval::cleanup ()
+{
+	stats.detach ();
+
+	stft.destroy ();
+	band.clear ();
+	output.clear ();
+
+	pthread_mutex_lock (& mutex);
+	band_rate = 0;
+	ready_band.clear ();
+	have_ready = false;
+	pthread_mutex_unlock (& mutex);
+}
+
+/* Whatever is equally loud and in phase in both channels of a bin is taken to
+ * be in the center, and is subtracted from both.  Bins that differ (instruments
+ * panned to one side, reverb, anything out of phase) are left alone. */
+static void remove_center (float * const * re, float * const * im, int channels,
+ int bins, void *)
+{
+	for (int k = 0; k < bins; k ++)
+	{
+		if (! band[k])
+			continue;
+
+		float lr = re[0][k], li = im[0][k];
+		float rr = re[1][k], ri = im[1][k];
+
+		float energy = lr * lr + li * li + rr * rr + ri * ri;
+		if (energy < 1e-20f)
+			continue;
+
+		/* 1 for identical channels, 0 for uncorrelated or one-sided */
+		float similar = 2 * (lr * rr + li * ri) / energy;
+		if (similar <= 0)
+			continue;
+
+		float amount = similar * similar * band[k] * 0.5f;
+		float cr = (lr + rr) * amount;
+		float ci = (li + ri) * amount;
+
+		re[0][k] = lr - cr;
+		im[0][k] = li - ci;
+		re[1][k] = rr - cr;
+		im[1][k] = ri - ci;
+	}
+}
+
+/* about 85 ms: long enough to resolve the harmonics of a voice */
+static int stft_size (int rate)
+{
+	int size = 1024;
+	while (size < rate * 0.085)
+		size *= 2;
+
+	return size;
+}
+
+/* weight of each bin, with half-octave ramps at the edges of the band */
+static void make_band (Index<float> & out, int rate)
+{
+	float low = aud_get_int ("voice_removal", "low_cutoff");
+	float high = aud_get_int ("voice_removal", "high_cutoff");
+	float strength = aud::clamp (aud_get_int ("voice_removal", "strength"), 0, 100) / 100.0f;
+
+	int size = stft_size (rate);
+	int bins = size / 2 + 1;
+
+	out.remove (0, -1);
+	out.insert (0, bins);
+
+	for (int k = 1; k < bins; k ++)
+	{
+		float freq = (float) k * rate / size;
+		float weight = 1;
+
+		if (freq < low)
+			weight = aud::max (0.0f, 1 - 2 * log2f (low / freq));
+		else if (freq > high)
+			weight = aud::max (0.0f, 1 - 2 * log2f (freq / high));
+
+		out[k] = weight * strength;
+	}
+}
+
+static void settings_cb ()
+{
+	pthread_mutex_lock (& mutex);
+
+	if (band_rate)
+	{
+		ready_mode = aud_get_int ("voice_removal", "mode");
+		make_band (ready_band, band_rate);
+		have_ready = true;
+	}
+
+	pthread_mutex_unlock (& mutex);
+}
+
+/* The old band goes back to the main thread to be freed.  Audio left in the
+ * STFT from before a change to classic mode and back is discarded. */
+static void collect_settings ()
+{
+	if (pthread_mutex_trylock (& mutex))
+		return;
+
+	if (have_ready)
+	{
+		if (ready_mode == MODE_SPECTRAL && voice_mode != MODE_SPECTRAL)
+			stft.reset ();
+
+		voice_mode = ready_mode;
+		std::swap (band, ready_band);
+		have_ready = false;
+	}
+
+	pthread_mutex_unlock (& mutex);
+}
+
+static bool spectral ()
+	{ return voice_mode == MODE_SPECTRAL && stft.ready (); }
 
 void VoiceRemoval::start (int * channels, int * rate)
 {
-	voice_channels = *channels;
+	voice_channels = * channels;
+	voice_rate = * rate;
+	voice_mode = aud_get_int ("voice_removal", "mode");
+
+	stft.destroy ();
+
+	pthread_mutex_lock (& mutex);
+	band_rate = voice_rate;
+	have_ready = false;
+	pthread_mutex_unlock (& mutex);
+
+	/* set up in either mode, so that the mode can be changed during playback;
+	 * the size depends only on the rate, so the output buffer is large enough
+	 * for finish () whatever the settings */
+	if (voice_channels == 2)
+	{
+		stft.init (2, stft_size (voice_rate), 4, remove_center, nullptr);
+		make_band (band, voice_rate);
+		stats.count_alloc (true);
+
+		output.insert (0, 2 * (DSP_BLOCK_FRAMES + stft.latency ()));
+		output.remove (0, -1);
+	}
 }
 
+/* both channels become left - right */
+static const float voice_matrix[4] = {
+	1, -1,
+	1, -1
+};
+
 void VoiceRemoval::process (float * * d, int * samples)
 {
-	float *f = *d, *end;
-	end = *d + *samples;
+	EffectStatsScope scope (stats, * samples);
+	DenormalGuard denormals;
 
 	if (voice_channels != 2)
 		return;
 
-	for (f = *d; f < end; f += 2)
-	{
-		f[0] -= f[1];
-		f[1] = f[0];
-	}
+	collect_settings ();
+
+	if (spectral ())
+		stft.process (* d, * samples / 2);
+	else
+		dsp_matrix_mix (* d, 2, * d, 2, voice_matrix, * samples / 2);
+}
+
+void VoiceRemoval::flush ()
+{
+	if (stft.ready ())
+		stft.reset ();
+}
+
+void VoiceRemoval::finish (float * * d, int * samples)
+{
+	EffectStatsScope scope (stats, * samples);
+
+	process (d, samples);
+
+	if (! spectral ())
+		return;
+
+	output.remove (0, -1);
+	output.insert (* d, -1, * samples);
+
+	stft.drain (output);
+	stft.reset ();
+
+	* d = output.begin ();
+	* samples = output.len ();
+}
+
+int VoiceRemoval::adjust_delay (int delay)
+{
+	int added = spectral () ? aud::rescale<int64_t> (stft.latency (), voice_rate, 1000) : 0;
+
+	stats.set_delay (added);
+	return delay + added;
 }
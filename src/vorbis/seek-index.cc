@@ -0,0 +1,111 @@
+/* Audacious - Cross-platform multimedia player
+ * Copyright (C) 2015 Audacious developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ */
+
+#include "seek-index.h"
+
+#include <string.h>
+
+#include <ogg/ogg.h>
+#include <vorbis/vorbisfile.h>
+
+#include "vorbis.h"
+
+#define READ_SIZE 65536
+
+/* vorbisfile already locates the chained links when the file is opened; the
+ * pages are then read in order, without decoding anything.  A page's granule
+ * position is the sample reached at its end, counted from the start of its
+ * link, which gives the position in the file after adding the length of the
+ * preceding links. */
+static bool scan_pages (SeekIndex & index, VFSFile & file)
+{
+    OggVorbis_File vf;
+    ogg_sync_state sync;
+
+    memset (& vf, 0, sizeof vf);
+    ogg_sync_init (& sync);
+
+    bool opened = (ov_open_callbacks (& file, & vf, nullptr, 0, vorbis_callbacks) == 0);
+    bool ok = (opened && ov_seekable (& vf) && file.fseek (0, VFS_SEEK_SET) == 0);
+    bool done = false;
+
+    int link = 0, links = opened ? ov_streams (& vf) : 0;
+    int64_t offset = 0, link_start = 0, next = 0;
+
+    while (ok && ! index.cancelled ())
+    {
+        ogg_page page;
+        long ret = ogg_sync_pageseek (& sync, & page);
+
+        if (! ret)
+        {
+            char * buffer = ogg_sync_buffer (& sync, READ_SIZE);
+            int64_t len = file.fread (buffer, 1, READ_SIZE);
+
+            if (len <= 0)
+            {
+                done = true;
+                break;
+            }
+
+            ogg_sync_wrote (& sync, len);
+            continue;
+        }
+
+        if (ret < 0)
+        {
+            /* skipped some garbage */
+            offset -= ret;
+            continue;
+        }
+
+        int64_t page_offset = offset;
+        offset += ret;
+
+        while (link + 1 < links && page_offset >= vf.offsets[link + 1])
+        {
+            link_start += ov_pcm_total (& vf, link);
+            link ++;
+        }
+
+        /* skip the headers, pages with no packet ending on them, and other
+         * logical streams */
+        int64_t granule = ogg_page_granulepos (& page);
+        if (granule <= vf.pcmlengths[2 * link] || ogg_page_serialno (& page) != vf.serialnos[link])
+            continue;
+
+        int64_t sample = link_start + granule - vf.pcmlengths[2 * link];
+
+        if (sample >= next)
+        {
+            index.add (SeekPoint {sample, page_offset});
+            next = sample + ov_info (& vf, link)->rate * SEEK_INDEX_INTERVAL;
+        }
+    }
+
+    ogg_sync_clear (& sync);
+
+    if (opened)
+        ov_clear (& vf);
+
+    return done;
+}
+
+SeekIndex seek_index ("vorbis-seek-index", scan_pages);
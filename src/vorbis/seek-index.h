@@ -0,0 +1,33 @@
+/* Audacious - Cross-platform multimedia player
+ * Copyright (C) 2015 Audacious developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ */
+
+#ifndef VORBIS_SEEK_INDEX_H
+#define VORBIS_SEEK_INDEX_H
+
+#include "../libseekindex/seek-index.h"
+
+/* ov_time_seek () finds the target page by bisection.  Instead, the pages are
+ * indexed in the background (see libseekindex/seek-index.h); a point is the
+ * byte offset of an Ogg page of the Vorbis stream and the sample position
+ * (counted from the start of the file, across chained links, as by
+ * ov_pcm_tell) reached at the end of the page. */
+extern SeekIndex seek_index;
+
+#endif
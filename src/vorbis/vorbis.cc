@@ -40,9 +40,37 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/input.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 
 #include "vorbis.h"
+#include "seek-index.h"
+#include "../libdsp/dsp.h"
+
+#define MAX_CHANNELS 8
+
+/* frames decoded before each write, at most what effects are prepared for */
+#define MIN_BLOCK_FRAMES 256
+
+static const char * const vorbis_defaults[] = {
+    "block_frames", "4096",
+    nullptr
+};
+
+static const PreferencesWidget vorbis_widgets[] = {
+    WidgetLabel (N_("<b>Advanced</b>")),
+    WidgetSpin (N_("Decode block size:"),
+        WidgetInt ("vorbis", "block_frames"),
+        {MIN_BLOCK_FRAMES, DSP_BLOCK_FRAMES, 256, N_("frames")})
+};
+
+static const PluginPreferences vorbis_prefs = {{vorbis_widgets}};
+
+static bool vorbis_init ()
+{
+    aud_config_set_defaults ("vorbis", vorbis_defaults);
+    return true;
+}
 
 static size_t ovcb_read (void * buffer, size_t size, size_t count, void * file)
 {
@@ -234,20 +262,81 @@ vorbis_update_replaygain(OggVorbis_File *vf, ReplayGainInfo *rg_info)
     return true;
 }
 
-static long
-vorbis_interleave_buffer(float **pcm, int samples, int ch, float *pcmout)
+/* Vorbis channel order for each number of channels, as the Vorbis channel
+ * feeding each output channel in the order used by Audacious (and FFmpeg). */
+static const int channel_order[MAX_CHANNELS][MAX_CHANNELS] = {
+    {0},                       /* mono */
+    {0, 1},                    /* stereo */
+    {0, 2, 1},                 /* 3.0: L C R */
+    {0, 1, 2, 3},              /* quadraphonic */
+    {0, 2, 1, 3, 4},           /* 5.0: FL C FR RL RR */
+    {0, 2, 1, 5, 3, 4},        /* 5.1: FL C FR RL RR LFE */
+    {0, 2, 1, 6, 5, 3, 4},     /* 6.1: FL C FR SL SR RC LFE */
+    {0, 2, 1, 7, 5, 6, 3, 4}   /* 7.1: FL C FR SL SR RL RR LFE */
+};
+
+static void vorbis_interleave (float * * pcm, int frames, int channels, float * out)
+{
+    const float * in[MAX_CHANNELS];
+
+    for (int c = 0; c < channels; c ++)
+        in[c] = pcm[channel_order[channels - 1][c]];
+
+    dsp_interleave (in, out, channels, frames);
+}
+
+/* Converts a time to a sample position as counted by ov_pcm_tell (), across
+ * chained links which may differ in sample rate. */
+static int64_t time_to_pcm (OggVorbis_File * vf, int time)
 {
-    int i, j;
-    for (i = 0; i < samples; i++)
-        for (j = 0; j < ch; j++)
-            *pcmout++ = pcm[j][i];
+    double seconds = (double) time / 1000;
+    int64_t pcm = 0;
+    int links = ov_streams (vf);
+
+    for (int i = 0; i < links; i ++)
+    {
+        double length = ov_time_total (vf, i);
+
+        if (seconds < length || i == links - 1)
+            return pcm + (int64_t) (seconds * ov_info (vf, i)->rate);
+
+        seconds -= length;
+        pcm += ov_pcm_total (vf, i);
+    }
 
-    return ch * samples * sizeof(float);
+    return pcm;
 }
 
+/* Jumps to the indexed page before the target and decodes forward from there,
+ * instead of the bisection done by ov_time_seek ().  ov_raw_seek () works out
+ * the exact position it lands at, so the samples up to the target can then be
+ * skipped just as ov_pcm_seek () would. */
+static bool seek_indexed (OggVorbis_File * vf, int time)
+{
+    int64_t target = time_to_pcm (vf, time);
+    SeekPoint point;
+
+    if (! seek_index.find (target, point) || ov_raw_seek (vf, point.offset) < 0)
+        return false;
+
+    int64_t pos;
 
-#define PCM_FRAMES 1024
-#define PCM_BUFSIZE (PCM_FRAMES * 2)
+    while ((pos = ov_pcm_tell (vf)) >= 0 && pos < target)
+    {
+        float * * pcm;
+        int section;
+
+        long samples = ov_read_float (vf, & pcm, aud::min (target - pos,
+         (int64_t) DSP_BLOCK_FRAMES), & section);
+
+        if (samples == OV_HOLE)
+            continue;
+        if (samples <= 0)
+            break;
+    }
+
+    return true;
+}
 
 static bool vorbis_play (const char * filename, VFSFile & file)
 {
@@ -255,10 +344,17 @@ static bool vorbis_play (const char * filename, VFSFile & file)
     OggVorbis_File vf;
     int last_section = -1;
     ReplayGainInfo rg_info;
-    float pcmout[PCM_BUFSIZE*sizeof(float)], **pcm;
-    int bytes, channels, samplerate, br;
+    Index<float> pcmout;
+    float **pcm;
+    int channels, samplerate, br;
     char * title = nullptr;
 
+    /* libvorbis returns at most one packet per call, so several calls are
+     * collected into each block written out */
+    int block_frames = aud::clamp (aud_get_int ("vorbis", "block_frames"),
+     MIN_BLOCK_FRAMES, DSP_BLOCK_FRAMES);
+    int frames = 0;
+
     memset(&vf, 0, sizeof(vf));
 
     bool stream = (file.fsize () < 0);
@@ -273,8 +369,11 @@ static bool vorbis_play (const char * filename, VFSFile & file)
 
     vi = ov_info(&vf, -1);
 
-    if (vi->channels > 2)
+    if (vi->channels > MAX_CHANNELS)
+    {
+        AUDERR ("Unsupported number of channels: %d\n", vi->channels);
         goto play_cleanup;
+    }
 
     br = vi->bitrate_nominal;
     channels = vi->channels;
@@ -290,6 +389,11 @@ static bool vorbis_play (const char * filename, VFSFile & file)
     vorbis_update_replaygain(&vf, &rg_info);
     aud_input_set_gain (& rg_info);
 
+    if (! stream)
+        seek_index.start (filename);
+
+    pcmout.insert (0, block_frames * MAX_CHANNELS);
+
     /*
      * Note that chaining changes things here; A vorbis file may
      * be a mix of different channels, bitrates and sample rates.
@@ -301,22 +405,32 @@ static bool vorbis_play (const char * filename, VFSFile & file)
     {
         int seek_value = aud_input_check_seek();
 
-        if (seek_value >= 0 && ov_time_seek (& vf, (double) seek_value / 1000) < 0)
+        if (seek_value >= 0)
         {
-            AUDERR ("seek failed\n");
-            error = true;
-            break;
+            if (! seek_indexed (& vf, seek_value) &&
+             ov_time_seek (& vf, (double) seek_value / 1000) < 0)
+            {
+                AUDERR ("seek failed\n");
+                error = true;
+                break;
+            }
+
+            frames = 0;
         }
 
         int current_section = last_section;
-        bytes = ov_read_float(&vf, &pcm, PCM_FRAMES, &current_section);
-        if (bytes == OV_HOLE)
+        long samples = ov_read_float (& vf, & pcm, block_frames - frames, & current_section);
+        if (samples == OV_HOLE)
             continue;
 
-        if (bytes <= 0)
-            break;
+        if (samples <= 0)
+        {
+            /* write out the last partial block */
+            if (frames)
+                aud_input_write_audio (pcmout.begin (), frames * channels * sizeof (float));
 
-        bytes = vorbis_interleave_buffer (pcm, bytes, channels, pcmout);
+            break;
+        }
 
         { /* try to detect when metadata has changed */
             vorbis_comment * comment = ov_comment (& vf, -1);
@@ -341,37 +455,50 @@ static bool vorbis_play (const char * filename, VFSFile & file)
              */
             vi = ov_info(&vf, -1);
 
-            if (vi->channels > 2)
-                goto stop_processing;
+            if (vi->channels > MAX_CHANNELS)
+            {
+                AUDERR ("Unsupported number of channels: %d\n", vi->channels);
+                break;
+            }
 
             if (vi->rate != samplerate || vi->channels != channels)
             {
+                /* the rest of the block is in the old format */
+                if (frames)
+                {
+                    aud_input_write_audio (pcmout.begin (), frames * channels * sizeof (float));
+                    frames = 0;
+                }
+
                 samplerate = vi->rate;
                 channels = vi->channels;
 
                 if (!aud_input_open_audio(FMT_FLOAT, vi->rate, vi->channels)) {
                     error = true;
-                    goto stop_processing;
+                    break;
                 }
 
                 vorbis_update_replaygain(&vf, &rg_info);
                 aud_input_set_gain (& rg_info); /* audio reopened */
             }
-        }
 
-        aud_input_write_audio (pcmout, bytes);
+            aud_input_set_bitrate (br);
+            last_section = current_section;
+        }
 
-stop_processing:
+        vorbis_interleave (pcm, samples, channels, pcmout.begin () + frames * channels);
+        frames += samples;
 
-        if (current_section != last_section)
+        if (frames == block_frames)
         {
-            aud_input_set_bitrate (br);
-            last_section = current_section;
+            aud_input_write_audio (pcmout.begin (), frames * channels * sizeof (float));
+            frames = 0;
         }
     } /* main loop */
 
 play_cleanup:
 
+    seek_index.stop ();
     ov_clear(&vf);
     g_free (title);
     return ! error;
@@ -492,6 +619,8 @@ static const char * const mimes[] = {"application/ogg", nullptr};
 
 #define AUD_PLUGIN_NAME        N_("Ogg Vorbis Decoder")
 #define AUD_PLUGIN_ABOUT       vorbis_about
+#define AUD_PLUGIN_PREFS       & vorbis_prefs
+#define AUD_PLUGIN_INIT        vorbis_init
 #define AUD_INPUT_PLAY         vorbis_play
 #define AUD_INPUT_READ_TUPLE   get_song_tuple
 #define AUD_INPUT_READ_IMAGE   get_song_image